@@ -0,0 +1,195 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#include <vector>
+
+#include "BatchScorer.h"
+
+// The SIMD kernels rely on the function level target attribute and on the
+// cpu feature detection builtins of gcc and clang. Note that this file has to
+// be compiled without floating point contraction (see CMakeLists.txt), since
+// a fused multiply-add would round differently than Scores::calcScore.
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define BATCHSCORER_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void scoreRowsScalar(const double* const* rows, std::size_t firstRow,
+    std::size_t numRows, std::size_t numFeatures,
+    const double* const* weights, std::size_t numWeights, double* scores) {
+  for (std::size_t i = firstRow; i < numRows; ++i) {
+    const double* row = rows[i];
+    for (std::size_t k = 0; k < numWeights; ++k) {
+      const double* w = weights[k];
+      std::size_t ix = numFeatures;
+      double score = w[ix];
+      for (; ix--;) {
+        score += row[ix] * w[ix];
+      }
+      scores[k * numRows + i] = score;
+    }
+  }
+}
+
+#ifdef BATCHSCORER_X86_KERNELS
+
+// copies the features of numLanes consecutive rows into tile, such that
+// tile[ix * numLanes + lane] = rows[lane][ix]
+inline void transposeTile(const double* const* rows, std::size_t numLanes,
+    std::size_t numFeatures, double* tile) {
+  for (std::size_t lane = 0; lane < numLanes; ++lane) {
+    const double* row = rows[lane];
+    double* col = tile + lane;
+    for (std::size_t ix = 0; ix < numFeatures; ++ix) {
+      col[ix * numLanes] = row[ix];
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+void scoreRowsAvx2(const double* const* rows, std::size_t numRows,
+    std::size_t numFeatures, const double* const* weights,
+    std::size_t numWeights, double* scores) {
+  const std::size_t kTileRows = 8u;
+  std::vector<double> tile(numFeatures * kTileRows);
+  double* t = &tile[0];
+  std::size_t i = 0;
+  for (; i + kTileRows <= numRows; i += kTileRows) {
+    transposeTile(rows + i, kTileRows, numFeatures, t);
+    for (std::size_t k = 0; k < numWeights; ++k) {
+      const double* w = weights[k];
+      // two independent accumulators of 4 PSMs each hide the add latency
+      __m256d acc0 = _mm256_set1_pd(w[numFeatures]);
+      __m256d acc1 = acc0;
+      for (std::size_t ix = numFeatures; ix--;) {
+        __m256d wx = _mm256_set1_pd(w[ix]);
+        const double* f = t + ix * kTileRows;
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(f), wx));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(f + 4), wx));
+      }
+      _mm256_storeu_pd(scores + k * numRows + i, acc0);
+      _mm256_storeu_pd(scores + k * numRows + i + 4, acc1);
+    }
+  }
+  scoreRowsScalar(rows, i, numRows, numFeatures, weights, numWeights, scores);
+}
+
+__attribute__((target("avx512f")))
+void scoreRowsAvx512(const double* const* rows, std::size_t numRows,
+    std::size_t numFeatures, const double* const* weights,
+    std::size_t numWeights, double* scores) {
+  const std::size_t kTileRows = 16u;
+  std::vector<double> tile(numFeatures * kTileRows);
+  double* t = &tile[0];
+  std::size_t i = 0;
+  for (; i + kTileRows <= numRows; i += kTileRows) {
+    transposeTile(rows + i, kTileRows, numFeatures, t);
+    for (std::size_t k = 0; k < numWeights; ++k) {
+      const double* w = weights[k];
+      __m512d acc0 = _mm512_set1_pd(w[numFeatures]);
+      __m512d acc1 = acc0;
+      for (std::size_t ix = numFeatures; ix--;) {
+        __m512d wx = _mm512_set1_pd(w[ix]);
+        const double* f = t + ix * kTileRows;
+        acc0 = _mm512_add_pd(acc0, _mm512_mul_pd(_mm512_loadu_pd(f), wx));
+        acc1 = _mm512_add_pd(acc1, _mm512_mul_pd(_mm512_loadu_pd(f + 8), wx));
+      }
+      _mm512_storeu_pd(scores + k * numRows + i, acc0);
+      _mm512_storeu_pd(scores + k * numRows + i + 8, acc1);
+    }
+  }
+  scoreRowsScalar(rows, i, numRows, numFeatures, weights, numWeights, scores);
+}
+
+BatchScorer::InstructionSet detectInstructionSet() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return BatchScorer::AVX512;
+  } else if (__builtin_cpu_supports("avx2")) {
+    return BatchScorer::AVX2;
+  }
+  return BatchScorer::SCALAR;
+}
+
+#else
+
+BatchScorer::InstructionSet detectInstructionSet() {
+  return BatchScorer::SCALAR;
+}
+
+#endif  // BATCHSCORER_X86_KERNELS
+
+}  // namespace
+
+BatchScorer::InstructionSet BatchScorer::getInstructionSet() {
+  static const InstructionSet instructionSet = detectInstructionSet();
+  return instructionSet;
+}
+
+bool BatchScorer::isSupported(InstructionSet instructionSet) {
+  switch (getInstructionSet()) {
+    case AVX512:
+      return true;
+    case AVX2:
+      return instructionSet != AVX512;
+    default:
+      return instructionSet == SCALAR;
+  }
+}
+
+const char* BatchScorer::getName(InstructionSet instructionSet) {
+  switch (instructionSet) {
+    case AVX512:
+      return "AVX-512";
+    case AVX2:
+      return "AVX2";
+    default:
+      return "scalar";
+  }
+}
+
+void BatchScorer::scoreRows(const double* const* rows, std::size_t numRows,
+    std::size_t numFeatures, const double* const* weights,
+    std::size_t numWeights, double* scores) {
+  scoreRows(rows, numRows, numFeatures, weights, numWeights, scores,
+            getInstructionSet());
+}
+
+void BatchScorer::scoreRows(const double* const* rows, std::size_t numRows,
+    std::size_t numFeatures, const double* const* weights,
+    std::size_t numWeights, double* scores, InstructionSet instructionSet) {
+  if (numRows == 0 || numWeights == 0) {
+    return;
+  }
+  if (!isSupported(instructionSet)) {
+    instructionSet = getInstructionSet();
+  }
+#ifdef BATCHSCORER_X86_KERNELS
+  if (numFeatures > 0) {
+    if (instructionSet == AVX512) {
+      scoreRowsAvx512(rows, numRows, numFeatures, weights, numWeights, scores);
+      return;
+    } else if (instructionSet == AVX2) {
+      scoreRowsAvx2(rows, numRows, numFeatures, weights, numWeights, scores);
+      return;
+    }
+  }
+#endif
+  scoreRowsScalar(rows, 0u, numRows, numFeatures, weights, numWeights, scores);
+}
@@ -0,0 +1,50 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef BATCHSCORER_H_
+#define BATCHSCORER_H_
+
+#include <cstddef>
+
+/*
+ * BatchScorer computes the linear SVM scores of a block of feature rows for
+ * one or more weight vectors in a single sweep over the feature memory,
+ *
+ *   scores[k * numRows + i] = w_k[numFeatures] + sum_j rows[i][j] * w_k[j]
+ *
+ * Rows are processed in tiles that are transposed into a small buffer, such
+ * that each SIMD lane scores its own PSM. The features of a PSM are hence
+ * summed in exactly the same order as Scores::calcScore does, which makes
+ * the result bit-identical for every instruction set. The AVX2 and AVX-512
+ * kernels are selected at runtime, with a portable scalar fallback.
+ */
+class BatchScorer {
+ public:
+  enum InstructionSet { SCALAR, AVX2, AVX512 };
+
+  static void scoreRows(const double* const* rows, std::size_t numRows,
+      std::size_t numFeatures, const double* const* weights,
+      std::size_t numWeights, double* scores);
+  static void scoreRows(const double* const* rows, std::size_t numRows,
+      std::size_t numFeatures, const double* const* weights,
+      std::size_t numWeights, double* scores, InstructionSet instructionSet);
+
+  static InstructionSet getInstructionSet();
+  static bool isSupported(InstructionSet instructionSet);
+  static const char* getName(InstructionSet instructionSet);
+};
+
+#endif /* BATCHSCORER_H_ */
@@ -36,7 +36,8 @@ using namespace std;
 Caller::Caller() :
     pNorm_(NULL), pCheck_(NULL), protEstimator_(NULL), enzyme_(NULL),
     tabInput_(true), readStdIn_(false), inputFN_(""), inputFNs_(), 
-    xmlSchemaValidation_(true), protEstimatorDecoyPrefix_("auto"),
+    xmlSchemaValidation_(true), usePinCache_(false), streamScoring_(false),
+    protEstimatorDecoyPrefix_("auto"),
     tabOutputFN_(""), xmlOutputFN_(""), pepXMLOutputFN_(""),weightOutputFN_(""),
     psmResultFN_(""), peptideResultFN_(""), proteinResultFN_(""),
     decoyPsmResultFN_(""), decoyPeptideResultFN_(""), decoyProteinResultFN_(""),
@@ -48,7 +49,8 @@ Caller::Caller() :
     numIterations_(10), maxPSMs_(0u),
     nestedXvalBins_(1u), selectedCpos_(0.0), selectedCneg_(0.0),
     reportEachIteration_(false), quickValidation_(false), 
-    trainBestPositive_(false), numThreads_(3u) {
+    trainBestPositive_(false), numThreads_(3u), numFolds_(3u),
+    svmColdStart_(false) {
 }
 
 Caller::~Caller() {
@@ -354,6 +356,10 @@ bool Caller::parseOptions(int argc, char **argv) {
       "num-threads",
       "Number of total parallel threads for SVM training during cross validation. Default (one thread per CV fold) = 3.",
       "value");
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "num-folds",
+      "Number of cross validation folds, at least 2. More folds train each SVM on a larger part of the data, fewer folds are faster for small data sets. The SVMs of all folds are trained in parallel, the training data of at most 3 folds (or as many as needed to keep all threads busy) is held in memory at a time. Default = 3.",
+      "value");
   cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
       "nested-xval-bins",
       "Number of nested cross validation bins within each cross validation bin. This should reduce overfitting of the hyperparameters. Default = 1.",
@@ -367,6 +373,11 @@ bool Caller::parseOptions(int argc, char **argv) {
       "Enforce that, for each spectrum, at most one PSM is included in the positive set during each training iteration. If the user only provides one PSM per spectrum, this filter will have no effect.",
       "",
       TRUE_IF_SET);
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "svm-cold-start",
+      "Train the SVMs of every iteration from zero weights instead of starting from the weights of the previous iteration. This is slower, but reproduces the results of earlier versions.",
+      "",
+      TRUE_IF_SET);
   cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
       "train-fdr-initial",
       "Set the FDR threshold for the first iteration. This is useful in cases where the original features do not display a good separation between targets and decoys. In subsequent iterations, the normal --trainFDR will be used.",
@@ -375,6 +386,16 @@ bool Caller::parseOptions(int argc, char **argv) {
       "parameter-file",
       "Read flags from a parameter file. If flags are specified on the command line as well, these will override the ones in the parameter file.",
       "filename");
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "pin-cache",
+      "Store the PSMs of the tab delimited input file in a binary cache file (<input file>.pcache) after the first read and memory map this cache in subsequent runs instead of parsing the input file again. The cache is rebuilt when the input file changes. Only applies to a single input file that is read in full, i.e. not in combination with standard input or --subset-max-train.",
+      "",
+      TRUE_IF_SET);
+  cmd.defineOption(Option::EXPERIMENTAL_FEATURE,
+      "stream-scoring",
+      "In combination with --subset-max-train, score the full list of PSMs of the tab delimited input file while streaming through it, keeping only the scores and scan numbers of the PSMs in memory. The ids, peptides and proteins are read from the input file again when writing the results, such that the memory use does not depend on their lengths. Unique peptides are determined by a hash of their sequence. Not available for standard input, XML output or protein inference.",
+      "",
+      TRUE_IF_SET);
   cmd.defineOption(
     "RT",
     "output-retention-time",
@@ -539,6 +560,9 @@ bool Caller::parseOptions(int argc, char **argv) {
   if (cmd.optionSet("train-best-positive")) {
     trainBestPositive_ = true;
   }
+  if (cmd.optionSet("svm-cold-start")) {
+    svmColdStart_ = true;
+  }
   if (cmd.optionSet("trainFDR")) {
     selectionFdr_ = cmd.getDouble("trainFDR", 0.0, 1.0);
     initialSelectionFdr_ = selectionFdr_;
@@ -565,6 +589,12 @@ bool Caller::parseOptions(int argc, char **argv) {
     PSMDescription::setProteinNameSeparator(cmd.options["protein-name-separator"]);
   }
   
+  if (cmd.optionSet("pin-cache")) {
+    usePinCache_ = true;
+  }
+  if (cmd.optionSet("stream-scoring")) {
+    streamScoring_ = true;
+  }
   if (cmd.optionSet("no-schema-validation")) {
     xmlSchemaValidation_ = false;
   }
@@ -621,6 +651,9 @@ bool Caller::parseOptions(int argc, char **argv) {
     skipNormalizeScores_ = false;
   }
 
+  if (cmd.optionSet("num-folds")) {
+    numFolds_ = cmd.getUInt("num-folds", 2, 100);
+  }
   if (cmd.optionSet("nested-xval-bins")) {
     nestedXvalBins_ = cmd.getUInt("nested-xval-bins", 1, 1000);
   }
@@ -729,6 +762,12 @@ bool Caller::parseOptions(int argc, char **argv) {
 
   }
 
+  if (streamScoring_ && (!xmlOutputFN_.empty() || reportPepXML_ || 
+                         ProteinProbEstimator::getCalcProteinLevelProb())) {
+    std::cerr << "Error: the --stream-scoring option cannot be combined with "
+      << "XML output or protein inference." << std::endl;
+    return 0;
+  }
 
   return true;
 }
@@ -870,10 +909,15 @@ void Caller::checkIsWritable(const std::string& filePath) {
   }
 }
 
-std::istream& Caller::getDataInStream(std::ifstream& fileStream){
+std::istream& Caller::getDataInStream(InputStream& fileStream){
   if (!readStdIn_) {
     if (!tabInput_) fileStream.exceptions(ifstream::badbit | ifstream::failbit);
-    fileStream.open(inputFN_.c_str(), ios::in);
+    if (inputFNs_.size() > 1) {
+      ValidateTabFile validateTab;
+      fileStream.open(validateTab.openMultiplePINs(inputFNs_));
+    } else {
+      fileStream.open(inputFN_);
+    }
   } else if (maxPSMs_ > 0u) {
     maxPSMs_ = 0u;
     std::cerr << "Warning: cannot use subset-max-train (-N flag) when reading "
@@ -1005,6 +1049,8 @@ int Caller::run() {
   omp_set_num_threads(static_cast<int>(
     std::min((unsigned int)omp_get_max_threads(), numThreads_)));
 #endif
+  // write the result files from a separate thread if we may use more than one
+  ResultWriter::setBackgroundWriting(numThreads_ > 1u);
 
   /* Validate tab file and get decoy prefix */
   TabFileValidator tabFileValidator;
@@ -1015,16 +1061,22 @@ int Caller::run() {
   if (inputFNs_.size() == 1) {
     inputFN_ = inputFNs_.at(0);
   } else if (inputFNs_.size() > 1) {
+    // the files are merged while reading them in getDataInStream
     tabInput_ = true;
-    ValidateTabFile validateTab;
-    inputFN_ = validateTab.concatenateMultiplePINs(inputFNs_);
+    inputFN_ = inputFNs_.at(0);
+    for (std::size_t ix = 1; ix < inputFNs_.size(); ++ix) {
+      inputFN_ += ", " + inputFNs_[ix];
+    }
   }
 
   int success = 0;
-  std::ifstream fileStream;
+  InputStream fileStream;
   XMLInterface xmlInterface(xmlOutputFN_, pepXMLOutputFN_, xmlSchemaValidation_, xmlPrintDecoys_, xmlPrintExpMass_);
   SetHandler setHandler(maxPSMs_);
   setHandler.setDecoyPrefix(protEstimatorDecoyPrefix_);
+  if (usePinCache_ && tabInput_ && !readStdIn_ && inputFNs_.size() <= 1u) {
+    setHandler.setPinCacheFN(inputFN_);
+  }
   Scores allScores(useMixMax_);
   allScores.setOutputRT(outputRT_);
 
@@ -1035,6 +1087,8 @@ int Caller::run() {
                                   testFdr_, selectionFdr_, initialSelectionFdr_, selectedCpos_,
                                   selectedCneg_, numIterations_, useMixMax_,
                                   nestedXvalBins_, trainBestPositive_, numThreads_, skipNormalizeScores_);
+  crossValidation.setNumFolds(numFolds_);
+  crossValidation.setWarmStart(!svmColdStart_);
 
   int firstNumberOfPositives = crossValidation.preIterationSetup(allScores, pCheck_, pNorm_, setHandler.getFeaturePool());
 
@@ -1075,6 +1129,13 @@ int Caller::run() {
 
     fileStream.clear();
     fileStream.seekg(0, ios::beg);
+    if (streamScoring_ && tabInput_ && fileStream.hasRandomAccess()) {
+      return streamAndOutputResult(fileStream, setHandler, rawWeights);
+    } else if (streamScoring_ && VERB > 0) {
+      std::cerr << "Warning: --stream-scoring is only available for a single "
+        << "uncompressed tab delimited input file, scoring the PSMs in memory "
+        << "instead." << std::endl;
+    }
     if (!tabInput_) {
       success = xmlInterface.readAndScorePin(fileStream, rawWeights, allScores, inputFN_, setHandler, pCheck_, protEstimator_, enzyme_);
     } else {
@@ -1108,6 +1169,95 @@ int Caller::run() {
 }
 
 
+/**
+ * Scores the full list of PSMs with the given weights while streaming through
+ * the tab delimited input and writes the PSM and peptide level results, 
+ * following the same steps as the in-memory scoring in run() and 
+ * calcAndOutputResult()
+ * @return 1 on success, 0 on error
+ */
+int Caller::streamAndOutputResult(InputStream& fileStream, 
+    SetHandler& setHandler, std::vector<double>& rawWeights) {
+  std::vector<OptionalField> optionalFields;
+  unsigned int lineNr = setHandler.readTabHeader(fileStream, optionalFields);
+  if (!fileStream) {
+    std::cerr << "ERROR: Failed to read in file, check if the correct " 
+      << "file-format was used." << std::endl;
+    return 0;
+  }
+  
+  StreamingScorer streamingScorer(useMixMax_, outputRT_);
+  streamingScorer.readAndScorePSMs(fileStream, lineNr, optionalFields, 
+                                   rawWeights, setHandler.getDecoyPrefix());
+  if (VERB > 1) {
+    cerr << "Evaluated set contained " << streamingScorer.posSize() << " positives and " << streamingScorer.negSize() << " negatives." << endl;
+  }
+  
+  streamingScorer.postMergeStep();
+  streamingScorer.calcQ(selectionFdr_);
+  streamingScorer.normalizeScores(selectionFdr_, rawWeights);
+  
+  // PSM level, followed by the unique peptide level if requested
+  for (int isUniquePeptideRun = 0; isUniquePeptideRun < 2; ++isUniquePeptideRun) {
+    bool writeOutput = ((isUniquePeptideRun == 1) == reportUniquePeptides_);
+    if (isUniquePeptideRun) {
+      if (!reportUniquePeptides_) break;
+      if (VERB > 0) {
+        cerr << "Tossing out \"redundant\" PSMs keeping only the best scoring PSM "
+            "for each unique peptide." << endl;
+      }
+      streamingScorer.weedOutRedundant();
+    } else if (targetDecoyCompetition_) {
+      streamingScorer.weedOutRedundantTDC();
+      if (VERB > 0) {
+        std::cerr << "Selected best-scoring PSM per file+scan+expMass"
+          << " (target-decoy competition): "
+          << streamingScorer.posSize() << " target PSMs and "
+          << streamingScorer.negSize() << " decoy PSMs." << std::endl;
+      }
+    }
+    
+    if (VERB > 0 && writeOutput) {
+      if (useMixMax_) {
+        std::cerr << "Selecting pi_0=" << streamingScorer.getPi0() << std::endl;
+      }
+      std::cerr << "Calculating q values." << std::endl;
+    }
+    int foundPSMs = streamingScorer.calcQ(testFdr_);
+    if (VERB > 0 && writeOutput) {
+      if (useMixMax_) {
+        std::cerr << "New pi_0 estimate on final list yields ";
+      } else {
+        std::cerr << "Final list yields ";
+      }
+      std::cerr << foundPSMs << " target " << (reportUniquePeptides_ ? "peptides" : "PSMs")
+                << " with q<" << testFdr_ << "." << endl;
+      std::cerr << "Calculating posterior error probabilities (PEPs)." << std::endl;
+    }
+    streamingScorer.calcPep();
+    
+    if (VERB > 1 && writeOutput) {
+      timer.stop();
+      std::cerr << "Processing took " << timer.getCPUTimeStr()
+                  << " cpu seconds or " << timer.getWallTimeStr() << " seconds wall clock time." << endl;
+    }
+    
+    std::string targetFN = isUniquePeptideRun ? peptideResultFN_ : psmResultFN_;
+    std::string decoyFN = isUniquePeptideRun ? decoyPeptideResultFN_ : decoyPsmResultFN_;
+    if (!targetFN.empty()) {
+      ofstream targetStream(targetFN.c_str(), ios::out);
+      streamingScorer.print(NORMAL, fileStream, targetStream);
+    } else if (writeOutput) {
+      streamingScorer.print(NORMAL, fileStream);
+    }
+    if (!decoyFN.empty()) {
+      ofstream decoyStream(decoyFN.c_str(), ios::out);
+      streamingScorer.print(SHUFFLED, fileStream, decoyStream);
+    }
+  }
+  return 1;
+}
+
 void Caller::calcAndOutputResult(Scores& allScores, XMLInterface& xmlInterface){
   // calculate psms level probabilities TDA or TDC
   bool isUniquePeptideRun = false;
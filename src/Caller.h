@@ -36,14 +36,17 @@ limitations under the License.
 #include "Enzyme.h"
 #include "FidoInterface.h"
 #include "Globals.h"
+#include "InputStream.h"
 #include "MyException.h"
 #include "Normalizer.h"
 #include "Option.h"
 #include "PickedProteinInterface.h"
 #include "ProteinProbEstimator.h"
+#include "ResultWriter.h"
 #include "SanityCheck.h"
 #include "Scores.h"
 #include "SetHandler.h"
+#include "StreamingScorer.h"
 #include "ValidateTabFile.h"
 #include "XMLInterface.h"
 
@@ -89,6 +92,8 @@ class Caller {
     std::string inputFN_;
     std::vector<std::string> inputFNs_;
     bool xmlSchemaValidation_;
+    bool usePinCache_;
+    bool streamScoring_;
     std::string protEstimatorDecoyPrefix_;
 
     // file output parameters
@@ -108,19 +113,21 @@ class Caller {
 
     // SVM / cross validation parameters
     double selectionFdr_, initialSelectionFdr_, testFdr_;
-    unsigned int numIterations_, maxPSMs_, nestedXvalBins_, numThreads_;
+    unsigned int numIterations_, maxPSMs_, nestedXvalBins_, numThreads_, numFolds_;
     double selectedCpos_, selectedCneg_;
     bool reportEachIteration_, quickValidation_, trainBestPositive_,
-        skipNormalizeScores_, analytics_;
+        skipNormalizeScores_, analytics_, svmColdStart_;
 
     // reporting parameters
     std::string call_;
 
     Timer timer;
 
-    std::istream& getDataInStream(std::ifstream& fileStream);
+    std::istream& getDataInStream(InputStream& fileStream);
     bool loadAndNormalizeData(std::istream& dataStream, XMLInterface& xmlInterface, SetHandler& setHandler, Scores& allScores);
     void calcAndOutputResult(Scores& allScores, XMLInterface& xmlInterface);
+    int streamAndOutputResult(InputStream& fileStream, SetHandler& setHandler,
+                              std::vector<double>& rawWeights);
 
     void calculatePSMProb(Scores& allScores, bool uniquePeptideRun);
     void calculateProteinProbabilities(Scores& allScores);
@@ -17,15 +17,16 @@
 
 #include "CrossValidation.h"
 
-// number of folds for cross validation
-const unsigned int CrossValidation::numFolds_ = 3u;
 #ifdef _OPENMP
-#include <algorithm>
 #include <omp.h>
-const unsigned int CrossValidation::numAlgInObjects_ = CrossValidation::numFolds_;
-#else
-const unsigned int CrossValidation::numAlgInObjects_ = 1u;
 #endif
+#include <algorithm>
+
+// default number of folds for cross validation
+const unsigned int CrossValidation::defaultNumFolds_ = 3u;
+// number of folds whose SVM training data is kept in memory at the same time,
+// unless more are needed to keep all threads busy
+const unsigned int CrossValidation::maxFoldsInMemory_ = 3u;
 // checks cross validation convergence in case of quickValidation_
 const double CrossValidation::requiredIncreaseOver2Iterations_ = 0.01; 
 
@@ -38,15 +39,19 @@ CrossValidation::CrossValidation(bool quickValidation,
     testFdr_(testFdr), selectionFdr_(selectionFdr), initialSelectionFdr_(initialSelectionFdr),
     selectedCpos_(selectedCpos), selectedCneg_(selectedCneg), niter_(niter),
     nestedXvalBins_(nestedXvalBins), trainBestPositive_(trainBestPositive),
-    numThreads_(numThreads), skipNormalizeScores_(skipNormalizeScores) {}
+    numThreads_(numThreads), skipNormalizeScores_(skipNormalizeScores),
+    warmStart_(true), numFolds_(defaultNumFolds_), numAlgInObjects_(1u) {}
 
 CrossValidation::~CrossValidation() { 
-  for (unsigned int set = 0; set < numFolds_ * nestedXvalBins_; ++set) {
+  for (unsigned int set = 0; set < svmInputs_.size(); ++set) {
     if (svmInputs_[set]) {
       delete svmInputs_[set];
     }
     svmInputs_[set] = NULL;
   }
+  for (std::size_t thread = 0; thread < svmWorkspaces_.size(); ++thread) {
+    delete svmWorkspaces_[thread];
+  }
 }
 
 /** 
@@ -59,22 +64,54 @@ CrossValidation::~CrossValidation() {
 int CrossValidation::preIterationSetup(Scores& fullset, SanityCheck* pCheck, 
     Normalizer* pNorm, FeatureMemoryPool& featurePool) {
   assert(nestedXvalBins_ >= 1u);
+  assert(numFolds_ >= 2u);
   
   // initialize weights vector for all folds
   w_ = vector<vector<double> >(numFolds_, 
            vector<double> (FeatureNames::getNumFeatures() + 1));
 
-  // One input set, to be reused multiple times
-  for (unsigned int set = 0; set < numFolds_ * nestedXvalBins_; ++set) {
+  // The SVM input sets are reused by the folds in batches of numAlgInObjects_
+  // folds, which bounds the memory when the number of folds grows. A batch 
+  // holds enough folds to give each thread at least one (cpos, cneg) pair.
+  numAlgInObjects_ = 1u;
+#ifdef _OPENMP
+  unsigned int numPairsPerFold = nestedXvalBins_;
+  if (!quickValidation_) {
+    unsigned int numCpos = (selectedCpos_ > 0) ? 1u : 3u;
+    unsigned int numCfrac = (selectedCpos_ > 0 && selectedCneg_ > 0) ? 1u : 3u;
+    numPairsPerFold *= numCpos * numCfrac;
+  }
+  unsigned int numFoldsForThreads = (numThreads_ + numPairsPerFold - 1) / numPairsPerFold;
+  numAlgInObjects_ = std::min(numFolds_, std::max(maxFoldsInMemory_, numFoldsForThreads));
+#endif
+  for (unsigned int set = 0; set < numAlgInObjects_ * nestedXvalBins_; ++set) {
     svmInputs_.push_back(new AlgIn(fullset.size(), static_cast<int>(FeatureNames::getNumFeatures()) + 1));
     assert( svmInputs_.back() );
   }
+  // The SVM solvers draw their buffers from a workspace per thread, which
+  // grows to the largest training set of the thread and is then reused by
+  // all its (cpos, cneg) pairs, folds and iterations
+  int numWorkspaces = 1;
+#ifdef _OPENMP
+  numWorkspaces = omp_get_max_threads();
+#endif
+  while (svmWorkspaces_.size() < static_cast<std::size_t>(numWorkspaces)) {
+    svmWorkspaces_.push_back(new SvmWorkspace());
+  }
   
   trainScores_.resize(numFolds_, Scores(usePi0_));
   testScores_.resize(numFolds_, Scores(usePi0_));
   
   fullset.createXvalSetsBySpectrum(trainScores_, testScores_, numFolds_, featurePool);
   
+  // The nested CV splits are drawn once and accessed through ScoresFoldViews 
+  // in all iterations, rather than copying the training sets in each step
+  if (nestedXvalBins_ > 1) {
+    for (unsigned int set = 0; set < numFolds_; ++set) {
+      trainScores_[set].assignXvalFoldsBySpectrum(nestedXvalBins_);
+    }
+  }
+  
   if (selectionFdr_ <= 0.0) {
     selectionFdr_ = testFdr_;
     if (initialSelectionFdr_ <= 0.0) {
@@ -184,7 +221,7 @@ void CrossValidation::train(Normalizer* pNorm) {
     if (reportPerformanceEachIteration_) {
       int foundTestPositives = 0;
       for (size_t set = 0; set < numFolds_; ++set) {
-        foundTestPositives += testScores_[set].calcScores(w_[set], testFdr_);
+        foundTestPositives += testScores_[set].calcNumPositives(w_[set], testFdr_);
       }
       if (VERB > 1) {
         std::cerr << "Found " << foundTestPositives << " test set PSMs with q<" 
@@ -222,7 +259,7 @@ void CrossValidation::train(Normalizer* pNorm) {
   }
   foundPositives = 0;
   for (size_t set = 0; set < numFolds_; ++set) {
-    foundPositives += testScores_[set].calcScores(w_[set], testFdr_);
+    foundPositives += testScores_[set].calcNumPositives(w_[set], testFdr_);
   }
   if (VERB > 0) {
     std::cerr << "Found " << foundPositives << 
@@ -265,44 +302,46 @@ int CrossValidation::doStep(Normalizer* pNorm, double selectionFdr) {
   //   -has a much smaller memory footprint by fixing memory leaks in L2_SVM_MFN and more efficient validation of the learned SVM parameters
   // ////
 
-  // Create SVM input data for parallelization
-   std::vector<AlgIn*> svmInputsVec;
-   std::vector< std::vector< Scores > > nestedTestScoresVec;
-   for (std::size_t set = 0; set < numFolds_; ++set) {
-     std::vector<Scores> nestedTrainScores(nestedXvalBins_, usePi0_), nestedTestScores(nestedXvalBins_, usePi0_);
-     if (nestedXvalBins_ > 1) {
-       FeatureMemoryPool featurePool;
-       trainScores_[set].createXvalSetsBySpectrum(nestedTrainScores, nestedTestScores, nestedXvalBins_, featurePool);
-     } else {
-       // sub-optimal cross validation
-       nestedTrainScores[0] = trainScores_[set];
-       nestedTestScores[0] = trainScores_[set];
-     }
-     nestedTestScoresVec.push_back(nestedTestScores);
-     // Set SVM input data for L2-SVM-MFN
-     for (std::size_t nestedFold = 0; nestedFold < nestedXvalBins_; ++nestedFold)
-       {
-         AlgIn* svmInput = svmInputs_[set * nestedXvalBins_ + nestedFold];
-         if ((VERB > 2) && (nestedFold==0)){
-           cerr << "Split " << set + 1 << ": Training with " 
-                << svmInput->positives << " positives and "
-                << svmInput->negatives << " negatives" << std::endl;
-         }
-         nestedTrainScores[nestedFold].generateNegativeTrainingSet(*svmInput, 1.0);
-         nestedTrainScores[nestedFold].generatePositiveTrainingSet(*svmInput, selectionFdr, 1.0, trainBestPositive_);
-         svmInputsVec.push_back(svmInput);
-       }
-   }
-
+  // The folds are processed in batches of numAlgInObjects_ folds, such that
+  // only the SVM input data of one batch is held in memory at a time. Within
+  // a batch, all (cpos, cneg) pairs of all nested CV folds are trained in 
+  // parallel.
+  std::size_t numCpCnPairsPerSet = classWeightsPerFold_.size() / numFolds_;
+  for (std::size_t firstSet = 0; firstSet < numFolds_; firstSet += numAlgInObjects_) {
+    std::size_t lastSet = std::min<std::size_t>(numFolds_, firstSet + numAlgInObjects_);
+    
+    // Set SVM input data for L2-SVM-MFN
+    int numInputs = static_cast<int>((lastSet - firstSet) * nestedXvalBins_);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int inputIdx = 0; inputIdx < numInputs; ++inputIdx) {
+      std::size_t set = firstSet + static_cast<std::size_t>(inputIdx) / nestedXvalBins_;
+      unsigned int nestedFold = static_cast<unsigned int>(inputIdx) % nestedXvalBins_;
+      AlgIn* svmInput = svmInputs_[static_cast<std::size_t>(inputIdx)];
+      ScoresFoldView nestedTrainScores = getNestedScores(set, nestedFold, false);
+      nestedTrainScores.generateNegativeTrainingSet(*svmInput, 1.0);
+      nestedTrainScores.generatePositiveTrainingSet(*svmInput, selectionFdr, 1.0, trainBestPositive_);
+    }
+    if (VERB > 2) {
+      for (std::size_t set = firstSet; set < lastSet; ++set) {
+        AlgIn* svmInput = svmInputs_[(set - firstSet) * nestedXvalBins_];
+        cerr << "Split " << set + 1 << ": Training with " 
+             << svmInput->positives << " positives and "
+             << svmInput->negatives << " negatives" << std::endl;
+      }
+    }
+    
+    int firstPair = static_cast<int>(firstSet * numCpCnPairsPerSet);
+    int lastPair = static_cast<int>(lastSet * numCpCnPairsPerSet);
 #pragma omp parallel for schedule(dynamic, 1) ordered 
-   for (int pairIdx = 0; pairIdx < classWeightsPerFold_.size(); pairIdx++){
-    candidateCposCfrac* cpCnFold = &classWeightsPerFold_[pairIdx];
-    AlgIn* svmInput = svmInputsVec[cpCnFold->set * nestedXvalBins_  + 
-    static_cast<unsigned int>(cpCnFold->nestedSet)];
-    trainCpCnPair(*cpCnFold, pOptions,svmInput);
+    for (int pairIdx = firstPair; pairIdx < lastPair; pairIdx++){
+      candidateCposCfrac* cpCnFold = &classWeightsPerFold_[pairIdx];
+      AlgIn* svmInput = svmInputs_[(cpCnFold->set - firstSet) * nestedXvalBins_ + 
+                                   static_cast<unsigned int>(cpCnFold->nestedSet)];
+      trainCpCnPair(*cpCnFold, pOptions,svmInput);
+    }
   }
 
-  estTruePos = mergeCpCnPairs(selectionFdr, pOptions, nestedTestScoresVec, candidatesCpos_, 
+  estTruePos = mergeCpCnPairs(selectionFdr, pOptions, candidatesCpos_, 
                               candidatesCfrac_);
   return estTruePos;
 }
@@ -315,45 +354,91 @@ int CrossValidation::doStep(Normalizer* pNorm, double selectionFdr) {
 */
 void CrossValidation::trainCpCnPair(candidateCposCfrac& cpCnFold,
       options& pOptions, AlgIn* svmInput) {
-
-  vector_double pWeights;
-  pWeights.d = static_cast<int>(FeatureNames::getNumFeatures()) + 1;
-  pWeights.vec = new double[pWeights.d];
-
   double cpos = cpCnFold.cpos;
   double cfrac = cpCnFold.cfrac;
     
-  // Create storage vector for SVM algorithm
-  vector_double Outputs;
-  size_t numInputs = static_cast<std::size_t>(svmInput->positives + svmInput->negatives);
-  Outputs.vec = new double[numInputs];
-  Outputs.d = static_cast<int>(numInputs);
+  // Create storage vectors for SVM algorithm
+  SvmWorkspace& workspace = getSvmWorkspace();
+  workspace.resize(svmInput->positives + svmInput->negatives,
+                   static_cast<int>(FeatureNames::getNumFeatures()) + 1);
+  vector_double& pWeights = workspace.weights;
+  vector_double& Outputs = workspace.outputs;
 
   if (VERB > 3) cerr << "- cross-validation with Cpos=" << cpos
                      << ", Cneg=" << cfrac * cpos << endl;
-  for (int ix = 0; ix < pWeights.d; ix++) {
-    pWeights.vec[ix] = 0;
-  }
-  for (int ix = 0; ix < Outputs.d; ix++) {
-    Outputs.vec[ix] = 0;
-  }
+  // the positive training set only changes slightly between iterations, 
+  // hence start from the weights this pair converged to in the last iteration
+  // (which are all zero in the first iteration)
+  initSvmStart(cpCnFold.ww, *svmInput, pWeights, Outputs);
         
   // Call SVM algorithm (see ssl.cpp)
-  L2_SVM_MFN(*svmInput, pOptions, pWeights, Outputs, cpos, cfrac * cpos);
+  L2_SVM_MFN(*svmInput, pOptions, pWeights, Outputs, cpos, cfrac * cpos,
+             workspace);
         
   for (std::size_t i = FeatureNames::getNumFeatures() + 1; i--;) {
     cpCnFold.ww[i] = pWeights.vec[i];
   }
 }
 
+/** 
+ * Returns the SVM solver workspace of the calling thread
+*/
+SvmWorkspace& CrossValidation::getSvmWorkspace() {
+  std::size_t thread = 0u;
+#ifdef _OPENMP
+  thread = static_cast<std::size_t>(omp_get_thread_num());
+#endif
+  return *svmWorkspaces_[thread];
+}
+
+/** 
+ * Sets the starting point of the SVM algorithm, either the given weights of a
+ * previous solution together with their outputs (warm start) or all zeros
+ * @param ww weights to start from
+ * @param svmInput training data
+ * @param pWeights initial weights for the SVM algorithm
+ * @param Outputs initial outputs for the SVM algorithm
+*/
+void CrossValidation::initSvmStart(const vector<double>& ww, const AlgIn& svmInput,
+      vector_double& pWeights, vector_double& Outputs) {
+  if (warmStart_) {
+    for (int ix = 0; ix < pWeights.d; ix++) {
+      pWeights.vec[ix] = ww[static_cast<std::size_t>(ix)];
+    }
+    computeOutputs(svmInput, pWeights, Outputs);
+  } else {
+    for (int ix = 0; ix < pWeights.d; ix++) {
+      pWeights.vec[ix] = 0;
+    }
+    for (int ix = 0; ix < Outputs.d; ix++) {
+      Outputs.vec[ix] = 0;
+    }
+  }
+}
+
+/** 
+ * Returns a view on the training or test set of a nested CV fold of a CV fold.
+ * Without nested cross validation, both are the CV fold's full training set.
+ * @param set CV fold
+ * @param nestedFold nested CV fold
+ * @param isTestSet return the test set rather than the training set
+*/
+ScoresFoldView CrossValidation::getNestedScores(std::size_t set, 
+    unsigned int nestedFold, bool isTestSet) {
+  if (nestedXvalBins_ > 1) {
+    return ScoresFoldView(trainScores_[set], nestedFold, isTestSet);
+  } else {
+    // sub-optimal cross validation
+    return ScoresFoldView(trainScores_[set]);
+  }
+}
+
 /** 
  * Validate and merge weights learned per cpos,cneg pairs per nested CV fold per CV fold
  * @param pWeights results vector from the SVM algorithm
  * @param pOptions options for the SVM algorithm
- * @param nestedTestScoresVec 2D vector, test sets per nested CV fold per CV fold
 */
-int CrossValidation::mergeCpCnPairs(double selectionFdr,
-                                    options& pOptions, vector< vector<Scores> >& nestedTestScoresVec,
+int CrossValidation::mergeCpCnPairs(double selectionFdr, options& pOptions,
                                     const vector<double>& cposCandidates, const vector<double>& cfracCandidates) {
   // for determining the number of positives, the decoys+1 in the FDR estimates 
   // is too restrictive for small datasets
@@ -374,11 +459,30 @@ int CrossValidation::mergeCpCnPairs(double selectionFdr,
     unsigned int b = (set+1) * numCpCnPairsPerSet;
     int tp = 0;
     std::vector<candidateCposCfrac>::iterator itCpCnPair;
+    // score all candidate weights of a nested test set in a single sweep
+    std::map<int, std::vector<candidateCposCfrac*> > pairsPerNestedSet;
+    for (itCpCnPair = classWeightsPerFold_.begin() + a; itCpCnPair < classWeightsPerFold_.begin() + b; itCpCnPair++) {
+      pairsPerNestedSet[itCpCnPair->nestedSet].push_back(&*itCpCnPair);
+    }
+    std::map<int, std::vector<candidateCposCfrac*> >::iterator itNested = pairsPerNestedSet.begin();
+    for (; itNested != pairsPerNestedSet.end(); ++itNested) {
+      std::vector<const std::vector<double>*> weights;
+      std::vector<candidateCposCfrac*>::iterator itPair = itNested->second.begin();
+      for (; itPair != itNested->second.end(); ++itPair) {
+        weights.push_back(&(*itPair)->ww);
+      }
+      std::vector<int> tps;
+      getNestedScores(static_cast<std::size_t>(set), static_cast<unsigned int>(itNested->first), true)
+          .calcNumPositives(weights, testFdr_, skipDecoysPlusOne, tps);
+      for (std::size_t ix = 0; ix < tps.size(); ++ix) {
+        itNested->second[ix]->tp = tps[ix];
+      }
+    }
+    
     std::map<std::pair<double, double>, int> intermediateResults;
     for (itCpCnPair = classWeightsPerFold_.begin() + a; itCpCnPair < classWeightsPerFold_.begin() + b; itCpCnPair++) {
-      tp = nestedTestScoresVec[set][static_cast<std::size_t>(itCpCnPair->nestedSet)].calcScores(itCpCnPair->ww, testFdr_, skipDecoysPlusOne);
+      tp = itCpCnPair->tp;
       intermediateResults[std::make_pair(itCpCnPair->cpos, itCpCnPair->cfrac)] += tp;
-      itCpCnPair->tp = tp;
       if (nestedXvalBins_ <= 1) {
         if(tp >= bestTruePoses[set]){
           bestTruePoses[set] = tp;
@@ -408,40 +512,39 @@ int CrossValidation::mergeCpCnPairs(double selectionFdr,
   }
   
   if (nestedXvalBins_ > 1) {
+    // retrain the selected pair on the full training set of each fold, again
+    // in batches of numAlgInObjects_ folds
+    for (int firstSet = 0; firstSet < numFolds_; firstSet += numAlgInObjects_) {
+      int lastSet = std::min<int>(numFolds_, firstSet + numAlgInObjects_);
 #pragma omp parallel for schedule(dynamic, 1) ordered
-    for (set = 0; set < numFolds_; ++set) {
-      vector_double pWeights;
-      pWeights.d = static_cast<int>(FeatureNames::getNumFeatures()) + 1;
-      pWeights.vec = new double[pWeights.d];
-
-      AlgIn* svmInput = svmInputs_[set * nestedXvalBins_];
-      trainScores_[set].generateNegativeTrainingSet(*svmInput, 1.0);
-      trainScores_[set].generatePositiveTrainingSet(*svmInput, selectionFdr, 1.0, trainBestPositive_);
+      for (set = firstSet; set < lastSet; ++set) {
+        AlgIn* svmInput = svmInputs_[(set - firstSet) * nestedXvalBins_];
+        trainScores_[set].generateNegativeTrainingSet(*svmInput, 1.0);
+        trainScores_[set].generatePositiveTrainingSet(*svmInput, selectionFdr, 1.0, trainBestPositive_);
     
-      // Create storage vector for SVM algorithm
-      vector_double Outputs;
-      size_t numInputs = static_cast<std::size_t>(svmInput->positives + svmInput->negatives);
-      Outputs.vec = new double[numInputs];
-      Outputs.d = static_cast<int>(numInputs);
+        // Create storage vectors for SVM algorithm
+        SvmWorkspace& workspace = getSvmWorkspace();
+        workspace.resize(svmInput->positives + svmInput->negatives,
+                         static_cast<int>(FeatureNames::getNumFeatures()) + 1);
+        vector_double& pWeights = workspace.weights;
+        vector_double& Outputs = workspace.outputs;
     
-      for (int ix = 0; ix < pWeights.d; ix++) {
-        pWeights.vec[ix] = 0;
-      }
-      for (int ix = 0; ix < Outputs.d; ix++) {
-        Outputs.vec[ix] = 0;
-      }
-      // Call SVM algorithm (see ssl.cpp)
-      L2_SVM_MFN(*svmInput, pOptions, pWeights, Outputs, bestCposes[set], bestCposes[set] * bestCfracs[set]);
+        // start from this fold's weights of the last iteration
+        initSvmStart(w_[set], *svmInput, pWeights, Outputs);
+        // Call SVM algorithm (see ssl.cpp)
+        L2_SVM_MFN(*svmInput, pOptions, pWeights, Outputs, bestCposes[set],
+                   bestCposes[set] * bestCfracs[set], workspace);
     
-      for (std::size_t i = FeatureNames::getNumFeatures() + 1; i--;) {
-        w_[set][i] = pWeights.vec[i];
+        for (std::size_t i = FeatureNames::getNumFeatures() + 1; i--;) {
+          w_[set][i] = pWeights.vec[i];
+        }
       }
     }
   }
 
   double bestTruePos = 0;
   for (set = 0; set < numFolds_; ++set) {
-    bestTruePos += trainScores_[set].calcScores(w_[set], testFdr_);
+    bestTruePos += trainScores_[set].calcNumPositives(w_[set], testFdr_);
   }
   return static_cast<int>(bestTruePos / (numFolds_ - 1));
 }
@@ -450,7 +553,7 @@ void CrossValidation::postIterationProcessing(Scores& fullset,
                                               SanityCheck* pCheck) {
   if (!pCheck->validateDirection(w_)) {
     for (std::size_t set = 0; set < numFolds_; ++set) {
-      testScores_[set].calcScores(w_[0], selectionFdr_);
+      testScores_[set].calcNumPositives(w_[0], selectionFdr_);
     }
   }
   fullset.merge(testScores_, selectionFdr_, skipNormalizeScores_, w_);
@@ -517,13 +620,13 @@ void CrossValidation::printAllWeightsColumns(
     std::vector< std::vector<double> > weightMatrix, ostream & outputStream) {
   // write to intermediate stream to prevent the fixed precision from sticking
   ostringstream weightStream;
-  for (unsigned int set = 0; set < numFolds_; ++set) {
+  for (unsigned int set = 0; set < weightMatrix.size(); ++set) {
     weightStream << " Split" << set + 1 << '\t'; // right-align with weights
   }
   weightStream << "FeatureName" << std::endl;
   size_t numRows = FeatureNames::getNumFeatures() + 1;
   for (unsigned int ix = 0; ix < numRows; ix++) {
-    for (unsigned int set = 0; set < numFolds_; ++set) {
+    for (unsigned int set = 0; set < weightMatrix.size(); ++set) {
       // align positive and negative weights
       if (weightMatrix[set][ix] >= 0) weightStream << " ";
       weightStream << fixed << setprecision(4) << weightMatrix[set][ix];
@@ -76,9 +76,14 @@ class CrossValidation {
   void inline setReportPerformanceEachIteration(bool on) { 
     reportPerformanceEachIteration_ = on;
   }
+  void inline setNumFolds(unsigned int n) { numFolds_ = n; }
+  unsigned int inline getNumFolds() { return numFolds_; }
+  void inline setWarmStart(bool on) { warmStart_ = on; }
+  bool inline getWarmStart() { return warmStart_; }
   
  protected:
   std::vector<AlgIn*> svmInputs_;
+  std::vector<SvmWorkspace*> svmWorkspaces_; // solver buffers for each thread
   std::vector< std::vector<double> > w_; // svm weights for each fold
   std::vector<candidateCposCfrac> classWeightsPerFold_; // cpos, cneg pairs to train for each nested CV fold
   
@@ -99,19 +104,26 @@ class CrossValidation {
   
   bool trainBestPositive_;
   bool skipNormalizeScores_;
+  bool warmStart_; // start SVM training from the previous iteration's weights
   
   const static double requiredIncreaseOver2Iterations_;
   
-  const static unsigned int numFolds_;
-  const static unsigned int numAlgInObjects_;
+  const static unsigned int defaultNumFolds_;
+  const static unsigned int maxFoldsInMemory_;
+  unsigned int numFolds_; // number of folds for cross validation
+  unsigned int numAlgInObjects_; // number of folds trained at the same time
   std::vector<Scores> trainScores_, testScores_;
   std::vector<double> candidatesCpos_, candidatesCfrac_;
 
   void trainCpCnPair(candidateCposCfrac& cpCnFold,
                      options& pOptions, AlgIn* svmInput);
+  SvmWorkspace& getSvmWorkspace();
+  void initSvmStart(const vector<double>& ww, const AlgIn& svmInput,
+                    vector_double& pWeights, vector_double& Outputs);
 
-  int mergeCpCnPairs(double selectionFdr,
-                     options& pOptions, std::vector< std::vector<Scores> >& nestedTestScoresVec,
+  ScoresFoldView getNestedScores(std::size_t set, unsigned int nestedFold,
+                                 bool isTestSet);
+  int mergeCpCnPairs(double selectionFdr, options& pOptions,
                      const vector<double>& cpos_vec, 
                      const vector<double>& cfrac_vec);
   int doStep(Normalizer* pNorm, double selectionFdr);
@@ -25,7 +25,7 @@
 #endif
 
 FeatureNames DataSet::featureNames_;
-bool DataSet::decoyWarningTripped_ = false;
+std::atomic<bool> DataSet::decoyWarningTripped_(false);
 
 DataSet::DataSet() {}
 
@@ -114,12 +114,22 @@ void DataSet::readPsm(const std::string& line, const unsigned int lineNr,
 
 int DataSet::readPsm(const std::string& line, const unsigned int lineNr,
     const std::vector<OptionalField>& optionalFields, bool readProteins,
-    PSMDescription*& myPsm, FeatureMemoryPool& featurePool, std::string decoyPrefix) {
+    PSMDescription*& myPsm, FeatureMemoryPool& featurePool, std::string decoyPrefix,
+    StringArena* stringArena) {
+  return readPsm(line, lineNr, optionalFields, readProteins, myPsm, 
+                 featurePool.allocate(), decoyPrefix, stringArena, NULL, NULL);
+}
+
+int DataSet::readPsm(const std::string& line, const unsigned int lineNr,
+    const std::vector<OptionalField>& optionalFields, bool readProteins,
+    PSMDescription*& myPsm, double* featureRow, const std::string& decoyPrefix,
+    StringArena* stringArena, std::string* specFileName, 
+    std::vector<std::string>* proteinNames) {
   TabReader reader(line);
   std::string tmp;
   
   myPsm = new PSMDescription();
-  myPsm->setId(reader.readString());
+  myPsm->setId(reader.readString(), stringArena);
   int label = reader.readInt();
   
   bool hasScannr = false;
@@ -153,7 +163,11 @@ int DataSet::readPsm(const std::string& line, const unsigned int lineNr,
           throw MyException(temp.str());
         break;
       } case FILENAME: {
-        myPsm->setSpectrumFileName(reader.readString());
+        if (specFileName != NULL) {
+          *specFileName = reader.readString();
+        } else {
+          myPsm->setSpectrumFileName(reader.readString());
+        }
         break;
       } default: {
         ostringstream temp;
@@ -166,7 +180,6 @@ int DataSet::readPsm(const std::string& line, const unsigned int lineNr,
   if (!hasScannr) myPsm->scan = lineNr;
   
   unsigned int numFeatures = static_cast<unsigned int>(FeatureNames::getNumFeatures());
-  double* featureRow = featurePool.allocate();
   myPsm->features = featureRow;
   for (register unsigned int j = 0; j < numFeatures; j++) {
     featureRow[j] = reader.readDouble();
@@ -192,7 +205,7 @@ int DataSet::readPsm(const std::string& line, const unsigned int lineNr,
   }
   
   std::string peptide_seq = reader.readString();
-  myPsm->setPeptide(peptide_seq);
+  myPsm->setPeptide(peptide_seq, stringArena);
   if (reader.error()) {
     ostringstream temp;
     temp << "ERROR: Reading tab file, error reading PSM " << myPsm->getId() 
@@ -232,19 +245,23 @@ int DataSet::readPsm(const std::string& line, const unsigned int lineNr,
       }
       if (names.size() > 0) proteins.push_back(names);
     }
-    proteins.swap(myPsm->proteinIds); // shrink to fit
-  }
-
-  if (label == -1) {
-    for (auto const& proteinId: myPsm->proteinIds) { 
-      bool startsWithDecoyPrefix = (proteinId.rfind(decoyPrefix, 0) == 0);
-      if (!startsWithDecoyPrefix && VERB > 1 && !decoyWarningTripped_) {
-        std::cerr << "Warning: protein decoy prefix " << decoyPrefix 
-                  << " doesn't match the decoy protein identifier " 
-                  << proteinId << "." << std::endl;
-        decoyWarningTripped_ = true;
+    
+    if (label == -1) {
+      for (auto const& proteinId: proteins) { 
+        bool startsWithDecoyPrefix = (proteinId.rfind(decoyPrefix, 0) == 0);
+        if (!startsWithDecoyPrefix && VERB > 1 && !decoyWarningTripped_.exchange(true)) {
+          std::cerr << "Warning: protein decoy prefix " << decoyPrefix 
+                    << " doesn't match the decoy protein identifier " 
+                    << proteinId << "." << std::endl;
+        }
       }
     }
+    
+    if (proteinNames != NULL) {
+      proteinNames->swap(proteins);
+    } else {
+      myPsm->setProteinNames(proteins);
+    }
   }
   return label;
 }
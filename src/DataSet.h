@@ -29,6 +29,7 @@
 #include <map>
 #include <cerrno>
 #include <random>
+#include <atomic>
 
 #include "Scores.h"
 #include "ResultHolder.h"
@@ -56,6 +57,7 @@ class DataSet {
   int inline getLabel() const { return label_; }
   
   unsigned int inline getSize() const { return static_cast<unsigned int>(psms_.size()); }
+  const std::vector<PSMDescription*>& getPsms() const { return psms_; }
     
   static FeatureNames& getFeatureNames() { return featureNames_; }
   static void resetFeatureNames() { 
@@ -75,9 +77,21 @@ class DataSet {
   void readPsm(const std::string& line, const unsigned int lineNr,
                const std::vector<OptionalField>& optionalFields, 
                FeatureMemoryPool& featurePool, std::string decoyPrefix);
+  // the id and peptide are stored in stringArena, or owned by the PSM if it
+  // is NULL
   static int readPsm(const std::string& line, const unsigned int lineNr,
     const std::vector<OptionalField>& optionalFields, bool readProteins,
-    PSMDescription*& myPsm, FeatureMemoryPool& featurePool, std::string decoyPrefix);
+    PSMDescription*& myPsm, FeatureMemoryPool& featurePool, std::string decoyPrefix,
+    StringArena* stringArena = NULL);
+  // thread safe variant that fills the given feature row and, if specFileName
+  // and proteinNames are not NULL, returns the spectrum file name and the
+  // protein names instead of registering them in the tables shared by all PSMs;
+  // concurrent calls need separate stringArenas
+  static int readPsm(const std::string& line, const unsigned int lineNr,
+    const std::vector<OptionalField>& optionalFields, bool readProteins,
+    PSMDescription*& myPsm, double* featureRow, const std::string& decoyPrefix,
+    StringArena* stringArena, std::string* specFileName, 
+    std::vector<std::string>* proteinNames);
   
   void registerPsm(PSMDescription* myPsm);
   
@@ -87,7 +101,7 @@ class DataSet {
   int label_;
   
   static FeatureNames featureNames_;
-  static bool decoyWarningTripped_;
+  static std::atomic<bool> decoyWarningTripped_;
 };
 
 #endif /*DATASET_H_*/
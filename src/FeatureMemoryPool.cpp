@@ -17,6 +17,8 @@
 
 #include "FeatureMemoryPool.h"
 
+#include <cassert>
+
 void FeatureMemoryPool::createPool(size_t numFeatures) {
   numFeatures_ = static_cast<unsigned int>(numFeatures);
   numRowsPerBlock_ = kBlockSize / numFeatures_;
@@ -28,9 +30,21 @@ void FeatureMemoryPool::createNewBlock() {
   memStarts_.push_back(memStart);
 }
 
+void FeatureMemoryPool::adoptBlocks(double* memStart, size_t numBlocks, 
+                                    size_t numRows) {
+  assert(memStarts_.empty() && numRows <= numBlocks * numRowsPerBlock_);
+  for (size_t i = 0; i < numBlocks; ++i) {
+    memStarts_.push_back(memStart + i * numFeatures_ * numRowsPerBlock_);
+  }
+  numExternalBlocks_ = numBlocks;
+  initializedRows_ = static_cast<unsigned int>(numRows);
+}
+
 void FeatureMemoryPool::destroyPool() {
   for (size_t i = 0; i < memStarts_.size(); ++i) {
-    if (memStarts_.at(i) != NULL) {
+    if (i < numExternalBlocks_) {
+      memStarts_.at(i) = NULL;
+    } else if (memStarts_.at(i) != NULL) {
       delete[] memStarts_.at(i);
       memStarts_.at(i) = NULL;
     }
@@ -26,12 +26,14 @@ class FeatureMemoryPool {
  private:
    static const unsigned int kBlockSize = 65536; // in number of doubles, e.g. 0.5MB if sizeof(double) = 8
    unsigned int numRowsPerBlock_, numFeatures_, initializedRows_;
+   size_t numExternalBlocks_; // leading blocks of memStarts_ not owned by the pool
    std::vector<double*> memStarts_;
    std::vector<double*> freeRows_;
    bool isInitialized_;
  public:
   FeatureMemoryPool() : numRowsPerBlock_(0), numFeatures_(0), 
-                        initializedRows_(0), isInitialized_(false) {}
+                        initializedRows_(0), numExternalBlocks_(0),
+                        isInitialized_(false) {}
 
   ~FeatureMemoryPool() { destroyPool(); }
 
@@ -39,7 +41,13 @@ class FeatureMemoryPool {
   void createNewBlock();
   void destroyPool();
   
+  // Uses numBlocks consecutive blocks starting at memStart (e.g. a memory 
+  // mapped PIN cache) as the first blocks of the pool, of which the first
+  // numRows rows are considered allocated. The memory is not freed by the pool.
+  void adoptBlocks(double* memStart, size_t numBlocks, size_t numRows);
+  
   inline bool isInitialized() const { return isInitialized_; }
+  inline unsigned int getNumRowsPerBlock() const { return numRowsPerBlock_; }
 
   double* addressFromIdx(unsigned int i) const;
 
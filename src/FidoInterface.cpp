@@ -17,6 +17,10 @@
 
 #include "FidoInterface.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 const double FidoInterface::kPsmThreshold = 0.0;
 const double FidoInterface::kPeptideThreshold = 0.001;
 const double FidoInterface::kPeptidePrior = 0.1; 
@@ -138,7 +142,7 @@ double FidoInterface::estimatePriors(Scores& peptideScores) {
       double prior = prior_protein * size;
       double tmp_prior = prior;
       // for each protein
-      for(std::vector<std::string>::iterator protIt = psm->pPSM->proteinIds.begin(); 
+      for(std::vector<unsigned int>::iterator protIt = psm->pPSM->proteinIds.begin(); 
 	          protIt != psm->pPSM->proteinIds.end(); protIt++) {
 	      unsigned index = static_cast<unsigned>(std::distance(psm->pPSM->proteinIds.begin(), protIt));
 	      tmp_prior = (tmp_prior * prior_protein * (size - index)) / (index + 1);
@@ -276,10 +280,15 @@ void FidoInterface::computeProbabilities(const std::string& fname) {
     proteinGraph_->setTrivialGrouping(trivialGrouping_);
     proteinGraph_->setMultipleLabeledPeptides(kAddPeptideDecoyLabel);
     
-    if (fname.size() > 0) {
-      proteinGraph_->read(fin);
-    } else {
-      proteinGraph_->read(peptideScorePtr_);
+    // the full graph is derived from the one read for the grid search
+    if (!proteinGraph_->rebuild()) {
+      if (fname.size() > 0) {
+        fin.clear();
+        fin.seekg(0, std::ios::beg);
+        proteinGraph_->read(fin);
+      } else {
+        proteinGraph_->read(peptideScorePtr_);
+      }
     }
     if (trivialGrouping_) updateTargetDecoySizes();
   }
@@ -417,20 +426,45 @@ void FidoInterface::gridSearch(std::vector<double>& alpha_search,
   double best_objective = -100000000;
   double current_objective;
   
+  std::vector<Model> gridPoints;
   for (unsigned int i = 0; i < gamma_search.size(); i++) {
-    double gamma_local = gamma_search[i];
     for (unsigned int j = 0; j < alpha_search.size(); j++) {
-      double alpha_local = alpha_search[j];
       for (unsigned int k = 0; k < beta_search.size(); k++) {
-        double beta_local = beta_search[k];
-        
-        current_objective = calcObjective(alpha_local, beta_local, gamma_local);
-        if (current_objective > best_objective) {
-          best_objective = current_objective;
-          gamma_best = gamma_local;
-          alpha_best = alpha_local;
-          beta_best = beta_local;
-        }
+        gridPoints.push_back(Model(alpha_search[j], beta_search[k], 
+                                   gamma_search[i]));
+      }
+    }
+  }
+  
+  // The protein probabilities, i.e. the inference on the graph, are computed 
+  // for a batch of grid points in parallel, each thread with its own model on
+  // the shared graph. The objectives are then evaluated in grid order, as 
+  // rocN_ and pi0_ carry over from one grid point to the next, which keeps 
+  // the selection identical to the serial search.
+  std::size_t batchSize = 1u;
+#ifdef _OPENMP
+  batchSize = static_cast<std::size_t>(omp_get_max_threads());
+#endif
+  std::vector<std::vector<std::vector<std::string> > > names(batchSize);
+  std::vector<std::vector<double> > probs(batchSize);
+  for (std::size_t start = 0; start < gridPoints.size(); start += batchSize) {
+    int numInBatch = static_cast<int>(
+        std::min(batchSize, gridPoints.size() - start));
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int b = 0; b < numInBatch; ++b) {
+      proteinGraph_->getProteinProbsAndNames(gridPoints[start + b], 
+          names[b], probs[b]);
+    }
+    
+    for (int b = 0; b < numInBatch; ++b) {
+      const Model& m = gridPoints[start + b];
+      current_objective = calcObjective(m.alpha, m.beta, m.gamma, 
+                                        names[b], probs[b]);
+      if (current_objective > best_objective) {
+        best_objective = current_objective;
+        gamma_best = m.gamma;
+        alpha_best = m.alpha;
+        beta_best = m.beta;
       }
     }
   }
@@ -439,15 +473,12 @@ void FidoInterface::gridSearch(std::vector<double>& alpha_search,
   gamma_ = gamma_best;
 }
 
-double FidoInterface::calcObjective(double alpha, double beta, double gamma) {
-  std::vector<std::vector<std::string> > names;
-  std::vector<double> probs, empq, estq; 
+double FidoInterface::calcObjective(double alpha, double beta, double gamma,
+    const std::vector<std::vector<std::string> >& names,
+    const std::vector<double>& probs) {
+  std::vector<double> empq, estq; 
   double roc ,mse, objective;
   
-  proteinGraph_->setAlphaBetaGamma(alpha, beta, gamma);
-  proteinGraph_->getProteinProbs();
-  proteinGraph_->getProteinProbsAndNames(names, probs);
-  
   getEstimated_and_Empirical_FDR(names, probs, empq, estq);
   getFDR_MSE(estq, empq, mse);
   getROC_AUC(names, probs, roc);
@@ -0,0 +1,539 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include "InputStream.h"
+#include "MyException.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+const std::size_t ProducerStreamBuf::kChunkSize = 1u << 20;
+const std::size_t ProducerStreamBuf::kNumChunks = 4u;
+const std::size_t DecompressingStreamBuf::kReadSize = 1u << 18;
+const std::size_t DecompressingStreamBuf::kBgzfBatchSize = 128u;
+
+static const std::size_t kNoChunk = static_cast<std::size_t>(-1);
+
+ProducerStreamBuf::ProducerStreamBuf() :
+    chunks_(kNumChunks, std::vector<char>(kChunkSize)),
+    chunkSizes_(kNumChunks, 0u), currentChunk_(kNoChunk), chunkStart_(0u),
+    appendChunk_(kNoChunk), appendSize_(0u), finished_(false),
+    stopping_(false) {}
+
+ProducerStreamBuf::~ProducerStreamBuf() {
+  stop();
+}
+
+DecompressingStreamBuf::DecompressingStreamBuf(const std::string& fileName,
+    Format format, int numThreads) : fileName_(fileName), format_(format),
+    numThreads_(numThreads > 0 ? numThreads : 1) {
+  start();
+}
+
+DecompressingStreamBuf::~DecompressingStreamBuf() {
+  // the producer thread calls produce(), which has to end before this
+  // object is destroyed
+  stop();
+}
+
+bool DecompressingStreamBuf::detectFormat(const std::string& fileName,
+                                          Format& format) {
+  unsigned char header[16];
+  FILE* file = fopen(fileName.c_str(), "rb");
+  if (file == NULL) return false;
+  std::size_t n = fread(header, 1, sizeof(header), file);
+  fclose(file);
+
+  if (n >= 4 && header[0] == 0x28 && header[1] == 0xb5 &&
+      header[2] == 0x2f && header[3] == 0xfd) {
+    format = ZSTD;
+    return true;
+  }
+  if (n >= 3 && header[0] == 0x1f && header[1] == 0x8b && header[2] == 8) {
+    // BGZF blocks carry their size in a "BC" subfield of the extra field
+    bool hasExtra = n >= 16 && (header[3] & 4) != 0;
+    if (hasExtra && header[12] == 'B' && header[13] == 'C' &&
+        header[14] == 2 && header[15] == 0) {
+      format = BGZF;
+    } else {
+      format = GZIP;
+    }
+    return true;
+  }
+  return false;
+}
+
+bool DecompressingStreamBuf::isSupported(Format format) {
+  switch (format) {
+#ifdef HAVE_ZLIB
+    case GZIP:
+    case BGZF:
+      return true;
+#endif
+#ifdef HAVE_ZSTD
+    case ZSTD:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+void ProducerStreamBuf::start() {
+  freeChunks_.clear();
+  filledChunks_.clear();
+  for (std::size_t chunk = 0; chunk < kNumChunks; ++chunk) {
+    freeChunks_.push_back(chunk);
+  }
+  currentChunk_ = kNoChunk;
+  chunkStart_ = 0u;
+  appendChunk_ = kNoChunk;
+  appendSize_ = 0u;
+  finished_ = false;
+  stopping_ = false;
+  error_.clear();
+  setg(NULL, NULL, NULL);
+  producer_ = std::thread(&ProducerStreamBuf::run, this);
+}
+
+void ProducerStreamBuf::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  condition_.notify_all();
+  if (producer_.joinable()) producer_.join();
+}
+
+uint64_t ProducerStreamBuf::position() const {
+  if (currentChunk_ == kNoChunk) return chunkStart_;
+  return chunkStart_ + static_cast<uint64_t>(gptr() - eback());
+}
+
+ProducerStreamBuf::int_type ProducerStreamBuf::underflow() {
+  if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (currentChunk_ != kNoChunk) {
+    chunkStart_ += chunkSizes_[currentChunk_];
+    freeChunks_.push_back(currentChunk_);
+    currentChunk_ = kNoChunk;
+    setg(NULL, NULL, NULL);
+    condition_.notify_all();
+  }
+  while (filledChunks_.empty() && !finished_) condition_.wait(lock);
+  if (filledChunks_.empty()) {
+    if (!error_.empty()) throw MyException(error_);
+    return traits_type::eof();
+  }
+  currentChunk_ = filledChunks_.front();
+  filledChunks_.pop_front();
+  char* begin = chunks_[currentChunk_].data();
+  setg(begin, begin, begin + chunkSizes_[currentChunk_]);
+  return traits_type::to_int_type(*gptr());
+}
+
+ProducerStreamBuf::pos_type ProducerStreamBuf::seekoff(off_type off,
+    std::ios_base::seekdir dir, std::ios_base::openmode which) {
+  if (dir == std::ios_base::beg) {
+    return seekpos(pos_type(off), which);
+  } else if (dir == std::ios_base::cur) {
+    if (off == 0) return pos_type(static_cast<off_type>(position()));
+    return seekpos(pos_type(static_cast<off_type>(position()) + off), which);
+  }
+  // the size of the produced data is not known in advance
+  return pos_type(off_type(-1));
+}
+
+ProducerStreamBuf::pos_type ProducerStreamBuf::seekpos(pos_type pos,
+    std::ios_base::openmode /*which*/) {
+  if (off_type(pos) < 0) return pos_type(off_type(-1));
+  uint64_t target = static_cast<uint64_t>(off_type(pos));
+  if (target < chunkStart_) {
+    stop();
+    start();
+  }
+  while (true) {
+    if (currentChunk_ != kNoChunk &&
+        target <= chunkStart_ + chunkSizes_[currentChunk_]) {
+      setg(eback(), eback() + (target - chunkStart_), egptr());
+      return pos;
+    }
+    if (currentChunk_ == kNoChunk && target == chunkStart_) return pos;
+    setg(eback(), egptr(), egptr());
+    if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+      return pos_type(off_type(-1));
+    }
+  }
+}
+
+bool ProducerStreamBuf::acquireChunk(std::size_t& chunk) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (freeChunks_.empty() && !stopping_) condition_.wait(lock);
+  if (stopping_) return false;
+  chunk = freeChunks_.front();
+  freeChunks_.pop_front();
+  return true;
+}
+
+void ProducerStreamBuf::publishChunk(std::size_t chunk, std::size_t size) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    chunkSizes_[chunk] = size;
+    filledChunks_.push_back(chunk);
+  }
+  condition_.notify_all();
+}
+
+bool ProducerStreamBuf::append(const char* data, std::size_t size) {
+  while (size > 0u) {
+    if (appendChunk_ == kNoChunk && !acquireChunk(appendChunk_)) return false;
+    std::size_t n = std::min(kChunkSize - appendSize_, size);
+    memcpy(chunks_[appendChunk_].data() + appendSize_, data, n);
+    appendSize_ += n;
+    data += n;
+    size -= n;
+    if (appendSize_ == kChunkSize) {
+      publishChunk(appendChunk_, appendSize_);
+      appendChunk_ = kNoChunk;
+      appendSize_ = 0u;
+    }
+  }
+  return true;
+}
+
+void ProducerStreamBuf::finishAppend() {
+  if (appendChunk_ != kNoChunk && appendSize_ > 0u) {
+    publishChunk(appendChunk_, appendSize_);
+  }
+  appendChunk_ = kNoChunk;
+  appendSize_ = 0u;
+}
+
+void ProducerStreamBuf::run() {
+  std::string error;
+  try {
+    produce();
+  } catch (const std::exception& e) {
+    error = e.what();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    error_ = error;
+  }
+  condition_.notify_all();
+}
+
+void DecompressingStreamBuf::produce() {
+  FILE* file = fopen(fileName_.c_str(), "rb");
+  if (file == NULL) {
+    throw MyException("ERROR: Could not open " + fileName_ + " for decompression.");
+  }
+  try {
+    switch (format_) {
+      case GZIP: inflateGzip(file); break;
+      case BGZF: inflateBgzf(file); break;
+      case ZSTD: decompressZstd(file); break;
+    }
+  } catch (...) {
+    fclose(file);
+    throw;
+  }
+  fclose(file);
+}
+
+#ifdef HAVE_ZLIB
+struct InflateGuard {
+  z_stream& strm;
+  explicit InflateGuard(z_stream& s) : strm(s) {}
+  ~InflateGuard() { inflateEnd(&strm); }
+};
+#endif
+
+void DecompressingStreamBuf::inflateGzip(FILE* file) {
+#ifndef HAVE_ZLIB
+  (void)file;  // never called, as isSupported(GZIP) is false
+#else
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  // 15 + 32: maximal window with automatic gzip/zlib header detection
+  if (inflateInit2(&strm, 15 + 32) != Z_OK) {
+    throw MyException("ERROR: Could not initialize the gzip decompression.");
+  }
+  InflateGuard guard(strm);
+
+  std::vector<unsigned char> in(kReadSize);
+  std::size_t chunk, filled = 0u;
+  if (!acquireChunk(chunk)) return;
+  bool memberEnd = false;
+  while (true) {
+    if (strm.avail_in == 0) {
+      std::size_t n = fread(in.data(), 1, kReadSize, file);
+      if (n == 0) {
+        if (ferror(file)) {
+          throw MyException("ERROR: Could not read " + fileName_ + ".");
+        }
+        break;
+      }
+      strm.next_in = in.data();
+      strm.avail_in = static_cast<uInt>(n);
+    }
+    if (memberEnd) {
+      // concatenated gzip members form a single stream
+      inflateReset(&strm);
+      memberEnd = false;
+    }
+    strm.next_out = reinterpret_cast<Bytef*>(chunks_[chunk].data() + filled);
+    strm.avail_out = static_cast<uInt>(kChunkSize - filled);
+    int ret = inflate(&strm, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      memberEnd = true;
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      throw MyException("ERROR: Could not decompress " + fileName_ + ": " +
+                        (strm.msg ? strm.msg : "corrupt gzip data") + ".");
+    }
+    filled = kChunkSize - strm.avail_out;
+    if (filled == kChunkSize) {
+      publishChunk(chunk, filled);
+      if (!acquireChunk(chunk)) return;
+      filled = 0u;
+    }
+  }
+  if (!memberEnd) {
+    throw MyException("ERROR: Unexpected end of the gzip compressed file " +
+                      fileName_ + ".");
+  }
+  if (filled > 0u) publishChunk(chunk, filled);
+#endif
+}
+
+static inline unsigned int readLittleEndian(const unsigned char* p, int n) {
+  unsigned int value = 0u;
+  for (int i = n; i-- > 0; ) value = (value << 8) | p[i];
+  return value;
+}
+
+void DecompressingStreamBuf::inflateBgzf(FILE* file) {
+#ifndef HAVE_ZLIB
+  (void)file;  // never called, as isSupported(BGZF) is false
+#else
+  std::vector<unsigned char> compressed;
+  std::vector<std::size_t> blockStarts, blockSizes, outStarts;
+  std::vector<unsigned int> outSizes, crcs;
+  std::vector<char> out;
+  std::vector<int> failed;
+
+  bool endOfFile = false;
+  while (!endOfFile) {
+    // read a batch of blocks, taking their sizes from the block headers
+    compressed.clear();
+    blockStarts.clear();
+    blockSizes.clear();
+    outStarts.clear();
+    outSizes.clear();
+    crcs.clear();
+    std::size_t totalOut = 0u;
+    while (blockStarts.size() < kBgzfBatchSize) {
+      unsigned char header[18];
+      std::size_t n = fread(header, 1, sizeof(header), file);
+      if (n == 0) {
+        endOfFile = true;
+        break;
+      }
+      unsigned int xlen = n == sizeof(header) ? readLittleEndian(header + 10, 2) : 0u;
+      if (n < sizeof(header) || header[0] != 0x1f || header[1] != 0x8b ||
+          (header[3] & 4) == 0 || xlen != 6 || header[12] != 'B' ||
+          header[13] != 'C') {
+        throw MyException("ERROR: " + fileName_ + " is not a valid BGZF file.");
+      }
+      // the BC subfield holds the total block size minus one
+      std::size_t blockSize = readLittleEndian(header + 16, 2) + 1u;
+      std::size_t remaining = blockSize - sizeof(header);
+      std::size_t start = compressed.size();
+      compressed.resize(start + remaining);
+      if (blockSize < sizeof(header) + 8u ||
+          fread(compressed.data() + start, 1, remaining, file) != remaining) {
+        throw MyException("ERROR: Unexpected end of the BGZF compressed file " +
+                          fileName_ + ".");
+      }
+      const unsigned char* trailer = compressed.data() + start + remaining - 8u;
+      blockStarts.push_back(start);
+      blockSizes.push_back(remaining - 8u);
+      crcs.push_back(readLittleEndian(trailer, 4));
+      outSizes.push_back(readLittleEndian(trailer + 4, 4));
+      outStarts.push_back(totalOut);
+      totalOut += outSizes.back();
+    }
+
+    int numBlocks = static_cast<int>(blockStarts.size());
+    out.resize(totalOut);
+    failed.assign(blockStarts.size(), 0);
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads_)
+    for (int block = 0; block < numBlocks; ++block) {
+      z_stream strm;
+      memset(&strm, 0, sizeof(strm));
+      if (inflateInit2(&strm, -15) != Z_OK) {
+        failed[block] = 1;
+        continue;
+      }
+      Bytef* blockOut = reinterpret_cast<Bytef*>(out.data() + outStarts[block]);
+      strm.next_in = compressed.data() + blockStarts[block];
+      strm.avail_in = static_cast<uInt>(blockSizes[block]);
+      strm.next_out = blockOut;
+      strm.avail_out = outSizes[block];
+      int ret = inflate(&strm, Z_FINISH);
+      if (ret != Z_STREAM_END || strm.total_out != outSizes[block] ||
+          crc32(crc32(0L, Z_NULL, 0), blockOut, outSizes[block]) != crcs[block]) {
+        failed[block] = 1;
+      }
+      inflateEnd(&strm);
+    }
+    for (int block = 0; block < numBlocks; ++block) {
+      if (failed[block]) {
+        throw MyException("ERROR: Could not decompress " + fileName_ +
+                          ": corrupt BGZF block.");
+      }
+    }
+
+    if (!append(out.data(), totalOut)) return;
+  }
+  finishAppend();
+#endif
+}
+
+void DecompressingStreamBuf::decompressZstd(FILE* file) {
+#ifndef HAVE_ZSTD
+  (void)file;  // never called, as isSupported(ZSTD) is false
+#else
+  ZSTD_DCtx* dctx = ZSTD_createDCtx();
+  if (dctx == NULL) {
+    throw MyException("ERROR: Could not initialize the zstd decompression.");
+  }
+  std::vector<char> in(kReadSize);
+  std::size_t chunk, filled = 0u, lastRet = 0u;
+  bool stopped = !acquireChunk(chunk);
+  try {
+    std::size_t n;
+    while (!stopped && (n = fread(in.data(), 1, kReadSize, file)) > 0) {
+      ZSTD_inBuffer input = { in.data(), n, 0 };
+      bool outputFull;
+      do {
+        ZSTD_outBuffer output = { chunks_[chunk].data(), kChunkSize, filled };
+        lastRet = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(lastRet)) {
+          throw MyException("ERROR: Could not decompress " + fileName_ + ": " +
+                            ZSTD_getErrorName(lastRet) + ".");
+        }
+        filled = output.pos;
+        outputFull = filled == kChunkSize;
+        if (outputFull) {
+          publishChunk(chunk, filled);
+          if (!acquireChunk(chunk)) {
+            stopped = true;
+            break;
+          }
+          filled = 0u;
+        }
+      } while (input.pos < input.size || outputFull);
+    }
+    if (!stopped && ferror(file)) {
+      throw MyException("ERROR: Could not read " + fileName_ + ".");
+    }
+    if (!stopped && lastRet != 0u) {
+      throw MyException("ERROR: Unexpected end of the zstd compressed file " +
+                        fileName_ + ".");
+    }
+  } catch (...) {
+    ZSTD_freeDCtx(dctx);
+    throw;
+  }
+  ZSTD_freeDCtx(dctx);
+  if (!stopped && filled > 0u) publishChunk(chunk, filled);
+#endif
+}
+
+InputStream::InputStream() : std::istream(NULL), producerBuf_(NULL),
+    savedExceptions_(std::ios::goodbit) {
+  rdbuf(&fileBuf_);
+}
+
+InputStream::InputStream(const std::string& fileName) :
+    std::istream(NULL), producerBuf_(NULL),
+    savedExceptions_(std::ios::goodbit) {
+  rdbuf(&fileBuf_);
+  open(fileName);
+}
+
+InputStream::~InputStream() {
+  close();
+}
+
+void InputStream::open(const std::string& fileName) {
+  close();
+  DecompressingStreamBuf::Format format;
+  if (DecompressingStreamBuf::detectFormat(fileName, format)) {
+    if (!DecompressingStreamBuf::isSupported(format)) {
+      throw MyException("ERROR: " + fileName + " is " +
+          (format == DecompressingStreamBuf::ZSTD ? "zstd" : "gzip") +
+          " compressed, but percolator was built without support for it.");
+    }
+    int numThreads = 1;
+#ifdef _OPENMP
+    numThreads = omp_get_max_threads();
+#endif
+    open(new DecompressingStreamBuf(fileName, format, numThreads));
+    return;
+  }
+  if (fileBuf_.open(fileName.c_str(), std::ios::in)) {
+    clear();
+  } else {
+    setstate(std::ios::failbit);
+  }
+}
+
+void InputStream::open(ProducerStreamBuf* producerBuf) {
+  close();
+  producerBuf_ = producerBuf;
+  rdbuf(producerBuf_);
+  clear();
+  // lets errors of the producer propagate instead of ending the input early
+  savedExceptions_ = exceptions();
+  exceptions(savedExceptions_ | std::ios::badbit);
+}
+
+bool InputStream::is_open() const {
+  return producerBuf_ != NULL || fileBuf_.is_open();
+}
+
+void InputStream::close() {
+  if (producerBuf_ != NULL) {
+    rdbuf(&fileBuf_);
+    exceptions(savedExceptions_);
+    delete producerBuf_;
+    producerBuf_ = NULL;
+  }
+  if (fileBuf_.is_open()) fileBuf_.close();
+}
@@ -0,0 +1,148 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef INPUTSTREAM_H_
+#define INPUTSTREAM_H_
+
+#ifndef WIN32
+  #include <stdint.h>
+#endif
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* ProducerStreamBuf is a read-only stream buffer whose data is produced by a
+* separate thread into a bounded queue of buffers, which the stream buffer
+* hands out to the parser in turn, so that producing and parsing the data
+* overlap. Derived classes implement produce() and call start() and stop()
+* from their constructor and destructor.
+*
+* Positions are offsets in the produced data. Seeking within the buffer that
+* is being read or forward is cheap, seeking further backward restarts the
+* producer from the beginning.
+*/
+class ProducerStreamBuf : public std::streambuf {
+ public:
+  ProducerStreamBuf();
+  virtual ~ProducerStreamBuf();
+
+ protected:
+  virtual int_type underflow();
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which);
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+
+  // runs on the producer thread, exceptions are rethrown to the reader
+  virtual void produce() = 0;
+
+  const static std::size_t kChunkSize, kNumChunks;
+
+  // chunks of produced data, either free, filled and waiting in the queue,
+  // being filled by the producer thread or being read
+  std::vector<std::vector<char> > chunks_;
+  std::vector<std::size_t> chunkSizes_;
+  std::deque<std::size_t> freeChunks_, filledChunks_;
+  std::size_t currentChunk_;
+  uint64_t chunkStart_; // offset of the current chunk in the produced data
+  std::size_t appendChunk_, appendSize_; // chunk being filled by append()
+
+  bool finished_, stopping_;
+  std::string error_;
+  std::thread producer_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+
+  void start();
+  void stop();
+  uint64_t position() const;
+  void run();
+
+  // used by the producer thread, which should return from produce() as soon
+  // as these return false
+  bool acquireChunk(std::size_t& chunk);
+  void publishChunk(std::size_t chunk, std::size_t size);
+  bool append(const char* data, std::size_t size);
+  void finishAppend();
+};
+
+/*
+* DecompressingStreamBuf is a ProducerStreamBuf on a gzip or zstd compressed
+* file, which is decompressed by the producer thread. Files in the block
+* compressed BGZF variant of gzip (as written by bgzip) are decompressed in
+* batches of blocks that are inflated in parallel.
+*/
+class DecompressingStreamBuf : public ProducerStreamBuf {
+ public:
+  enum Format { GZIP, BGZF, ZSTD };
+
+  DecompressingStreamBuf(const std::string& fileName, Format format,
+                         int numThreads = 1);
+  virtual ~DecompressingStreamBuf();
+
+  // Returns true if the file starts like a compressed file of a supported
+  // format, which is then returned in format
+  static bool detectFormat(const std::string& fileName, Format& format);
+  static bool isSupported(Format format);
+
+ protected:
+  const static std::size_t kReadSize, kBgzfBatchSize;
+
+  std::string fileName_;
+  Format format_;
+  int numThreads_;
+
+  virtual void produce();
+  void inflateGzip(FILE* file);
+  void inflateBgzf(FILE* file);
+  void decompressZstd(FILE* file);
+};
+
+/*
+* InputStream is an input file stream that transparently decompresses gzip
+* and zstd compressed files, detected by their first bytes, and reads all
+* other files through a std::filebuf. It can also read from any other
+* ProducerStreamBuf, of which it then takes ownership.
+*/
+class InputStream : public std::istream {
+ public:
+  InputStream();
+  explicit InputStream(const std::string& fileName);
+  virtual ~InputStream();
+
+  void open(const std::string& fileName);
+  void open(ProducerStreamBuf* producerBuf);
+  bool is_open() const;
+  void close();
+  // Only plain files can be repositioned at a low cost
+  inline bool hasRandomAccess() const { return producerBuf_ == NULL; }
+
+ protected:
+  std::filebuf fileBuf_;
+  ProducerStreamBuf* producerBuf_;
+  // exception mask to restore when the producer is closed
+  std::ios::iostate savedExceptions_;
+};
+
+#endif /*INPUTSTREAM_H_*/
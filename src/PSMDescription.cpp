@@ -19,19 +19,94 @@
 #include <assert.h>
 
 #include <cmath>
+#include <cstring>
 
 #include "Globals.h"
 
-PSMDescription::PSMDescription() : features(NULL), expMass(0.), calcMass(0.), retentionTime_(nan("")), scan(0u), id_(""), peptide(""), specFileNr(0u) {
+PSMDescription::PSMDescription() : features(NULL), expMass(0.), calcMass(0.), retentionTime_(nan("")), scan(0u), specFileNr(0u), id_(""), peptide_(""), peptideLength_(0u), ownsId_(false), ownsPeptide_(false) {
 }
 
-PSMDescription::PSMDescription(const std::string& pep) : features(NULL), expMass(0.), calcMass(0.), retentionTime_(nan("")), scan(0u), id_(""), peptide(pep), specFileNr(0u) {
+PSMDescription::PSMDescription(const std::string& pep) : features(NULL), expMass(0.), calcMass(0.), retentionTime_(nan("")), scan(0u), specFileNr(0u), id_(""), peptide_(""), peptideLength_(0u), ownsId_(false), ownsPeptide_(false) {
+    setPeptide(pep);
 }
 
-PSMDescription::~PSMDescription() {}
+PSMDescription::~PSMDescription() {
+    releaseId();
+    releasePeptide();
+}
 
 std::string PSMDescription::proteinNameSeparator_ = "\t";
 std::vector<string> PSMDescription::spectraFileNames_(0);
+boost::unordered_map<std::string, unsigned int> PSMDescription::spectraFileNrs_;
+SymbolTable PSMDescription::proteinNames_;
+
+const char* PSMDescription::copyString(const std::string& str,
+                                       StringArena* stringArena) {
+    if (stringArena != NULL) return stringArena->store(str);
+    char* copy = new char[str.size() + 1u];
+    std::memcpy(copy, str.c_str(), str.size() + 1u);
+    return copy;
+}
+
+void PSMDescription::releaseId() {
+    if (ownsId_) delete[] id_;
+    id_ = "";
+    ownsId_ = false;
+}
+
+void PSMDescription::releasePeptide() {
+    if (ownsPeptide_) delete[] peptide_;
+    peptide_ = "";
+    peptideLength_ = 0u;
+    ownsPeptide_ = false;
+}
+
+void PSMDescription::setId(const std::string& id, StringArena* stringArena) {
+    releaseId();
+    id_ = copyString(id, stringArena);
+    ownsId_ = (stringArena == NULL);
+}
+
+void PSMDescription::setPeptide(const std::string& pep_seq, StringArena* stringArena) {
+    releasePeptide();
+    peptide_ = copyString(pep_seq, stringArena);
+    peptideLength_ = static_cast<unsigned int>(pep_seq.size());
+    ownsPeptide_ = (stringArena == NULL);
+}
+
+void PSMDescription::setSharedPeptide(const char* peptide, unsigned int length) {
+    releasePeptide();
+    peptide_ = peptide;
+    peptideLength_ = length;
+}
+
+void PSMDescription::setProteinNames(const std::vector<std::string>& proteinNames) {
+    std::vector<unsigned int> symbols(proteinNames.size());
+    for (size_t ix = 0; ix < proteinNames.size(); ++ix) {
+        symbols[ix] = proteinNames_.intern(proteinNames[ix]);
+    }
+    symbols.swap(proteinIds);
+}
+
+void PSMDescription::setSpectrumFileName(const std::string& fileName) {
+    boost::unordered_map<std::string, unsigned int>::const_iterator it =
+        spectraFileNrs_.find(fileName);
+    if (it != spectraFileNrs_.end()) {
+        specFileNr = it->second;
+    } else {
+        specFileNr = static_cast<unsigned int>(spectraFileNames_.size());
+        spectraFileNrs_[fileName] = specFileNr;
+        spectraFileNames_.push_back(fileName);
+    }
+}
+
+void PSMDescription::setSpectraFileNames(const std::vector<std::string>& fileNames) {
+    spectraFileNames_ = fileNames;
+    spectraFileNrs_.clear();
+    for (size_t ix = 0; ix < fileNames.size(); ++ix) {
+        spectraFileNrs_.insert(std::make_pair(fileNames[ix], static_cast<unsigned int>(ix)));
+    }
+}
 
 void PSMDescription::deletePtr(PSMDescription* psm) {
     if (psm != NULL) {
@@ -70,11 +145,11 @@ std::string PSMDescription::removePTMs(const string& peptide) {
 }
 
 void PSMDescription::printProteins(std::ostream& out) {
-    std::vector<std::string>::const_iterator it = proteinIds.begin();
+    std::vector<unsigned int>::const_iterator it = proteinIds.begin();
     if (it != proteinIds.end()) {
-        out << *it;
+        out << getProteinName(*it);
         for (++it; it != proteinIds.end(); ++it) {
-            out << PSMDescription::proteinNameSeparator_ << *it;
+            out << PSMDescription::proteinNameSeparator_ << getProteinName(*it);
         }
     }
 }
@@ -16,12 +16,16 @@
  *******************************************************************************/
 #ifndef PSMDESCRIPTION_H_
 #define PSMDESCRIPTION_H_
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <string>
 #include <vector>
 
+#include <boost/unordered_map.hpp>
+
 #include "Enzyme.h"
+#include "StringArena.h"
 
 /*
  * PSMDescription
@@ -29,6 +33,11 @@
  * Here are some useful abbreviations:
  * PSM - Peptide Spectrum Match
  *
+ * The id and peptide are null terminated strings that are either stored in
+ * the StringArena passed to their setter, which has to outlive the PSM, or
+ * owned by the PSM itself. Protein names are interned in a table shared by
+ * all PSMs, proteinIds holds their symbols.
+ *
  */
 class PSMDescription {
    public:
@@ -54,28 +63,50 @@ class PSMDescription {
         return *one == *other;
     }
 
-    std::string getPeptideSequence() { return peptide.substr(2, peptide.size() - 4); }
-    std::string& getFullPeptideSequence() { return peptide; }
-    std::string getFlankN() { return peptide.substr(0, 1); }
-    std::string getFlankC() { return peptide.substr(peptide.size() - 1, peptide.size()); }
+    std::string getPeptideSequence() const {
+        if (peptideLength_ < 4) return std::string(peptide_, peptideLength_).substr(2);
+        return std::string(peptide_ + 2, peptideLength_ - 4);
+    }
+    const char* getFullPeptideSequence() const { return peptide_; }
+    std::string getFlankN() const { return std::string(peptide_, peptideLength_ > 0 ? 1 : 0); }
+    std::string getFlankC() const {
+        return peptideLength_ > 0 ? std::string(peptide_ + peptideLength_ - 1, 1) : std::string();
+    }
 
     friend std::ostream& operator<<(std::ostream& out, PSMDescription& psm);
     void printProteins(std::ostream& out);
 
     bool operator<(const PSMDescription& other) const {
-        return (peptide < other.peptide) ||
-               (peptide == other.peptide && getRetentionTime() < other.getRetentionTime());
+        int peptideCmp = std::strcmp(peptide_, other.peptide_);
+        return (peptideCmp < 0) ||
+               (peptideCmp == 0 && getRetentionTime() < other.getRetentionTime());
     }
 
     bool operator==(const PSMDescription& other) const {
-        return (peptide == other.peptide);
+        return (std::strcmp(peptide_, other.peptide_) == 0);
     }
 
-    inline void setId(const std::string& id) { id_ = id; }
-    inline std::string& getId() { return id_; }
+    void setId(const std::string& id, StringArena* stringArena = NULL);
+    inline const char* getId() const { return id_; }
+
+    const char* getFullPeptide() const { return peptide_; }
+    unsigned int getFullPeptideLength() const { return peptideLength_; }
+    void setPeptide(const std::string& pep_seq, StringArena* stringArena = NULL);
+    // shares a peptide that is already stored in an arena, e.g. by another PSM
+    void setSharedPeptide(const char* peptide, unsigned int length);
+
+    // interns the protein names and stores their symbols in proteinIds
+    void setProteinNames(const std::vector<std::string>& proteinNames);
+    static inline unsigned int addProteinName(const std::string& proteinName) {
+        return proteinNames_.intern(proteinName);
+    }
+    static inline const char* getProteinName(unsigned int symbol) {
+        return proteinNames_[symbol];
+    }
+    static inline std::size_t getNumProteinNames() { return proteinNames_.size(); }
+    // invalidates the symbols of all PSMDescriptions
+    static inline void clearProteinNames() { proteinNames_.clear(); }
 
-    std::string& getFullPeptide() { return peptide; }
-    void setPeptide(const std::string& pep_seq) { peptide = pep_seq; }
     PSMDescription* getAParent() { return this; }
     void checkFragmentPeptides(
         std::vector<PSMDescription*>::reverse_iterator other,
@@ -85,17 +116,7 @@ class PSMDescription {
     }
     static inline const std::string& getProteinNameSeparator() { return proteinNameSeparator_; }
 
-    void setSpectrumFileName(std::string fileName) {
-        size_t index(0);
-        auto specFilePos = std::find(spectraFileNames_.begin(), spectraFileNames_.end(), fileName);
-        if (specFilePos != spectraFileNames_.end()) {
-            index = specFilePos - spectraFileNames_.begin();
-        } else {
-            index = spectraFileNames_.end() - spectraFileNames_.begin();
-            spectraFileNames_.push_back(fileName);
-        }
-        specFileNr = index;
-    }
+    void setSpectrumFileName(const std::string& fileName);
     inline const std::string getSpectrumFileName() {
         std::string fn("");
         if (hasSpectrumFileName())
@@ -103,6 +124,8 @@ class PSMDescription {
         return fn;
     }
     inline const bool static hasSpectrumFileName() { return !spectraFileNames_.empty(); }
+    static inline const std::vector<std::string>& getSpectraFileNames() { return spectraFileNames_; }
+    static void setSpectraFileNames(const std::vector<std::string>& fileNames);
 
     void setRetentionFeatures(double* retentionFeatures) {}
     double* getRetentionFeatures() { return NULL; }
@@ -119,17 +142,29 @@ class PSMDescription {
     double expMass, calcMass, retentionTime_;
     unsigned int scan;
     unsigned int specFileNr;
-    std::vector<std::string> proteinIds;
+    std::vector<unsigned int> proteinIds;  // symbols of the protein names
 
    protected:
-    std::string id_;
-    std::string peptide;
+    const char* id_;
+    const char* peptide_;
+    unsigned int peptideLength_;
+    bool ownsId_, ownsPeptide_;
     static std::string proteinNameSeparator_;
     static vector<std::string> spectraFileNames_;
+    static boost::unordered_map<std::string, unsigned int> spectraFileNrs_;
+    static SymbolTable proteinNames_;
+
+    static const char* copyString(const std::string& str, StringArena* stringArena);
+    void releaseId();
+    void releasePeptide();
+
+   private:
+    PSMDescription(const PSMDescription&);
+    PSMDescription& operator=(const PSMDescription&);
 };
 
 inline std::ostream& operator<<(std::ostream& out, PSMDescription& psm) {
-    out << "Peptide: " << psm.peptide << endl;
+    out << "Peptide: " << psm.peptide_ << endl;
     out << "Spectrum scan number: " << psm.scan << endl;
     out << endl;
     return out;
@@ -246,49 +246,77 @@ void PickedProteinInterface::groupProteins(Scores& peptideScores,
     }
   }
   
+  // the representative protein of every protein name symbol, i.e. the
+  // protein it is a fragment or duplicate of or else itself, is determined
+  // only once per symbol
+  SymbolTable representatives;
+  std::vector<unsigned int> representativeBySymbol;
+  std::vector<bool> isReportedBySymbol, isKnownSymbol;
+  
   std::map<std::string, std::set<std::string> > groupProteinIds;
   unsigned int numGroups = 0;
   for (vector<ScoreHolder>::iterator peptideIt = peptideScores.begin(); 
           peptideIt != peptideScores.end(); ++peptideIt) {
     std::string lastProteinId;
-    std::set<std::string> proteinsInGroup;
+    unsigned int lastRepresentative = 0u;
+    std::set<unsigned int> proteinsInGroup;
     bool isFirst = true, isShared = false;
     
     if (peptideIt->p > maxPeptidePval_) continue;
     
-    for (std::vector<std::string>::iterator protIt = peptideIt->pPSM->proteinIds.begin(); 
+    for (std::vector<unsigned int>::const_iterator protIt = peptideIt->pPSM->proteinIds.begin(); 
             protIt != peptideIt->pPSM->proteinIds.end(); protIt++) {
-      std::string proteinId = *protIt;
-      
-      if (fragment_map.find(proteinId) != fragment_map.end()) {
-        if (reportFragmentProteins_) proteinsInGroup.insert(*protIt);
-        proteinId = fragment_map[proteinId];
-      } else if (duplicate_map.find(proteinId) != duplicate_map.end()) {
-        if (reportDuplicateProteins_) proteinsInGroup.insert(*protIt);
-        proteinId = duplicate_map[proteinId];
-      } else {
-        proteinsInGroup.insert(*protIt);
+      if (*protIt >= isKnownSymbol.size()) {
+        size_t numSymbols = PSMDescription::getNumProteinNames();
+        representativeBySymbol.resize(numSymbols, 0u);
+        isReportedBySymbol.resize(numSymbols, false);
+        isKnownSymbol.resize(numSymbols, false);
+      }
+      if (!isKnownSymbol[*protIt]) {
+        std::string proteinId = PSMDescription::getProteinName(*protIt);
+        bool isReported = true;
+        if (fragment_map.find(proteinId) != fragment_map.end()) {
+          isReported = reportFragmentProteins_;
+          proteinId = fragment_map[proteinId];
+        } else if (duplicate_map.find(proteinId) != duplicate_map.end()) {
+          isReported = reportDuplicateProteins_;
+          proteinId = duplicate_map[proteinId];
+        }
+        representativeBySymbol[*protIt] = representatives.intern(proteinId);
+        isReportedBySymbol[*protIt] = isReported;
+        isKnownSymbol[*protIt] = true;
       }
       
+      if (isReportedBySymbol[*protIt]) proteinsInGroup.insert(*protIt);
+      unsigned int representative = representativeBySymbol[*protIt];
       if (isFirst) {
-        lastProteinId = proteinId;
+        lastRepresentative = representative;
         isFirst = false;
-      } else if (lastProteinId != proteinId) {
+      } else if (lastRepresentative != representative) {
         isShared = true;
         break;
       }
     }
     
     if (proteinsInGroup.size() == 1) {
-      lastProteinId = *(proteinsInGroup.begin());
+      lastProteinId = PSMDescription::getProteinName(*(proteinsInGroup.begin()));
+    } else if (!isFirst) {
+      lastProteinId = representatives[lastRepresentative];
     }
     
     if (!isShared) {
+      std::set<std::string> proteinNamesInGroup;
+      if (proteinsInGroup.size() > 1) {
+        std::set<unsigned int>::const_iterator groupIt = proteinsInGroup.begin();
+        for (; groupIt != proteinsInGroup.end(); ++groupIt) {
+          proteinNamesInGroup.insert(PSMDescription::getProteinName(*groupIt));
+        }
+      }
       ProteinScoreHolder::Peptide peptide(peptideIt->pPSM->getPeptideSequence(), 
           peptideIt->isDecoy(), peptideIt->p, peptideIt->pep, peptideIt->q, peptideIt->score);
       if (proteinToIdxMap_.find(lastProteinId) == proteinToIdxMap_.end()) {
         if (proteinsInGroup.size() > 1) {
-          groupProteinIds[lastProteinId] = proteinsInGroup;
+          groupProteinIds[lastProteinId] = proteinNamesInGroup;
         }
         ProteinScoreHolder newProtein(lastProteinId, peptideIt->isDecoy(),
             peptide, static_cast<int>(++numGroups));
@@ -302,8 +330,8 @@ void PickedProteinInterface::groupProteins(Scores& peptideScores,
       } else {
         proteins_.at(proteinToIdxMap_[lastProteinId]).addPeptide(peptide);
         if (proteinsInGroup.size() > 1) {
-          groupProteinIds[lastProteinId].insert(proteinsInGroup.begin(), 
-                                                 proteinsInGroup.end());
+          groupProteinIds[lastProteinId].insert(proteinNamesInGroup.begin(), 
+                                                 proteinNamesInGroup.end());
         }
       }
     }
@@ -0,0 +1,422 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include "PinCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <boost/unordered_map.hpp>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+#include "Globals.h"
+#include "ProteinProbEstimator.h"
+
+const char PinCache::kMagic[8] = {'P', 'E', 'R', 'C', 'P', 'I', 'N', 'C'};
+
+namespace {
+
+void writePadding(std::ofstream& out, uint64_t alignment) {
+  static const char zeros[64] = {0};
+  uint64_t pos = static_cast<uint64_t>(out.tellp());
+  uint64_t pad = (alignment - pos % alignment) % alignment;
+  out.write(zeros, static_cast<std::streamsize>(pad));
+}
+
+template<class T>
+void writeColumn(std::ofstream& out, const std::vector<T>& column) {
+  if (!column.empty()) {
+    out.write(reinterpret_cast<const char*>(&column[0]),
+              static_cast<std::streamsize>(column.size() * sizeof(T)));
+  }
+}
+
+// string table: count, count+1 offsets into the character data, characters
+void writeStringTable(std::ofstream& out, const std::vector<std::string>& strings) {
+  std::vector<uint64_t> offsets(1, strings.size());
+  uint64_t offset = 0u;
+  offsets.push_back(offset);
+  std::vector<std::string>::const_iterator it = strings.begin();
+  for ( ; it != strings.end(); ++it) {
+    offset += it->size();
+    offsets.push_back(offset);
+  }
+  writeColumn(out, offsets);
+  for (it = strings.begin(); it != strings.end(); ++it) {
+    out.write(it->data(), static_cast<std::streamsize>(it->size()));
+  }
+}
+
+uint32_t intern(const std::string& str, std::vector<std::string>& table,
+    boost::unordered_map<std::string, uint32_t>& lookUp) {
+  boost::unordered_map<std::string, uint32_t>::const_iterator it = lookUp.find(str);
+  if (it != lookUp.end()) return it->second;
+  uint32_t ix = static_cast<uint32_t>(table.size());
+  lookUp[str] = ix;
+  table.push_back(str);
+  return ix;
+}
+
+} // namespace
+
+PinCache::PinCache() : pinFN_(""), data_(NULL), size_(0u), isMapped_(false) {}
+
+PinCache::~PinCache() {
+  release();
+}
+
+void PinCache::release() {
+  if (data_ == NULL) return;
+#ifndef _WIN32
+  if (isMapped_) {
+    munmap(data_, size_);
+  } else {
+    delete[] data_;
+  }
+#else
+  delete[] data_;
+#endif
+  data_ = NULL;
+  size_ = 0u;
+  isMapped_ = false;
+}
+
+bool PinCache::getPinStats(uint64_t& size, int64_t& modTime) const {
+  struct stat pinStat;
+  if (stat(pinFN_.c_str(), &pinStat) != 0) return false;
+  size = static_cast<uint64_t>(pinStat.st_size);
+  modTime = static_cast<int64_t>(pinStat.st_mtime);
+  return true;
+}
+
+bool PinCache::map(const std::string& cacheFN) {
+  release();
+#ifndef _WIN32
+  int fd = open(cacheFN.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat cacheStat;
+  if (fstat(fd, &cacheStat) != 0 || cacheStat.st_size < static_cast<off_t>(sizeof(Header))) {
+    close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(cacheStat.st_size);
+  // private mapping: the features are normalized in place, which only
+  // creates private copies of the touched pages and leaves the file as is
+  void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return false;
+  data_ = static_cast<char*>(addr);
+  size_ = size;
+  isMapped_ = true;
+#else
+  std::ifstream cacheStream(cacheFN.c_str(), std::ios::in | std::ios::binary);
+  if (!cacheStream) return false;
+  cacheStream.seekg(0, std::ios::end);
+  size_t size = static_cast<size_t>(cacheStream.tellg());
+  if (size < sizeof(Header)) return false;
+  cacheStream.seekg(0, std::ios::beg);
+  data_ = new char[size];
+  size_ = size;
+  if (!cacheStream.read(data_, static_cast<std::streamsize>(size))) {
+    release();
+    return false;
+  }
+#endif
+  return true;
+}
+
+bool PinCache::isValid(const Header& header) const {
+  uint64_t pinSize = 0u;
+  int64_t pinModTime = 0;
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.byteOrderMark != kByteOrderMark ||
+      header.fileSize != size_) {
+    return false;
+  }
+  if (!getPinStats(pinSize, pinModTime) || header.pinSize != pinSize ||
+      header.pinModTime != pinModTime) {
+    return false;
+  }
+  for (unsigned int section = 0; section < NUM_SECTIONS; ++section) {
+    if (header.sectionOffsets[section] > size_ ||
+        header.sectionOffsets[section] % kAlignment != 0u) {
+      return false;
+    }
+  }
+  if (header.numFeatures != DataSet::getNumFeatures()) return false;
+  // peptide sequences were only checked if protein inference was active
+  if (ProteinProbEstimator::getCalcProteinLevelProb() && !header.checkedPeptides) {
+    return false;
+  }
+  return getString(getSection<char>(header, SEPARATOR), 0u) ==
+             PSMDescription::getProteinNameSeparator();
+}
+
+std::string PinCache::getString(const char* table, uint64_t ix) {
+  const uint64_t* offsets = reinterpret_cast<const uint64_t*>(table);
+  uint64_t count = offsets[0];
+  const char* chars = table + (count + 2u) * sizeof(uint64_t);
+  return std::string(chars + offsets[ix + 1u],
+                     static_cast<size_t>(offsets[ix + 2u] - offsets[ix + 1u]));
+}
+
+bool PinCache::read(FeatureMemoryPool& featurePool, StringArena& stringArena,
+    std::vector<DataSet*>& subsets, bool& concatenatedSearch) {
+  std::string cacheFN = getCacheFN(pinFN_);
+  if (!map(cacheFN)) return false;
+
+  Header header;
+  std::memcpy(&header, data_, sizeof(Header));
+  if (!isValid(header) || header.numRowsPerBlock != featurePool.getNumRowsPerBlock()) {
+    if (VERB > 1) {
+      std::cerr << "PIN cache " << cacheFN << " does not match the input file "
+                << "and will be rewritten." << std::endl;
+    }
+    release();
+    return false;
+  }
+
+  size_t numPsms = static_cast<size_t>(header.numPsms);
+  size_t numFeatures = header.numFeatures;
+  double* features = reinterpret_cast<double*>(data_ + header.sectionOffsets[FEATURES]);
+  featurePool.adoptBlocks(features, static_cast<size_t>(header.numFeatureBlocks), numPsms);
+
+  const int32_t* labels = getSection<int32_t>(header, LABELS);
+  const uint32_t* scans = getSection<uint32_t>(header, SCANS);
+  const uint32_t* specFileNrs = getSection<uint32_t>(header, SPEC_FILE_NRS);
+  const double* expMasses = getSection<double>(header, EXP_MASSES);
+  const double* calcMasses = getSection<double>(header, CALC_MASSES);
+  const double* retentionTimes = getSection<double>(header, RET_TIMES);
+  const char* psmIds = getSection<char>(header, PSM_IDS);
+  const uint32_t* peptideRefs = getSection<uint32_t>(header, PEPTIDE_REFS);
+  const uint64_t* proteinRefStarts = getSection<uint64_t>(header, PROTEIN_REF_STARTS);
+  const uint32_t* proteinRefs = getSection<uint32_t>(header, PROTEIN_REFS);
+  const char* peptides = getSection<char>(header, PEPTIDES);
+  const char* proteins = getSection<char>(header, PROTEINS);
+  const char* specFileNames = getSection<char>(header, SPEC_FILE_NAMES);
+
+  uint64_t numSpecFileNames = *reinterpret_cast<const uint64_t*>(specFileNames);
+  if (numSpecFileNames > 0u) {
+    std::vector<std::string> fileNames;
+    for (uint64_t ix = 0; ix < numSpecFileNames; ++ix) {
+      fileNames.push_back(getString(specFileNames, ix));
+    }
+    PSMDescription::setSpectraFileNames(fileNames);
+  }
+
+  // the peptides are interned in the cache, so PSMs of the same peptide 
+  // share its copy in the arena; protein names are interned only once
+  const uint64_t numPeptides = *reinterpret_cast<const uint64_t*>(peptides);
+  const uint64_t numProteins = *reinterpret_cast<const uint64_t*>(proteins);
+  std::vector<const char*> peptideStrings(static_cast<size_t>(numPeptides), NULL);
+  std::vector<unsigned int> peptideLengths(static_cast<size_t>(numPeptides), 0u);
+  std::vector<unsigned int> proteinSymbols(static_cast<size_t>(numProteins));
+  for (uint64_t ix = 0; ix < numProteins; ++ix) {
+    proteinSymbols[ix] = PSMDescription::addProteinName(getString(proteins, ix));
+  }
+
+  DataSet* targetSet = new DataSet();
+  targetSet->setLabel(1);
+  DataSet* decoySet = new DataSet();
+  decoySet->setLabel(-1);
+  for (size_t ix = 0; ix < numPsms; ++ix) {
+    PSMDescription* myPsm = new PSMDescription();
+    myPsm->setId(getString(psmIds, ix), &stringArena);
+    myPsm->scan = scans[ix];
+    myPsm->specFileNr = specFileNrs[ix];
+    myPsm->expMass = expMasses[ix];
+    myPsm->calcMass = calcMasses[ix];
+    myPsm->setRetentionTime(retentionTimes[ix]);
+    uint32_t peptideRef = peptideRefs[ix];
+    if (peptideStrings[peptideRef] == NULL) {
+      std::string peptide = getString(peptides, peptideRef);
+      peptideStrings[peptideRef] = stringArena.store(peptide);
+      peptideLengths[peptideRef] = static_cast<unsigned int>(peptide.size());
+    }
+    myPsm->setSharedPeptide(peptideStrings[peptideRef], peptideLengths[peptideRef]);
+    myPsm->proteinIds.reserve(static_cast<size_t>(proteinRefStarts[ix + 1] - proteinRefStarts[ix]));
+    for (uint64_t jx = proteinRefStarts[ix]; jx < proteinRefStarts[ix + 1]; ++jx) {
+      myPsm->proteinIds.push_back(proteinSymbols[proteinRefs[jx]]);
+    }
+    myPsm->features = features + ix * numFeatures;
+    if (labels[ix] == 1) {
+      targetSet->registerPsm(myPsm);
+    } else {
+      decoySet->registerPsm(myPsm);
+    }
+  }
+  subsets.push_back(targetSet);
+  subsets.push_back(decoySet);
+  concatenatedSearch = (header.concatenatedSearch != 0u);
+
+  if (VERB > 1) {
+    std::cerr << "Found " << numPsms << " PSMs in PIN cache " << cacheFN << std::endl;
+  }
+  return true;
+}
+
+bool PinCache::write(const FeatureMemoryPool& featurePool,
+    const std::vector<DataSet*>& subsets, bool concatenatedSearch) {
+  std::string cacheFN = getCacheFN(pinFN_);
+  std::string tmpFN = cacheFN + ".tmp";
+
+  Header header;
+  std::memset(&header, 0, sizeof(Header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byteOrderMark = kByteOrderMark;
+  if (!getPinStats(header.pinSize, header.pinModTime)) return false;
+
+  size_t numFeatures = DataSet::getNumFeatures();
+  size_t numRowsPerBlock = featurePool.getNumRowsPerBlock();
+  header.numFeatures = static_cast<uint32_t>(numFeatures);
+  header.numRowsPerBlock = static_cast<uint32_t>(numRowsPerBlock);
+  header.concatenatedSearch = concatenatedSearch ? 1u : 0u;
+  header.checkedPeptides = ProteinProbEstimator::getCalcProteinLevelProb() ? 1u : 0u;
+
+  std::vector<PSMDescription*> psms;
+  std::vector<int32_t> labels;
+  std::vector<DataSet*>::const_iterator setIt = subsets.begin();
+  for ( ; setIt != subsets.end(); ++setIt) {
+    const std::vector<PSMDescription*>& setPsms = (*setIt)->getPsms();
+    psms.insert(psms.end(), setPsms.begin(), setPsms.end());
+    labels.resize(psms.size(), (*setIt)->getLabel());
+  }
+  header.numPsms = psms.size();
+  header.numFeatureBlocks = (psms.size() + numRowsPerBlock - 1u) / numRowsPerBlock;
+
+  std::ofstream out(tmpFN.c_str(), std::ios::out | std::ios::binary);
+  if (!out) {
+    if (VERB > 0) {
+      std::cerr << "Warning: could not write PIN cache " << cacheFN
+                << ", continuing without cache." << std::endl;
+    }
+    return false;
+  }
+  out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+  writePadding(out, kAlignment);
+  header.sectionOffsets[FEATURES] = static_cast<uint64_t>(out.tellp());
+  std::vector<PSMDescription*>::const_iterator it = psms.begin();
+  for ( ; it != psms.end(); ++it) {
+    out.write(reinterpret_cast<const char*>((*it)->features),
+              static_cast<std::streamsize>(numFeatures * sizeof(double)));
+  }
+  std::vector<double> paddingRow(numFeatures, 0.0);
+  for (size_t ix = psms.size(); ix < header.numFeatureBlocks * numRowsPerBlock; ++ix) {
+    writeColumn(out, paddingRow);
+  }
+
+  std::vector<uint32_t> scans, specFileNrs, peptideRefs, proteinRefs;
+  std::vector<uint64_t> proteinRefStarts(1, 0u);
+  std::vector<double> expMasses, calcMasses, retentionTimes;
+  std::vector<std::string> psmIds, peptides, proteins;
+  boost::unordered_map<std::string, uint32_t> peptideLookUp;
+  // protein names are already interned, their references are indexed by symbol
+  const uint32_t kNoRef = ~0u;
+  std::vector<uint32_t> proteinRefBySymbol(PSMDescription::getNumProteinNames(), kNoRef);
+  for (it = psms.begin(); it != psms.end(); ++it) {
+    PSMDescription* psm = *it;
+    scans.push_back(psm->scan);
+    specFileNrs.push_back(psm->specFileNr);
+    expMasses.push_back(psm->expMass);
+    calcMasses.push_back(psm->calcMass);
+    retentionTimes.push_back(psm->getRetentionTime());
+    psmIds.push_back(psm->getId());
+    peptideRefs.push_back(intern(psm->getFullPeptide(), peptides, peptideLookUp));
+    std::vector<unsigned int>::const_iterator protIt = psm->proteinIds.begin();
+    for ( ; protIt != psm->proteinIds.end(); ++protIt) {
+      uint32_t& proteinRef = proteinRefBySymbol[*protIt];
+      if (proteinRef == kNoRef) {
+        proteinRef = static_cast<uint32_t>(proteins.size());
+        proteins.push_back(PSMDescription::getProteinName(*protIt));
+      }
+      proteinRefs.push_back(proteinRef);
+    }
+    proteinRefStarts.push_back(proteinRefs.size());
+  }
+
+  writePadding(out, kAlignment);
+  header.sectionOffsets[LABELS] = static_cast<uint64_t>(out.tellp());
+  writeColumn(out, labels);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[SCANS] = static_cast<uint64_t>(out.tellp());
+  writeColumn(out, scans);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[SPEC_FILE_NRS] = static_cast<uint64_t>(out.tellp());
+  writeColumn(out, specFileNrs);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[EXP_MASSES] = static_cast<uint64_t>(out.tellp());
+  writeColumn(out, expMasses);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[CALC_MASSES] = static_cast<uint64_t>(out.tellp());
+  writeColumn(out, calcMasses);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[RET_TIMES] = static_cast<uint64_t>(out.tellp());
+  writeColumn(out, retentionTimes);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[PSM_IDS] = static_cast<uint64_t>(out.tellp());
+  writeStringTable(out, psmIds);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[PEPTIDE_REFS] = static_cast<uint64_t>(out.tellp());
+  writeColumn(out, peptideRefs);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[PROTEIN_REF_STARTS] = static_cast<uint64_t>(out.tellp());
+  writeColumn(out, proteinRefStarts);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[PROTEIN_REFS] = static_cast<uint64_t>(out.tellp());
+  writeColumn(out, proteinRefs);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[PEPTIDES] = static_cast<uint64_t>(out.tellp());
+  writeStringTable(out, peptides);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[PROTEINS] = static_cast<uint64_t>(out.tellp());
+  writeStringTable(out, proteins);
+  writePadding(out, kAlignment);
+  header.sectionOffsets[SPEC_FILE_NAMES] = static_cast<uint64_t>(out.tellp());
+  writeStringTable(out, PSMDescription::getSpectraFileNames());
+  writePadding(out, kAlignment);
+  header.sectionOffsets[SEPARATOR] = static_cast<uint64_t>(out.tellp());
+  writeStringTable(out, std::vector<std::string>(1, PSMDescription::getProteinNameSeparator()));
+  writePadding(out, kAlignment);
+  header.fileSize = static_cast<uint64_t>(out.tellp());
+
+  out.seekp(0, std::ios::beg);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  out.close();
+
+  std::remove(cacheFN.c_str());
+  if (!out || std::rename(tmpFN.c_str(), cacheFN.c_str()) != 0) {
+    std::remove(tmpFN.c_str());
+    if (VERB > 0) {
+      std::cerr << "Warning: could not write PIN cache " << cacheFN
+                << ", continuing without cache." << std::endl;
+    }
+    return false;
+  }
+  if (VERB > 1) {
+    std::cerr << "Wrote PIN cache " << cacheFN << std::endl;
+  }
+  return true;
+}
@@ -0,0 +1,109 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef PINCACHE_H_
+#define PINCACHE_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "DataSet.h"
+#include "FeatureMemoryPool.h"
+#include "PSMDescription.h"
+#include "StringArena.h"
+
+/*
+ * PinCache is a binary, memory mappable copy of the PSMs of a tab delimited
+ * input file. It is written to <pin>.pcache after the first full read of the
+ * input file and memory mapped on subsequent runs, such that the rows of the
+ * FeatureMemoryPool point directly into the mapped feature matrix and no text
+ * has to be parsed. The cache is ignored, and rewritten, as soon as the size
+ * or modification time of the input file no longer match.
+ *
+ * Layout (native byte order, every section starts at a multiple of 64 bytes):
+ *   header | feature matrix (row-major, padded to whole FeatureMemoryPool
+ *   blocks) | label, scan, specFileNr, expMass, calcMass and retention time
+ *   columns | PSM ids | peptide references | protein references |
+ *   interned peptide and protein names | spectrum file names | separator
+ *
+ * PSMs are stored with all targets first, followed by all decoys.
+ */
+class PinCache {
+ public:
+  PinCache();
+  ~PinCache();
+
+  void setPinFN(const std::string& pinFN) { pinFN_ = pinFN; }
+  inline bool isEnabled() const { return !pinFN_.empty(); }
+  static std::string getCacheFN(const std::string& pinFN) {
+    return pinFN + ".pcache";
+  }
+
+  // Maps the cache of the current input file and appends a target and a
+  // decoy DataSet to subsets, whose ids and peptides are stored in 
+  // stringArena. Returns false, without touching any of the arguments, if 
+  // the cache is missing or does not match the input file.
+  bool read(FeatureMemoryPool& featurePool, StringArena& stringArena,
+            std::vector<DataSet*>& subsets, bool& concatenatedSearch);
+  // Writes the PSMs of a freshly parsed input file, i.e. before any
+  // normalization of the features has taken place.
+  bool write(const FeatureMemoryPool& featurePool,
+             const std::vector<DataSet*>& subsets, bool concatenatedSearch);
+
+  void release();
+
+ protected:
+  enum Section {
+    FEATURES, LABELS, SCANS, SPEC_FILE_NRS, EXP_MASSES, CALC_MASSES,
+    RET_TIMES, PSM_IDS, PEPTIDE_REFS, PROTEIN_REF_STARTS, PROTEIN_REFS,
+    PEPTIDES, PROTEINS, SPEC_FILE_NAMES, SEPARATOR, NUM_SECTIONS
+  };
+
+  struct Header {
+    char magic[8];
+    uint32_t version, byteOrderMark;
+    uint64_t pinSize;
+    int64_t pinModTime;
+    uint32_t numFeatures, numRowsPerBlock;
+    uint64_t numPsms, numFeatureBlocks;
+    uint32_t concatenatedSearch, checkedPeptides;
+    uint64_t sectionOffsets[NUM_SECTIONS];
+    uint64_t fileSize;
+  };
+
+  static const char kMagic[8];
+  static const uint32_t kVersion = 1u;
+  static const uint32_t kByteOrderMark = 0x01020304u;
+  static const uint64_t kAlignment = 64u;
+
+  std::string pinFN_;
+  char* data_;
+  size_t size_;
+  bool isMapped_;
+
+  bool getPinStats(uint64_t& size, int64_t& modTime) const;
+  bool map(const std::string& cacheFN);
+  bool isValid(const Header& header) const;
+
+  template<class T>
+  const T* getSection(const Header& header, Section section) const {
+    return reinterpret_cast<const T*>(data_ + header.sectionOffsets[section]);
+  }
+  static std::string getString(const char* table, uint64_t ix);
+};
+
+#endif /* PINCACHE_H_ */
@@ -41,6 +41,7 @@ using namespace std;
 static int noIntervals = 500;
 static unsigned int numLambda = 100;
 static double maxLambda = 0.5;
+static size_t maxBootstrapSize = 1000;
 
 bool PosteriorEstimator::reversed = false;
 bool PosteriorEstimator::pvalInput = false;
@@ -63,19 +64,6 @@ bool isMixed(const pair<double, bool>& aPair) {
   return aPair.second;
 }
 
-template<class T> void bootstrap(const vector<T>& in, vector<T>& out,
-                                 size_t max_size = 1000) {
-  out.clear();
-  double n = static_cast<double>(in.size());
-  size_t num_draw = min(in.size(), max_size);
-  for (size_t ix = 0; ix < num_draw; ++ix) {
-    size_t draw = (size_t)(PseudoRandom::lcg_uniform_rand() * n);
-    out.push_back(in[draw]);
-  }
-  // sort in desending order
-  sort(out.begin(), out.end());
-}
-
 double mymin(double a, double b) {
   return a > b ? b : a;
 }
@@ -92,6 +80,15 @@ void PosteriorEstimator::estimatePEP(vector<pair<double, bool> >& combined,
       xvals.push_back(elem->first);
     }
   }
+  predictPEP(lr, xvals, peps);
+}
+
+/**
+ * Predicts the PEPs of the scores in xvals, sorted in descending order, with
+ * the fitted logistic regression and makes them monotonically increasing.
+ */
+void PosteriorEstimator::predictPEP(LogisticRegression& lr,
+    const vector<double>& xvals, vector<double>& peps) {
   lr.predict(xvals, peps);
 #define OUTPUT_DEBUG_FILES
 #undef OUTPUT_DEBUG_FILES
@@ -211,6 +208,19 @@ void PosteriorEstimator::estimate(vector<pair<double, bool> >& combined,
     }
   }
 
+  fitLogisticRegression(lr, medians, negatives, sizes);
+  // restore sorting order
+  if (!reversed && !usePi0) {
+    reverse(combined.begin(), combined.end());
+  }
+}
+
+/**
+ * Fits the logistic regression to the binned decoy rates of binData, adding
+ * bins if fewer than 4 are available and the no-terminate flag is set.
+ */
+void PosteriorEstimator::fitLogisticRegression(LogisticRegression& lr,
+    vector<double>& medians, vector<double>& negatives, vector<double>& sizes) {
   if (medians.size() < 4) {
     ostringstream oss;
     oss << "ERROR: Fewer than 4 bins available for PEP estimation, "
@@ -245,10 +255,6 @@ void PosteriorEstimator::estimate(vector<pair<double, bool> >& combined,
   
   lr.setData(medians, negatives, sizes);
   lr.roughnessPenaltyIRLS();
-  // restore sorting order
-  if (!reversed && !usePi0) {
-    reverse(combined.begin(), combined.end());
-  }
 }
 
 // Estimates q-values and prints
@@ -321,6 +327,10 @@ void PosteriorEstimator::finishStandaloneGeneralized(
 	}
 }
 
+int PosteriorEstimator::getNumBins() {
+  return noIntervals;
+}
+
 /*
  * If pi0 == 1.0 this is equal to the "traditional" binning
  */
@@ -584,18 +594,48 @@ double PosteriorEstimator::estimatePi0(vector<double>& p,
   }
   double minPi0 = *min_element(pi0s.begin(), pi0s.end());
   
-  vector<double> pBoot, mse;
-  // Initialize the vector mse with zeroes.
-  fill_n(back_inserter(mse), pi0s.size(), 0.0);
-  // Examine which lambda level that is most stable under bootstrap
+  // Examine which lambda level that is most stable under bootstrap.
+  // A bootstrap replicate only needs the number of drawn p-values at or
+  // above each lambda. As p is sorted, a draw of index i is so for all
+  // lambdas whose lower_bound position in p is at most i, so each draw is
+  // binned into a histogram over these positions instead of materializing
+  // and sorting the resampled p-values.
+  size_t numLambdas = lambdas.size();
+  vector<size_t> lambdaStarts(numLambdas);
+  for (size_t ix = 0; ix < numLambdas; ++ix) {
+    lambdaStarts[ix] = static_cast<size_t>(distance(p.begin(),
+        lower_bound(p.begin(), p.end(), lambdas[ix])));
+  }
+  size_t numDraw = min(n, maxBootstrapSize);
+  // Every replicate draws from its own counter based stream, making the
+  // result independent of the number of threads. Unlike the earlier serial
+  // bootstrap, which drew every resampled index from the global generator,
+  // only the stream key is taken from it. For a given seed the estimated
+  // pi0 hence differs from earlier versions, and so does every later draw
+  // from the global generator.
+  uint64_t streamKey = PseudoRandom::lcg_rand();
+  vector<unsigned int> bootCounts(numBoot * (numLambdas + 1), 0u);
+  #pragma omp parallel for schedule(dynamic, 4)
+  for (int boot = 0; boot < static_cast<int>(numBoot); ++boot) {
+    unsigned int* counts = &bootCounts[boot * (numLambdas + 1)];
+    uint64_t counter = static_cast<uint64_t>(boot) * numDraw;
+    for (size_t ix = 0; ix < numDraw; ++ix) {
+      size_t draw = static_cast<size_t>(
+          PseudoRandom::stream_uniform_rand(streamKey, counter + ix) * n);
+      ++counts[distance(lambdaStarts.begin(), upper_bound(
+          lambdaStarts.begin(), lambdaStarts.end(), draw))];
+    }
+  }
+  
+  vector<double> mse(numLambdas, 0.0);
+  // Accumulate in replicate order for reproducible rounding.
   for (unsigned int boot = 0; boot < numBoot; ++boot) {
-    // Create an array of bootstrapped p-values, and sort in ascending order.
-    bootstrap<double> (p, pBoot);
-    n = pBoot.size();
-    for (unsigned int ix = 0; ix < lambdas.size(); ++ix) {
-      start = lower_bound(pBoot.begin(), pBoot.end(), lambdas[ix]);
-      double Wl = (double)distance(start, pBoot.end());
-      double pi0Boot = Wl / static_cast<double>(n) / (1. - lambdas[ix]);
+    const unsigned int* counts = &bootCounts[boot * (numLambdas + 1)];
+    size_t Wl = 0u;
+    for (size_t ix = numLambdas; ix-- > 0; ) {
+      Wl += counts[ix + 1];
+      double pi0Boot = static_cast<double>(Wl) / 
+          static_cast<double>(numDraw) / (1. - lambdas[ix]);
       // Estimated mean-squared error.
       mse[ix] += (pi0Boot - minPi0) * (pi0Boot - minPi0);
     }
@@ -38,6 +38,13 @@ class PosteriorEstimator {
   static void estimatePEPGeneralized(std::vector<std::pair<double, bool> >& combined,
 				 std::vector<double>& peps,
 				 bool include_negative = false);
+  static void fitLogisticRegression(LogisticRegression& lr,
+                                    std::vector<double>& medians,
+                                    std::vector<double>& negatives,
+                                    std::vector<double>& sizes);
+  static void predictPEP(LogisticRegression& lr,
+                         const std::vector<double>& xvals,
+                         std::vector<double>& peps);
   static void getPValues(const std::vector<std::pair<double, bool> >& combined,
                          std::vector<double>& p);
   static void getQValues(double pi0,
@@ -53,6 +60,8 @@ class PosteriorEstimator {
   static void setReversed(bool status) {
 	  reversed = status;
   }
+  static bool getReversed() { return reversed; }
+  static int getNumBins();
   static void setGeneralized(bool general) {
 	  competition = general;
 	  assert(!(general && pvalInput));
@@ -16,6 +16,7 @@
  *******************************************************************************/
 
 #include "ProteinProbEstimator.h"
+#include "ResultWriter.h"
 
 const double ProteinProbEstimator::target_decoy_ratio = 1.0;
 const double ProteinProbEstimator::psmThresholdMayu = 0.90;
@@ -307,30 +308,37 @@ void ProteinProbEstimator::estimateQValuesEmp() {
 void ProteinProbEstimator::setTargetandDecoysNames(Scores& peptideScores) {
   int numGroups = 0;
   bool decoyFound = false;
+  // proteins are indexed by the symbols of their names, the names are only
+  // needed for new proteins
+  const size_t kNoProtein = static_cast<size_t>(-1);
+  std::vector<size_t> proteinIdxBySymbol(PSMDescription::getNumProteinNames(), kNoProtein);
   std::vector<ScoreHolder>::iterator psm = peptideScores.begin();
   for (; psm!= peptideScores.end(); ++psm) {
     // for each protein
-    std::vector<std::string>::iterator protIt = psm->pPSM->proteinIds.begin();
+    std::vector<unsigned int>::const_iterator protIt = psm->pPSM->proteinIds.begin();
     for (; protIt != psm->pPSM->proteinIds.end(); protIt++) {
       ProteinScoreHolder::Peptide peptide(psm->pPSM->getPeptideSequence(), 
           psm->isDecoy(), psm->p, psm->pep, psm->q, psm->score);
-      if (proteinToIdxMap_.find(*protIt) == proteinToIdxMap_.end()) {
-	      ProteinScoreHolder newProtein(*protIt, psm->isDecoy(), peptide, ++numGroups);
-	      proteinToIdxMap_[*protIt] = proteins_.size();
+      size_t& proteinIdx = proteinIdxBySymbol[*protIt];
+      if (proteinIdx == kNoProtein) {
+	      std::string proteinName = PSMDescription::getProteinName(*protIt);
+	      ProteinScoreHolder newProtein(proteinName, psm->isDecoy(), peptide, ++numGroups);
+	      proteinIdx = proteins_.size();
+	      proteinToIdxMap_[proteinName] = proteinIdx;
 	      proteins_.push_back(newProtein);
 	      
 	      if (!useDecoyPrefix) {
 	        if (psm->isDecoy()) {
-	          falsePosSet_.insert(*protIt);
+	          falsePosSet_.insert(proteinName);
 	          decoyFound = true;
 	        } else {
-	          truePosSet_.insert(*protIt);
+	          truePosSet_.insert(proteinName);
 	        }
-	      } else if (isDecoy(*protIt)) {
+	      } else if (isDecoy(proteinName)) {
 	        decoyFound = true;
 	      }
       } else {
-      	proteins_.at(proteinToIdxMap_[*protIt]).addPeptide(peptide);
+      	proteins_.at(proteinIdx).addPeptide(peptide);
       }
     }
   }
@@ -349,17 +357,23 @@ void ProteinProbEstimator::setTargetandDecoysNames(Scores& peptideScores) {
 }
 
 void ProteinProbEstimator::addSpectralCounts(Scores& peptideScores) {
+  // the protein of each protein name symbol is looked up by name only once
+  const size_t kUnknown = static_cast<size_t>(-1), kNoProtein = kUnknown - 1u;
+  std::vector<size_t> proteinIdxBySymbol(PSMDescription::getNumProteinNames(), kUnknown);
   std::vector<ScoreHolder>::iterator psm = peptideScores.begin();
   for (; psm!= peptideScores.end(); ++psm) {
     // for each protein
-    std::vector<std::string>::const_iterator protIt = psm->pPSM->proteinIds.begin();
+    std::vector<unsigned int>::const_iterator protIt = psm->pPSM->proteinIds.begin();
     std::set<unsigned int> seenProteinIdxs;
     for (; protIt != psm->pPSM->proteinIds.end(); protIt++) {
-      if (proteinToIdxMap_.find(*protIt) != proteinToIdxMap_.end()) {
-        unsigned int proteinIdx = static_cast<unsigned int>(proteinToIdxMap_[*protIt]);
-        if (seenProteinIdxs.find(proteinIdx) == seenProteinIdxs.end()) {
-          seenProteinIdxs.insert(proteinIdx);
-        }
+      size_t& proteinIdx = proteinIdxBySymbol[*protIt];
+      if (proteinIdx == kUnknown) {
+        std::map<std::string, size_t>::const_iterator it = 
+            proteinToIdxMap_.find(PSMDescription::getProteinName(*protIt));
+        proteinIdx = (it != proteinToIdxMap_.end()) ? it->second : kNoProtein;
+      }
+      if (proteinIdx != kNoProtein) {
+        seenProteinIdxs.insert(static_cast<unsigned int>(proteinIdx));
       }
     }
     
@@ -477,28 +491,31 @@ void ProteinProbEstimator::writeOutputToXML(string xmlOutputFN, bool outputDecoy
 }
 
 void ProteinProbEstimator::print(ostream& myout, bool decoy) {  
-  myout << "ProteinId\tProteinGroupId\tq-value\tposterior_error_prob\t";
+  ResultWriter writer(myout);
+  writer << "ProteinId\tProteinGroupId\tq-value\tposterior_error_prob\t";
   if (specCountQvalThreshold_ > 0.0) {
-    myout << "spec_count_unique\tspec_count_all\t";
+    writer << "spec_count_unique\tspec_count_all\t";
   }
-  myout << "peptideIds" << std::endl;
+  writer << "peptideIds";
+  writer.endRow();
   
   for (std::vector<ProteinScoreHolder>::const_iterator myP = proteins_.begin(); 
 	        myP != proteins_.end(); myP++) {
     if( (decoy && myP->isDecoy()) || (!decoy && myP->isTarget())) {
-      myout << myP->getName() << "\t" << myP->getGroupId() << "\t" 
-            << myP->getQemp() << "\t" << myP->getPEP() << "\t";
+      writer << myP->getName() << '\t' << myP->getGroupId() << '\t' 
+             << myP->getQemp() << '\t' << myP->getPEP() << '\t';
       if (specCountQvalThreshold_ > 0.0) {
-        myout << myP->getSpecCountsUnique() << "\t" << myP->getSpecCountsAll() << "\t";
+        writer << myP->getSpecCountsUnique() << '\t' << myP->getSpecCountsAll() << '\t';
       }
-      const std::vector<ProteinScoreHolder::Peptide> peptides = myP->getPeptidesByRef();
+      const std::vector<ProteinScoreHolder::Peptide>& peptides = myP->getPeptidesByRef();
       std::vector<ProteinScoreHolder::Peptide>::const_iterator peptIt = peptides.begin();
       for(; peptIt != peptides.end(); peptIt++) {
         if (peptIt->name != "") {
-          myout << peptIt->name << " ";
+          writer << peptIt->name << ' ';
         }
       }
-      myout << std::endl;
+      writer.endRow();
     }
   }
+  writer.close();
 }
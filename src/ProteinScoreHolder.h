@@ -40,7 +40,7 @@ class ProteinScoreHolder {
   ~ProteinScoreHolder();
   
   inline void setName(std::string name) { name_ = name; }
-  inline std::string getName() const { return name_; }
+  inline const std::string& getName() const { return name_; }
   
   inline void setQ(double q) { q_ = q; }
   inline double getQ() const { return q_; }
@@ -29,4 +29,20 @@ unsigned long PseudoRandom::lcg_rand() {
 // Generates a random double between 0 and 1
 double PseudoRandom::lcg_uniform_rand() {
   return (double)PseudoRandom::lcg_rand() / ((double)PseudoRandom::kRandMax + (double)1);
-}
\ No newline at end of file
+}
+
+// SplitMix64 finalizer, a bijective mixing of all 64 bits
+static inline uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+uint64_t PseudoRandom::stream_rand(uint64_t key, uint64_t counter) {
+  return mix64(mix64(key) + (counter + 1u) * 0x9E3779B97F4A7C15ULL);
+}
+
+// Generates a random double in [0, 1) from the 53 upper bits
+double PseudoRandom::stream_uniform_rand(uint64_t key, uint64_t counter) {
+  return (double)(stream_rand(key, counter) >> 11) * (1.0 / 9007199254740992.0);
+}
@@ -32,6 +32,11 @@ class PseudoRandom {
   inline static void setSeed(unsigned long s) { seed_ = s; }
   static unsigned long lcg_rand();
   static double lcg_uniform_rand();
+  // Counter based generator: returns the counter-th number of the stream
+  // identified by key without any shared state, so that several threads can
+  // draw from their own streams with results independent of the scheduling.
+  static uint64_t stream_rand(uint64_t key, uint64_t counter);
+  static double stream_uniform_rand(uint64_t key, uint64_t counter);
   const static uint64_t kRandMax = 4294967291u;
  protected:
   static uint64_t seed_;
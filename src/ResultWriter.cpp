@@ -0,0 +1,212 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include "ResultWriter.h"
+
+const std::size_t ResultWriter::kDefaultBufferSize = 1u << 20;
+bool ResultWriter::backgroundWriting_ = false;
+
+// powers of ten that are exactly representable as doubles
+static const int kMaxExactPow10 = 22;
+static const long double kPow10[kMaxExactPow10 + 1] = {
+  1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L,
+  1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L
+};
+// largest precision for which the scaled values leave room for the rounding
+// decision in the integer part of an unsigned long long
+static const int kMaxFastPrecision = 15;
+
+ResultWriter::ResultWriter(std::ostream& os, std::size_t bufferSize) :
+    os_(os), bufferSize_(bufferSize), closed_(false),
+    background_(backgroundWriting_), stopWriter_(false) {
+  precision_ = static_cast<int>(os.precision());
+  buffer_.reserve(bufferSize_ + bufferSize_ / 8u);
+  if (background_) {
+    pending_.reserve(buffer_.capacity());
+    writer_ = std::thread(&ResultWriter::runWriter, this);
+  }
+}
+
+ResultWriter::~ResultWriter() {
+  close();
+}
+
+void ResultWriter::close() {
+  if (closed_) return;
+  closed_ = true;
+  if (!buffer_.empty()) writeBuffer();
+  if (background_) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopWriter_ = true;
+    }
+    condition_.notify_all();
+    writer_.join();
+  }
+  os_.flush();
+}
+
+/**
+ * Writes the buffer directly, or hands it over to the writer thread as soon
+ * as it has finished writing the previous one
+ */
+void ResultWriter::writeBuffer() {
+  if (!background_) {
+    os_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!pending_.empty()) condition_.wait(lock);
+  pending_.swap(buffer_);
+  lock.unlock();
+  condition_.notify_all();
+}
+
+void ResultWriter::runWriter() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    while (pending_.empty() && !stopWriter_) condition_.wait(lock);
+    if (pending_.empty()) break;
+    // the pending buffer is not touched by the formatting thread until it
+    // has been emptied again
+    lock.unlock();
+    os_.write(pending_.data(), static_cast<std::streamsize>(pending_.size()));
+    lock.lock();
+    pending_.clear();
+    condition_.notify_all();
+  }
+}
+
+ResultWriter& ResultWriter::operator<<(double value) {
+  char out[32];
+  buffer_.append(out, formatDouble(value, precision_, out));
+  return *this;
+}
+
+ResultWriter& ResultWriter::operator<<(int value) {
+  appendUnsigned(value < 0 ? 0u - static_cast<unsigned long>(value)
+                           : static_cast<unsigned long>(value), value < 0);
+  return *this;
+}
+
+ResultWriter& ResultWriter::operator<<(unsigned int value) {
+  appendUnsigned(value, false);
+  return *this;
+}
+
+ResultWriter& ResultWriter::operator<<(long value) {
+  appendUnsigned(value < 0 ? 0u - static_cast<unsigned long>(value)
+                           : static_cast<unsigned long>(value), value < 0);
+  return *this;
+}
+
+ResultWriter& ResultWriter::operator<<(unsigned long value) {
+  appendUnsigned(value, false);
+  return *this;
+}
+
+void ResultWriter::appendUnsigned(unsigned long value, bool negative) {
+  char digits[24];
+  char* end = digits + sizeof(digits);
+  char* begin = end;
+  do {
+    *--begin = static_cast<char>('0' + value % 10u);
+    value /= 10u;
+  } while (value > 0u);
+  if (negative) *--begin = '-';
+  buffer_.append(begin, static_cast<std::size_t>(end - begin));
+}
+
+std::size_t ResultWriter::formatDouble(double value, int precision, char* out) {
+  int numDigits = precision > 0 ? precision : 1;
+  double absValue = std::fabs(value);
+  if (numDigits > kMaxFastPrecision || !(absValue > 0.0) || !(absValue <= DBL_MAX)) {
+    return static_cast<std::size_t>(snprintf(out, 32, "%.*g", precision, value));
+  }
+
+  // scale the value to numDigits digits before the decimal point, which
+  // takes a single rounding with exactly representable powers of ten
+  int exponent = static_cast<int>(std::floor(std::log10(absValue)));
+  long double scaled = 0.0L;
+  bool inRange = false;
+  for (int attempt = 0; attempt < 3 && !inRange; ++attempt) {
+    int shift = numDigits - 1 - exponent;
+    if (shift > kMaxExactPow10 || shift < -kMaxExactPow10) break;
+    scaled = shift >= 0 ? absValue * kPow10[shift] : absValue / kPow10[-shift];
+    if (scaled >= kPow10[numDigits]) {
+      ++exponent;
+    } else if (scaled < kPow10[numDigits - 1]) {
+      --exponent;
+    } else {
+      inRange = true;
+    }
+  }
+
+  long double integerPart = std::floor(scaled);
+  long double fraction = scaled - integerPart;
+  // leave values within the rounding error of a tie to the exact conversion
+  if (!inRange || std::fabs(fraction - 0.5L) <= scaled * LDBL_EPSILON * 4.0L) {
+    return static_cast<std::size_t>(snprintf(out, 32, "%.*g", precision, value));
+  }
+  unsigned long long mantissa = static_cast<unsigned long long>(integerPart);
+  if (fraction > 0.5L) ++mantissa;
+  if (mantissa == static_cast<unsigned long long>(kPow10[numDigits])) {
+    mantissa /= 10u;
+    ++exponent;
+  }
+
+  char digits[20];
+  for (int ix = numDigits; ix-- > 0; ) {
+    digits[ix] = static_cast<char>('0' + mantissa % 10u);
+    mantissa /= 10u;
+  }
+  // %g drops the trailing zeros of the fraction
+  int lastDigit = numDigits;
+  while (lastDigit > 1 && digits[lastDigit - 1] == '0') --lastDigit;
+
+  char* pos = out;
+  if (value < 0.0) *pos++ = '-';
+  if (exponent < -4 || exponent >= numDigits) {
+    *pos++ = digits[0];
+    if (lastDigit > 1) {
+      *pos++ = '.';
+      for (int ix = 1; ix < lastDigit; ++ix) *pos++ = digits[ix];
+    }
+    *pos++ = 'e';
+    *pos++ = exponent < 0 ? '-' : '+';
+    int absExponent = exponent < 0 ? -exponent : exponent;
+    if (absExponent >= 100) *pos++ = static_cast<char>('0' + absExponent / 100);
+    *pos++ = static_cast<char>('0' + (absExponent / 10) % 10);
+    *pos++ = static_cast<char>('0' + absExponent % 10);
+  } else if (exponent >= 0) {
+    for (int ix = 0; ix <= exponent; ++ix) *pos++ = digits[ix];
+    if (lastDigit > exponent + 1) {
+      *pos++ = '.';
+      for (int ix = exponent + 1; ix < lastDigit; ++ix) *pos++ = digits[ix];
+    }
+  } else {
+    *pos++ = '0';
+    *pos++ = '.';
+    for (int ix = -1; ix > exponent; --ix) *pos++ = '0';
+    for (int ix = 0; ix < lastDigit; ++ix) *pos++ = digits[ix];
+  }
+  *pos = '\0';
+  return static_cast<std::size_t>(pos - out);
+}
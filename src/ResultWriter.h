@@ -0,0 +1,106 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef RESULTWRITER_H_
+#define RESULTWRITER_H_
+
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* ResultWriter formats the rows of the tab delimited result files into a
+* large buffer that is written to the output stream only when full, instead
+* of formatting every field through the stream and flushing every row.
+*
+* Floating point numbers are formatted like the default format of the output
+* stream, i.e. printf's %g with the precision of the stream, through an
+* integer based conversion that falls back on snprintf for the rare values
+* that lie too close to a rounding boundary to decide. The output is hence
+* identical to streaming the values.
+*
+* If background writing is switched on, full buffers are handed over to a
+* writer thread, so that the formatting of the next rows overlaps with the
+* writing of the previous ones. The stream must then not be used by anyone
+* else until the ResultWriter is closed.
+*/
+class ResultWriter {
+ public:
+  explicit ResultWriter(std::ostream& os,
+                        std::size_t bufferSize = kDefaultBufferSize);
+  ~ResultWriter();
+
+  inline ResultWriter& operator<<(const std::string& s) {
+    buffer_.append(s);
+    return *this;
+  }
+  inline ResultWriter& operator<<(const char* s) {
+    buffer_.append(s, strlen(s));
+    return *this;
+  }
+  inline ResultWriter& operator<<(char c) {
+    buffer_.push_back(c);
+    return *this;
+  }
+  ResultWriter& operator<<(double value);
+  ResultWriter& operator<<(int value);
+  ResultWriter& operator<<(unsigned int value);
+  ResultWriter& operator<<(long value);
+  ResultWriter& operator<<(unsigned long value);
+
+  // Ends the current row, writing the buffer if it is full
+  inline void endRow() {
+    buffer_.push_back('\n');
+    if (buffer_.size() >= bufferSize_) writeBuffer();
+  }
+  // Writes the remaining rows and flushes the stream
+  void close();
+
+  // Formats value like printf("%.*g", precision, value) into out, which
+  // needs room for 32 characters, and returns the number of characters
+  static std::size_t formatDouble(double value, int precision, char* out);
+
+  static void setBackgroundWriting(bool on) { backgroundWriting_ = on; }
+  static bool getBackgroundWriting() { return backgroundWriting_; }
+
+  const static std::size_t kDefaultBufferSize;
+
+ protected:
+  std::ostream& os_;
+  std::size_t bufferSize_;
+  int precision_;
+  bool closed_;
+  std::string buffer_;
+
+  // state shared with the writer thread
+  bool background_, stopWriter_;
+  std::string pending_;
+  std::thread writer_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+
+  static bool backgroundWriting_;
+
+  void writeBuffer();
+  void runWriter();
+  void appendUnsigned(unsigned long value, bool negative);
+};
+
+#endif /*RESULTWRITER_H_*/
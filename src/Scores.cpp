@@ -20,6 +20,7 @@
 #include <boost/assign.hpp>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -32,11 +33,13 @@
 #include <utility>
 #include <vector>
 using namespace boost::algorithm;
+#include "BatchScorer.h"
 #include "DataSet.h"
 #include "Globals.h"
 #include "MassHandler.h"
 #include "Normalizer.h"
 #include "PosteriorEstimator.h"
+#include "ResultWriter.h"
 #include "Scores.h"
 #include "SetHandler.h"
 #include "ssl.h"
@@ -59,6 +62,142 @@ inline double truncateTo(double truncateMe, const char* length) {
     return atof(truncated);
 }
 
+namespace {
+
+/*
+ * Compact sort entry used on the training hot path instead of sorting the
+ * ScoreHolders themselves. The key orders the scores descendingly when
+ * compared as an unsigned integer, the reference holds the index of the
+ * ScoreHolder shifted by one bit, with the target flag in the lowest bit.
+ */
+struct ScoreKey {
+    uint64_t key;
+    uint32_t ref;
+    
+    inline std::size_t index() const { return ref >> 1; }
+    inline bool isTarget() const { return (ref & 1u) != 0u; }
+    inline bool operator<(const ScoreKey& other) const { return key < other.key; }
+};
+
+inline uint64_t descendingKey(double score) {
+    score += 0.0;  // maps -0.0 to 0.0, so that equal scores have equal keys
+    uint64_t bits;
+    memcpy(&bits, &score, sizeof(bits));
+    const uint64_t signBit = 0x8000000000000000ULL;
+    // ascending order of the doubles is the ascending order of these keys
+    bits = (bits & signBit) ? ~bits : (bits | signBit);
+    return ~bits;
+}
+
+/*
+ * LSD radix sort on 11 bit digits. Digits for which all keys fall into the
+ * same bucket, typically the sign and exponent bits, are skipped.
+ */
+void radixSort(std::vector<ScoreKey>& keys) {
+    const std::size_t n = keys.size();
+    if (n < 256u) {
+        std::sort(keys.begin(), keys.end());
+        return;
+    }
+    const unsigned int kBits = 11u, kNumBuckets = 1u << kBits, kNumPasses = 6u;
+    std::vector<uint32_t> counts(kNumPasses * kNumBuckets, 0u);
+    std::vector<ScoreKey>::const_iterator it = keys.begin();
+    for (; it != keys.end(); ++it) {
+        for (unsigned int pass = 0; pass < kNumPasses; ++pass) {
+            ++counts[pass * kNumBuckets + ((it->key >> (pass * kBits)) & (kNumBuckets - 1u))];
+        }
+    }
+    std::vector<ScoreKey> buffer(n);
+    for (unsigned int pass = 0; pass < kNumPasses; ++pass) {
+        uint32_t* count = &counts[pass * kNumBuckets];
+        unsigned int shift = pass * kBits;
+        if (count[(keys[0].key >> shift) & (kNumBuckets - 1u)] == n) {
+            continue;
+        }
+        uint32_t offset = 0u;
+        for (unsigned int bucket = 0; bucket < kNumBuckets; ++bucket) {
+            uint32_t c = count[bucket];
+            count[bucket] = offset;
+            offset += c;
+        }
+        for (it = keys.begin(); it != keys.end(); ++it) {
+            buffer[count[(it->key >> shift) & (kNumBuckets - 1u)]++] = *it;
+        }
+        keys.swap(buffer);
+    }
+}
+
+inline const ScoreHolder& deref(const ScoreHolder& sh) { return sh; }
+inline const ScoreHolder& deref(const ScoreHolder* sh) { return *sh; }
+
+/*
+ * Sorts the scores of either the ScoreHolders or pointers to them (as used
+ * by ScoresFoldView) descendingly.
+ */
+template <typename ScoreHolderRef>
+void sortScores(const std::vector<ScoreHolderRef>& scores, const double* scoreValues,
+                std::vector<ScoreKey>& keys) {
+    keys.resize(scores.size());
+    for (std::size_t ix = 0; ix < scores.size(); ++ix) {
+        keys[ix].key = descendingKey(scoreValues[ix]);
+        keys[ix].ref = static_cast<uint32_t>((ix << 1) | (deref(scores[ix]).label > 0 ? 1u : 0u));
+    }
+    radixSort(keys);
+}
+
+/*
+ * Applies a comparator for ScoreHolders to pointers to ScoreHolders.
+ */
+template <typename Compare>
+struct DerefCompare {
+    Compare comp;
+    inline bool operator()(const ScoreHolder* x, const ScoreHolder* y) const {
+        return comp(*x, *y);
+    }
+};
+
+/**
+ * Counts the targets with q < fdr, given the keys sorted by descending score.
+ * For target-decoy competition (pi0 = 1) this is a single pass: the q-value
+ * of a target is below fdr exactly if the FDR after its own or any later
+ * group of tied scores is below fdr.
+ */
+int countPositives(const std::vector<ScoreKey>& keys, const double* scoreValues,
+                   double pi0, double fdr, bool skipDecoysPlusOne) {
+    if (pi0 < 1.0) {
+        std::vector<pair<double, bool> > combined;
+        combined.reserve(keys.size());
+        std::vector<ScoreKey>::const_iterator keyIt = keys.begin();
+        for (; keyIt != keys.end(); ++keyIt) {
+            combined.push_back(make_pair(scoreValues[keyIt->index()], keyIt->isTarget()));
+        }
+        std::vector<double> qvals;
+        PosteriorEstimator::setNegative(true);  // also get q-values for decoys
+        PosteriorEstimator::getQValues(pi0, combined, qvals, skipDecoysPlusOne);
+        int numPos = 0;
+        for (std::size_t ix = 0; ix < qvals.size(); ++ix) {
+            if (qvals[ix] < fdr && keys[ix].isTarget()) ++numPos;
+        }
+        return numPos;
+    }
+    
+    int n_z_ge_w = skipDecoysPlusOne ? 0 : 1, n_w_ge_w = 0, numPos = 0;
+    for (std::size_t ix = 0; ix < keys.size(); ++ix) {
+        if (keys[ix].isTarget()) {
+            ++n_w_ge_w;
+        } else {
+            ++n_z_ge_w;
+        }
+        if (ix + 1 == keys.size() || keys[ix].key != keys[ix + 1].key) {
+            double groupFdr = (n_z_ge_w * pi0 + 0.0) / (double)((std::max)(1, n_w_ge_w));
+            if ((std::min)(groupFdr, 1.0) < fdr) numPos = n_w_ge_w;
+        }
+    }
+    return numPos;
+}
+
+}  // namespace
+
 void ScoreHolder::printPSM(ostream& os, bool printDecoys, bool printExpMass) {
     if (!isDecoy() || printDecoys) {
         os << "    <psm p:psm_id=\"" << pPSM->getId() << "\"";
@@ -90,9 +229,9 @@ void ScoreHolder::printPSM(ostream& os, bool printDecoys, bool printExpMass) {
             os << "      <peptide_seq n=\"" << n << "\" c=\"" << c << "\" seq=\"" << centpep << "\"/>" << endl;
         }
 
-        std::vector<std::string>::const_iterator pidIt = pPSM->proteinIds.begin();
+        std::vector<unsigned int>::const_iterator pidIt = pPSM->proteinIds.begin();
         for (; pidIt != pPSM->proteinIds.end(); ++pidIt) {
-            os << "      <protein_id>" << getRidOfUnprintablesAndUnicode(*pidIt) << "</protein_id>" << endl;
+            os << "      <protein_id>" << getRidOfUnprintablesAndUnicode(PSMDescription::getProteinName(*pidIt)) << "</protein_id>" << endl;
         }
 
         os << "      <p_value>" << scientific << p << "</p_value>" << endl;
@@ -120,9 +259,9 @@ void ScoreHolder::printPeptide(ostream& os, bool printDecoys, bool printExpMass,
         }
         os << "      <calc_mass>" << fixed << setprecision(3) << pPSM->calcMass << "</calc_mass>" << endl;
 
-        std::vector<std::string>::const_iterator pidIt = pPSM->proteinIds.begin();
+        std::vector<unsigned int>::const_iterator pidIt = pPSM->proteinIds.begin();
         for (; pidIt != pPSM->proteinIds.end(); ++pidIt) {
-            os << "      <protein_id>" << getRidOfUnprintablesAndUnicode(*pidIt) << "</protein_id>" << endl;
+            os << "      <protein_id>" << getRidOfUnprintablesAndUnicode(PSMDescription::getProteinName(*pidIt)) << "</protein_id>" << endl;
         }
 
         os << "      <p_value>" << scientific << p << "</p_value>" << endl;
@@ -175,13 +314,14 @@ void ScoreHolder::printPepXML(ostream& os, map<char, float>& aaWeight, int index
     /* num_tot_proteins */
     int num_tot_proteins = pPSM->proteinIds.size();
 
-    std::vector<std::string>::const_iterator pidIt = pPSM->proteinIds.begin();
+    std::vector<unsigned int>::const_iterator pidIt = pPSM->proteinIds.begin();
     for (; pidIt != pPSM->proteinIds.end(); ++pidIt) {
+        std::string proteinName = getRidOfUnprintablesAndUnicode(PSMDescription::getProteinName(*pidIt));
         if (n_protein == 0) {
             /*  set calc_neutral_pep_mass  as calcMass as placeholder for now */
-            os << "                <search_hit calc_neutral_pep_mass=\"" << calcMass << "\" num_tot_proteins=\"" << num_tot_proteins << "\" hit_rank=\"" << hit_rank << "\" massdiff=\"" << massdiff << "\" peptide=\"" << peptide_sequence << "\" protein=\"" << getRidOfUnprintablesAndUnicode(*pidIt) << "\">" << endl;
+            os << "                <search_hit calc_neutral_pep_mass=\"" << calcMass << "\" num_tot_proteins=\"" << num_tot_proteins << "\" hit_rank=\"" << hit_rank << "\" massdiff=\"" << massdiff << "\" peptide=\"" << peptide_sequence << "\" protein=\"" << proteinName << "\">" << endl;
         } else {
-            os << "                    <alternative_protein protein=\"" << getRidOfUnprintablesAndUnicode(*pidIt) << "\"/>" << endl;
+            os << "                    <alternative_protein protein=\"" << proteinName << "\"/>" << endl;
         }
         n_protein++;
     }
@@ -228,7 +368,7 @@ void Scores::merge(std::vector<Scores>& sv, double fdr, bool skipNormalizeScores
     std::vector<Scores>::iterator cvBinScores = sv.begin();
     std::vector<std::vector<double> >::iterator weights = all_w.begin();
     for (; cvBinScores != sv.end(); cvBinScores++, weights++) {
-        sort(cvBinScores->begin(), cvBinScores->end(), greater<ScoreHolder>());
+        sortByKeys<ScanMassKey>(cvBinScores->scores_, GreaterScanMassKey());
         cvBinScores->checkSeparationAndSetPi0();
         cvBinScores->calcQ(fdr);
         if (!skipNormalizeScores) {
@@ -240,7 +380,7 @@ void Scores::merge(std::vector<Scores>& sv, double fdr, bool skipNormalizeScores
 }
 
 void Scores::postMergeStep() {
-    sort(scores_.begin(), scores_.end(), greater<ScoreHolder>());
+    sortByKeys<ScanMassKey>(scores_, GreaterScanMassKey());
     totalNumberOfDecoys_ = static_cast<unsigned int>(count_if(scores_.begin(),
                                                               scores_.end(),
                                                               mem_fn(&ScoreHolder::isDecoy)));
@@ -288,31 +428,43 @@ void Scores::scoreAndAddPSM(ScoreHolder& sh,
 }
 
 void Scores::print(int label, std::ostream& os) {
-    std::vector<ScoreHolder>::iterator scoreIt = scores_.begin();
-    os << "PSMId\t";
+    ResultWriter writer(os);
+    writer << "PSMId\t";
     if (PSMDescription::hasSpectrumFileName()) {
-        os << "filename\t";
+        writer << "filename\t";
     }
-    os << "score\tq-value\tposterior_error_prob\tpeptide\tproteinIds";
+    writer << "score\tq-value\tposterior_error_prob\tpeptide\tproteinIds";
     if (is_output_rt_) {
-        os << "\trt\n";
-    } else {
-        os << "\n";
+        writer << "\trt";
     }
+    writer.endRow();
 
+    const std::string& separator = PSMDescription::getProteinNameSeparator();
+    std::vector<ScoreHolder>::const_iterator scoreIt = scores_.begin();
     for (; scoreIt != scores_.end(); ++scoreIt) {
         if (scoreIt->label == label) {
-            std::ostringstream out;
-            scoreIt->pPSM->printProteins(out);
-            ResultHolder rh(scoreIt->score, scoreIt->q, scoreIt->pep, scoreIt->pPSM->getId(), scoreIt->pPSM->getFullPeptide(), out.str(), scoreIt->pPSM->getSpectrumFileName());
+            // same format as ResultHolder's operator<<
+            PSMDescription* pPSM = scoreIt->pPSM;
+            writer << pPSM->getId() << '\t';
+            if (PSMDescription::hasSpectrumFileName()) {
+                const std::string& fileName =
+                    PSMDescription::getSpectraFileNames().at(pPSM->specFileNr);
+                if (!fileName.empty()) writer << fileName << '\t';
+            }
+            writer << scoreIt->score << '\t' << scoreIt->q << '\t'
+                   << scoreIt->pep << '\t' << pPSM->getFullPeptide() << '\t';
+            std::vector<unsigned int>::const_iterator protIt = pPSM->proteinIds.begin();
+            for (; protIt != pPSM->proteinIds.end(); ++protIt) {
+                if (protIt != pPSM->proteinIds.begin()) writer << separator;
+                writer << PSMDescription::getProteinName(*protIt);
+            }
             if (is_output_rt_) {
-                rh.retentionTime = scoreIt->pPSM->getRetentionTime();
-                rh.outputRT = true;  // Ideally this should be set once outside this loop, but ResultHolder needs to be initialized before.
+                writer << '\t' << pPSM->getRetentionTime();
             }
-
-            os << rh << std::endl;
+            writer.endRow();
         }
     }
+    writer.close();
 }
 
 void Scores::populateWithPSMs(SetHandler& setHandler) {
@@ -368,12 +520,14 @@ void Scores::populateWithPSMs(SetHandler& setHandler) {
  * @param test vector containing the test sets of PSMs
  * @param xval_fold number of folds in train and test
  */
-void Scores::createXvalSetsBySpectrum(std::vector<Scores>& train,
-                                      std::vector<Scores>& test, const unsigned int xval_fold,
-                                      FeatureMemoryPool& featurePool) {
-    // set the number of cross validation folds for train and test to xval_fold
-    train.resize(xval_fold, Scores(usePi0_));
-    test.resize(xval_fold, Scores(usePi0_));
+/**
+ * Assigns each PSM to one of xval_fold cross validation folds, such that all
+ * PSMs of a spectrum end up in the same fold. The fold is stored in the 
+ * ScoreHolders, which can then be split by createXvalSetsBySpectrum or be 
+ * accessed without copying through a ScoresFoldView.
+ * @param xval_fold number of folds
+ */
+void Scores::assignXvalFoldsBySpectrum(const unsigned int xval_fold) {
     // remain keeps track of residual space available in each fold
     std::vector<int> remain(xval_fold);
     // set values for remain: initially each fold is assigned (tot number of
@@ -384,7 +538,7 @@ void Scores::createXvalSetsBySpectrum(std::vector<Scores>& train,
         ix -= remain[static_cast<std::size_t>(fold)];
     }
 
-    std::sort(scores_.begin(), scores_.end(), OrderScanHash());
+    sortByKeys<ScanHashKey>(scores_, std::less<ScanHashKey>());
 
     if (scores_.size() == 0) {
         ostringstream oss;
@@ -397,14 +551,13 @@ void Scores::createXvalSetsBySpectrum(std::vector<Scores>& train,
         }
     }
 
-    // put scores into the folds; choose a fold (at random) and change it only
+    // assign scores to the folds; choose a fold (at random) and change it only
     // when scores from a new spectra are encountered
     unsigned int previousSpectrum = scores_.begin()->pPSM->scan;
     size_t randIndex = PseudoRandom::lcg_rand() % xval_fold;
     for (std::vector<ScoreHolder>::iterator it = scores_.begin();
          it != scores_.end(); ++it) {
         const unsigned int curScan = (*it).pPSM->scan;
-        const ScoreHolder sh = (*it);
         // if current score is from a different spectra than the one encountered in
         // the previous iteration, choose new fold
 
@@ -415,19 +568,35 @@ void Scores::createXvalSetsBySpectrum(std::vector<Scores>& train,
                 randIndex = PseudoRandom::lcg_rand() % xval_fold;
             }
         }
-        // insert
-        for (unsigned int i = 0; i < xval_fold; ++i) {
-            if (i == randIndex) {
-                test[i].addScoreHolder(sh);
-            } else {
-                train[i].addScoreHolder(sh);
-            }
-        }
+        it->xvalFold = static_cast<unsigned int>(randIndex);
         // update number of free position for used fold
         --remain[randIndex];
         // set previous spectrum to current one for next iteration
         previousSpectrum = curScan;
     }
+}
+
+void Scores::createXvalSetsBySpectrum(std::vector<Scores>& train,
+                                      std::vector<Scores>& test, const unsigned int xval_fold,
+                                      FeatureMemoryPool& featurePool) {
+    // set the number of cross validation folds for train and test to xval_fold
+    train.resize(xval_fold, Scores(usePi0_));
+    test.resize(xval_fold, Scores(usePi0_));
+    
+    assignXvalFoldsBySpectrum(xval_fold);
+    if (scores_.size() == 0) return;
+    
+    // put scores into the folds
+    for (std::vector<ScoreHolder>::const_iterator it = scores_.begin();
+         it != scores_.end(); ++it) {
+        for (unsigned int i = 0; i < xval_fold; ++i) {
+            if (i == it->xvalFold) {
+                test[i].addScoreHolder(*it);
+            } else {
+                train[i].addScoreHolder(*it);
+            }
+        }
+    }
 
     // calculate ratios of target over decoy for train and test set
     for (unsigned int i = 0; i < xval_fold; ++i) {
@@ -487,70 +656,104 @@ void Scores::reorderFeatureRows(FeatureMemoryPool& featurePool,
  * @param weights SVM weights used to compute SVM scores
  */
 void Scores::normalizeScores(double fdr, std::vector<double>& weights) {
-    unsigned int medianIndex = std::max(0u, totalNumberOfDecoys_ / 2u), decoys = 0u;
-
-    if (scores_.size() == 0) {
-        ostringstream oss;
-        oss << "Error: no scored PSMs were provided.\n";
-        if (NO_TERMINATE) {
-            cerr << oss.str() << "No-terminate flag set: ignoring error." << std::endl;
-            return;
-        } else {
-            throw MyException(oss.str());
-        }
-    }
-
-    std::vector<ScoreHolder>::iterator it = scores_.begin();
-    double fdrScore = it->score;
-    double medianDecoyScore = fdrScore + 1.0;
+    TargetDecoyStatistics::normalizeScores(scores_, totalNumberOfDecoys_, fdr, weights);
+}
 
-    for (; it != scores_.end(); ++it) {
-        if (it->q < fdr)
-            fdrScore = it->score;
-        if (it->isDecoy()) {
-            if (++decoys == medianIndex) {
-                medianDecoyScore = it->score;
-                break;
-            }
-        }
+/**
+ * Calculates the SVM cost/score of each PSM and sorts them
+ * @param w normal vector used for SVM cost
+ * @param fdr FDR threshold specified by user (default 0.01)
+ * @return number of true positives
+ */
+int Scores::calcScores(std::vector<double>& w, double fdr, bool skipDecoysPlusOne) {
+    std::vector<double> scoreValues;
+    scoreAll(w, scoreValues);
+    
+    // sort a compact copy and only apply the full comparator to tied scores
+    std::vector<ScoreKey> keys;
+    sortScores(scores_, scoreValues.empty() ? NULL : &scoreValues[0], keys);
+    std::vector<uint32_t> destinations(keys.size());
+    for (std::size_t ix = 0; ix < keys.size(); ++ix) {
+        scores_[ix].score = scoreValues[ix];
+        destinations[keys[ix].index()] = static_cast<uint32_t>(ix);
     }
-
-    double diff = fdrScore - medianDecoyScore;
-    if (diff <= 0) {
-        ostringstream oss;
-        oss << "Error: median decoy score <= score at " << fdr * 100
-            << "\% FDR. Cannot rescale scores to merge cross validation bins, try lowering --trainFDR.\n";
-        if (NO_TERMINATE) {
-            cerr << oss.str() << "No-terminate flag set: apply offset such that median "
-                 << "decoy has score -1, but skipping rescaling." << std::endl;
-            diff = 1.0;
-            fdrScore += 1.0;
-        } else {
-            throw MyException(oss.str());
+    moveToDestinations(scores_.begin(), destinations);
+    std::vector<ScanMassKey> tieKeys;
+    std::vector<ScoreKey>::const_iterator keyIt;
+    std::vector<ScoreHolder>::iterator tieStart = scores_.begin();
+    for (keyIt = keys.begin(); keyIt != keys.end(); ) {
+        std::vector<ScoreKey>::const_iterator tieEnd = keyIt + 1;
+        while (tieEnd != keys.end() && tieEnd->key == keyIt->key) ++tieEnd;
+        std::vector<ScoreHolder>::iterator tieStop = tieStart + (tieEnd - keyIt);
+        if (tieEnd - keyIt > 1) {
+            sortByKeys<ScanMassKey, GreaterScanMassKey, GreaterScanMassKey>(
+                tieStart, tieStop, GreaterScanMassKey(), NULL, tieKeys, destinations);
         }
+        tieStart = tieStop;
+        keyIt = tieEnd;
     }
-
-    std::vector<ScoreHolder>::iterator scoreIt = scores_.begin();
-    for (; scoreIt != scores_.end(); ++scoreIt) {
-        scoreIt->score -= fdrScore;
-        scoreIt->score /= diff;
-    }
-    Normalizer::endScoreNormalizeWeights(weights, weights, fdrScore, diff);
+    
+    printTopAndBottomScores();
+    return calcQ(fdr, skipDecoysPlusOne);
 }
 
 /**
- * Calculates the SVM cost/score of each PSM and sorts them
+ * Calculates the SVM cost/score of each PSM, but neither sorts them nor
+ * assigns q-values, which is all that is needed to evaluate a weight vector
  * @param w normal vector used for SVM cost
  * @param fdr FDR threshold specified by user (default 0.01)
  * @return number of true positives
  */
-int Scores::calcScores(std::vector<double>& w, double fdr, bool skipDecoysPlusOne) {
-    std::size_t ix;
+int Scores::calcNumPositives(std::vector<double>& w, double fdr, bool skipDecoysPlusOne) {
+    std::vector<double> scoreValues;
+    scoreAll(w, scoreValues);
+    std::vector<double>::const_iterator sIt = scoreValues.begin();
     std::vector<ScoreHolder>::iterator scoreIt = scores_.begin();
+    for (; scoreIt != scores_.end(); ++scoreIt, ++sIt) {
+        scoreIt->score = *sIt;
+    }
+    
+    std::vector<ScoreKey> keys;
+    sortScores(scores_, scoreValues.empty() ? NULL : &scoreValues[0], keys);
+    return countPositives(keys, scoreValues.empty() ? NULL : &scoreValues[0],
+                          pi0_, fdr, skipDecoysPlusOne);
+}
+
+/**
+ * Scores all PSMs for several weight vectors in one sweep over the features
+ * and calculates the number of true positives for each of them. The PSMs
+ * themselves are left untouched.
+ * @param weights normal vectors used for SVM cost
+ * @param fdr FDR threshold specified by user (default 0.01)
+ * @param numPositives number of true positives for each weight vector
+ */
+void Scores::calcNumPositives(const std::vector<const std::vector<double>*>& weights,
+                              double fdr, bool skipDecoysPlusOne,
+                              std::vector<int>& numPositives) {
+    ScoresFoldView(*this).calcNumPositives(weights, fdr, skipDecoysPlusOne, numPositives);
+}
+
+void Scores::scoreAll(std::vector<double>& w, std::vector<double>& scoreValues) const {
+    std::vector<const double*> rows;
+    getFeatureRows(rows);
+    scoreValues.resize(scores_.size());
+    const double* weights = &w[0];
+    BatchScorer::scoreRows(rows.empty() ? NULL : &rows[0], rows.size(),
+                           FeatureNames::getNumFeatures(), &weights, 1u,
+                           scoreValues.empty() ? NULL : &scoreValues[0]);
+}
+
+void Scores::getFeatureRows(std::vector<const double*>& rows) const {
+    rows.clear();
+    rows.reserve(scores_.size());
+    std::vector<ScoreHolder>::const_iterator scoreIt = scores_.begin();
     for (; scoreIt != scores_.end(); ++scoreIt) {
-        scoreIt->score = calcScore(scoreIt->pPSM->features, w);
+        rows.push_back(scoreIt->pPSM->features);
     }
-    sort(scores_.begin(), scores_.end(), greater<ScoreHolder>());
+}
+
+void Scores::printTopAndBottomScores() const {
+    std::size_t ix;
     if (VERB > 3) {
         if (scores_.size() >= 10) {
             cerr << "10 best scores and labels" << endl;
@@ -565,13 +768,6 @@ int Scores::calcScores(std::vector<double>& w, double fdr, bool skipDecoysPlusOn
             cerr << "Too few scores to display top and bottom PSMs (" << scores_.size() << " scores found)." << endl;
         }
     }
-    return calcQ(fdr, skipDecoysPlusOne);
-}
-
-void Scores::getScoreLabelPairs(std::vector<pair<double, bool> >& combined) {
-    combined.clear();
-    transform(scores_.begin(), scores_.end(), back_inserter(combined),
-              mem_fn(&ScoreHolder::toPair));
 }
 
 /**
@@ -582,65 +778,18 @@ void Scores::getScoreLabelPairs(std::vector<pair<double, bool> >& combined) {
  */
 int Scores::calcQ(double fdr, bool skipDecoysPlusOne) {
     assert(totalNumberOfDecoys_ + totalNumberOfTargets_ == size());
-
-    std::vector<pair<double, bool> > combined;
-    getScoreLabelPairs(combined);
-
-    std::vector<double> qvals;
+    
     PosteriorEstimator::setNegative(true);  // also get q-values for decoys
-    PosteriorEstimator::getQValues(pi0_, combined, qvals, skipDecoysPlusOne);
-
-    // set q-values and count number of positives
-    std::vector<double>::const_iterator qIt = qvals.begin();
-    std::vector<ScoreHolder>::iterator scoreIt = scores_.begin();
-
-    int numPos = 0;
-    for (; qIt != qvals.end(); ++qIt, ++scoreIt) {
-        scoreIt->q = *qIt;
-        if (scoreIt->q < fdr && scoreIt->isTarget()) ++numPos;
-    }
-
-    return numPos;
+    return statistics_.assignQValues(scores_, pi0_, skipDecoysPlusOne, fdr);
 }
 
 void Scores::generateNegativeTrainingSet(AlgIn& data, const double cneg) {
-    std::size_t ix2 = 0;
-    std::vector<ScoreHolder>::const_iterator scoreIt = scores_.begin();
-    for (; scoreIt != scores_.end(); ++scoreIt) {
-        if (scoreIt->isDecoy()) {
-            data.vals[ix2] = scoreIt->pPSM->features;
-            data.Y[ix2] = -1;
-            data.C[ix2++] = cneg;
-        }
-    }
-    data.negatives = static_cast<int>(ix2);
+    ScoresFoldView(*this).generateNegativeTrainingSet(data, cneg);
 }
 
 void Scores::generatePositiveTrainingSet(AlgIn& data, const double fdr,
                                          const double cpos, const bool trainBestPositive) {
-    std::size_t ix2 = static_cast<std::size_t>(data.negatives);
-    int p = 0;
-
-    std::vector<ScoreHolder>::iterator lastUniqueIt = scores_.end();
-    if (trainBestPositive) {
-        std::sort(scores_.begin(), scores_.end(), OrderScanLabel());
-        lastUniqueIt = std::unique(scores_.begin(), scores_.end(), UniqueScanLabel());
-        std::sort(scores_.begin(), lastUniqueIt, greater<ScoreHolder>());
-    }
-
-    std::vector<ScoreHolder>::const_iterator scoreIt = scores_.begin();
-    for (; scoreIt != lastUniqueIt; ++scoreIt) {
-        if (scoreIt->isTarget()) {
-            if (scoreIt->q <= fdr) {
-                data.vals[ix2] = scoreIt->pPSM->features;
-                data.Y[ix2] = 1;
-                data.C[ix2++] = cpos;
-                ++p;
-            }
-        }
-    }
-    data.positives = p;
-    data.m = static_cast<int>(ix2);
+    ScoresFoldView(*this).generatePositiveTrainingSet(data, fdr, cpos, trainBestPositive);
 }
 
 void Scores::weedOutRedundant() {
@@ -655,7 +804,7 @@ void Scores::weedOutRedundant() {
  */
 void Scores::weedOutRedundant(std::map<std::string, unsigned int>& peptideSpecCounts, double specCountQvalThreshold) {
     // lexicographically order the scores_ (based on peptides names,labels and scores)
-    std::sort(scores_.begin(), scores_.end(), lexicOrderProb());
+    sortByKeys<PeptideKey>(scores_, LexicOrderPeptideKey());
 
     /*
      * much simpler version but it does not fill up the peptide-PSM map:
@@ -689,8 +838,7 @@ void Scores::weedOutRedundant(std::map<std::string, unsigned int>& peptideSpecCo
  */
 void Scores::weedOutRedundantTDC() {
     // order the scores (based on spectra id and score)
-    std::sort(scores_.begin(), scores_.end(), OrderScanMassCharge());
-    scores_.erase(std::unique(scores_.begin(), scores_.end(), UniqueScanMassCharge()), scores_.end());
+    sortUniqueByKeys<SpectrumKey>(scores_, OrderSpectrumMassKey(), UniqueSpectrumMassKey());
 
     /* does not actually release memory because of memory fragmentation
     double previousExpMass = 0.0;
@@ -719,8 +867,8 @@ void Scores::weedOutRedundantTDC() {
  */
 void Scores::weedOutRedundantMixMax() {
     // order the scores (based on spectra id and score)
-    std::sort(scores_.begin(), scores_.end(), OrderScanMassLabelCharge());
-    scores_.erase(std::unique(scores_.begin(), scores_.end(), UniqueScanMassLabelCharge()), scores_.end());
+    sortUniqueByKeys<SpectrumKey>(scores_, OrderSpectrumMassLabelKey(),
+                                  UniqueSpectrumMassLabelKey());
 
     postMergeStep();
 }
@@ -739,7 +887,7 @@ int Scores::getInitDirection(const double initialSelectionFdr, std::vector<doubl
              scoreIt != scores_.end(); ++scoreIt) {
             scoreIt->score = scoreIt->pPSM->features[featNo];
         }
-        sort(scores_.begin(), scores_.end());
+        sortByKeys<ScanMassKey>(scores_, LessScanMassKey());
         // check once in forward direction (i = 0, higher scores are better) and
         // once in backward direction (i = 1, lower scores are better)
         for (int i = 0; i < 2; i++) {
@@ -786,43 +934,11 @@ int Scores::getInitDirection(const double initialSelectionFdr, std::vector<doubl
 }
 
 void Scores::checkSeparationAndSetPi0() {
-    std::vector<pair<double, bool> > combined;
-    getScoreLabelPairs(combined);
-
-    std::vector<double> pvals;
-    PosteriorEstimator::getPValues(combined, pvals);
-
-    pi0_ = 1.0;
-    bool tooGoodSeparation = PosteriorEstimator::checkSeparation(pvals);
-    if (tooGoodSeparation) {
-        ostringstream oss;
-        oss << "Error in the input data: too good separation between target "
-            << "and decoy PSMs.\n";
-        if (NO_TERMINATE) {
-            cerr << oss.str();
-            if (usePi0_) {
-                std::cerr << "No-terminate flag set: setting pi0 = 1 and ignoring error." << std::endl;
-            } else {
-                std::cerr << "No-terminate flag set: ignoring error." << std::endl;
-            }
-        } else {
-            throw MyException(oss.str() + "Terminating.\n");
-        }
-    } else if (usePi0_) {
-        pi0_ = PosteriorEstimator::estimatePi0(pvals);
-    }
+    pi0_ = statistics_.checkSeparationAndEstimatePi0(scores_, usePi0_);
 }
 
 void Scores::calcPep() {
-    std::vector<pair<double, bool> > combined;
-    getScoreLabelPairs(combined);
-
-    std::vector<double> peps;
-    // Logistic regression on the data
-    PosteriorEstimator::estimatePEP(combined, usePi0_, pi0_, peps, true);
-    for (size_t ix = 0; ix < scores_.size(); ix++) {
-        scores_[ix].pep = peps[ix];
-    }
+    statistics_.assignPEPs(scores_, usePi0_, pi0_);
 }
 
 unsigned Scores::getQvaluesBelowLevel(double level) {
@@ -839,3 +955,120 @@ unsigned Scores::getQvaluesBelowLevel(double level) {
 void Scores::setUsePi0(bool usePi0) {
     usePi0_ = usePi0;
 }
+
+void ScoresFoldView::getScoreHolders(std::vector<const ScoreHolder*>& scoreHolders) const {
+    scoreHolders.clear();
+    scoreHolders.reserve(pScores_->scores_.size());
+    std::vector<ScoreHolder>::const_iterator scoreIt = pScores_->scores_.begin();
+    for (; scoreIt != pScores_->scores_.end(); ++scoreIt) {
+        if (contains(*scoreIt)) scoreHolders.push_back(&*scoreIt);
+    }
+}
+
+/**
+ * Scores the PSMs of the view for several weight vectors in one sweep over 
+ * the features and calculates the number of true positives for each of them.
+ * The PSMs themselves are left untouched.
+ * @param weights normal vectors used for SVM cost
+ * @param fdr FDR threshold specified by user (default 0.01)
+ * @param numPositives number of true positives for each weight vector
+ */
+void ScoresFoldView::calcNumPositives(const std::vector<const std::vector<double>*>& weights,
+                                      double fdr, bool skipDecoysPlusOne,
+                                      std::vector<int>& numPositives) const {
+    numPositives.clear();
+    if (weights.empty()) return;
+
+    std::vector<const ScoreHolder*> scoreHolders;
+    getScoreHolders(scoreHolders);
+    std::vector<const double*> rows;
+    rows.reserve(scoreHolders.size());
+    std::vector<const ScoreHolder*>::const_iterator shIt = scoreHolders.begin();
+    for (; shIt != scoreHolders.end(); ++shIt) {
+        rows.push_back((*shIt)->pPSM->features);
+    }
+    std::vector<const double*> weightPtrs;
+    std::vector<const std::vector<double>*>::const_iterator wIt = weights.begin();
+    for (; wIt != weights.end(); ++wIt) {
+        weightPtrs.push_back(&(**wIt)[0]);
+    }
+    std::size_t numRows = rows.size();
+    std::vector<double> scoreValues(numRows * weights.size());
+    BatchScorer::scoreRows(rows.empty() ? NULL : &rows[0], numRows,
+                           FeatureNames::getNumFeatures(), &weightPtrs[0],
+                           weightPtrs.size(), scoreValues.empty() ? NULL : &scoreValues[0]);
+
+    std::vector<ScoreKey> keys;
+    for (std::size_t k = 0; k < weights.size(); ++k) {
+        const double* kScores = scoreValues.empty() ? NULL : &scoreValues[k * numRows];
+        sortScores(scoreHolders, kScores, keys);
+        numPositives.push_back(countPositives(keys, kScores, pScores_->pi0_, fdr, skipDecoysPlusOne));
+    }
+}
+
+void ScoresFoldView::generateNegativeTrainingSet(AlgIn& data, const double cneg) const {
+    std::size_t ix2 = 0;
+    const std::vector<ScoreHolder>& scores = pScores_->scores_;
+    int numNegatives = 0;
+    std::vector<ScoreHolder>::const_iterator scoreIt = scores.begin();
+    for (; scoreIt != scores.end(); ++scoreIt) {
+        if (scoreIt->isDecoy() && contains(*scoreIt)) ++numNegatives;
+    }
+    data.reserveRows(numNegatives);
+    for (scoreIt = scores.begin(); scoreIt != scores.end(); ++scoreIt) {
+        if (scoreIt->isDecoy() && contains(*scoreIt)) {
+            data.setRow(static_cast<int>(ix2), scoreIt->pPSM->features);
+            data.Y[ix2] = -1;
+            data.C[ix2++] = cneg;
+        }
+    }
+    data.negatives = static_cast<int>(ix2);
+}
+
+/**
+ * Adds the targets of the view with q <= fdr to the training set, in the
+ * current order of the underlying Scores object. If trainBestPositive is set,
+ * only the best scoring target per spectrum is used, which is selected on 
+ * pointers to the ScoreHolders to leave the Scores object untouched.
+ */
+void ScoresFoldView::generatePositiveTrainingSet(AlgIn& data, const double fdr,
+                                                 const double cpos, const bool trainBestPositive) const {
+    std::size_t ix2 = static_cast<std::size_t>(data.negatives);
+    int p = 0;
+
+    std::vector<const ScoreHolder*> positives;
+    if (trainBestPositive) {
+        std::vector<const ScoreHolder*> scoreHolders;
+        getScoreHolders(scoreHolders);
+        DerefCompare<OrderScanLabel> orderScanLabel;
+        std::stable_sort(scoreHolders.begin(), scoreHolders.end(), orderScanLabel);
+        DerefCompare<UniqueScanLabel> uniqueScanLabel;
+        scoreHolders.erase(std::unique(scoreHolders.begin(), scoreHolders.end(), 
+                                       uniqueScanLabel), scoreHolders.end());
+        DerefCompare<greater<ScoreHolder> > greaterScore;
+        std::sort(scoreHolders.begin(), scoreHolders.end(), greaterScore);
+        std::vector<const ScoreHolder*>::const_iterator shIt = scoreHolders.begin();
+        for (; shIt != scoreHolders.end(); ++shIt) {
+            if ((*shIt)->isTarget() && (*shIt)->q <= fdr) positives.push_back(*shIt);
+        }
+    } else {
+        const std::vector<ScoreHolder>& scores = pScores_->scores_;
+        std::vector<ScoreHolder>::const_iterator scoreIt = scores.begin();
+        for (; scoreIt != scores.end(); ++scoreIt) {
+            if (scoreIt->isTarget() && scoreIt->q <= fdr && contains(*scoreIt)) {
+                positives.push_back(&*scoreIt);
+            }
+        }
+    }
+    data.reserveRows(data.negatives + static_cast<int>(positives.size()));
+
+    std::vector<const ScoreHolder*>::const_iterator shIt = positives.begin();
+    for (; shIt != positives.end(); ++shIt) {
+        data.setRow(static_cast<int>(ix2), (*shIt)->pPSM->features);
+        data.Y[ix2] = 1;
+        data.C[ix2++] = cpos;
+        ++p;
+    }
+    data.positives = p;
+    data.m = static_cast<int>(ix2);
+}
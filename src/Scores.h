@@ -33,6 +33,7 @@
 #include "PseudoRandom.h"
 #include "Normalizer.h"
 #include "FeatureMemoryPool.h"
+#include "TargetDecoyStatistics.h"
 
 #include <boost/unordered/unordered_map.hpp>
 
@@ -46,17 +47,20 @@ class Scores;
 * Here are some useful abbreviations:
 * PSM - Peptide Spectrum Match
 *
+* ScoreHolder has no virtual functions, such that it stays a plain record
+* without a vtable pointer in the large vectors of Scores.
 */
 class ScoreHolder {
  public:
   double score, q, pep, p;
   PSMDescription* pPSM;
   int label;
+  unsigned int xvalFold; // cross validation fold within the owning Scores
   
-  ScoreHolder() : score(0.0), q(0.0), pep(0.0), p(0.0), label(0), pPSM(NULL) {}
+  ScoreHolder() : score(0.0), q(0.0), pep(0.0), p(0.0), label(0), pPSM(NULL),
+    xvalFold(0u) {}
   ScoreHolder(const double s, const int l, PSMDescription* psm = NULL) :
-    score(s), q(0.0), pep(0.0), p(0.0), label(l), pPSM(psm) {}
-  virtual ~ScoreHolder() {}
+    score(s), q(0.0), pep(0.0), p(0.0), label(l), pPSM(psm), xvalFold(0u) {}
   
   std::pair<double, bool> toPair() const { 
     return pair<double, bool> (score, label > 0); 
@@ -81,29 +85,6 @@ struct lessThanBaseName
 inline bool operator>(const ScoreHolder& one, const ScoreHolder& other);
 inline bool operator<(const ScoreHolder& one, const ScoreHolder& other);
   
-struct lexicOrderProb : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  static int compStrIt(std::string::iterator first1, std::string::iterator last1,
-                       std::string::iterator first2, std::string::iterator last2) {
-    for ( ; (first1 != last1) && (first2 != last2); first1++, first2++ ) {
-      if (*first1 < *first2) return 1;
-      if (*first2 < *first1) return -1;
-    }
-    if (first2 != last2) return 1;
-    else if (first1 != last1) return -1;
-    else return 0;
-  }
-  
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    int peptCmp = compStrIt(__x.pPSM->getFullPeptideSequence().begin() + 2, 
-                            __x.pPSM->getFullPeptideSequence().end() - 2, 
-                            __y.pPSM->getFullPeptideSequence().begin() + 2, 
-                            __y.pPSM->getFullPeptideSequence().end() - 2);
-    return ( ( peptCmp == 1 ) 
-    || ( (peptCmp == 0) && (__x.label > __y.label) )
-    || ( (peptCmp == 0) && (__x.label == __y.label) && (__x.score > __y.score) ) );
-  }
-};
-
 /**
  * Computes a fast hash for unsigned int using the function suggested at:
  * https://stackoverflow.com/questions/664014/what-integer-hash-function-are-good-that-accepts-an-integer-hash-key
@@ -117,67 +98,231 @@ inline unsigned int fast_uint_hash(unsigned int x) {
     return x;
 }
 
-/**
- * Orders ScoreHolders by a hash computed from the specFileNr and scan.
- * Uses the hash combination function h1 ^ (h2 << 1) suggested in https://en.cppreference.com/w/cpp/utility/hash
- */
-struct OrderScanHash : public binary_function<ScoreHolder, ScoreHolder, bool> {
+struct OrderScanLabel : public binary_function<ScoreHolder, ScoreHolder, bool> {
   bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    size_t hash_x = fast_uint_hash(__x.pPSM->specFileNr) ^ (fast_uint_hash(__x.pPSM->scan) << 1);
-    size_t hash_y = fast_uint_hash(__y.pPSM->specFileNr) ^ (fast_uint_hash(__y.pPSM->scan) << 1);
-    return (hash_x < hash_y);
+    return ( (__x.pPSM->specFileNr < __y.pPSM->specFileNr )
+    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan < __y.pPSM->scan) )
+    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.label > __y.label) ) );
   }
 };
 
-struct OrderScanMassCharge : public binary_function<ScoreHolder, ScoreHolder, bool> {
+
+struct UniqueScanLabel : public binary_function<ScoreHolder, ScoreHolder, bool> {
   bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return ( (__x.pPSM->specFileNr < __y.pPSM->specFileNr )
-    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan < __y.pPSM->scan) )
-    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass < __y.pPSM->expMass) )
-    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass == __y.pPSM->expMass) 
-       && (__x.score > __y.score) ) );
+    return (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.label == __y.label);
   }
 };
 
-struct OrderScanMassLabelCharge : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return ( (__x.pPSM->specFileNr < __y.pPSM->specFileNr )
-    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan < __y.pPSM->scan) )
-    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass < __y.pPSM->expMass) )
-    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass == __y.pPSM->expMass) 
-       && (__x.label > __y.label) )
-    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass == __y.pPSM->expMass) 
-       && (__x.label == __y.label) && (__x.score > __y.score) ) );
+/*
+* Spectrum fields of a PSM record, for the keys that are built from both
+* ScoreHolders and the StreamedPsms of StreamingScorer
+*/
+inline unsigned int getScan(const ScoreHolder& sh) { return sh.pPSM->scan; }
+inline unsigned int getSpecFileNr(const ScoreHolder& sh) {
+  return sh.pPSM->specFileNr;
+}
+inline double getExpMass(const ScoreHolder& sh) { return sh.pPSM->expMass; }
+
+/*
+* Sort entries that hold the fields compared by the PSM orders inline, such
+* that sorting moves these instead of the ScoreHolders and never touches the
+* PSMDescriptions. The reference holds the index of the record shifted by
+* one bit, with the target flag in the lowest bit.
+*/
+struct ScanMassKey {
+  double score, expMass;
+  uint32_t scan, ref;
+
+  template <typename Record>
+  ScanMassKey(const Record& psm, std::size_t ix) : score(psm.score),
+    expMass(getExpMass(psm)), scan(getScan(psm)),
+    ref(static_cast<uint32_t>((ix << 1) | (psm.label > 0 ? 1u : 0u))) {}
+  inline std::size_t index() const { return ref >> 1; }
+  inline unsigned int isTarget() const { return ref & 1u; }
+};
+
+// descending score, then scan, mass and label (operator> on ScoreHolders)
+struct GreaterScanMassKey {
+  inline bool operator()(const ScanMassKey& x, const ScanMassKey& y) const {
+    return (x.score > y.score) || (x.score == y.score && x.scan > y.scan)
+      || (x.score == y.score && x.scan == y.scan && x.expMass > y.expMass)
+      || (x.score == y.score && x.scan == y.scan && x.expMass == y.expMass
+          && x.isTarget() > y.isTarget());
   }
 };
 
-struct OrderScanLabel : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return ( (__x.pPSM->specFileNr < __y.pPSM->specFileNr )
-    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan < __y.pPSM->scan) )
-    || ( (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.label > __y.label) ) );
+// ascending score, then scan, mass and label (operator< on ScoreHolders)
+struct LessScanMassKey {
+  inline bool operator()(const ScanMassKey& x, const ScanMassKey& y) const {
+    return (x.score < y.score) || (x.score == y.score && x.scan < y.scan)
+      || (x.score == y.score && x.scan == y.scan && x.expMass < y.expMass)
+      || (x.score == y.score && x.scan == y.scan && x.expMass == y.expMass
+          && x.isTarget() < y.isTarget());
   }
 };
 
+struct SpectrumKey {
+  uint64_t spectrum; // spectrum file number in the upper, scan in the lower bits
+  double expMass, score;
+  uint32_t ref;
 
-struct UniqueScanMassCharge : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.pPSM->expMass == __y.pPSM->expMass);
+  template <typename Record>
+  SpectrumKey(const Record& psm, std::size_t ix) :
+    spectrum((static_cast<uint64_t>(getSpecFileNr(psm)) << 32) | getScan(psm)),
+    expMass(getExpMass(psm)), score(psm.score),
+    ref(static_cast<uint32_t>((ix << 1) | (psm.label > 0 ? 1u : 0u))) {}
+  inline std::size_t index() const { return ref >> 1; }
+  inline unsigned int isTarget() const { return ref & 1u; }
+};
+
+// spectrum file, scan and mass, then descending score
+struct OrderSpectrumMassKey {
+  inline bool operator()(const SpectrumKey& x, const SpectrumKey& y) const {
+    return (x.spectrum < y.spectrum)
+      || (x.spectrum == y.spectrum && x.expMass < y.expMass)
+      || (x.spectrum == y.spectrum && x.expMass == y.expMass && x.score > y.score);
   }
 };
 
-struct UniqueScanMassLabelCharge : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.label == __y.label) && (__x.pPSM->expMass == __y.pPSM->expMass);
+struct UniqueSpectrumMassKey {
+  inline bool operator()(const SpectrumKey& x, const SpectrumKey& y) const {
+    return x.spectrum == y.spectrum && x.expMass == y.expMass;
   }
 };
 
-struct UniqueScanLabel : public binary_function<ScoreHolder, ScoreHolder, bool> {
-  bool operator()(const ScoreHolder& __x, const ScoreHolder& __y) const {
-    return (__x.pPSM->specFileNr == __y.pPSM->specFileNr) && (__x.pPSM->scan == __y.pPSM->scan) && (__x.label == __y.label);
+// spectrum file, scan and mass, then targets first and descending score
+struct OrderSpectrumMassLabelKey {
+  inline bool operator()(const SpectrumKey& x, const SpectrumKey& y) const {
+    return (x.spectrum < y.spectrum)
+      || (x.spectrum == y.spectrum && x.expMass < y.expMass)
+      || (x.spectrum == y.spectrum && x.expMass == y.expMass
+          && x.isTarget() > y.isTarget())
+      || (x.spectrum == y.spectrum && x.expMass == y.expMass
+          && x.isTarget() == y.isTarget() && x.score > y.score);
+  }
+};
+
+struct UniqueSpectrumMassLabelKey {
+  inline bool operator()(const SpectrumKey& x, const SpectrumKey& y) const {
+    return x.spectrum == y.spectrum && x.isTarget() == y.isTarget()
+      && x.expMass == y.expMass;
+  }
+};
+
+// orders the spectra randomly but reproducibly for the fold assignment
+struct ScanHashKey {
+  uint32_t hash, ref;
+
+  // h1 ^ (h2 << 1) as suggested in https://en.cppreference.com/w/cpp/utility/hash
+  ScanHashKey(const ScoreHolder& sh, std::size_t ix) :
+    hash(fast_uint_hash(sh.pPSM->specFileNr) ^ (fast_uint_hash(sh.pPSM->scan) << 1)),
+    ref(static_cast<uint32_t>(ix << 1)) {}
+  inline std::size_t index() const { return ref >> 1; }
+  inline bool operator<(const ScanHashKey& other) const { return hash < other.hash; }
+};
+
+struct PeptideKey {
+  const char* peptide; // the peptide without its flanking residues
+  uint32_t length, ref;
+  double score;
+
+  PeptideKey(const ScoreHolder& sh, std::size_t ix) :
+    peptide(sh.pPSM->getFullPeptideSequence() + 2),
+    length(static_cast<uint32_t>(sh.pPSM->getFullPeptideLength() - 4u)),
+    ref(static_cast<uint32_t>((ix << 1) | (sh.label > 0 ? 1u : 0u))),
+    score(sh.score) {}
+  inline std::size_t index() const { return ref >> 1; }
+  inline unsigned int isTarget() const { return ref & 1u; }
+};
+
+// lexicographic peptide order, then targets first, descending score and
+// position, such that the first of the best scoring PSMs of a peptide is
+// kept independently of how std::sort orders ties
+struct LexicOrderPeptideKey {
+  inline bool operator()(const PeptideKey& x, const PeptideKey& y) const {
+    uint32_t n = std::min(x.length, y.length);
+    for (uint32_t ix = 0; ix < n; ++ix) {
+      if (x.peptide[ix] < y.peptide[ix]) return true;
+      if (y.peptide[ix] < x.peptide[ix]) return false;
+    }
+    if (x.length != y.length) return x.length < y.length;
+    return (x.isTarget() > y.isTarget())
+      || (x.isTarget() == y.isTarget() && x.score > y.score)
+      || (x.isTarget() == y.isTarget() && x.score == y.score
+          && x.index() < y.index());
   }
 };
 
+/*
+* Moves the record at first + ix to first + destinations[ix] in place, by
+* following the cycles of the permutation. Leaves destinations as the
+* identity.
+*/
+template <typename RandomIt>
+void moveToDestinations(RandomIt first, std::vector<uint32_t>& destinations) {
+  for (std::size_t ix = 0; ix < destinations.size(); ++ix) {
+    while (destinations[ix] != ix) {
+      uint32_t dest = destinations[ix];
+      std::swap(first[static_cast<std::ptrdiff_t>(ix)],
+                first[static_cast<std::ptrdiff_t>(dest)]);
+      std::swap(destinations[ix], destinations[dest]);
+    }
+  }
+}
+
+/*
+* Reorders the records in [first, last) by sorting keys of the given type
+* instead of the records themselves. If unique is given, only the first
+* record of each run of keys that it considers equal is kept, and the new
+* end of the range is returned. The records are moved in place, with
+* destinations as the only buffer.
+*/
+template <typename Key, typename Compare, typename Equal, typename RandomIt>
+RandomIt sortByKeys(RandomIt first, RandomIt last, Compare comp,
+                    const Equal* unique, std::vector<Key>& keys,
+                    std::vector<uint32_t>& destinations) {
+  const std::size_t n = static_cast<std::size_t>(last - first);
+  keys.clear();
+  keys.reserve(n);
+  for (std::size_t ix = 0; ix < n; ++ix) {
+    keys.push_back(Key(first[static_cast<std::ptrdiff_t>(ix)], ix));
+  }
+  std::sort(keys.begin(), keys.end(), comp);
+  if (unique != NULL) {
+    keys.erase(std::unique(keys.begin(), keys.end(), *unique), keys.end());
+  }
+
+  // the dropped records are moved behind the kept ones
+  const uint32_t unassigned = static_cast<uint32_t>(-1);
+  destinations.assign(n, unassigned);
+  for (std::size_t ix = 0; ix < keys.size(); ++ix) {
+    destinations[keys[ix].index()] = static_cast<uint32_t>(ix);
+  }
+  uint32_t nextDropped = static_cast<uint32_t>(keys.size());
+  for (std::size_t ix = 0; nextDropped < n; ++ix) {
+    if (destinations[ix] == unassigned) destinations[ix] = nextDropped++;
+  }
+  moveToDestinations(first, destinations);
+  return first + static_cast<std::ptrdiff_t>(keys.size());
+}
+
+template <typename Key, typename Record, typename Compare>
+void sortByKeys(std::vector<Record>& records, Compare comp) {
+  std::vector<Key> keys;
+  std::vector<uint32_t> destinations;
+  sortByKeys<Key, Compare, Compare>(records.begin(), records.end(), comp,
+                                    NULL, keys, destinations);
+}
+
+template <typename Key, typename Record, typename Compare, typename Equal>
+void sortUniqueByKeys(std::vector<Record>& records, Compare comp, Equal unique) {
+  std::vector<Key> keys;
+  std::vector<uint32_t> destinations;
+  records.erase(sortByKeys<Key, Compare, Equal>(records.begin(), records.end(),
+                                                comp, &unique, keys, destinations),
+                records.end());
+}
+
 inline string getRidOfUnprintablesAndUnicode(string inpString) {
   string outputs = "";
   for (unsigned int jj = 0; jj < inpString.size(); jj++) {
@@ -219,6 +364,9 @@ class Scores {
   void scoreAndAddPSM(ScoreHolder& sh, const std::vector<double>& rawWeights,
                       FeatureMemoryPool& featurePool);
   int calcScores(vector<double>& w, double fdr, bool skipDecoysPlusOne = false);
+  int calcNumPositives(vector<double>& w, double fdr, bool skipDecoysPlusOne = false);
+  void calcNumPositives(const std::vector<const std::vector<double>*>& weights,
+                        double fdr, bool skipDecoysPlusOne, std::vector<int>& numPositives);
   int calcQ(double fdr, bool skipDecoysPlusOne = false);
   void recalculateDescriptionOfCorrect(const double fdr);
   void calcPep();
@@ -226,6 +374,7 @@ class Scores {
   void populateWithPSMs(SetHandler& setHandler);
   
   int getInitDirection(const double initialSelectionFdr, std::vector<double>& direction);
+  void assignXvalFoldsBySpectrum(const unsigned int xval_fold);
   void createXvalSetsBySpectrum(std::vector<Scores>& train, 
       std::vector<Scores>& test, const unsigned int xval_fold,
       FeatureMemoryPool& featurePool);
@@ -277,6 +426,8 @@ class Scores {
     is_output_rt_ = is_output_rt;
   }
  protected:
+  friend class ScoresFoldView;
+
   bool usePi0_;
   
   double pi0_;
@@ -289,11 +440,51 @@ class Scores {
   double* decoyPtr_;
   double* targetPtr_;
   
+  // (score, label) column for q-values, p-values and PEPs
+  TargetDecoyStatistics statistics_;
+  
   void reorderFeatureRows(FeatureMemoryPool& featurePool, bool isTarget,
     boost::unordered_map<double*, double*>& movedAddresses, size_t& idx);
-  void getScoreLabelPairs(std::vector<pair<double, bool> >& combined);
+  void getFeatureRows(std::vector<const double*>& rows) const;
+  void scoreAll(std::vector<double>& w, std::vector<double>& scoreValues) const;
+  void printTopAndBottomScores() const;
   void checkSeparationAndSetPi0();
   bool is_output_rt_ = false;
 };
 
+/*
+* ScoresFoldView is a lightweight view on the ScoreHolders of a Scores object
+* that avoids copying them into separate Scores objects per cross validation
+* fold. The folds are assigned once by Scores::assignXvalFoldsBySpectrum, 
+* after which the view of a fold either contains the PSMs of that fold (the 
+* test set) or all other PSMs (the training set). The ScoreHolders, and 
+* hence their current scores and q-values, are shared with the Scores object,
+* which may be reordered in between uses of the view.
+*/
+class ScoresFoldView {
+ public:
+  // view on all PSMs
+  explicit ScoresFoldView(Scores& scores) : pScores_(&scores), fold_(0u),
+    isTestSet_(false), isSplit_(false) {}
+  ScoresFoldView(Scores& scores, unsigned int fold, bool isTestSet) : 
+    pScores_(&scores), fold_(fold), isTestSet_(isTestSet), isSplit_(true) {}
+  
+  void calcNumPositives(const std::vector<const std::vector<double>*>& weights,
+                        double fdr, bool skipDecoysPlusOne, std::vector<int>& numPositives) const;
+  
+  void generatePositiveTrainingSet(AlgIn& data, const double fdr,
+      const double cpos, const bool trainBestPositive) const;
+  void generateNegativeTrainingSet(AlgIn& data, const double cneg) const;
+  
+  inline bool contains(const ScoreHolder& sh) const {
+    return !isSplit_ || ((sh.xvalFold == fold_) == isTestSet_);
+  }
+ protected:
+  Scores* pScores_;
+  unsigned int fold_;
+  bool isTestSet_, isSplit_;
+  
+  void getScoreHolders(std::vector<const ScoreHolder*>& scoreHolders) const;
+};
+
 #endif /*SCORES_H_*/
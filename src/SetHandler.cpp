@@ -17,6 +17,13 @@
 
 #include "SetHandler.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// bytes of the input that are read per thread and block in readAllPSMs
+const size_t SetHandler::kReadBlockSize = 1u << 22;
+
 SetHandler::SetHandler(unsigned int maxPSMs) : maxPSMs_(maxPSMs) {}
 
 SetHandler::~SetHandler() {
@@ -31,6 +38,9 @@ void SetHandler::reset() {
     subsets_[ix] = NULL;
   }
   subsets_.clear();
+  stringArena_.clear();
+  // no PSMs refer to the protein names anymore
+  PSMDescription::clearProteinNames();
   DataSet::resetFeatureNames();
 }
 /**
@@ -252,6 +262,7 @@ void SetHandler::readPSMs(istream& dataStream, std::string& psmLine,
       if (subsetPSMs.size() < maxPSMs_ || randIdx < upperLimit) {
         PSMDescriptionPriority psmPriority;
         bool readProteins = false;
+        // most of these PSMs are discarded again, so they own their strings
         psmPriority.label = DataSet::readPsm(psmLine, lineNr, optionalFields, 
                                  readProteins, psmPriority.psm, featurePool_, decoyPrefix_);
         psmPriority.priority = randIdx;
@@ -269,40 +280,162 @@ void SetHandler::readPSMs(istream& dataStream, std::string& psmLine,
     
     addQueueToSets(subsetPSMs, targetSet, decoySet);
   } else { // simply read all PSMs
-    std::map<ScanId, bool> scanIdLookUp; // ScanId -> isDecoy
-    do {
+    readAllPSMs(dataStream, psmLine, lineNr, concatenatedSearch, optionalFields,
+                targetSet, decoySet);
+  }
+  
+  if (VERB > 1) {
+    std::cerr << "Found " << lineNr - (hasInitialValueRow ? 3u : 2u) << " PSMs" << std::endl;
+  }
+  
+  push_back_dataset(targetSet);
+  push_back_dataset(decoySet);
+}
+
+/**
+ * Reads all PSMs from the stream in blocks of complete lines. Each block is
+ * split into chunks at line ends which are parsed in parallel into
+ * preallocated feature rows, after which the PSMs are registered in file 
+ * order, such that the result does not depend on the number of threads.
+ * @param psmLine first PSM line, which was already read from the stream
+ * @param lineNr line number of psmLine, returns the line number after the last PSM
+ */
+void SetHandler::readAllPSMs(istream& dataStream, const std::string& psmLine,
+    unsigned int& lineNr, bool& concatenatedSearch,
+    std::vector<OptionalField>& optionalFields,
+    DataSet* targetSet, DataSet* decoySet) {
+  int numThreads = 1;
+#ifdef _OPENMP
+  numThreads = omp_get_max_threads();
+#endif
+  const size_t numChunks = 4u * static_cast<size_t>(numThreads);
+  const size_t blockSize = kReadBlockSize * static_cast<size_t>(numThreads);
+  bool hasFileName = std::find(optionalFields.begin(), optionalFields.end(), 
+                               FILENAME) != optionalFields.end();
+  std::map<ScanId, bool> scanIdLookUp; // ScanId -> isDecoy
+  
+  std::vector<char> buffer(psmLine.begin(), psmLine.end());
+  buffer.push_back('\n');
+  bool endOfStream = false;
+  while (true) {
+    if (!endOfStream) {
+      size_t filled = buffer.size();
+      buffer.resize(filled + blockSize);
+      dataStream.read(&buffer[filled], static_cast<std::streamsize>(blockSize));
+      buffer.resize(filled + static_cast<size_t>(dataStream.gcount()));
+      endOfStream = !dataStream;
+    }
+    
+    // only process complete lines, the remainder goes into the next block
+    size_t blockEnd = buffer.size();
+    if (endOfStream) {
+      if (blockEnd == 0u) break;
+      if (buffer[blockEnd - 1] != '\n') {
+        buffer.push_back('\n');
+        ++blockEnd;
+      }
+    } else {
+      while (blockEnd > 0u && buffer[blockEnd - 1] != '\n') --blockEnd;
+      if (blockEnd == 0u) continue; // line longer than the block
+    }
+    
+    std::vector<size_t> chunkStarts(1, 0u);
+    for (size_t chunk = 1; chunk < numChunks; ++chunk) {
+      size_t pos = std::max(chunkStarts.back(), blockEnd * chunk / numChunks);
+      while (pos > 0u && pos < blockEnd && buffer[pos - 1] != '\n') ++pos;
+      chunkStarts.push_back(pos);
+    }
+    chunkStarts.push_back(blockEnd);
+    
+    std::vector<size_t> chunkFirstLine(numChunks + 1, 0u);
+#pragma omp parallel for schedule(static)
+    for (int chunk = 0; chunk < static_cast<int>(numChunks); ++chunk) {
+      chunkFirstLine[chunk + 1] = static_cast<size_t>(std::count(
+          buffer.begin() + static_cast<std::ptrdiff_t>(chunkStarts[chunk]),
+          buffer.begin() + static_cast<std::ptrdiff_t>(chunkStarts[chunk + 1]), '\n'));
+    }
+    for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+      chunkFirstLine[chunk + 1] += chunkFirstLine[chunk];
+    }
+    size_t numLines = chunkFirstLine.back();
+    
+    // the memory pool is not thread safe, rows are allocated in file order
+    std::vector<double*> featureRows(numLines);
+    for (size_t ix = 0; ix < numLines; ++ix) {
+      featureRows[ix] = featurePool_.allocate();
+    }
+    
+    std::vector<ParsedPsmLine> parsedLines(numLines);
+    std::vector<std::string> chunkErrors(numChunks);
+    // each chunk stores its ids and peptides in an arena of its own, which
+    // avoids locking a shared arena for every PSM
+    std::vector<StringArena> chunkArenas(numChunks);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int chunk = 0; chunk < static_cast<int>(numChunks); ++chunk) {
+      try {
+        const char* pos = &buffer[0] + chunkStarts[chunk];
+        const char* chunkEnd = &buffer[0] + chunkStarts[chunk + 1];
+        for (size_t ix = chunkFirstLine[chunk]; pos < chunkEnd; ++ix) {
+          const char* lineEnd = static_cast<const char*>(
+              memchr(pos, '\n', static_cast<size_t>(chunkEnd - pos)));
+          std::string line(pos, static_cast<size_t>(lineEnd - pos));
+          line = rtrim(line);
+          unsigned int psmLineNr = lineNr + static_cast<unsigned int>(ix);
+          ParsedPsmLine& parsedLine = parsedLines[ix];
+          parsedLine.scanId = getScanId(line, parsedLine.label, optionalFields, psmLineNr);
+          if (parsedLine.label == 1 || parsedLine.label == -1) {
+            bool readProteins = true;
+            DataSet::readPsm(line, psmLineNr, optionalFields, readProteins,
+                parsedLine.psm, featureRows[ix], decoyPrefix_, &chunkArenas[chunk],
+                hasFileName ? &parsedLine.specFileName : NULL,
+                &parsedLine.proteinNames);
+          }
+          pos = lineEnd + 1;
+        }
+      } catch (const std::exception& e) {
+        chunkErrors[chunk] = e.what();
+      }
+    }
+    for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+      stringArena_.take(chunkArenas[chunk]);
+    }
+    // report the first error in file order
+    for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+      if (!chunkErrors[chunk].empty()) throw MyException(chunkErrors[chunk]);
+    }
+    
+    for (size_t ix = 0; ix < numLines; ++ix, ++lineNr) {
       if (lineNr % 1000000 == 0 && VERB > 1) {
         std::cerr << "Reading line " << lineNr << std::endl;
       }
-      psmLine = rtrim(psmLine);
-      int label = 0;
-      ScanId scanId = getScanId(psmLine, label, optionalFields, lineNr);
-      bool isDecoy = (label == -1);
-      if (scanIdLookUp.find(scanId) != scanIdLookUp.end()) {
-        if (concatenatedSearch && isDecoy != scanIdLookUp[scanId]) {
+      ParsedPsmLine& parsedLine = parsedLines[ix];
+      bool isDecoy = (parsedLine.label == -1);
+      std::map<ScanId, bool>::iterator it = scanIdLookUp.find(parsedLine.scanId);
+      if (it != scanIdLookUp.end()) {
+        if (concatenatedSearch && isDecoy != it->second) {
           concatenatedSearch = false;
         }
       } else {
-        scanIdLookUp[scanId] = isDecoy;
+        scanIdLookUp[parsedLine.scanId] = isDecoy;
       }
-      if (label == 1) {
-        targetSet->readPsm(psmLine, lineNr, optionalFields, featurePool_, decoyPrefix_);
-      } else if (label == -1) {
-        decoySet->readPsm(psmLine, lineNr, optionalFields, featurePool_, decoyPrefix_);
-      } else {
+      if (parsedLine.psm == NULL) {
         std::cerr << "Warning: the PSM on line " << lineNr
             << " has a label not in {1,-1} and will be ignored." << std::endl;
+        featurePool_.deallocate(featureRows[ix]);
+        continue;
       }
-      ++lineNr;
-    } while (getline(dataStream, psmLine));
-  }
-  
-  if (VERB > 1) {
-    std::cerr << "Found " << lineNr - (hasInitialValueRow ? 3u : 2u) << " PSMs" << std::endl;
+      if (hasFileName) {
+        parsedLine.psm->setSpectrumFileName(parsedLine.specFileName);
+      }
+      parsedLine.psm->setProteinNames(parsedLine.proteinNames);
+      if (parsedLine.label == 1) {
+        targetSet->registerPsm(parsedLine.psm);
+      } else {
+        decoySet->registerPsm(parsedLine.psm);
+      }
+    }
+    buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(blockEnd));
   }
-  
-  push_back_dataset(targetSet);
-  push_back_dataset(decoySet);
 }
 
 void SetHandler::addQueueToSets(
@@ -494,7 +627,16 @@ int SetHandler::readAndScoreTab(istream& dataStream,
     // that have both at least one target and decoy PSM
     bool concatenatedSearch = true;
     
-    readPSMs(dataStream, psmLine, hasInitialValueRow, concatenatedSearch, optionalFields);
+    // the cache only holds complete inputs, so it is not used for subsets
+    bool useCache = pinCache_.isEnabled() && maxPSMs_ == 0u;
+    if (!useCache || !pinCache_.read(featurePool_, stringArena_, subsets_, concatenatedSearch)) {
+      readPSMs(dataStream, psmLine, hasInitialValueRow, concatenatedSearch, optionalFields);
+      // features replaced by zeroes under the no-terminate flag should not 
+      // end up in the cache
+      if (useCache && !NO_TERMINATE) {
+        pinCache_.write(featurePool_, subsets_, concatenatedSearch);
+      }
+    }
     
     pCheck = new SanityCheck();
     pCheck->checkAndSetDefaultDir();
@@ -504,6 +646,34 @@ int SetHandler::readAndScoreTab(istream& dataStream,
   return 1;
 }
 
+unsigned int SetHandler::readTabHeader(istream& dataStream,
+    std::vector<OptionalField>& optionalFields) {
+  std::string headerLine, defaultDirectionLine, psmLine;
+  getline(dataStream, headerLine); // line with feature names
+  headerLine = rtrim(headerLine);
+  int optionalFieldCount = getOptionalFields(headerLine, optionalFields);
+  
+  unsigned int lineNr = 2u;
+  std::streampos firstPsmPos = dataStream.tellg();
+  getline(dataStream, defaultDirectionLine);
+  defaultDirectionLine = rtrim(defaultDirectionLine);
+  if (isDefaultDirectionLine(defaultDirectionLine)) {
+    firstPsmPos = dataStream.tellg();
+    getline(dataStream, psmLine);
+    lineNr = 3u;
+  } else {
+    psmLine = defaultDirectionLine;
+  }
+  psmLine = rtrim(psmLine);
+  
+  // the feature names are cleared by reset(), so fill them in again
+  int numFeatures = getNumFeatures(psmLine, optionalFieldCount);
+  getFeatureNames(headerLine, numFeatures, optionalFieldCount, 
+                  DataSet::getFeatureNames());
+  dataStream.seekg(firstPsmPos);
+  return lineNr;
+}
+
 void SetHandler::readAndScorePSMs(istream& dataStream, std::string& psmLine, 
     bool hasInitialValueRow, std::vector<OptionalField>& optionalFields, 
     std::vector<double>& rawWeights, Scores& allScores) {
@@ -515,7 +685,7 @@ void SetHandler::readAndScorePSMs(istream& dataStream, std::string& psmLine,
     }
     psmLine = rtrim(psmLine);
     ScoreHolder sh;
-    sh.label = DataSet::readPsm(psmLine, lineNr, optionalFields, readProteins, sh.pPSM, featurePool_, decoyPrefix_);
+    sh.label = DataSet::readPsm(psmLine, lineNr, optionalFields, readProteins, sh.pPSM, featurePool_, decoyPrefix_, &stringArena_);
     allScores.scoreAndAddPSM(sh, rawWeights, featurePool_);
     ++lineNr;
   } while (getline(dataStream, psmLine));
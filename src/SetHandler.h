@@ -41,6 +41,8 @@
 #include "SanityCheck.h"
 #include "PseudoRandom.h"
 #include "FeatureMemoryPool.h"
+#include "StringArena.h"
+#include "PinCache.h"
 
 using namespace std;
 
@@ -59,6 +61,19 @@ struct PSMDescriptionPriority {
 */
 typedef std::pair<int, double> ScanId;
 
+/*
+* ParsedPsmLine holds a PSM line parsed by one of the threads of 
+* SetHandler::readAllPSMs until it is registered in file order.
+*/
+struct ParsedPsmLine {
+  ParsedPsmLine() : label(0), psm(NULL) {}
+  int label;
+  ScanId scanId;
+  PSMDescription* psm;
+  std::string specFileName;
+  std::vector<std::string> proteinNames;
+};
+
 /*
 * SetHandler is a class that provides functionality to handle training,
 * testing, Xval data sets, reads/writes from/to a file, prints them.
@@ -72,6 +87,10 @@ class SetHandler {
   void push_back_dataset(DataSet* ds);
 
   void setDecoyPrefix(std::string& decoyPrefix) { decoyPrefix_ = decoyPrefix; }
+  const std::string& getDecoyPrefix() const { return decoyPrefix_; }
+  // Reads the PSMs from, or writes them to, a binary cache of the given
+  // tab delimited input file (see PinCache)
+  void setPinCacheFN(const std::string& pinFN) { pinCache_.setPinFN(pinFN); }
 
      
   //const double* getFeatures(const int setPos, const int ixPos) const; 
@@ -82,6 +101,11 @@ class SetHandler {
   int readTab(std::istream& dataStream, SanityCheck*& pCheck);
   int readAndScoreTab(std::istream& dataStream, 
     std::vector<double>& rawWeights, Scores& allScores, SanityCheck*& pCheck);
+  // Reads the header and feature names of a tab delimited stream that was 
+  // read before and returns the line number of the first PSM, the stream is 
+  // left at that line
+  unsigned int readTabHeader(std::istream& dataStream,
+    std::vector<OptionalField>& optionalFields);
   void addQueueToSets(std::priority_queue<PSMDescriptionPriority>& subsetPSMs,
     DataSet* targetSet, DataSet* decoySet);
   
@@ -102,13 +126,18 @@ class SetHandler {
   static void deletePSMPointer(PSMDescription* psm);
   
   FeatureMemoryPool& getFeaturePool() { return featurePool_; }
+  StringArena& getStringArena() { return stringArena_; }
   
   void reset();
 
  protected:
+  static const size_t kReadBlockSize;
+  
   size_t maxPSMs_;
   vector<DataSet*> subsets_;
+  PinCache pinCache_; // declared before featurePool_, which may point into it
   FeatureMemoryPool featurePool_;
+  StringArena stringArena_; // ids and peptides of the PSMs in subsets_
   std::string decoyPrefix_; // Used to determine if a psm is a decoy
   
   unsigned int getSubsetIndexFromLabel(int label);
@@ -128,6 +157,10 @@ class SetHandler {
   void readPSMs(istream& dataStream, std::string& psmLine, 
     bool hasInitialValueRow, bool& separateSearches,
     std::vector<OptionalField>& optionalFields);
+  void readAllPSMs(istream& dataStream, const std::string& psmLine,
+    unsigned int& lineNr, bool& concatenatedSearch,
+    std::vector<OptionalField>& optionalFields,
+    DataSet* targetSet, DataSet* decoySet);
   void readAndScorePSMs(istream& dataStream, std::string& psmLine, 
     bool hasInitialValueRow, std::vector<OptionalField>& optionalFields, 
     std::vector<double>& rawWeights, Scores& allScores);
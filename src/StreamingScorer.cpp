@@ -0,0 +1,282 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <utility>
+
+#include "StreamingScorer.h"
+#include "FeatureNames.h"
+#include "Globals.h"
+#include "MyException.h"
+#include "PosteriorEstimator.h"
+#include "PSMDescription.h"
+#include "Scores.h"
+
+// number of output lines that are read back from the input at a time
+const std::size_t StreamingScorer::kPrintBlockSize = 1u << 16;
+
+namespace {
+
+inline void rtrim(std::string& s) {
+  std::size_t end = s.size();
+  while (end > 0 && std::isspace(static_cast<unsigned char>(s[end - 1]))) --end;
+  s.erase(end);
+}
+
+/*
+ * Same order as LexicOrderPeptideKey in Scores.h, except that the peptides
+ * are ordered by their symbols, which keeps the same PSM per peptide
+ */
+struct PeptideSymbolKey {
+  unsigned int peptide;
+  uint32_t ref;
+  double score;
+
+  PeptideSymbolKey(const StreamedPsm& psm, std::size_t ix) :
+    peptide(psm.peptide),
+    ref(static_cast<uint32_t>((ix << 1) | (psm.label > 0 ? 1u : 0u))),
+    score(psm.score) {}
+  inline std::size_t index() const { return ref >> 1; }
+  inline unsigned int isTarget() const { return ref & 1u; }
+};
+
+struct OrderPeptideSymbolKey {
+  inline bool operator()(const PeptideSymbolKey& x, const PeptideSymbolKey& y) const {
+    if (x.peptide != y.peptide) return x.peptide < y.peptide;
+    if (x.isTarget() != y.isTarget()) return x.isTarget() > y.isTarget();
+    if (x.score != y.score) return x.score > y.score;
+    return x.index() < y.index();
+  }
+};
+
+struct UniquePeptideSymbolKey {
+  inline bool operator()(const PeptideSymbolKey& x, const PeptideSymbolKey& y) const {
+    return x.peptide == y.peptide && x.isTarget() == y.isTarget();
+  }
+};
+
+}  // namespace
+
+/**
+ * Scores each PSM of the stream as it is read and keeps only its compact
+ * record. The stream has to be positioned at the first PSM line.
+ * @param dataStream tab delimited input, seekable for the second pass
+ * @param lineNr line number of the first PSM, used as scan number if absent
+ * @param rawWeights weights for the unnormalized features
+ */
+void StreamingScorer::readAndScorePSMs(std::istream& dataStream,
+    unsigned int lineNr, const std::vector<OptionalField>& optionalFields,
+    const std::vector<double>& rawWeights, const std::string& decoyPrefix) {
+  optionalFields_ = optionalFields;
+  decoyPrefix_ = decoyPrefix;
+  psms_.clear();
+  peptides_.clear();
+  totalNumberOfTargets_ = 0u;
+  totalNumberOfDecoys_ = 0u;
+
+  const unsigned int numFeatures = static_cast<unsigned int>(FeatureNames::getNumFeatures());
+  std::vector<double> featureRow(std::max(1u, numFeatures));
+
+  const unsigned int firstLineNr = lineNr;
+  uint64_t offset = static_cast<uint64_t>(dataStream.tellg());
+  std::string psmLine;
+  while (getline(dataStream, psmLine)) {
+    if (lineNr % 1000000 == 0 && VERB > 1) {
+      std::cerr << "Processing line " << lineNr << std::endl;
+    }
+    StreamedPsm psm;
+    psm.offset = offset;
+    offset += psmLine.size() + 1u;
+    rtrim(psmLine);
+
+    PSMDescription* pPSM = NULL;
+    bool readProteins = false;
+    psm.label = DataSet::readPsm(psmLine, lineNr++, optionalFields_, readProteins,
+                                 pPSM, &featureRow[0], decoyPrefix_, NULL, NULL, NULL);
+    if (psm.label != 1 && psm.label != -1) {
+      std::cerr << "Warning: the PSM " << pPSM->getId()
+                << " has a label not in {1,-1} and will be ignored." << std::endl;
+      PSMDescription::deletePtr(pPSM);
+      continue;
+    }
+
+    psm.score = 0.0;
+    for (unsigned int j = 0; j < numFeatures; j++) {
+      psm.score += featureRow[j] * rawWeights[j];
+    }
+    psm.score += rawWeights[numFeatures];
+    psm.q = 0.0;
+    psm.pep = 0.0;
+    psm.expMass = pPSM->expMass;
+    psm.scan = pPSM->scan;
+    psm.specFileNr = pPSM->specFileNr;
+    psm.peptide = peptides_.intern(pPSM->getPeptideSequence());
+    PSMDescription::deletePtr(pPSM);
+
+    if (psm.label == 1) {
+      ++totalNumberOfTargets_;
+    } else {
+      ++totalNumberOfDecoys_;
+    }
+    psms_.push_back(psm);
+  }
+
+  if (VERB > 1) {
+    std::cerr << "Found " << lineNr - firstLineNr << " PSMs" << std::endl;
+  }
+}
+
+void StreamingScorer::postMergeStep() {
+  sortByKeys<ScanMassKey>(psms_, GreaterScanMassKey());
+  pi0_ = statistics_.checkSeparationAndEstimatePi0(psms_, usePi0_);
+  totalNumberOfTargets_ = static_cast<unsigned int>(statistics_.numTargets());
+  totalNumberOfDecoys_ = static_cast<unsigned int>(statistics_.numDecoys());
+}
+
+/**
+ * Calculates the q-values of the records, which have to be sorted by
+ * descending score (see postMergeStep)
+ * @param fdr FDR threshold specified by user (default 0.01)
+ * @return number of true positives
+ */
+int StreamingScorer::calcQ(double fdr) {
+  PosteriorEstimator::setNegative(true);  // also get q-values for decoys
+  return statistics_.assignQValues(psms_, pi0_, false, fdr);
+}
+
+/**
+ * Linear rescaling of the scores such that q=fdr = 0 and the median decoy = -1
+ */
+void StreamingScorer::normalizeScores(double fdr, std::vector<double>& weights) {
+  TargetDecoyStatistics::normalizeScores(psms_, totalNumberOfDecoys_, fdr, weights);
+}
+
+/**
+ * Keeps only the best scoring target and decoy PSM per peptide
+ */
+void StreamingScorer::weedOutRedundant() {
+  sortUniqueByKeys<PeptideSymbolKey>(psms_, OrderPeptideSymbolKey(),
+                                     UniquePeptideSymbolKey());
+  postMergeStep();
+}
+
+/**
+ * Keeps only the best scoring PSM per file+scan+expMass
+ */
+void StreamingScorer::weedOutRedundantTDC() {
+  sortUniqueByKeys<SpectrumKey>(psms_, OrderSpectrumMassKey(), UniqueSpectrumMassKey());
+  postMergeStep();
+}
+
+void StreamingScorer::calcPep() {
+  statistics_.assignPEPs(psms_, usePi0_, pi0_);
+}
+
+/**
+ * Writes the PSMs with the given label in the same format as Scores::print.
+ * The ids, peptides and proteins are read back from the input stream.
+ * @param label label of the PSMs to print
+ * @param dataStream the input stream the PSMs were read from
+ * @param os output stream
+ */
+void StreamingScorer::print(int label, std::istream& dataStream, std::ostream& os) {
+  ResultWriter writer(os);
+  writer << "PSMId\t";
+  if (PSMDescription::hasSpectrumFileName()) {
+    writer << "filename\t";
+  }
+  writer << "score\tq-value\tposterior_error_prob\tpeptide\tproteinIds";
+  if (outputRT_) {
+    writer << "\trt";
+  }
+  writer.endRow();
+
+  std::vector<std::size_t> block;
+  block.reserve(kPrintBlockSize);
+  std::vector<std::string> lines;
+  for (std::size_t ix = 0; ix < psms_.size(); ++ix) {
+    if (psms_[ix].label == label) {
+      block.push_back(ix);
+      if (block.size() == kPrintBlockSize) {
+        printBlock(block, dataStream, writer, lines);
+      }
+    }
+  }
+  printBlock(block, dataStream, writer, lines);
+  writer.close();
+}
+
+/**
+ * Reads the lines of a block of PSMs in file order and writes their results
+ * in the order of the block, using lines as buffer.
+ */
+void StreamingScorer::printBlock(std::vector<std::size_t>& block,
+    std::istream& dataStream, ResultWriter& writer,
+    std::vector<std::string>& lines) {
+  // pairs of input offset and position in the block
+  std::vector<std::pair<uint64_t, std::size_t> > fileOrder;
+  fileOrder.reserve(block.size());
+  for (std::size_t ix = 0; ix < block.size(); ++ix) {
+    fileOrder.push_back(std::make_pair(psms_[block[ix]].offset, ix));
+  }
+  std::sort(fileOrder.begin(), fileOrder.end());
+
+  lines.resize(block.size());
+  std::vector<std::pair<uint64_t, std::size_t> >::const_iterator it = fileOrder.begin();
+  for (; it != fileOrder.end(); ++it) {
+    dataStream.clear();
+    dataStream.seekg(static_cast<std::streamoff>(it->first));
+    if (!getline(dataStream, lines[it->second])) {
+      throw MyException("ERROR: Could not read back a PSM from the input file.\n");
+    }
+    rtrim(lines[it->second]);
+  }
+
+  std::vector<double> featureRow(std::max<std::size_t>(1u, FeatureNames::getNumFeatures()));
+  // the protein names are not interned, as they are only needed here
+  std::vector<std::string> proteinNames;
+  const std::string& separator = PSMDescription::getProteinNameSeparator();
+  for (std::size_t ix = 0; ix < block.size(); ++ix) {
+    const StreamedPsm& psm = psms_[block[ix]];
+    PSMDescription* pPSM = NULL;
+    bool readProteins = true;
+    proteinNames.clear();
+    DataSet::readPsm(lines[ix], 0u, optionalFields_, readProteins, pPSM,
+                     &featureRow[0], decoyPrefix_, NULL, NULL, &proteinNames);
+
+    // same format as Scores::print
+    writer << pPSM->getId() << '\t';
+    if (PSMDescription::hasSpectrumFileName()) {
+      const std::string& fileName =
+          PSMDescription::getSpectraFileNames().at(psm.specFileNr);
+      if (!fileName.empty()) writer << fileName << '\t';
+    }
+    writer << psm.score << '\t' << psm.q << '\t' << psm.pep << '\t'
+           << pPSM->getFullPeptide() << '\t';
+    for (std::size_t k = 0; k < proteinNames.size(); ++k) {
+      if (k > 0u) writer << separator;
+      writer << proteinNames[k];
+    }
+    if (outputRT_) {
+      writer << '\t' << pPSM->getRetentionTime();
+    }
+    writer.endRow();
+    PSMDescription::deletePtr(pPSM);
+  }
+  block.clear();
+}
@@ -0,0 +1,113 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef STREAMINGSCORER_H_
+#define STREAMINGSCORER_H_
+
+#ifndef WIN32
+  #include <stdint.h>
+#endif
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "DataSet.h"
+#include "ResultWriter.h"
+#include "StringArena.h"
+#include "TargetDecoyStatistics.h"
+
+/*
+* StreamedPsm is the compact record a PSM is reduced to when it is scored
+* while streaming through the input: everything needed for target-decoy
+* competition, q-values and PEPs, plus the offset of its line in the input
+* to read back the strings for the output.
+*/
+struct StreamedPsm {
+  double score, q, pep;
+  double expMass;
+  uint64_t offset; // byte offset of the PSM's line in the input file
+  unsigned int scan, specFileNr;
+  unsigned int peptide; // symbol of the peptide sequence without flanks
+  int label;
+};
+
+// spectrum fields for the sort keys of Scores.h
+inline unsigned int getScan(const StreamedPsm& psm) { return psm.scan; }
+inline unsigned int getSpecFileNr(const StreamedPsm& psm) {
+  return psm.specFileNr;
+}
+inline double getExpMass(const StreamedPsm& psm) { return psm.expMass; }
+
+/*
+* StreamingScorer scores the PSMs of a tab delimited input file with a
+* trained weight vector as they are read, without keeping the PSMDescriptions,
+* i.e. their ids, peptides and proteins, in memory. It follows the final
+* scoring steps of Scores on the StreamedPsm records and writes the results
+* by reading the lines of the reported PSMs a second time, in blocks of at
+* most kPrintBlockSize lines. The final scoring steps are the ones of Scores,
+* shared through TargetDecoyStatistics and the sort keys of Scores.h. Peak
+* memory is hence independent of the sizes of the ids and protein strings.
+*
+* Unique peptides are determined on the interned peptide sequences, which
+* are the only strings kept in memory, once per distinct peptide. Protein
+* inference and XML output need the full PSMDescriptions and are not
+* supported.
+*/
+class StreamingScorer {
+ public:
+  StreamingScorer(bool usePi0, bool outputRT) : usePi0_(usePi0),
+    outputRT_(outputRT), pi0_(1.0), totalNumberOfTargets_(0u),
+    totalNumberOfDecoys_(0u) {}
+
+  void readAndScorePSMs(std::istream& dataStream, unsigned int lineNr,
+    const std::vector<OptionalField>& optionalFields,
+    const std::vector<double>& rawWeights, const std::string& decoyPrefix);
+
+  void postMergeStep();
+  int calcQ(double fdr);
+  void normalizeScores(double fdr, std::vector<double>& weights);
+  void weedOutRedundant();
+  void weedOutRedundantTDC();
+  void calcPep();
+
+  void print(int label, std::istream& dataStream, std::ostream& os = std::cout);
+
+  inline double getPi0() const { return pi0_; }
+  inline unsigned int size() const {
+    return totalNumberOfTargets_ + totalNumberOfDecoys_;
+  }
+  inline unsigned int posSize() const { return totalNumberOfTargets_; }
+  inline unsigned int negSize() const { return totalNumberOfDecoys_; }
+
+ protected:
+  static const std::size_t kPrintBlockSize;
+
+  bool usePi0_, outputRT_;
+  double pi0_;
+  unsigned int totalNumberOfTargets_, totalNumberOfDecoys_;
+
+  std::vector<StreamedPsm> psms_;
+  std::vector<OptionalField> optionalFields_;
+  std::string decoyPrefix_;
+  SymbolTable peptides_;
+  TargetDecoyStatistics statistics_;
+
+  void printBlock(std::vector<std::size_t>& block, std::istream& dataStream,
+                  ResultWriter& writer, std::vector<std::string>& lines);
+};
+
+#endif /*STREAMINGSCORER_H_*/
@@ -0,0 +1,139 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+
+#include "StringArena.h"
+
+#include <cstring>
+
+// bytes per block, strings of more than a quarter block get their own block
+const std::size_t StringArena::kBlockSize = 1u << 16;
+const std::size_t SymbolTable::kInitialSlots = 1024u;
+const unsigned int SymbolTable::kEmptySlot = ~0u;
+const unsigned int SymbolTable::kNotFound = ~0u;
+
+StringArena::StringArena() : pos_(NULL), end_(NULL), numBytes_(0u) {}
+
+StringArena::~StringArena() {
+  clear();
+}
+
+const char* StringArena::store(const char* data, std::size_t size) {
+  std::size_t numBytes = size + 1u;
+  char* str;
+  if (numBytes > kBlockSize / 4u) {
+    // the remainder of the current block is not wasted on long strings
+    str = new char[numBytes];
+    blocks_.push_back(str);
+  } else {
+    if (static_cast<std::size_t>(end_ - pos_) < numBytes) {
+      pos_ = new char[kBlockSize];
+      end_ = pos_ + kBlockSize;
+      blocks_.push_back(pos_);
+    }
+    str = pos_;
+    pos_ += numBytes;
+  }
+  if (size > 0u) std::memcpy(str, data, size);
+  str[size] = '\0';
+  numBytes_ += numBytes;
+  return str;
+}
+
+void StringArena::take(StringArena& other) {
+  // the remainder of the last block of other is not used anymore, this
+  // arena keeps filling its own block
+  blocks_.insert(blocks_.end(), other.blocks_.begin(), other.blocks_.end());
+  numBytes_ += other.numBytes_;
+  other.blocks_.clear();
+  other.pos_ = other.end_ = NULL;
+  other.numBytes_ = 0u;
+}
+
+void StringArena::clear() {
+  for (std::size_t ix = 0; ix < blocks_.size(); ++ix) {
+    delete[] blocks_[ix];
+  }
+  blocks_.clear();
+  pos_ = end_ = NULL;
+  numBytes_ = 0u;
+}
+
+SymbolTable::SymbolTable() : slots_(kInitialSlots, kEmptySlot) {}
+
+uint64_t SymbolTable::hash(const char* data, std::size_t size) {
+  uint64_t h = 14695981039346656037ULL;
+  for (std::size_t k = 0; k < size; ++k) {
+    h ^= static_cast<unsigned char>(data[k]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// the slot holding the string, or the empty slot where it would go
+std::size_t SymbolTable::findSlot(const char* data, std::size_t size,
+                                  uint64_t h) const {
+  std::size_t mask = slots_.size() - 1u;
+  std::size_t slot = static_cast<std::size_t>(h) & mask;
+  while (slots_[slot] != kEmptySlot) {
+    unsigned int symbol = slots_[slot];
+    if (hashes_[symbol] == h && lengths_[symbol] == size &&
+        std::memcmp(names_[symbol], data, size) == 0) {
+      break;
+    }
+    slot = (slot + 1u) & mask;
+  }
+  return slot;
+}
+
+unsigned int SymbolTable::intern(const char* data, std::size_t size,
+                                 bool& inserted) {
+  uint64_t h = hash(data, size);
+  std::size_t slot = findSlot(data, size, h);
+  inserted = (slots_[slot] == kEmptySlot);
+  if (!inserted) return slots_[slot];
+
+  unsigned int symbol = static_cast<unsigned int>(names_.size());
+  slots_[slot] = symbol;
+  hashes_.push_back(h);
+  names_.push_back(arena_.store(data, size));
+  lengths_.push_back(static_cast<unsigned int>(size));
+  if (2u * hashes_.size() > slots_.size()) grow();
+  return symbol;
+}
+
+unsigned int SymbolTable::lookup(const std::string& str) const {
+  // an empty slot holds kEmptySlot, which equals kNotFound
+  return slots_[findSlot(str.data(), str.size(), hash(str.data(), str.size()))];
+}
+
+void SymbolTable::grow() {
+  slots_.assign(2u * slots_.size(), kEmptySlot);
+  std::size_t mask = slots_.size() - 1u;
+  for (std::size_t k = 0; k < hashes_.size(); ++k) {
+    std::size_t slot = static_cast<std::size_t>(hashes_[k]) & mask;
+    while (slots_[slot] != kEmptySlot) slot = (slot + 1u) & mask;
+    slots_[slot] = static_cast<unsigned int>(k);
+  }
+}
+
+void SymbolTable::clear() {
+  slots_.assign(kInitialSlots, kEmptySlot);
+  hashes_.clear();
+  names_.clear();
+  lengths_.clear();
+  arena_.clear();
+}
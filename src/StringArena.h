@@ -0,0 +1,115 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef STRING_ARENA_H_
+#define STRING_ARENA_H_
+
+#ifndef WIN32
+  #include <stdint.h>
+#endif
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+* StringArena is a bump allocator for immutable, null terminated strings.
+* Strings are copied back to back into large blocks and are only freed all
+* at once, by clear() or when the arena is destroyed, which avoids the
+* per string heap allocation and bookkeeping of std::string. Storing strings
+* is not thread safe, threads store into arenas of their own, which are then
+* moved into one arena with take().
+*/
+class StringArena {
+ public:
+  StringArena();
+  ~StringArena();
+
+  // Returns a null terminated copy of the size characters at data, which
+  // stays valid until the arena is cleared or destroyed
+  const char* store(const char* data, std::size_t size);
+  inline const char* store(const std::string& str) {
+    return store(str.data(), str.size());
+  }
+
+  // Moves the blocks of other into this arena, its strings stay valid
+  void take(StringArena& other);
+
+  void clear();
+  inline std::size_t getNumBytes() const { return numBytes_; }
+
+ private:
+  const static std::size_t kBlockSize;
+
+  std::vector<char*> blocks_;
+  char* pos_;
+  char* end_;
+  std::size_t numBytes_;
+
+  StringArena(const StringArena&);
+  StringArena& operator=(const StringArena&);
+};
+
+/*
+* SymbolTable interns strings as 32 bit symbols, which number the distinct
+* strings in the order they were first added. The strings are stored once in
+* a StringArena and looked up with open addressing and linear probing on a
+* 64 bit FNV-1a hash, keeping the load below one half. It interns the protein
+* names of the PSMs as well as the PSM and protein names of the fido graphs.
+* Interning is not thread safe.
+*/
+class SymbolTable {
+ public:
+  SymbolTable();
+
+  // the symbol of the string, with inserted telling whether it was new
+  unsigned int intern(const char* data, std::size_t size, bool& inserted);
+  inline unsigned int intern(const char* data, std::size_t size) {
+    bool inserted;
+    return intern(data, size, inserted);
+  }
+  inline unsigned int intern(const std::string& str) {
+    return intern(str.data(), str.size());
+  }
+  // the symbol of the string, or kNotFound if it has not been interned
+  unsigned int lookup(const std::string& str) const;
+  inline const char* operator[](unsigned int symbol) const {
+    return names_[symbol];
+  }
+  inline std::size_t size() const { return names_.size(); }
+
+  void clear();
+
+  const static unsigned int kNotFound;
+
+ private:
+  const static std::size_t kInitialSlots;
+  const static unsigned int kEmptySlot;
+
+  static uint64_t hash(const char* data, std::size_t size);
+  std::size_t findSlot(const char* data, std::size_t size, uint64_t h) const;
+  void grow();
+
+  // symbols of the strings, kEmptySlot for empty slots; the size is a power
+  // of two
+  std::vector<unsigned int> slots_;
+  std::vector<uint64_t> hashes_;
+  std::vector<const char*> names_;
+  std::vector<unsigned int> lengths_;
+  StringArena arena_;
+};
+
+#endif /* STRING_ARENA_H_ */
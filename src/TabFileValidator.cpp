@@ -17,8 +17,16 @@
 
 #include "TabFileValidator.h"
 
+// bytes of PSM rows that are sampled to detect the protein decoy prefix
+const std::size_t TabFileValidator::kDecoySampleBytes = 1u << 26;
+// windows the sampled bytes are spread over, as files often list all
+// targets first
+const std::size_t TabFileValidator::kDecoySampleWindows = 64u;
+// used if no decoy protein prefix can be detected
+const std::string TabFileValidator::kDefaultDecoyPrefix = "decoy_";
+
 bool TabFileValidator::isTabFile(std::string fileName) {
-  std::ifstream file(fileName.c_str());
+  InputStream file(fileName);
   
   if (!file.is_open()) return false;
   
@@ -59,7 +67,7 @@ std::string TabFileValidator::getDecoyPrefix(std::vector<std::string> fileNames)
 
 void TabFileValidator::getProteinAndLabelColumnIndices(std::string fileName, int &proteinIndex, int &labelIndex) {
   // open C++ stream to file
-  std::ifstream file(fileName.c_str());
+  InputStream file(fileName);
 
   // file not opened, return false
   if(!file.is_open()) {
@@ -113,8 +121,78 @@ std::string TabFileValidator::getLongestCommonPrefix(std::vector<std::string> st
   return "";
 }
 
-std::string TabFileValidator::findDecoyPrefix(std::string fileName, int proteinIndex, int labelIndex) {
-  std::ifstream file(fileName.c_str());
+/* Adds the protein column of the row if it is a decoy. Only the label and
+   protein columns are needed, the others are skipped without copying */
+static void addDecoyProtein(const std::string& row, int proteinIndex, int labelIndex,
+                            std::vector<std::string>& proteinNames) {
+  const char* pos = row.c_str();
+  const char* rowEnd = pos + row.size();
+  bool isDecoy = false;
+  for (int col = 0; col <= proteinIndex; ++col) {
+    const char* tab = static_cast<const char*>(
+        memchr(pos, '\t', static_cast<std::size_t>(rowEnd - pos)));
+    const char* valueEnd = tab != NULL ? tab : rowEnd;
+    if (col == labelIndex && valueEnd - pos == 2 && pos[0] == '-' && pos[1] == '1') {
+      isDecoy = true;
+    }
+    if (col == proteinIndex && isDecoy) {
+      proteinNames.push_back(std::string(pos, valueEnd));
+    }
+    if (tab == NULL) break;
+    pos = tab + 1;
+  }
+}
+
+/**
+ * Collects the proteins of the decoy rows among about sampleBytes of rows,
+ * starting at the current position of the stream, which has to be the start
+ * of a row. If strided, and there are more rows than that, the sample is
+ * spread over kDecoySampleWindows evenly spaced windows, each of which first
+ * skips the rest of the row it was positioned in. Otherwise only the first
+ * rows are sampled, as for compressed input, where seeking means
+ * decompressing everything before.
+ * @return the number of bytes read, at most sampleBytes plus one row per
+ * window
+ */
+std::size_t TabFileValidator::sampleDecoyProteins(std::istream& in, bool strided,
+    int proteinIndex, int labelIndex, std::size_t sampleBytes,
+    std::vector<std::string>& proteinNames) {
+  std::size_t numWindows = 1u;
+  std::streamoff start = 0, rowBytes = 0;
+  if (strided) {
+    start = in.tellg();
+    in.seekg(0, std::ios::end);
+    rowBytes = static_cast<std::streamoff>(in.tellg()) - start;
+    in.seekg(start);
+    if (rowBytes > static_cast<std::streamoff>(sampleBytes)) {
+      numWindows = kDecoySampleWindows;
+    }
+  }
+
+  std::size_t windowBytes = sampleBytes / numWindows;
+  std::size_t bytesRead = 0u;
+  std::string row;
+  for (std::size_t w = 0; w < numWindows; ++w) {
+    std::size_t windowRead = 0u;
+    if (w > 0u) {
+      in.clear();
+      in.seekg(start + rowBytes * static_cast<std::streamoff>(w) /
+               static_cast<std::streamoff>(numWindows));
+      if (!getline(in, row)) break;
+      windowRead += row.size() + 1u;
+    }
+    while (windowRead < windowBytes && getline(in, row)) {
+      windowRead += row.size() + 1u;
+      addDecoyProtein(row, proteinIndex, labelIndex, proteinNames);
+    }
+    bytesRead += windowRead;
+  }
+  return bytesRead;
+}
+
+std::string TabFileValidator::findDecoyPrefix(std::string fileName, int proteinIndex, int labelIndex,
+                                              std::size_t sampleBytes) {
+  InputStream file(fileName);
 
   if (!file.is_open()) return "error";
 
@@ -122,22 +200,11 @@ std::string TabFileValidator::findDecoyPrefix(std::string fileName, int proteinI
   std::string nextRow;
   getline(file, nextRow);
 
+  /* Only sample the rows of large files, the prefix is the same throughout */
   std::vector<std::string> proteinNames;
-  while (getline(file, nextRow)) {
-    TabReader readerRow(nextRow);
-    int col = 0;
-    bool isDecoy = false;
-    while (!readerRow.error()) {
-      std::string value = readerRow.readString();
-      if (col == labelIndex && value == "-1") {
-        isDecoy = true;
-      }
-      if (col == proteinIndex && isDecoy) {
-        proteinNames.push_back(value);
-      }
-      col++;
-    }
-  }
+  sampleDecoyProteins(file, file.hasRandomAccess(), proteinIndex, labelIndex,
+                      sampleBytes, proteinNames);
+  bool sawDecoys = !proteinNames.empty();
 
   /* Randomly sample 10% of the protein identifiers */
   auto rng = std::default_random_engine {};
@@ -151,6 +218,19 @@ std::string TabFileValidator::findDecoyPrefix(std::string fileName, int proteinI
     prefix = prefix.substr(0, loc + 1);
   }
 
+  /* An empty prefix would match all proteins */
+  if (prefix.empty()) {
+    prefix = kDefaultDecoyPrefix;
+    if (sawDecoys) {
+      std::cerr << "Warning: Could not detect a protein decoy prefix in " << fileName
+                << ", using the default \"" << prefix << "\". Set the prefix with "
+                << "the option --protein-decoy-pattern." << std::endl;
+    } else if (VERB > 0) {
+      std::cerr << "No decoy PSMs in the sampled rows of " << fileName
+                << ", using the default protein decoy prefix." << std::endl;
+    }
+  }
+
   if (VERB > 0) {
     std::cerr << "Using protein decoy prefix \"" << prefix << "\"" << std::endl;  
   }
@@ -21,8 +21,10 @@
 #include <vector>
 #include <random>
 #include <algorithm>
+#include <cstring>
 
 #include "Globals.h"
+#include "InputStream.h"
 #include "TabReader.h"
 
 class TabFileValidator {
@@ -33,8 +35,16 @@ class TabFileValidator {
     static std::string detectDecoyPrefix(std::string fileName);
     static bool validateTabFiles(std::vector<std::string> fileNames, std::string &decoyPrefix);
     static void getProteinAndLabelColumnIndices(std::string fileName, int &proteinIndex, int &labelIndex);
-    static std::string findDecoyPrefix(std::string fileName, int proteinIndex, int labelIndex);
+    static std::string findDecoyPrefix(std::string fileName, int proteinIndex, int labelIndex,
+                                       std::size_t sampleBytes = kDecoySampleBytes);
+    static std::size_t sampleDecoyProteins(std::istream& in, bool strided, int proteinIndex,
+                                           int labelIndex, std::size_t sampleBytes,
+                                           std::vector<std::string>& proteinNames);
     static std::string getLongestCommonPrefix(std::vector<std::string> strings);
+
+    const static std::size_t kDecoySampleBytes;
+    const static std::size_t kDecoySampleWindows;
+    const static std::string kDefaultDecoyPrefix;
 };
 
 #endif /*TABFILEVALIDATOR_H_*/
\ No newline at end of file
@@ -0,0 +1,275 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "TargetDecoyStatistics.h"
+#include "Globals.h"
+#include "LogisticRegression.h"
+#include "MyException.h"
+#include "Normalizer.h"
+#include "PosteriorEstimator.h"
+
+void TargetDecoyStatistics::resize(std::size_t n) {
+  column_.resize(n);
+  numTargets_ = 0u;
+  numDecoys_ = 0u;
+}
+
+/**
+ * Estimated probability that an incorrect target PSM scores below a decoy
+ * of the group of tied scores preceded by targetsAbove targets and
+ * decoysAbove decoys, see PosteriorEstimator::getQValues
+ */
+double TargetDecoyStatistics::mixMaxCorrection(double pi0,
+    std::size_t targetsAbove, std::size_t decoysAbove) const {
+  // N_{w<=z} and N_{z<=z}, i.e. getMixMaxCounts at this group
+  int cnt_w = static_cast<int>(numTargets_ - targetsAbove);
+  int cnt_z = static_cast<int>(numDecoys_ - decoysAbove);
+  double estPx_lt_zj = (double)(cnt_w - pi0*cnt_z) / ((1.0 - pi0)*cnt_z);
+  estPx_lt_zj = estPx_lt_zj > 1 ? 1 : estPx_lt_zj;
+  estPx_lt_zj = estPx_lt_zj < 0 ? 0 : estPx_lt_zj;
+  return estPx_lt_zj;
+}
+
+/**
+ * If skipDecoysPlusOne is set with pi0 < 1, the mix-max counts are taken at
+ * the group of tied scores itself. PosteriorEstimator::getQValues indexes
+ * them one decoy further down the list instead, which runs past the end of
+ * its counts and throws std::out_of_range at the first decoy.
+ */
+void TargetDecoyStatistics::calcQValues(double pi0, bool includeDecoys,
+    bool skipDecoysPlusOne, std::vector<double>& q) const {
+  std::size_t n = column_.size();
+  q.resize(includeDecoys ? n : numTargets_);
+
+  double E_f1_mod_run_tot = 0.0;
+  int n_z_ge_w = skipDecoysPlusOne ? 0 : 1, n_w_ge_w = 0; // N_{z>=w} and N_{w>=w}
+  int decoyQueue = 0, targetQueue = 0; // handles ties
+  std::size_t targetsAbove = 0u, decoysAbove = 0u, qIdx = 0u;
+  for (std::size_t ix = 0; ix < n; ++ix) {
+    if (column_[ix].second) {
+      ++n_w_ge_w; // target PSM
+      ++targetQueue;
+    } else {
+      ++n_z_ge_w; // decoy PSM
+      ++decoyQueue;
+    }
+
+    if (ix + 1 == n || column_[ix].first != column_[ix + 1].first) {
+      if (pi0 < 1.0 && decoyQueue > 0) {
+        E_f1_mod_run_tot += decoyQueue *
+            mixMaxCorrection(pi0, targetsAbove, decoysAbove) * (1.0 - pi0);
+      }
+      targetsAbove += static_cast<std::size_t>(targetQueue);
+      decoysAbove += static_cast<std::size_t>(decoyQueue);
+
+      if (includeDecoys) {
+        targetQueue += decoyQueue;
+      }
+      double fdr = (n_z_ge_w * pi0 + E_f1_mod_run_tot) /
+                       (double)((std::max)(1, n_w_ge_w));
+      fdr = (std::min)(fdr, 1.0);
+      for (int i = 0; i < targetQueue; ++i) {
+        q[qIdx++] = fdr;
+      }
+      decoyQueue = 0;
+      targetQueue = 0;
+    }
+  }
+  // Convert the FDRs into q-values.
+  for (std::size_t ix = q.size(); ix-- > 1; ) {
+    if (q[ix - 1] > q[ix]) q[ix - 1] = q[ix];
+  }
+}
+
+void TargetDecoyStatistics::calcPValues(std::vector<double>& p) const {
+  std::size_t n = column_.size();
+  p.resize(numTargets_);
+
+  double totalDecoys = static_cast<double>(numDecoys_ + 1u);
+  std::size_t nDecoys = 1, posSame = 0, negSame = 0, pIdx = 0;
+  for (std::size_t ix = 0; ix < n; ++ix) {
+    if (column_[ix].second) { // isTarget
+      ++posSame;
+    } else { // isDecoy
+      ++negSame;
+    }
+    if (ix + 1 == n || column_[ix].first != column_[ix + 1].first) {
+      for (std::size_t k = 0; k < posSame; ++k) {
+        p[pIdx++] = (static_cast<double>(nDecoys) +
+            static_cast<double>(negSame * (k + 1)) / (double)(posSame + 1)) /
+            totalDecoys;
+      }
+      nDecoys += negSame;
+      negSame = 0;
+      posSame = 0;
+    }
+  }
+}
+
+void TargetDecoyStatistics::binData(double pi0, bool ascending,
+    std::vector<double>& medians, std::vector<double>& negatives,
+    std::vector<double>& sizes) const {
+  medians.clear();
+  negatives.clear();
+  sizes.clear();
+
+  int n = static_cast<int>(column_.size());
+  int noIntervals = PosteriorEstimator::getNumBins();
+  double E_f1_mod_run_tot = 0.0;
+  int binsLeft = noIntervals - 1;
+  double targetedBinSize = (std::max)(static_cast<double>(n) / (double)(noIntervals), 1.0);
+
+  int n_z_ge_w = 0; // N_{z>=w} in bin
+  int decoyQueue = 0, targetQueue = 0, psmsInBin = 0, binStartIdx = 0;
+  std::size_t targetsAbove = 0u, decoysAbove = 0u;
+  for (int k = 0; k < n; ++k) {
+    const std::pair<double, bool>& myPair = column_[ascending ? n - 1 - k : k];
+    if (!myPair.second) { // decoy PSM
+      ++n_z_ge_w;
+      ++decoyQueue;
+    } else {
+      ++targetQueue;
+    }
+    ++psmsInBin;
+
+    // handles ties
+    if (k + 1 == n ||
+        myPair.first != column_[ascending ? n - 2 - k : k + 1].first) {
+      if (pi0 < 1.0 && decoyQueue > 0) {
+        E_f1_mod_run_tot += decoyQueue *
+            mixMaxCorrection(pi0, targetsAbove, decoysAbove) * (1.0 - pi0);
+      }
+      targetsAbove += static_cast<std::size_t>(targetQueue);
+      decoysAbove += static_cast<std::size_t>(decoyQueue);
+      decoyQueue = 0;
+      targetQueue = 0;
+
+      if (n - binStartIdx - psmsInBin <= binsLeft * targetedBinSize) {
+        int medianIdx = binStartIdx + psmsInBin / 2;
+        double median = column_[ascending ? n - 1 - medianIdx : medianIdx].first;
+        double numNegatives = n_z_ge_w * pi0 + E_f1_mod_run_tot;
+        double numPsmsCorrected = psmsInBin - n_z_ge_w + numNegatives;
+
+        if (medians.size() > 0 && *(medians.rbegin()) == median) {
+          *(negatives.rbegin()) += numNegatives;
+          *(sizes.rbegin()) += numPsmsCorrected;
+        } else {
+          medians.push_back(median);
+          negatives.push_back(numNegatives);
+          sizes.push_back(numPsmsCorrected);
+        }
+
+        if (VERB > 4) {
+          std::cerr << "Median = " << median << ", Num psms = " << psmsInBin
+                    << ", Num psms corrected = " << numPsmsCorrected
+                    << ", Num decoys = " << n_z_ge_w
+                    << ", Num negatives = " << numNegatives << std::endl;
+        }
+        binStartIdx += psmsInBin;
+        --binsLeft;
+
+        psmsInBin = 0;
+        E_f1_mod_run_tot = 0.0;
+        n_z_ge_w = 0;
+      }
+    }
+  }
+}
+
+void TargetDecoyStatistics::calcPEPs(bool usePi0, double pi0,
+                                     std::vector<double>& peps) {
+  // PosteriorEstimator::estimate bins from the worst score without mix-max
+  bool ascending = !PosteriorEstimator::getReversed() && !usePi0;
+  binData(pi0, ascending, medians_, negatives_, sizes_);
+  if (medians_.size() < 2) {
+    // the error handling for a single bin may perturb the scores in the
+    // column, which is refilled before every use
+    PosteriorEstimator::estimatePEP(column_, usePi0, pi0, peps, true);
+    return;
+  }
+
+  LogisticRegression lr;
+  PosteriorEstimator::fitLogisticRegression(lr, medians_, negatives_, sizes_);
+  xvals_.resize(column_.size());
+  for (std::size_t ix = 0; ix < column_.size(); ++ix) {
+    xvals_[ix] = column_[ix].first;
+  }
+  PosteriorEstimator::predictPEP(lr, xvals_, peps);
+}
+
+double TargetDecoyStatistics::checkSeparationAndEstimatePi0(bool usePi0) {
+  std::vector<double>& pvals = values_;
+  calcPValues(pvals);
+
+  bool tooGoodSeparation = PosteriorEstimator::checkSeparation(pvals);
+  if (tooGoodSeparation) {
+    std::ostringstream oss;
+    oss << "Error in the input data: too good separation between target "
+        << "and decoy PSMs.\n";
+    if (NO_TERMINATE) {
+      std::cerr << oss.str();
+      if (usePi0) {
+        std::cerr << "No-terminate flag set: setting pi0 = 1 and ignoring error." << std::endl;
+      } else {
+        std::cerr << "No-terminate flag set: ignoring error." << std::endl;
+      }
+    } else {
+      throw MyException(oss.str() + "Terminating.\n");
+    }
+  } else if (usePi0) {
+    return PosteriorEstimator::estimatePi0(pvals);
+  }
+  return 1.0;
+}
+
+bool TargetDecoyStatistics::checkNotEmpty(std::size_t numRecords) {
+  if (numRecords > 0u) return true;
+  std::ostringstream oss;
+  oss << "Error: no scored PSMs were provided.\n";
+  if (NO_TERMINATE) {
+    std::cerr << oss.str() << "No-terminate flag set: ignoring error." << std::endl;
+    return false;
+  } else {
+    throw MyException(oss.str());
+  }
+}
+
+/**
+ * Checks that the score at q=fdr lies above the median decoy score, sets
+ * diff to their difference and rescales the weights accordingly
+ */
+void TargetDecoyStatistics::checkNormalization(double fdr,
+    double medianDecoyScore, double& fdrScore, double& diff,
+    std::vector<double>& weights) {
+  diff = fdrScore - medianDecoyScore;
+  if (diff <= 0) {
+    std::ostringstream oss;
+    oss << "Error: median decoy score <= score at " << fdr * 100
+        << "\% FDR. Cannot rescale scores to merge cross validation bins, try lowering --trainFDR.\n";
+    if (NO_TERMINATE) {
+      std::cerr << oss.str() << "No-terminate flag set: apply offset such that median "
+                << "decoy has score -1, but skipping rescaling." << std::endl;
+      diff = 1.0;
+      fdrScore += 1.0;
+    } else {
+      throw MyException(oss.str());
+    }
+  }
+  Normalizer::endScoreNormalizeWeights(weights, weights, fdrScore, diff);
+}
@@ -0,0 +1,208 @@
+/*******************************************************************************
+ Copyright 2006-2012 Lukas Käll <lukas.kall@scilifelab.se>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ *******************************************************************************/
+#ifndef TARGETDECOYSTATISTICS_H_
+#define TARGETDECOYSTATISTICS_H_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/*
+* TargetDecoyStatistics computes the q-values, p-values and PEP bins of one
+* column of (score, isTarget) pairs sorted in descending score order, with
+* the same results as the corresponding functions of PosteriorEstimator.
+*
+* The mix-max counts N_{w<=z} and N_{z<=z} of a group of tied scores are the
+* label totals minus the counts of the scores above it, so they follow from
+* the totals counted while filling the column instead of being stored in
+* separate arrays. Every statistic is then a single pass over the column,
+* plus a backward pass for turning FDRs into q-values.
+*
+* The column and the intermediate buffers are kept between calls, so that
+* repeated calls on columns of similar size do not reallocate. The output
+* vectors are resized, which does not reallocate either when reused.
+*
+* The final scoring steps that Scores and StreamingScorer share are member
+* templates on their records, ScoreHolders and StreamedPsms, which have
+* score, q, pep and label members and are sorted by descending score: pi0,
+* q-values and PEPs are assigned through the column, and the scores are
+* normalized on the records themselves.
+*/
+class TargetDecoyStatistics {
+ public:
+  TargetDecoyStatistics() : numTargets_(0u), numDecoys_(0u) {}
+
+  // Prepares the column for n pairs, each of which has to be set once
+  void resize(std::size_t n);
+  inline void set(std::size_t ix, double score, bool isTarget) {
+    column_[ix] = std::make_pair(score, isTarget);
+    if (isTarget) ++numTargets_; else ++numDecoys_;
+  }
+
+  inline std::size_t size() const { return column_.size(); }
+  inline std::size_t numTargets() const { return numTargets_; }
+  inline std::size_t numDecoys() const { return numDecoys_; }
+
+  // Same as PosteriorEstimator::getQValues
+  void calcQValues(double pi0, bool includeDecoys, bool skipDecoysPlusOne,
+                   std::vector<double>& q) const;
+  // Same as PosteriorEstimator::getPValues
+  void calcPValues(std::vector<double>& p) const;
+  // Same as PosteriorEstimator::binData on the column, or on the reversed
+  // column if ascending is set
+  void binData(double pi0, bool ascending, std::vector<double>& medians,
+               std::vector<double>& negatives,
+               std::vector<double>& sizes) const;
+  // Same as PosteriorEstimator::estimatePEP including the decoys
+  void calcPEPs(bool usePi0, double pi0, std::vector<double>& peps);
+
+  template <typename Record>
+  void fillColumn(const std::vector<Record>& records);
+  // Estimated pi0 if usePi0 is set, and 1 otherwise. Too good a separation
+  // of targets and decoys is an error, unless the no-terminate flag is set.
+  template <typename Record>
+  double checkSeparationAndEstimatePi0(const std::vector<Record>& records,
+                                       bool usePi0);
+  // Sets the q-values of the records and returns the number of targets
+  // with q < fdr
+  template <typename Record>
+  int assignQValues(std::vector<Record>& records, double pi0,
+                    bool skipDecoysPlusOne, double fdr);
+  template <typename Record>
+  void assignPEPs(std::vector<Record>& records, bool usePi0, double pi0);
+  // Linear rescaling of the scores such that q=fdr = 0 and the median
+  // decoy = -1, which is applied to the weights that yield the scores too
+  template <typename Record>
+  static void normalizeScores(std::vector<Record>& records,
+                              std::size_t numDecoys, double fdr,
+                              std::vector<double>& weights);
+
+ protected:
+  std::vector<std::pair<double, bool> > column_;
+  std::size_t numTargets_, numDecoys_;
+  std::vector<double> medians_, negatives_, sizes_, xvals_;
+  std::vector<double> values_; // p-values, q-values or PEPs of the records
+
+  double mixMaxCorrection(double pi0, std::size_t targetsAbove,
+                          std::size_t decoysAbove) const;
+  double checkSeparationAndEstimatePi0(bool usePi0);
+  static bool checkNotEmpty(std::size_t numRecords);
+  static void checkNormalization(double fdr, double medianDecoyScore,
+                                 double& fdrScore, double& diff,
+                                 std::vector<double>& weights);
+};
+
+template <typename Record>
+void TargetDecoyStatistics::fillColumn(const std::vector<Record>& records) {
+  resize(records.size());
+  for (std::size_t ix = 0; ix < records.size(); ++ix) {
+    set(ix, records[ix].score, records[ix].label > 0);
+  }
+}
+
+template <typename Record>
+double TargetDecoyStatistics::checkSeparationAndEstimatePi0(
+    const std::vector<Record>& records, bool usePi0) {
+  fillColumn(records);
+  return checkSeparationAndEstimatePi0(usePi0);
+}
+
+/**
+ * For pi0 = 1 this is the same as calcQValues, but directly on the records:
+ * the FDRs are assigned per group of tied scores in a forward pass and
+ * turned into q-values in a backward pass.
+ */
+template <typename Record>
+int TargetDecoyStatistics::assignQValues(std::vector<Record>& records,
+    double pi0, bool skipDecoysPlusOne, double fdr) {
+  std::size_t n = records.size();
+  int numPos = 0;
+  if (pi0 < 1.0) {
+    fillColumn(records);
+    calcQValues(pi0, true, skipDecoysPlusOne, values_);
+    for (std::size_t ix = 0; ix < n; ++ix) {
+      records[ix].q = values_[ix];
+      if (records[ix].q < fdr && records[ix].label > 0) ++numPos;
+    }
+    return numPos;
+  }
+
+  int n_z_ge_w = skipDecoysPlusOne ? 0 : 1, n_w_ge_w = 0;
+  std::size_t groupStart = 0;
+  for (std::size_t ix = 0; ix < n; ++ix) {
+    if (records[ix].label > 0) {
+      ++n_w_ge_w;
+    } else {
+      ++n_z_ge_w;
+    }
+    if (ix + 1 == n || records[ix].score != records[ix + 1].score) {
+      double groupFdr = (n_z_ge_w * pi0 + 0.0) / (double)((std::max)(1, n_w_ge_w));
+      groupFdr = (std::min)(groupFdr, 1.0);
+      for (; groupStart <= ix; ++groupStart) {
+        records[groupStart].q = groupFdr;
+      }
+    }
+  }
+  for (std::size_t ix = n; ix--;) {
+    if (ix + 1 < n && records[ix].q > records[ix + 1].q) {
+      records[ix].q = records[ix + 1].q;
+    }
+    if (records[ix].q < fdr && records[ix].label > 0) ++numPos;
+  }
+  return numPos;
+}
+
+template <typename Record>
+void TargetDecoyStatistics::assignPEPs(std::vector<Record>& records,
+                                       bool usePi0, double pi0) {
+  fillColumn(records);
+  // Logistic regression on the data
+  calcPEPs(usePi0, pi0, values_);
+  for (std::size_t ix = 0; ix < records.size(); ++ix) {
+    records[ix].pep = values_[ix];
+  }
+}
+
+template <typename Record>
+void TargetDecoyStatistics::normalizeScores(std::vector<Record>& records,
+    std::size_t numDecoys, double fdr, std::vector<double>& weights) {
+  if (!checkNotEmpty(records.size())) return;
+
+  std::size_t medianIndex = numDecoys / 2u, decoys = 0u;
+  double fdrScore = records.front().score;
+  double medianDecoyScore = fdrScore + 1.0;
+  typename std::vector<Record>::iterator it = records.begin();
+  for (; it != records.end(); ++it) {
+    if (it->q < fdr)
+      fdrScore = it->score;
+    if (it->label == -1) {
+      if (++decoys == medianIndex) {
+        medianDecoyScore = it->score;
+        break;
+      }
+    }
+  }
+
+  double diff = 0.0;
+  checkNormalization(fdr, medianDecoyScore, fdrScore, diff, weights);
+  for (it = records.begin(); it != records.end(); ++it) {
+    it->score -= fdrScore;
+    it->score /= diff;
+  }
+}
+
+#endif /*TARGETDECOYSTATISTICS_H_*/
@@ -1,158 +1,187 @@
 #include "ValidateTabFile.h"
 
-std::string ValidateTabFile::concatenateMultiplePINs(std::vector<std::basic_string<char>> fileNames) {
-  // Validate multiple tab-files, and then concatenate them.
-  std::string inputFN;
-  std::ifstream pinFileStream;
-
-  /* Complete column position to header name */
-  std::map<int,std::string> columnMap = {};
-  /* Temporary mapper while searching for complete position-to-header mapper */
-  std::map<int,std::string> tmpMap;
-
-  /* Keep track on col index */
-  int column_index;
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// bytes of rows that are mapped onto the merged columns at a time
+const std::size_t MergedPinStreamBuf::kBlockSize = 1u << 22;
+
+MergedPinStreamBuf::MergedPinStreamBuf(const std::vector<std::string>& fileNames,
+    const std::vector<std::string>& columns, int numThreads) :
+    fileNames_(fileNames), columns_(columns),
+    numThreads_(numThreads > 0 ? numThreads : 1), numPasses_(0) {
+  start();
+}
 
-  /* Loop through all files to search for column headers */
-  for(const std::string &text : fileNames) {
-      
-    /* Get header */
-    pinFileStream.open(text.c_str(), std::ios::in);
-    std::string headerRow;
+MergedPinStreamBuf::~MergedPinStreamBuf() {
+  // the producer thread calls produce(), which has to end before this
+  // object is destroyed
+  stop();
+}
 
-    getline(pinFileStream, headerRow);
+void MergedPinStreamBuf::produce() {
+  // the files are read again if the stream is rewound
+  ++numPasses_;
+  for (std::size_t ix = 0; ix < fileNames_.size(); ++ix) {
+    if (!appendFile(fileNames_[ix], ix == 0u)) return;
+  }
+  finishAppend();
+}
 
-    TabReader reader(headerRow);
+bool MergedPinStreamBuf::appendLine(const std::string& line) {
+  return append(line.data(), line.size()) && append("\n", 1u);
+}
 
-    column_index = 0;
-    while (!reader.error()) {
-      std::string optionalHeader = reader.readString();
+/**
+ * Finds the merged columns that are missing in a file, which are the
+ * columns skipped while matching the column names of its header in order
+ * @param numColumns returns the number of merged columns up to the last
+ * column of the file
+ */
+void MergedPinStreamBuf::getMissingColumns(const std::string& fileName,
+    const std::string& headerRow, std::vector<bool>& missingCols,
+    std::size_t& numColumns) {
+  missingCols.assign(columns_.size(), false);
+  TabReader reader(headerRow);
+  std::size_t col = 0;
+  while (!reader.error()) {
+    std::string optionalHeader = reader.readString();
+    while (col < columns_.size() && columns_[col] != optionalHeader) {
+      missingCols[col++] = true;
+    }
+    if (col == columns_.size()) {
+      ostringstream temp;
+      temp << "ERROR: The column " << optionalHeader << " of " << fileName
+           << " does not match the columns of the other input files." << std::endl;
+      throw MyException(temp.str());
+    }
+    ++col;
+  }
+  numColumns = col;
+}
 
-      tmpMap[column_index] = optionalHeader;
-      column_index++;
+// inserts zeroes for the missing columns in front of every column of the row
+static void mapRow(const std::string& row, const std::vector<bool>& missingCols,
+                   std::string& mappedRow) {
+  mappedRow.clear();
+  std::size_t col = 0, pos = 0;
+  while (true) {
+    while (col < missingCols.size() && missingCols[col]) {
+      mappedRow += "0\t";
+      ++col;
     }
+    std::size_t tab = row.find('\t', pos);
+    mappedRow.append(row, pos, tab == std::string::npos ? std::string::npos : tab - pos);
+    mappedRow += '\t';
+    ++col;
+    if (tab == std::string::npos) break;
+    pos = tab + 1;
+  }
+}
 
-    /* Get header from file with the most columns */
-    if (columnMap.size() < tmpMap.size()) {
-      columnMap = tmpMap;
+bool MergedPinStreamBuf::appendFile(const std::string& fileName, bool firstFile) {
+  if (VERB > 0 && numPasses_ == 1) {
+    std::cerr << "Reading file: " << fileName << std::endl;
+  }
+  InputStream pinFileStream(fileName);
+  if (!pinFileStream.is_open()) {
+    throw MyException("ERROR: Could not open " + fileName + ".");
+  }
+  std::string headerRow;
+  getline(pinFileStream, headerRow);
+
+  std::vector<bool> missingCols;
+  std::size_t numColumns = 0;
+  getMissingColumns(fileName, headerRow, missingCols, numColumns);
+  bool needsMapping = std::find(missingCols.begin(), missingCols.end(), true)
+                          != missingCols.end();
+
+  std::string nextRow;
+  bool hasRow = static_cast<bool>(getline(pinFileStream, nextRow));
+  if (firstFile) {
+    std::string mergedHeader;
+    for (std::size_t col = 0; col < numColumns; ++col) {
+      mergedHeader += columns_[col] + "\t";
+    }
+    if (!appendLine(mergedHeader)) return false;
+  } else if (hasRow) {
+    std::string defaultDirectionString = "defaultdirection";
+    if (nextRow.size() >= defaultDirectionString.size()) {
+      std::string psmid = nextRow.substr(0, defaultDirectionString.size());
+      std::transform(psmid.begin(), psmid.end(), psmid.begin(), ::tolower);
+      if (psmid == defaultDirectionString) {
+        hasRow = static_cast<bool>(getline(pinFileStream, nextRow)); // skip row with default direction
+      }
     }
-    tmpMap.clear();
-    pinFileStream.close();
   }
 
-  /* Create a temporary tab file to concatenate tab files in to */ 
-  string tcf = "";
-  string tcd = "";
-
-  TmpDir tmpDir;
-  tmpDir.createTempFile(tcf, tcd);
-  inputFN = tcf;
-  ofstream outFile;
-  outFile.open(inputFN);
-
-  /* Only want to print header once */
-  bool firstFile = true;
-  /* If go to next column when going though missing charge states */
-  bool nextColumn;
-
-  /* Start appending pin files to one pin file. */
-  for(const string &text : fileNames) {
-    if (VERB > 0) {
-      std::cerr << "Reading file: " << text.c_str() << std::endl;
+  // rows that need no mapping are passed on as they are, the others are
+  // mapped in parallel in blocks
+  std::vector<std::string> rows, mappedRows;
+  while (hasRow) {
+    if (!needsMapping) {
+      if (!appendLine(nextRow)) return false;
+      hasRow = static_cast<bool>(getline(pinFileStream, nextRow));
+      continue;
+    }
+    std::size_t numRows = 0, blockBytes = 0;
+    while (hasRow && blockBytes < kBlockSize) {
+      if (rows.size() == numRows) rows.resize(numRows + 1);
+      rows[numRows].swap(nextRow);
+      blockBytes += rows[numRows++].size();
+      hasRow = static_cast<bool>(getline(pinFileStream, nextRow));
+    }
+    if (mappedRows.size() < numRows) mappedRows.resize(numRows);
+#pragma omp parallel for schedule(static) num_threads(numThreads_)
+    for (int ix = 0; ix < static_cast<int>(numRows); ++ix) {
+      mapRow(rows[ix], missingCols, mappedRows[ix]);
+    }
+    for (std::size_t ix = 0; ix < numRows; ++ix) {
+      if (!appendLine(mappedRows[ix])) return false;
     }
-    /* Keep track of missing charge columns for a given file */
-    std::vector<int> missingCols;
-        
-    /* Read pin file */
-    pinFileStream.open(text.c_str(), std::ios::in);
+  }
+  return true;
+}
+
+/**
+ * Opens multiple tab delimited files as a single stream with the columns of
+ * the file with the most columns, without writing them to disk
+ */
+ProducerStreamBuf* ValidateTabFile::openMultiplePINs(std::vector<std::basic_string<char>> fileNames) {
+  InputStream pinFileStream;
+
+  /* Complete column position to header name */
+  std::vector<std::string> columns;
+  /* Temporary columns while searching for the complete columns */
+  std::vector<std::string> tmpColumns;
+
+  /* Loop through all files to search for column headers */
+  for(const std::string &text : fileNames) {
+
+    /* Get header */
+    pinFileStream.open(text);
     std::string headerRow;
+
     getline(pinFileStream, headerRow);
+
     TabReader reader(headerRow);
 
-    /* Keep track on column index */
-    column_index = 0;
-    /* Go through all columns to print header and search for missing charge state */
     while (!reader.error()) {
-      std::string optionalHeader = reader.readString();
-          
-      /* Check if charge state is missing */
-      if (columnMap[column_index] != optionalHeader) {
-        /* Charge state is missing at  'column_index' */
-        missingCols.push_back(column_index);
-        nextColumn=true;
-        if (firstFile) {
-          outFile << columnMap[column_index] << "\t";
-        }
-        /* Check if there are any adjacent missing charge states */
-        while(nextColumn) {
-          column_index++;
-          if (columnMap[column_index] == optionalHeader) {
-            /* No missing charge state, continue */
-            nextColumn=false;
-          } else {
-            /* Missing charge state */
-            missingCols.push_back(column_index);
-            if (firstFile) {
-              outFile << columnMap[column_index] << "\t";
-            }             
-          }
-        }
-      } 
-      if (firstFile) {
-        outFile << columnMap[column_index] << "\t";
-      }
-      column_index++;
+      tmpColumns.push_back(reader.readString());
     }
 
-    /* Go through rest of the rows in pin-file */
-    std::string nextRow;
-    getline(pinFileStream, nextRow);
-
-    if (firstFile) {
-      outFile <<  "\n";
-    } else {
-      std::string defaultDirectionString = "defaultdirection";
-      if (nextRow.size() >= defaultDirectionString.size()) {
-        std::string psmid = nextRow.substr(0, defaultDirectionString.size());
-        std::transform(psmid.begin(), psmid.end(), psmid.begin(), ::tolower);
-        if (psmid == defaultDirectionString) {
-          getline(pinFileStream, nextRow); // skip row with default direction
-        }
-      }
+    /* Get header from file with the most columns */
+    if (columns.size() < tmpColumns.size()) {
+      columns.swap(tmpColumns);
     }
-
-    do {
-      TabReader readerRow(nextRow);
-
-      /* Keep track on column for missing charge states */
-      int col = 0;
-      while (!readerRow.error()) {           
-        std::string value = readerRow.readString();
-        /* Check for missing charge state */
-        if (std::find(missingCols.begin(), missingCols.end(), col) != missingCols.end()) {
-          nextColumn=true;
-          outFile << 0 << "\t";
-          col++;
-          /* Check for adjecent missing charge states */
-          while(nextColumn) {
-            if(std::find(missingCols.begin(), missingCols.end(), col) != missingCols.end()) {
-              /* Missing adjecent charge state  */
-              outFile << 0 << "\t";
-              col++;
-            } else {
-              /* Charge states  */
-              nextColumn = false;
-            }
-          }  
-        }
-        outFile << value << "\t";
-        col++;
-      }
-      outFile << "\n";
-    } while (getline(pinFileStream, nextRow));
+    tmpColumns.clear();
     pinFileStream.close();
-    firstFile = false;      
   }
-  outFile.close();
-  return inputFN;
+
+  int numThreads = 1;
+#ifdef _OPENMP
+  numThreads = omp_get_max_threads();
+#endif
+  return new MergedPinStreamBuf(fileNames, columns, numThreads);
 }
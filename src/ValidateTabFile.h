@@ -4,9 +4,35 @@
 #include <fstream>
 
 #include "DataSet.h"
-#include "TmpDir.h"
+#include "InputStream.h"
 
-class ValidateTabFile {       
-  public:     
-    std::string concatenateMultiplePINs(std::vector<std::basic_string<char>> fileNames);        
-};
\ No newline at end of file
+/*
+* MergedPinStreamBuf reads multiple tab delimited input files as one, with
+* the columns of every file mapped onto the columns of the file with the
+* most columns. Missing charge state columns are filled with zeroes, and
+* only the header and default direction row of the first file are kept.
+*/
+class MergedPinStreamBuf : public ProducerStreamBuf {
+ public:
+  MergedPinStreamBuf(const std::vector<std::string>& fileNames,
+                     const std::vector<std::string>& columns, int numThreads = 1);
+  virtual ~MergedPinStreamBuf();
+
+ protected:
+  const static std::size_t kBlockSize;
+
+  std::vector<std::string> fileNames_, columns_;
+  int numThreads_, numPasses_;
+
+  virtual void produce();
+  bool appendLine(const std::string& line);
+  void getMissingColumns(const std::string& fileName,
+      const std::string& headerRow, std::vector<bool>& missingCols,
+      std::size_t& numColumns);
+  bool appendFile(const std::string& fileName, bool firstFile);
+};
+
+class ValidateTabFile {
+  public:
+    ProducerStreamBuf* openMultiplePINs(std::vector<std::basic_string<char>> fileNames);
+};
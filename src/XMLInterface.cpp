@@ -197,7 +197,8 @@ int XMLInterface::readAndScorePin(istream& dataStream, std::vector<double>& rawW
 
                         if (subsetPSMs.size() < setHandler.getMaxPSMs() || randIdx < upperLimit) {
                             PSMDescriptionPriority psmPriority;
-                            psmPriority.psm = readPsm(*psmIt, fragSpectrumScan.scanNumber(), readProteins, setHandler.getFeaturePool());
+                            // most of these PSMs are discarded again, so they own their strings
+                            psmPriority.psm = readPsm(*psmIt, fragSpectrumScan.scanNumber(), readProteins, setHandler.getFeaturePool(), NULL);
                             psmPriority.label = (psmIt->isDecoy() ? -1 : 1);
                             psmPriority.priority = randIdx;
                             subsetPSMs.push(psmPriority);
@@ -232,7 +233,7 @@ int XMLInterface::readAndScorePin(istream& dataStream, std::vector<double>& rawW
                             scanIdLookUp[scanId] = psmIt->isDecoy();
                         }
 
-                        PSMDescription* psm = readPsm(*psmIt, fragSpectrumScan.scanNumber(), readProteins, setHandler.getFeaturePool());
+                        PSMDescription* psm = readPsm(*psmIt, fragSpectrumScan.scanNumber(), readProteins, setHandler.getFeaturePool(), &setHandler.getStringArena());
                         if (psmIt->isDecoy()) {
                             decoySet->registerPsm(psm);
                         } else {
@@ -263,7 +264,7 @@ int XMLInterface::readAndScorePin(istream& dataStream, std::vector<double>& rawW
                 for (; psmIt != fragSpectrumScan.peptideSpectrumMatch().end(); ++psmIt) {
                     ScoreHolder sh;
                     sh.label = (psmIt->isDecoy() ? -1 : 1);
-                    sh.pPSM = readPsm(*psmIt, fragSpectrumScan.scanNumber(), readProteins, setHandler.getFeaturePool());
+                    sh.pPSM = readPsm(*psmIt, fragSpectrumScan.scanNumber(), readProteins, setHandler.getFeaturePool(), &setHandler.getStringArena());
 
                     allScores.scoreAndAddPSM(sh, rawWeights, setHandler.getFeaturePool());
                 }
@@ -340,7 +341,7 @@ std::string XMLInterface::decoratePeptide(const ::percolatorInNs::peptideType& p
 
 PSMDescription* XMLInterface::readPsm(
     const percolatorInNs::peptideSpectrumMatch& psm, unsigned scanNumber,
-    bool readProteins, FeatureMemoryPool& featurePool) {
+    bool readProteins, FeatureMemoryPool& featurePool, StringArena* stringArena) {
     PSMDescription* myPsm = new PSMDescription();
     string mypept = decoratePeptide(psm.peptide());
 
@@ -354,14 +355,16 @@ PSMDescription* XMLInterface::readPsm(
 
     percolatorInNs::peptideSpectrumMatch::occurence_const_iterator occIt;
     occIt = psm.occurence().begin();
+    std::string peptide;
     for (; occIt != psm.occurence().end(); ++occIt) {
-        if (readProteins) myPsm->proteinIds.push_back(occIt->proteinId());
+        if (readProteins) myPsm->proteinIds.push_back(PSMDescription::addProteinName(occIt->proteinId()));
         // adding n-term and c-term residues to peptide
         // NOTE the residues for the peptide in the PSMs are always the same for every protein
-        myPsm->setPeptide(occIt->flankN() + "." + mypept + "." + occIt->flankC());
+        peptide = occIt->flankN() + "." + mypept + "." + occIt->flankC();
     }
+    myPsm->setPeptide(peptide, stringArena);
 
-    myPsm->setId(psm.id());
+    myPsm->setId(psm.id(), stringArena);
     myPsm->scan = scanNumber;
     myPsm->expMass = psm.experimentalMass();
     myPsm->calcMass = psm.calculatedMass();
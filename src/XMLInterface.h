@@ -124,7 +124,7 @@ class XMLInterface {
 #ifdef XML_SUPPORT
   PSMDescription* readPsm(const ::percolatorInNs::peptideSpectrumMatch &psm, 
                           unsigned scanNumber, bool readProteins,
-                          FeatureMemoryPool& featurePool);
+                          FeatureMemoryPool& featurePool, StringArena* stringArena);
   ScanId getScanId(const percolatorInNs::peptideSpectrumMatch& psm, 
                    unsigned scanNumber);
   std::string decoratePeptide(const ::percolatorInNs::peptideType& peptide);
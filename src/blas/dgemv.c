@@ -1,4 +1,5 @@
 #include "blas.h"
+#include "kernels.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -129,11 +130,7 @@ int dgemv_(char *trans, int *m, int *n,
 	    for (j = 1; j <= i1; ++j) {
 		if (x[jx] != 0.) {
 		    temp = *alpha * x[jx];
-		    i2 = *m;
-		    for (i = 1; i <= i2; ++i) {
-			y[i] += temp * a[i + j * a_dim1];
-/* L50: */
-		    }
+		    daxpy_kernel(*m, temp, &a[1 + j * a_dim1], &y[1]);
 		}
 		jx += *incx;
 /* L60: */
@@ -163,12 +160,7 @@ int dgemv_(char *trans, int *m, int *n,
 	if (*incx == 1) {
 	    i1 = *n;
 	    for (j = 1; j <= i1; ++j) {
-		temp = 0.;
-		i2 = *m;
-		for (i = 1; i <= i2; ++i) {
-		    temp += a[i + j * a_dim1] * x[i];
-/* L90: */
-		}
+		temp = ddot_kernel(*m, &a[1 + j * a_dim1], &x[1]);
 		y[jy] += *alpha * temp;
 		jy += *incy;
 /* L100: */
@@ -1,5 +1,6 @@
 #include <math.h>  /* Needed for fabs() and sqrt() */
 #include "blas.h"
+#include "kernels.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +30,10 @@ double dnrm2_(int *n, double *x, int *incx)
     {
       norm = fabs(x[0]);
     }
+    else if (iincx == 1) /* code for increment equal to 1 */
+    {
+      norm = dnrm2_kernel(nn, x);
+    }
     else
     {
       scale = 0.0;
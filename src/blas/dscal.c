@@ -1,4 +1,5 @@
 #include "blas.h"
+#include "kernels.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -6,7 +7,7 @@ extern "C" {
 
 int dscal_(int *n, double *sa, double *sx, int *incx)
 {
-  long int i, m, nincx, nn, iincx;
+  long int i, nincx, nn, iincx;
   double ssa;
 
   /* scales a vector by a constant.
@@ -24,17 +25,7 @@ int dscal_(int *n, double *sa, double *sx, int *incx)
   {
     if (iincx == 1) /* code for increment equal to 1 */
     {
-      m = nn-4;
-      for (i = 0; i < m; i += 5)
-      {
-        sx[i] = ssa * sx[i];
-        sx[i+1] = ssa * sx[i+1];
-        sx[i+2] = ssa * sx[i+2];
-        sx[i+3] = ssa * sx[i+3];
-        sx[i+4] = ssa * sx[i+4];
-      }
-      for ( ; i < nn; ++i) /* clean-up loop */
-        sx[i] = ssa * sx[i];
+      dscal_kernel(nn, ssa, sx);
     }
     else /* code for increment not equal to 1 */
     {
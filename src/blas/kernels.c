@@ -0,0 +1,255 @@
+#include <float.h> /* Needed for DBL_MAX */
+#include <math.h>  /* Needed for fabs() and sqrt() */
+#include "kernels.h"
+
+/* The SIMD kernels rely on the function level target attribute and on the */
+/* cpu feature detection builtins of gcc and clang. This library has to be */
+/* compiled without floating point contraction (see CMakeLists.txt), since */
+/* a fused multiply-add would round differently than the scalar kernels.   */
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define BLAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NUM_PARTIAL_SUMS 16
+
+/* element i of the unrolled part of a reduction is always accumulated in */
+/* partial sum i % 16, the partial sums are then combined pairwise        */
+static double combinePartialSums(const double *s)
+{
+  double t[8], u[4];
+  int j;
+
+  for (j = 0; j < 8; ++j)
+    t[j] = s[j] + s[j+8];
+  for (j = 0; j < 4; ++j)
+    u[j] = t[j] + t[j+4];
+  return (u[0] + u[2]) + (u[1] + u[3]);
+}
+
+static double ddotScalar(long int n, const double *x, const double *y)
+{
+  double s[NUM_PARTIAL_SUMS] = { 0.0 }, stemp;
+  long int i, m = n - n % NUM_PARTIAL_SUMS;
+  int j;
+
+  for (i = 0; i < m; i += NUM_PARTIAL_SUMS)
+    for (j = 0; j < NUM_PARTIAL_SUMS; ++j)
+      s[j] += x[i+j] * y[i+j];
+  stemp = combinePartialSums(s);
+  for ( ; i < n; ++i) /* clean-up loop */
+    stemp += x[i] * y[i];
+  return stemp;
+}
+
+static void daxpyScalar(long int n, double a, const double *x, double *y)
+{
+  long int i;
+
+  for (i = 0; i < n; ++i)
+    y[i] += a * x[i];
+}
+
+static void dscalScalar(long int n, double a, double *x)
+{
+  long int i;
+
+  for (i = 0; i < n; ++i)
+    x[i] = a * x[i];
+}
+
+#ifdef BLAS_X86_KERNELS
+
+__attribute__((target("avx2")))
+static double ddotAvx2(long int n, const double *x, const double *y)
+{
+  double s[NUM_PARTIAL_SUMS], stemp;
+  long int i, m = n - n % NUM_PARTIAL_SUMS;
+  __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+
+  for (i = 0; i < m; i += NUM_PARTIAL_SUMS)
+  {
+    s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i)));
+    s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(x+i+4), _mm256_loadu_pd(y+i+4)));
+    s2 = _mm256_add_pd(s2, _mm256_mul_pd(_mm256_loadu_pd(x+i+8), _mm256_loadu_pd(y+i+8)));
+    s3 = _mm256_add_pd(s3, _mm256_mul_pd(_mm256_loadu_pd(x+i+12), _mm256_loadu_pd(y+i+12)));
+  }
+  _mm256_storeu_pd(s, s0);
+  _mm256_storeu_pd(s+4, s1);
+  _mm256_storeu_pd(s+8, s2);
+  _mm256_storeu_pd(s+12, s3);
+  stemp = combinePartialSums(s);
+  for ( ; i < n; ++i) /* clean-up loop */
+    stemp += x[i] * y[i];
+  return stemp;
+}
+
+__attribute__((target("avx2")))
+static void daxpyAvx2(long int n, double a, const double *x, double *y)
+{
+  long int i, m = n - n % 8;
+  __m256d va = _mm256_set1_pd(a);
+
+  for (i = 0; i < m; i += 8)
+  {
+    _mm256_storeu_pd(y+i, _mm256_add_pd(_mm256_loadu_pd(y+i),
+                                        _mm256_mul_pd(va, _mm256_loadu_pd(x+i))));
+    _mm256_storeu_pd(y+i+4, _mm256_add_pd(_mm256_loadu_pd(y+i+4),
+                                          _mm256_mul_pd(va, _mm256_loadu_pd(x+i+4))));
+  }
+  for ( ; i < n; ++i) /* clean-up loop */
+    y[i] += a * x[i];
+}
+
+__attribute__((target("avx2")))
+static void dscalAvx2(long int n, double a, double *x)
+{
+  long int i, m = n - n % 4;
+  __m256d va = _mm256_set1_pd(a);
+
+  for (i = 0; i < m; i += 4)
+    _mm256_storeu_pd(x+i, _mm256_mul_pd(va, _mm256_loadu_pd(x+i)));
+  for ( ; i < n; ++i) /* clean-up loop */
+    x[i] = a * x[i];
+}
+
+__attribute__((target("avx512f")))
+static double ddotAvx512(long int n, const double *x, const double *y)
+{
+  double s[NUM_PARTIAL_SUMS], stemp;
+  long int i, m = n - n % NUM_PARTIAL_SUMS;
+  __m512d s0 = _mm512_setzero_pd(), s1 = s0;
+
+  for (i = 0; i < m; i += NUM_PARTIAL_SUMS)
+  {
+    s0 = _mm512_add_pd(s0, _mm512_mul_pd(_mm512_loadu_pd(x+i), _mm512_loadu_pd(y+i)));
+    s1 = _mm512_add_pd(s1, _mm512_mul_pd(_mm512_loadu_pd(x+i+8), _mm512_loadu_pd(y+i+8)));
+  }
+  _mm512_storeu_pd(s, s0);
+  _mm512_storeu_pd(s+8, s1);
+  stemp = combinePartialSums(s);
+  for ( ; i < n; ++i) /* clean-up loop */
+    stemp += x[i] * y[i];
+  return stemp;
+}
+
+__attribute__((target("avx512f")))
+static void daxpyAvx512(long int n, double a, const double *x, double *y)
+{
+  long int i, m = n - n % 16;
+  __m512d va = _mm512_set1_pd(a);
+
+  for (i = 0; i < m; i += 16)
+  {
+    _mm512_storeu_pd(y+i, _mm512_add_pd(_mm512_loadu_pd(y+i),
+                                        _mm512_mul_pd(va, _mm512_loadu_pd(x+i))));
+    _mm512_storeu_pd(y+i+8, _mm512_add_pd(_mm512_loadu_pd(y+i+8),
+                                          _mm512_mul_pd(va, _mm512_loadu_pd(x+i+8))));
+  }
+  for ( ; i < n; ++i) /* clean-up loop */
+    y[i] += a * x[i];
+}
+
+__attribute__((target("avx512f")))
+static void dscalAvx512(long int n, double a, double *x)
+{
+  long int i, m = n - n % 8;
+  __m512d va = _mm512_set1_pd(a);
+
+  for (i = 0; i < m; i += 8)
+    _mm512_storeu_pd(x+i, _mm512_mul_pd(va, _mm512_loadu_pd(x+i)));
+  for ( ; i < n; ++i) /* clean-up loop */
+    x[i] = a * x[i];
+}
+
+static double (*ddotImpl)(long int, const double *, const double *) = ddotScalar;
+static void (*daxpyImpl)(long int, double, const double *, double *) = daxpyScalar;
+static void (*dscalImpl)(long int, double, double *) = dscalScalar;
+
+__attribute__((constructor))
+static void selectKernels(void)
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+  {
+    ddotImpl = ddotAvx512;
+    daxpyImpl = daxpyAvx512;
+    dscalImpl = dscalAvx512;
+  }
+  else if (__builtin_cpu_supports("avx2"))
+  {
+    ddotImpl = ddotAvx2;
+    daxpyImpl = daxpyAvx2;
+    dscalImpl = dscalAvx2;
+  }
+}
+
+#else
+
+#define ddotImpl ddotScalar
+#define daxpyImpl daxpyScalar
+#define dscalImpl dscalScalar
+
+#endif /* BLAS_X86_KERNELS */
+
+double ddot_kernel(long int n, const double *x, const double *y)
+{
+  return ddotImpl(n, x, y);
+}
+
+void daxpy_kernel(long int n, double a, const double *x, double *y)
+{
+  daxpyImpl(n, a, x, y);
+}
+
+void dscal_kernel(long int n, double a, double *x)
+{
+  dscalImpl(n, a, x);
+}
+
+double dnrm2_kernel(long int n, const double *x)
+{
+  double amax = 0.0, absxi, inv, s[NUM_PARTIAL_SUMS] = { 0.0 }, ssq, temp;
+  long int i, m;
+  int j;
+
+  for (i = 0; i < n; ++i)
+  {
+    absxi = fabs(x[i]);
+    if (absxi > amax)
+      amax = absxi;
+  }
+  if (amax == 0.0 || amax > DBL_MAX)
+    return amax;
+
+  /* squares of elements within these bounds can neither under- nor overflow */
+  if (amax > 1.0e-150 && amax < 1.0e150)
+    return sqrt(ddotImpl(n, x, x));
+
+  inv = 1.0 / amax;
+  m = n - n % NUM_PARTIAL_SUMS;
+  for (i = 0; i < m; i += NUM_PARTIAL_SUMS)
+  {
+    for (j = 0; j < NUM_PARTIAL_SUMS; ++j)
+    {
+      temp = x[i+j] * inv;
+      s[j] += temp * temp;
+    }
+  }
+  ssq = combinePartialSums(s);
+  for ( ; i < n; ++i) /* clean-up loop */
+  {
+    temp = x[i] * inv;
+    ssq += temp * temp;
+  }
+  return amax * sqrt(ssq);
+}
+
+#ifdef __cplusplus
+}
+#endif
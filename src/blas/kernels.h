@@ -0,0 +1,32 @@
+/* kernels.h  --  unit stride kernels of the bundled BLAS routines      */
+/*                                                                      */
+/* The kernels are selected once, when the library is loaded, depending */
+/* on the instruction sets supported by the processor (AVX-512, AVX2 or */
+/* a portable scalar version). The reductions (ddot, dnrm2) always use  */
+/* 16 partial sums that are combined in a fixed order, so all versions  */
+/* return bit-identical results.                                        */
+
+#ifndef BLAS_KERNELS_INCLUDE
+#define BLAS_KERNELS_INCLUDE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* sum_i x[i]*y[i] */
+double ddot_kernel(long int n, const double *x, const double *y);
+
+/* y := a*x + y */
+void daxpy_kernel(long int n, double a, const double *x, double *y);
+
+/* x := a*x */
+void dscal_kernel(long int n, double a, double *x);
+
+/* sqrt(sum_i x[i]*x[i]), guarded against over- and underflow */
+double dnrm2_kernel(long int n, const double *x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,6 +3,8 @@
 
 #include "BasicBigraph.h"
 
+#include <algorithm>
+
 BasicBigraph::BasicBigraph(): PsmThreshold(0.0), PeptideThreshold(1e-3),
   ProteinThreshold(1e-3) {}
 
@@ -13,11 +15,24 @@ BasicBigraph::BasicBigraph(double __psmthreshold, double __peptidethreshold,
 
 BasicBigraph::~BasicBigraph() {}
 
+// the interned names in the order of their symbols, i.e. of their nodes
+static Array<string> namesBySymbol(const SymbolTable & st) {
+  Array<string> names;
+  for (std::size_t k = 0; k < st.size(); k++) {
+    names.add( st[ static_cast<unsigned int>(k) ] );
+  }
+  return names;
+}
+
 void BasicBigraph::read(Scores* fullset, bool multiple_labeled_peptides) {
   string pepName, protName;
   double value =  -10;
   int pepIndex = -1;
-  StringTable PSMNames, proteinNames;
+  SymbolTable PSMNames, proteinNames;
+  std::vector<std::pair<int, int> > edges;
+  // protein nodes by the symbols of the protein names, such that every name
+  // is only cleaned up and looked up once
+  std::vector<int> protIndexBySymbol(PSMDescription::getNumProteinNames(), -1);
 
   vector<ScoreHolder>::iterator psm = fullset->begin();
   for (; psm!= fullset->end(); ++psm) {
@@ -40,27 +55,26 @@ void BasicBigraph::read(Scores* fullset, bool multiple_labeled_peptides) {
       pepName += "*";
     }
     
-    if ( PSMNames.lookup(pepName) == -1 ){
-      add(PSMsToProteins, PSMNames, pepName);
-    }
-    pepIndex = PSMNames.lookup(pepName);
+    pepIndex = add(PSMsToProteins, PSMNames, pepName);
 
     // r proteins
-    std::vector<string>::const_iterator pid = psm->pPSM->proteinIds.begin();
+    std::vector<unsigned int>::const_iterator pid = psm->pPSM->proteinIds.begin();
     for (; pid!= psm->pPSM->proteinIds.end(); ++pid) {
-      protName = getRidOfUnprintablesAndUnicode(*pid);
-      if (proteinNames.lookup(protName) == -1) {
-        add(proteinsToPSMs, proteinNames, protName);
+      int& protIndex = protIndexBySymbol[*pid];
+      if (protIndex == -1) {
+        protName = getRidOfUnprintablesAndUnicode(PSMDescription::getProteinName(*pid));
+        protIndex = add(proteinsToPSMs, proteinNames, protName);
       }
-      connect(PSMNames, pepName, proteinNames, protName);
+      edges.push_back(std::make_pair(pepIndex, protIndex));
     }
     // p probability of the peptide match to the spectrum
     value = 1 - psm->pep;
     PSMsToProteins.weights[ pepIndex ] = max(PSMsToProteins.weights[pepIndex], value);
  }
 
-  PSMsToProteins.names = PSMNames.getItemsByNumber();
-  proteinsToPSMs.names = proteinNames.getItemsByNumber();
+  connectAll(edges);
+  PSMsToProteins.names = namesBySymbol(PSMNames);
+  proteinsToPSMs.names = namesBySymbol(proteinNames);
   
   //NOTE this function is assigning PeptideThreshold probablity to all the PSMs with a prob below PeptideThreshold
   /**pseudoCountPSMs();**/
@@ -75,7 +89,8 @@ void BasicBigraph::read(istream & is, bool multiple_labeled_peptides) {
   int pepIndex = -1;
   int state = 'e';
 
-  StringTable PSMNames, proteinNames;
+  SymbolTable PSMNames, proteinNames;
+  std::vector<std::pair<int, int> > edges;
 
   while (is >> instr) {
     if (instr == 'e' && (state == 'e' || state == 'p')) {
@@ -90,21 +105,15 @@ void BasicBigraph::read(istream & is, bool multiple_labeled_peptides) {
       is >> pepName;
       //pepName = cleanPeptideSequence(pepName);
       
-      if (PSMNames.lookup(pepName) == -1) {
-        add(PSMsToProteins, PSMNames, pepName);
-      }
-      
-      pepIndex = PSMNames.lookup(pepName);
+      pepIndex = add(PSMsToProteins, PSMNames, pepName);
       state = 'c';
     } else if (instr == 'c' && state == 'c') {
       state = 'r';
     } else if ( instr == 'r' && ( state == 'c' || state == 'r' || state == 'p' ) ) {
       is >> protName;
 
-      if ( proteinNames.lookup(protName) == -1 )
-        add(proteinsToPSMs, proteinNames, protName);
-
-      connect(PSMNames, pepName, proteinNames, protName);
+      int protIndex = add(proteinsToPSMs, proteinNames, protName);
+      edges.push_back(std::make_pair(pepIndex, protIndex));
       state = 'p';
     } else if ( instr == 'p' && state == 'p' ) {
       is >> value;
@@ -120,8 +129,9 @@ void BasicBigraph::read(istream & is, bool multiple_labeled_peptides) {
     }
   }
 
-  PSMsToProteins.names = PSMNames.getItemsByNumber();
-  proteinsToPSMs.names = proteinNames.getItemsByNumber();
+  connectAll(edges);
+  PSMsToProteins.names = namesBySymbol(PSMNames);
+  proteinsToPSMs.names = namesBySymbol(proteinNames);
 
   //NOTE this function is assigning PeptideThreshold probablity to all the PSMs with a prob below PeptideThreshold
   /**pseudoCountPSMs();**/
@@ -279,59 +289,104 @@ BasicBigraph BasicBigraph::buildSubgraph(const Set & connectedProteins, const Se
 }
 
 void BasicBigraph::removePoorPSMs() {
+  std::vector<bool> poorPSMs(static_cast<std::size_t>(PSMsToProteins.size()), false);
   for (int k = 0; k < PSMsToProteins.size(); k++) {
     if (PSMsToProteins.weights[k] < PsmThreshold) {
-      disconnectPSM(k);
+      poorPSMs[k] = true;
     }
   }
+  disconnectPSMs(poorPSMs);
 }
 
 void BasicBigraph::removePoorProteins() {
+  std::vector<bool> poorProteins(static_cast<std::size_t>(proteinsToPSMs.size()), false);
   for (int k = 0; k < proteinsToPSMs.size(); k++) {
-    if (Vector(PSMsToProteins.weights[ proteinsToPSMs.associations[k] ]).max() < ProteinThreshold) {
-      disconnectProtein(k);
+    double bestPSM = -Numerical::inf();
+    const Set & as = proteinsToPSMs.associations[k];
+    for (int j = 0; j < as.size(); j++) {
+      bestPSM = max(bestPSM, PSMsToProteins.weights[ as[j] ]);
+    }
+    if (bestPSM < ProteinThreshold) {
+      poorProteins[k] = true;
     }
   }
+  disconnectProteins(poorProteins);
 }
 
-void BasicBigraph::disconnectPSM(int k) {
-  Set& as = PSMsToProteins.associations[k];
-  for (Set::Iterator iter = as.begin(); iter != as.end(); iter++) {
-    Set& setRef = proteinsToPSMs.associations[ *iter ];
-    setRef = setRef.without( Set::SingletonSet( k ) );
+// removes the edges of the nodes in @remove from @from and, in a single pass
+// over the affected nodes, the edges pointing back at them from @to
+static void disconnectNodes(const std::vector<bool> & remove, GraphLayer & from, GraphLayer & to) {
+  std::vector<bool> affected(static_cast<std::size_t>(to.size()), false);
+  for (int k = 0; k < from.size(); k++) {
+    if (remove[k]) {
+      const Set & as = from.associations[k];
+      for (int j = 0; j < as.size(); j++) {
+        affected[ as[j] ] = true;
+      }
+      from.associations[k] = Set();
+    }
+  }
+  
+  for (int k = 0; k < to.size(); k++) {
+    if (affected[k]) {
+      const Set & as = to.associations[k];
+      Set remaining;
+      for (int j = 0; j < as.size(); j++) {
+        if (!remove[ as[j] ]) remaining.add(as[j]);
+      }
+      to.associations[k] = remaining;
+    }
   }
-  as = Set();
 }
 
-void BasicBigraph::disconnectProtein(int k) {
-  Set & as = proteinsToPSMs.associations[k];
-  for (Set::Iterator iter = as.begin(); iter != as.end(); iter++) {
-    Set & setRef = PSMsToProteins.associations[ *iter ];
-    setRef = setRef.without( Set::SingletonSet( k ) );
-  }
-  as = Set();
+void BasicBigraph::disconnectPSMs(const std::vector<bool> & remove) {
+  disconnectNodes(remove, PSMsToProteins, proteinsToPSMs);
+}
+
+void BasicBigraph::disconnectProteins(const std::vector<bool> & remove) {
+  disconnectNodes(remove, proteinsToPSMs, PSMsToProteins);
 }
 
-void BasicBigraph::add(GraphLayer & gl, StringTable & st, const string & item) {
-  if ( st.lookup(item) == -1 ) {
+int BasicBigraph::add(GraphLayer & gl, SymbolTable & st, const string & item) {
+  bool inserted = false;
+  int index = static_cast<int>(st.intern(item.data(), item.size(), inserted));
+  if ( inserted ) {
     // if the string is not already known, then add a new node for it
-    st.add(item);
     gl.associations.add( Set() );
     gl.weights.add( -1.0 );
     gl.sections.add(-1);
   }
+  return index;
 }
 
-void BasicBigraph::connect(const StringTable & pepNames, const string & pepName, const StringTable & proteinNames, const string & protName)
-{
-  int pepIndex = pepNames.lookup(pepName);
-  int protIndex = proteinNames.lookup(protName);
-
-  // performance note: currently O(n^2) worstcase. Later use a bitset
-  // and then after the graph is read, pack it into a set. 
-
-  PSMsToProteins.associations[ pepIndex ] |= Set::SingletonSet(protIndex);
-  proteinsToPSMs.associations[ protIndex ] |= Set::SingletonSet(pepIndex);
+// builds the associations of both layers from the list of (PSM, protein) 
+// edges, with duplicates, by bucketing the edges per node in CSR fashion
+void BasicBigraph::connectAll(const std::vector<std::pair<int, int> > & edges) {
+  std::vector<std::pair<int, int> > sortedEdges(edges);
+  std::sort(sortedEdges.begin(), sortedEdges.end());
+  sortedEdges.erase(std::unique(sortedEdges.begin(), sortedEdges.end()), sortedEdges.end());
+  
+  // the edges are sorted by PSM and then protein, so the proteins of each 
+  // PSM come in increasing order; a stable bucketing by protein keeps the 
+  // PSMs of each protein in increasing order as well
+  std::vector<int> proteinOffsets(static_cast<std::size_t>(proteinsToPSMs.size()) + 1, 0);
+  for (std::size_t k = 0; k < sortedEdges.size(); k++) {
+    PSMsToProteins.associations[ sortedEdges[k].first ].add( sortedEdges[k].second );
+    proteinOffsets[ sortedEdges[k].second + 1 ]++;
+  }
+  for (std::size_t k = 1; k < proteinOffsets.size(); k++) {
+    proteinOffsets[k] += proteinOffsets[k-1];
+  }
+  std::vector<int> proteinEdges(sortedEdges.size());
+  std::vector<int> fill(proteinOffsets.begin(), proteinOffsets.end() - 1);
+  for (std::size_t k = 0; k < sortedEdges.size(); k++) {
+    proteinEdges[ fill[ sortedEdges[k].second ]++ ] = sortedEdges[k].first;
+  }
+  for (int k = 0; k < proteinsToPSMs.size(); k++) {
+    for (int j = proteinOffsets[k]; j < proteinOffsets[k+1]; j++) {
+      proteinsToPSMs.associations[k].add( proteinEdges[j] );
+    }
+  }
 }
 
 void BasicBigraph::printProteinWeights() const
@@ -347,25 +402,33 @@ void BasicBigraph::printProteinWeights() const
 }
 
 void BasicBigraph::traceConnected(int index, GraphLayer & gl, int sectionNumber) {
-  if ( gl.sections[index] == sectionNumber )
-    return;
-  
-  // if it has not already been marked by this section, do so
-  gl.sections[index] = sectionNumber;
-  // add mark to set of marks for this node, set can only be larger than 1 for 
-  // peptides below PeptideThreshold
-  gl.sectionMarks[index] |= Set::SingletonSet(sectionNumber);
-  
-  // do not follow edges with PSM probability below PeptideThreshold
-  if (&gl == &PSMsToProteins && gl.weights[index] <= PeptideThreshold)
-    return;
-
-  const Set& as = gl.associations[index];
-  for (Set::Iterator iter = as.begin(); iter != as.end(); iter++) {
-    if ( &gl == &proteinsToPSMs )
-      traceConnected(*iter, PSMsToProteins, sectionNumber);
-    else
-      traceConnected(*iter, proteinsToPSMs, sectionNumber);
+  // depth first search with an explicit stack, as the components of 
+  // proteome scale graphs are too deep for recursion
+  std::vector<std::pair<GraphLayer*, int> > stack;
+  stack.push_back(std::make_pair(&gl, index));
+  while (!stack.empty()) {
+    GraphLayer & layer = *stack.back().first;
+    int k = stack.back().second;
+    stack.pop_back();
+    
+    if ( layer.sections[k] == sectionNumber )
+      continue;
+    
+    // if it has not already been marked by this section, do so
+    layer.sections[k] = sectionNumber;
+    // add mark to set of marks for this node, set can only be larger than 1 for 
+    // peptides below PeptideThreshold
+    layer.sectionMarks[k] |= Set::SingletonSet(sectionNumber);
+    
+    // do not follow edges with PSM probability below PeptideThreshold
+    if (&layer == &PSMsToProteins && layer.weights[k] <= PeptideThreshold)
+      continue;
+
+    GraphLayer * other = (&layer == &proteinsToPSMs) ? &PSMsToProteins : &proteinsToPSMs;
+    const Set& as = layer.associations[k];
+    for (Set::Iterator iter = as.begin(); iter != as.end(); iter++) {
+      stack.push_back(std::make_pair(other, *iter));
+    }
   }
 }
 
@@ -378,7 +441,7 @@ int BasicBigraph::markSectionPartitions() {
   proteinsToPSMs.sections = Array<int>(proteinsToPSMs.size(), -1);
   
   // MT: make sure proteins with equal peptide evidence end up in the same section
-  Array<Set> groups = ReplicateIndexer<Set>::replicates(Set::sumSetElements, proteinsToPSMs.associations );
+  Array<Set> groups = ReplicateIndexer<Set>::replicates(Set::hashSetElements, proteinsToPSMs.associations );
   std::map<int, int> mapToFirstInGroup;
   
   for (int k = 0; k < groups.size(); k++) {
@@ -2,8 +2,10 @@
 #define _BasicBigraph_H
 
 #include <fstream>
+#include <utility>
+#include <vector>
 #include "Scores.h"
-#include "StringTable.h"
+#include "StringArena.h"
 #include "Array.h"
 #include "Vector.h"
 #include "ReplicateIndexer.h"
@@ -88,11 +90,10 @@ class BasicBigraph {
   
 protected:
   
-  void add(GraphLayer & gl, StringTable & st, const string & item);
-  void connect(const StringTable & PSMNames, const string & pepStr, 
-	       const StringTable & proteinNames, const string & protStr);
-  void disconnectProtein(int k);
-  void disconnectPSM(int k);
+  int add(GraphLayer & gl, SymbolTable & st, const string & item);
+  void connectAll(const std::vector<std::pair<int, int> > & edges);
+  void disconnectProteins(const std::vector<bool> & remove);
+  void disconnectPSMs(const std::vector<bool> & remove);
   void pseudoCountPSMs();
   void floorLowPSMs();
   int markSectionPartitions();
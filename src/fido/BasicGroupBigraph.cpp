@@ -3,6 +3,9 @@
 
 #include "BasicGroupBigraph.h"
 
+#include <algorithm>
+#include <vector>
+
 BasicGroupBigraph::BasicGroupBigraph(double peptidePrior, bool noClustering, bool trivialGrouping) :
     logLikelihoodConstantCachedFunctor(
       &BasicGroupBigraph::logLikelihoodConstant, "logLikelihoodConstant"),
@@ -55,12 +58,13 @@ void BasicGroupBigraph::groupProteinsBy(const Array<Set> & groups) {
   }
 
   // remove all but the first of each group from the graph
+  std::vector<bool> replicates(static_cast<std::size_t>(proteinsToPSMs.size()), false);
   for (int k = 0; k < groups.size(); k++) {
-    Set reps = groups[k].without( Set::SingletonSet(groups[k][0]) );
-    for (Set::Iterator iter = reps.begin(); iter != reps.end(); iter++) {
-      disconnectProtein(*iter);
+    for (int j = 1; j < groups[k].size(); j++) {
+      replicates[ groups[k][j] ] = true;
     }
   }
+  disconnectProteins(replicates);
 
   reindex();
 }
@@ -68,7 +72,7 @@ void BasicGroupBigraph::groupProteinsBy(const Array<Set> & groups) {
 // uses hashing of PSMs associations set per protein to find proteins with the
 // same set of PSMs
 void BasicGroupBigraph::groupProteins() {
-  Array<Set> groups = ReplicateIndexer<Set>::replicates(Set::sumSetElements, proteinsToPSMs.associations );
+  Array<Set> groups = ReplicateIndexer<Set>::replicates(Set::hashSetElements, proteinsToPSMs.associations );
   groupProteinsBy(groups);
 }
 
@@ -83,17 +87,6 @@ int BasicGroupBigraph::numberAssociatedProteins(int indexEpsilon) const {
   return tot;
 }
 
-int BasicGroupBigraph::numberActiveAssociatedProteins(int indexEpsilon, const Array<Counter> & n) const {
-  int tot = 0;
-
-  const Set & s = PSMsToProteins.associations[indexEpsilon];
-  for (int k=0; k<s.size(); k++) {
-    tot += n[ s[k] ].state;
-  }
-  
-  return tot;
-}
-
 Array<double> BasicGroupBigraph::probabilityE(const Model & m) const {
   Array<double> result( PSMsToProteins.size() );
 
@@ -123,56 +116,6 @@ double BasicGroupBigraph::probabilityNumberAssociatedProteins(const Model & m, i
   return m.probabilityProteins(total, active);
 }
 
-double BasicGroupBigraph::probabilityEEpsilonGivenN(const Model & m, int indexEpsilon, const Array<Counter> & n) const {
-  int active = numberActiveAssociatedProteins(indexEpsilon, n);
-
-  return probabilityEEpsilonGivenActiveAssociatedProteins(m, active);
-}
-
-double BasicGroupBigraph::likelihoodNGivenD(const Model & m, const Array<Counter> & n) const {
-  double prod = 1.0;
-  for (int k=0; k<PSMsToProteins.size(); k++) {
-    double probEGivenD = PSMsToProteins.weights[k];
-    double probEGivenN = probabilityEEpsilonGivenN(m, k, n);
-    double probE = PeptidePrior;
-    double termE = probEGivenD / probE * probEGivenN;
-    double termNotE = (1-probEGivenD) / (1-probE) * (1-probEGivenN);
-    double term = termE + termNotE;
-    
-    prod *= term;
-  }
-
-  return prod;
-}
-
-double BasicGroupBigraph::logLikelihoodNGivenD(const Model & m, const Array<Counter> & n) const {
-  double logProd = 0.0;
-
-  for (int k=0; k<PSMsToProteins.size(); k++) {
-    double probEGivenD = PSMsToProteins.weights[k];
-    double probEGivenN = probabilityEEpsilonGivenN(m, k, n);
-    double probE = PeptidePrior;
-    double termE = probEGivenD / probE * probEGivenN;
-    double termNotE = (1-probEGivenD) / (1-probE) * (1-probEGivenN);
-    double term = termE + termNotE;
-    
-    logProd += log2(term);
-  }
-
-  return logProd;
-}
-
-double BasicGroupBigraph::probabilityN(const Model & m, const Array<Counter> & n) const {
-  double prod = 1.0;
-
-  for (int k=0; k<n.size(); k++)
-    {
-      prod *= probabilityNNu(m, n[k]);
-    }
-
-  return prod;
-}
-
 double BasicGroupBigraph::logNumberOfConfigurations() const {
   double result = 0.0;
 
@@ -183,126 +126,185 @@ double BasicGroupBigraph::logNumberOfConfigurations() const {
   return result;
 }
 
-double BasicGroupBigraph::probabilityNNu(const Model & m, const Counter & nNu) const {
-  return m.probabilityProteins(nNu.size, nNu.state);
-}
-
-double BasicGroupBigraph::probabilityNGivenD(const Model & m, const Array<Counter> & n) const {
-  double logLike= logLikelihoodNGivenD(m,n) + log2(probabilityN(m,n)) - logLikelihoodConstantCachedFunctor(m,this);
-  return pow(2.0, logLike);
-}
-
 double BasicGroupBigraph::logLikelihoodConstant(const Model & m) const {
-  double result = 0.0;
-  bool starting = true;
-
-  Array<Counter> n = originalN;
-
-  for (Counter::start(n); Counter::inRange(n); Counter::advance(n)) {
-    double L = logLikelihoodNGivenD(m, n);
-    double p = log2(probabilityN(m, n));
-    double logLikeTerm = L+p;
-
-    if ( starting ) {
-      starting = false;
-      result = logLikeTerm;
-    } else {
-      result = Numerical::logAdd(result, logLikeTerm);
-    }
-  }
-
-  return result;
+  return enumerateConfigurations(m, NULL, NULL);
 }
 
 double BasicGroupBigraph::likelihoodConstant(const Model & m) const {
-  double result = 0.0;
-
-  Array<Counter> n = originalN;
-  for (Counter::start(n); Counter::inRange(n); Counter::advance(n)) {
-    double L = likelihoodNGivenD(m, n);
-    double p = probabilityN(m, n);
-    double term = L*p;
-    result += term;
-  }
-    
-  return result;
+  return pow(2.0, logLikelihoodConstant(m));
 }
 
-Array<double> BasicGroupBigraph::probabilityEGivenD(const Model & m) {
-  Array<Counter> n = originalN;
-  Vector result;
-
-  for (Counter::start(n); Counter::inRange(n); Counter::advance(n)) {
-    //Vector term = pow(2.0, logLikelihoodNGivenD(m, n) - logLikelihoodConstantCachedFunctor(m, this) ) * Vector( eCorrection(m, n) );
-    Vector term = probabilityNGivenD(m, n) * Vector( eCorrection(m, n) );
-    
-    if ( result.size() == 0 ) {
-      result = term;
-    } else {
-      result += term;
-    }
-  }
-
-  return result.unpack();
+Array<double> BasicGroupBigraph::probabilityEGivenD(const Model & m) const {
+  Array<double> probE;
+  enumerateConfigurations(m, NULL, &probE);
+  return probE;
 }
 
-Array<double> BasicGroupBigraph::eCorrection(const Model & m, const Array<Counter> & n) {
-  Array<double> result(PSMsToProteins.size());
-
-  for (int k=0; k<result.size(); k++) {
-    result[k] = eCorrectionEpsilon(k, m, n);
-  }
-
-  return result;
+Array<double> BasicGroupBigraph::probabilityRGivenD(const Model & m) const {
+  Array<double> probR;
+  enumerateConfigurations(m, &probR, NULL);
+  return probR;
 }
 
-double BasicGroupBigraph::eCorrectionEpsilon(int indexEpsilon, const Model & m, const Array<Counter> & n) {
-  double probEGivenD = PSMsToProteins.weights[indexEpsilon];
-  double probEGivenN = probabilityEEpsilonGivenN(m, indexEpsilon, n);
-  double probE = PeptidePrior;
+// log2 of the likelihood term of a PSM, and its share of the term coming 
+// from the PSM being present (the E correction)
+static void psmTerm(double probEGivenD, double probE, double probEGivenN, 
+                    double & logTerm, double & eCorrection) {
   double termE = probEGivenD / probE * probEGivenN;
   double termNotE = (1-probEGivenD) / (1-probE) * (1-probEGivenN);
   double term = termE + termNotE;
-  return termE / term;
+  logTerm = log2(term);
+  eCorrection = termE / term;
 }
 
-Array<double> BasicGroupBigraph::probabilityRGivenD(const Model & m) {
-  Array<Counter> n = originalN;
-  Vector result;
-
-  for (Counter::start(n); Counter::inRange(n); Counter::advance(n)) {
-    Vector term = probabilityNGivenD(m, n) * Vector( probabilityRGivenN(n) );
-
-    if ( result.size() == 0 ) {
-      result = term;
-    } else {
-      result += term;
-    }
+// zero probabilities are counted rather than summed as -inf, so that they 
+// can be taken out again
+static void addLogTerm(double logTerm, int sign, double & logSum, int & numZeros) {
+  if (std::isinf(logTerm) && logTerm < 0) {
+    numZeros += sign;
+  } else {
+    logSum += sign * logTerm;
   }
-
-  return result.unpack();
 }
 
-Array<double> BasicGroupBigraph::probabilityRGivenN(const Array<Counter> & n) {
-  Array<double> result(n.size());
-
-  for (int k=0; k<result.size(); k++) {
-    result[k] = probabilityRRhoGivenN(k, n);
+// Enumerates all configurations n of the protein groups in reflected 
+// mixed-radix Gray code order, i.e. every step changes the state of a single 
+// group by one. Only the terms of the PSMs connected to that group are 
+// updated, and the normalizer and the marginals of R and E (if requested) 
+// are accumulated in the same pass. A marginal only changes when its group 
+// or PSM is touched, so it is accumulated lazily as its value times the sum 
+// of the configuration weights since the last change. The weights are kept 
+// relative to a reference log likelihood, which is raised if it is exceeded 
+// by a large margin. Returns the log2 of the normalizer.
+double BasicGroupBigraph::enumerateConfigurations(const Model & m, 
+    Array<double>* probR, Array<double>* probE) const {
+  const double kMaxLogWeight = 64.0;
+  int numGroups = static_cast<int>(originalN.size());
+  int numPSMs = PSMsToProteins.size();
+  
+  std::vector<std::vector<int> > groupToPSMs(static_cast<std::size_t>(numGroups));
+  int maxActive = 0;
+  for (int k = 0; k < numPSMs; k++) {
+    const Set & s = PSMsToProteins.associations[k];
+    for (int j = 0; j < s.size(); j++) {
+      groupToPSMs[ s[j] ].push_back(k);
+    }
+    maxActive = std::max(maxActive, numberAssociatedProteins(k));
   }
-
-  return result;
-}
-
-double BasicGroupBigraph::probabilityRRhoGivenN(int indexRho, const Array<Counter> & n) {
-  const Counter & c = n[indexRho];
-
-  return double(c.state) / c.size;
+  
+  std::vector<double> probEGivenActive;
+  for (int a = 0; a <= maxActive; a++) {
+    probEGivenActive.push_back(probabilityEEpsilonGivenActiveAssociatedProteins(m, a));
+  }
+  
+  std::vector<std::vector<double> > logProbGroupStates(static_cast<std::size_t>(numGroups));
+  for (int g = 0; g < numGroups; g++) {
+    for (int state = 0; state <= originalN[g].size; state++) {
+      logProbGroupStates[g].push_back(log2(m.probabilityProteins(originalN[g].size, state)));
+    }
+  }
+  
+  // start with all groups absent
+  std::vector<int> states(static_cast<std::size_t>(numGroups), 0);
+  std::vector<int> directions(static_cast<std::size_t>(numGroups), 1);
+  std::vector<int> active(static_cast<std::size_t>(numPSMs), 0);
+  std::vector<double> logTerms(static_cast<std::size_t>(numPSMs));
+  std::vector<double> eCorrections(static_cast<std::size_t>(numPSMs));
+  double logSum = 0.0;
+  int numZeros = 0;
+  for (int k = 0; k < numPSMs; k++) {
+    psmTerm(PSMsToProteins.weights[k], PeptidePrior, probEGivenActive[0],
+            logTerms[k], eCorrections[k]);
+    addLogTerm(logTerms[k], 1, logSum, numZeros);
+  }
+  for (int g = 0; g < numGroups; g++) {
+    addLogTerm(logProbGroupStates[g][0], 1, logSum, numZeros);
+  }
+  
+  bool hasReference = false;
+  double referenceLogLike = 0.0, cumWeight = 0.0;
+  std::vector<double> sumR(static_cast<std::size_t>(numGroups), 0.0);
+  std::vector<double> lastCumWeightR(static_cast<std::size_t>(numGroups), 0.0);
+  std::vector<double> sumE(static_cast<std::size_t>(numPSMs), 0.0);
+  std::vector<double> lastCumWeightE(static_cast<std::size_t>(numPSMs), 0.0);
+  
+  while (true) {
+    if (numZeros == 0) {
+      if (!hasReference || logSum > referenceLogLike + kMaxLogWeight) {
+        double scale = hasReference ? pow(2.0, referenceLogLike - logSum) : 0.0;
+        cumWeight *= scale;
+        for (int g = 0; g < numGroups; g++) {
+          sumR[g] *= scale;
+          lastCumWeightR[g] *= scale;
+        }
+        for (int k = 0; k < numPSMs; k++) {
+          sumE[k] *= scale;
+          lastCumWeightE[k] *= scale;
+        }
+        referenceLogLike = logSum;
+        hasReference = true;
+      }
+      cumWeight += pow(2.0, logSum - referenceLogLike);
+    }
+    
+    // the first group that can move in its direction changes, the 
+    // directions of the groups before it are reversed
+    int g = 0;
+    for (; g < numGroups; g++) {
+      int nextState = states[g] + directions[g];
+      if (nextState >= 0 && nextState <= originalN[g].size) break;
+      directions[g] = -directions[g];
+    }
+    if (g == numGroups) break;
+    
+    if (probR) {
+      sumR[g] += states[g] * (cumWeight - lastCumWeightR[g]);
+      lastCumWeightR[g] = cumWeight;
+    }
+    addLogTerm(logProbGroupStates[g][ states[g] ], -1, logSum, numZeros);
+    states[g] += directions[g];
+    addLogTerm(logProbGroupStates[g][ states[g] ], 1, logSum, numZeros);
+    
+    const std::vector<int> & psms = groupToPSMs[g];
+    for (std::size_t j = 0; j < psms.size(); j++) {
+      int k = psms[j];
+      if (probE) {
+        sumE[k] += eCorrections[k] * (cumWeight - lastCumWeightE[k]);
+        lastCumWeightE[k] = cumWeight;
+      }
+      addLogTerm(logTerms[k], -1, logSum, numZeros);
+      active[k] += directions[g];
+      psmTerm(PSMsToProteins.weights[k], PeptidePrior, probEGivenActive[ active[k] ],
+              logTerms[k], eCorrections[k]);
+      addLogTerm(logTerms[k], 1, logSum, numZeros);
+    }
+  }
+  
+  if (probR) {
+    *probR = Array<double>(numGroups);
+    for (int g = 0; g < numGroups; g++) {
+      sumR[g] += states[g] * (cumWeight - lastCumWeightR[g]);
+      (*probR)[g] = sumR[g] / originalN[g].size / cumWeight;
+    }
+  }
+  if (probE) {
+    *probE = Array<double>(numPSMs);
+    for (int k = 0; k < numPSMs; k++) {
+      sumE[k] += eCorrections[k] * (cumWeight - lastCumWeightE[k]);
+      (*probE)[k] = sumE[k] / cumWeight;
+    }
+  }
+  return referenceLogLike + log2(cumWeight);
 }
 
 void BasicGroupBigraph::getProteinProbs(const Model & m) {
   probabilityR = probabilityRGivenD(m);
 }
 
+Array<double> BasicGroupBigraph::computeProteinProbs(const Model & m) const {
+  return probabilityRGivenD(m);
+}
+
 double BasicGroupBigraph::probabilityEEpsilonOverAllAlphaBeta(const GridModel & gm, int indexEpsilon) const {
   GridModel localModel( gm );
 
@@ -96,6 +96,9 @@ class BasicGroupBigraph : public BasicBigraph {
   
   double logNumberOfConfigurations() const;
   void getProteinProbs(const Model& m);
+  // computes the protein probabilities without storing them, so that several
+  // models can be evaluated on the same subgraph concurrently
+  Array<double> computeProteinProbs(const Model& m) const;
   void printProteinWeights() const;
 
   const Array<double>& proteinProbabilities() const { return probabilityR; }
@@ -130,32 +133,21 @@ class BasicGroupBigraph : public BasicBigraph {
  
   // protected utility functions
   int numberAssociatedProteins(int indexEpsilon) const;
-  int numberActiveAssociatedProteins(int indexEpsilon, const Array<Counter> & n) const;
  
   // protected mathematical functions
   double probabilityEEpsilon(const Model& m, int indexEpsilon) const;
   Array<double> probabilityE(const Model& m) const;
   double probabilityEEpsilonGivenActiveAssociatedProteins(const Model& m, int active) const;
   double probabilityNumberAssociatedProteins(const Model& m, int total, int active) const;
-  double probabilityEEpsilonGivenN(const Model& m, int indexEpsilon, const Array<Counter> & n) const;
-
-  double likelihoodNGivenD(const Model& m, const Array<Counter> & n) const;
-  double logLikelihoodNGivenD(const Model& m, const Array<Counter> & n) const;
-
-  double probabilityN(const Model& m, const Array<Counter> & n) const;
-  double probabilityNNu(const Model& m, const Counter & nNu) const;
-  double probabilityNGivenD(const Model& m, const Array<Counter> & n) const;
 
   double logLikelihoodConstant(const Model& m) const;
   double likelihoodConstant(const Model& m) const;
 
-  Array<double> probabilityRGivenD(const Model& m);
-  Array<double> probabilityRGivenN(const Array<Counter> & n);
-  double probabilityRRhoGivenN(int indexRho, const Array<Counter> & n);
-
-  Array<double> probabilityEGivenD(const Model& m);
-  Array<double> eCorrection(const Model& m, const Array<Counter> & n);
-  double eCorrectionEpsilon(int indexEpsilon, const Model& m, const Array<Counter> & n);
+  Array<double> probabilityRGivenD(const Model& m) const;
+  Array<double> probabilityEGivenD(const Model& m) const;
+  
+  double enumerateConfigurations(const Model& m, Array<double>* probR, 
+                                 Array<double>* probE) const;
 
   // for unknown alpha, beta
   double probabilityEEpsilonOverAllAlphaBeta(const GridModel& gm, int indexEpsilon) const;
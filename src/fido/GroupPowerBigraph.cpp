@@ -3,17 +3,44 @@
 
 #include "GroupPowerBigraph.h"
 
+#include <algorithm>
+
 GroupPowerBigraph::~GroupPowerBigraph() { }
 
+// The subgraphs are independent, so their inference runs in parallel. They 
+// are scheduled dynamically starting with the largest numbers of 
+// configurations, such that the few huge subgraphs do not end up last on a 
+// single thread, and the results are concatenated in the original order.
 Array<double> GroupPowerBigraph::proteinProbs() {
+  int numSubgraphs = static_cast<int>(subgraphOrder_.size());
+  #pragma omp parallel for schedule(dynamic, 1)
+  for (int i = 0; i < numSubgraphs; i++) {
+    subgraphs_[ subgraphOrder_[i] ].getProteinProbs(params_);
+  }
+  
   Array<double> result;
   for (int k = 0; k < subgraphs_.size(); k++) {
-    subgraphs_[k].getProteinProbs(params_);
     result.append( subgraphs_[k].proteinProbabilities() );
   }
   return result;
 }
 
+Array<double> GroupPowerBigraph::proteinProbs(const Model& m) const {
+  std::vector<Array<double> > subgraphProbs(subgraphOrder_.size());
+  int numSubgraphs = static_cast<int>(subgraphOrder_.size());
+  #pragma omp parallel for schedule(dynamic, 1)
+  for (int i = 0; i < numSubgraphs; i++) {
+    int k = subgraphOrder_[i];
+    subgraphProbs[k] = subgraphs_[k].computeProteinProbs(m);
+  }
+  
+  Array<double> result;
+  for (std::size_t k = 0; k < subgraphProbs.size(); k++) {
+    result.append( subgraphProbs[k] );
+  }
+  return result;
+}
+
 void GroupPowerBigraph::getProteinProbs() {
   probsPresentProteins_ = proteinProbs();
 }
@@ -86,10 +113,23 @@ void GroupPowerBigraph::getProteinNames(std::vector<std::vector<std::string> > &
 void GroupPowerBigraph::getProteinProbsAndNames(
     std::vector<std::vector<std::string> > &names, 
     std::vector<double> &probs) const {
+  sortProteinProbsAndNames(probsPresentProteins_, names, probs);
+}
+
+void GroupPowerBigraph::getProteinProbsAndNames(const Model& m,
+    std::vector<std::vector<std::string> > &names, 
+    std::vector<double> &probs) const {
+  sortProteinProbsAndNames(proteinProbs(m), names, probs);
+}
+
+void GroupPowerBigraph::sortProteinProbsAndNames(
+    const Array<double>& probsPresentProteins,
+    std::vector<std::vector<std::string> > &names, 
+    std::vector<double> &probs) const {
   names.clear();
   probs.clear();
   
-  Array<double> sorted = probsPresentProteins_;
+  Array<double> sorted = probsPresentProteins;
   Array<int> indices = sorted.sort();
   for (int k=0; k<sorted.size(); k++) {
     double pep = (1.0 - sorted[k]);
@@ -157,19 +197,57 @@ Array<BasicBigraph> GroupPowerBigraph::iterativePartitionSubgraphs(BasicBigraph
 }
 
 void GroupPowerBigraph::read(Scores* fullset) {
-  BasicBigraph basicBigraph(psmThreshold_, peptideThreshold_, proteinThreshold_);
-  basicBigraph.read(fullset, addPeptideDecoyLabel_);  
-  initialize(basicBigraph);
+  readGraph_ = BasicBigraph();
+  readGraph_.read(fullset, addPeptideDecoyLabel_);
+  hasReadGraph_ = true;
+  readWithPeptideDecoyLabel_ = addPeptideDecoyLabel_;
+  hasSubgraphs_ = false;
+  initialize(readGraph_);
 }
 
 void GroupPowerBigraph::read(istream& is) {
-  BasicBigraph basicBigraph(psmThreshold_, peptideThreshold_, proteinThreshold_);
-  basicBigraph.read(is, addPeptideDecoyLabel_);
-  initialize(basicBigraph);
+  readGraph_ = BasicBigraph();
+  readGraph_.read(is, addPeptideDecoyLabel_);
+  hasReadGraph_ = true;
+  readWithPeptideDecoyLabel_ = addPeptideDecoyLabel_;
+  hasSubgraphs_ = false;
+  initialize(readGraph_);
+}
+
+bool GroupPowerBigraph::rebuild() {
+  if (!hasReadGraph_ || readWithPeptideDecoyLabel_ != addPeptideDecoyLabel_) {
+    return false;
+  }
+  // the partitioning and grouping only change with the thresholds and settings
+  if (!hasSubgraphs_ || !(builtSettings_ == getBuildSettings())) {
+    initialize(readGraph_);
+  }
+  return true;
+}
+
+GroupPowerBigraph::BuildSettings GroupPowerBigraph::getBuildSettings() const {
+  BuildSettings settings;
+  settings.psmThreshold = psmThreshold_;
+  settings.peptideThreshold = peptideThreshold_;
+  settings.proteinThreshold = proteinThreshold_;
+  settings.peptidePrior = peptidePrior_;
+  settings.maxAllowedConfigurations = LOG_MAX_ALLOWED_CONFIGURATIONS;
+  settings.noPartitioning = noPartitioning_;
+  settings.noClustering = noClustering_;
+  settings.noPruning = noPruning_;
+  settings.trivialGrouping = trivialGrouping_;
+  return settings;
 }
 
-void GroupPowerBigraph::initialize(BasicBigraph& basicBigraph) {
+void GroupPowerBigraph::initialize(const BasicBigraph& readGraph) {
+  // pruning works in place, so it is applied to a copy of the graph as read
+  BasicBigraph basicBigraph(readGraph);
+  basicBigraph.setPsmThreshold(psmThreshold_);
+  basicBigraph.setPeptideThreshold(peptideThreshold_);
+  basicBigraph.setProteinThreshold(proteinThreshold_);
+  
   severedProteins_ = Array<string>();
+  groupProtNames_ = Array<Array<string> >();
   if (noPartitioning_) {
     basicBigraph.prune();
     severedProteins_.append(basicBigraph.severedProteins);
@@ -190,6 +268,22 @@ void GroupPowerBigraph::initialize(BasicBigraph& basicBigraph) {
     }
   }
   getGroupProtNames();
+  orderSubgraphsBySize();
+  builtSettings_ = getBuildSettings();
+  hasSubgraphs_ = true;
+}
+
+void GroupPowerBigraph::orderSubgraphsBySize() {
+  std::vector<std::pair<double, int> > sizes;
+  for (int k = 0; k < subgraphs_.size(); k++) {
+    sizes.push_back(std::make_pair(-subgraphs_[k].logNumberOfConfigurations(), k));
+  }
+  std::sort(sizes.begin(), sizes.end());
+  
+  subgraphOrder_.clear();
+  for (std::size_t i = 0; i < sizes.size(); i++) {
+    subgraphOrder_.push_back(sizes[i].second);
+  }
 }
 
 ostream & operator <<(ostream & os, pair<double,double> rhs) {
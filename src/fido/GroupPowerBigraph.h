@@ -5,7 +5,6 @@
 #define _GroupPowerBigraph_H
 
 #include "BasicGroupBigraph.h"
-#include "StringTable.h"
 #include "Array.h"
 #include "Random.h"
 #include "Model.h"
@@ -31,18 +30,23 @@ class GroupPowerBigraph {
       bool noPruning = false, bool trivialGrouping = false) :
         params_(alpha, beta, gamma), noPartitioning_(noPartitioning), 
         noClustering_(noClustering), noPruning_(noPruning),
-        LOG_MAX_ALLOWED_CONFIGURATIONS(18),
+        addPeptideDecoyLabel_(false), LOG_MAX_ALLOWED_CONFIGURATIONS(18),
         psmThreshold_(0.0), peptideThreshold_(1e-3),
         proteinThreshold_(1e-3), peptidePrior_(0.1),
-        trivialGrouping_(trivialGrouping) {}
+        trivialGrouping_(trivialGrouping), hasReadGraph_(false), 
+        hasSubgraphs_(false) {}
   ~GroupPowerBigraph();
   
   Array<double> proteinProbs();
+  Array<double> proteinProbs(const Model& m) const;
   void printProteinWeights() const;
   void getProteinProbsPercolator(
     std::vector<ProteinScoreHolder>& proteins,
     std::map<std::string, size_t>& proteinToIdxMap) const;
   void getProteinProbsAndNames(std::vector<std::vector<std::string> > &names, std::vector<double> &probs) const;
+  // evaluates the model @m on the graph without changing its parameters or 
+  // stored probabilities, i.e. it can be called from several threads at once
+  void getProteinProbsAndNames(const Model& m, std::vector<std::vector<std::string> > &names, std::vector<double> &probs) const;
   void getProteinNames(std::vector<std::vector<std::string> > &names) const;
   void getProteinProbs();
   Array<string> peptideNames() const;
@@ -89,11 +93,40 @@ class GroupPowerBigraph {
   
   void read(Scores* fullset);
   void read(istream & is);
+  // rebuilds the subgraphs from the graph that was read last, with the 
+  // current thresholds and settings; returns false if the graph has to be 
+  // read again because it was read with a different peptide labeling
+  bool rebuild();
   //NOTE to clone object
   //GroupPowerBigraph *clone();
 private:
-  void initialize(BasicBigraph& basicBigraph);
+  /* thresholds and settings that determine the pruning, partitioning and
+     grouping of the graph */
+  struct BuildSettings {
+    double psmThreshold, peptideThreshold, proteinThreshold, peptidePrior;
+    double maxAllowedConfigurations;
+    bool noPartitioning, noClustering, noPruning, trivialGrouping;
+    
+    bool operator==(const BuildSettings& rhs) const {
+      return psmThreshold == rhs.psmThreshold && 
+             peptideThreshold == rhs.peptideThreshold &&
+             proteinThreshold == rhs.proteinThreshold &&
+             peptidePrior == rhs.peptidePrior &&
+             maxAllowedConfigurations == rhs.maxAllowedConfigurations &&
+             noPartitioning == rhs.noPartitioning && 
+             noClustering == rhs.noClustering && 
+             noPruning == rhs.noPruning && 
+             trivialGrouping == rhs.trivialGrouping;
+    }
+  };
+  BuildSettings getBuildSettings() const;
+  
+  void initialize(const BasicBigraph& readGraph);
   void getGroupProtNames();
+  void orderSubgraphsBySize();
+  void sortProteinProbsAndNames(const Array<double>& probsPresentProteins,
+      std::vector<std::vector<std::string> > &names, 
+      std::vector<double> &probs) const;
   
   Array<BasicBigraph> iterativePartitionSubgraphs(BasicBigraph & bb, double newPeptideThreshold );
   
@@ -125,6 +158,16 @@ private:
   Array<Array<std::string> > groupProtNames_;
   /* subgraphs resulting from the partitioning and pruning steps */
   Array<BasicGroupBigraph> subgraphs_;
+  /* the graph as it was read, before pruning, to derive the subgraphs for 
+     other thresholds from without reading the PSMs again */
+  BasicBigraph readGraph_;
+  bool hasReadGraph_;
+  bool readWithPeptideDecoyLabel_;
+  /* the settings subgraphs_ were built with */
+  BuildSettings builtSettings_;
+  bool hasSubgraphs_;
+  /* indices of subgraphs_ by decreasing number of configurations */
+  std::vector<int> subgraphOrder_;
 };
 
 ostream & operator <<(ostream & os, pair<double,double> rhs);
@@ -2,18 +2,31 @@
 // see license for more information
 
 template <typename T>
-Array<Set> ReplicateIndexer<T>::replicates(unsigned int (*hashFunction) (const T & key), const Array<T> & rhs) {
+Array<Set> ReplicateIndexer<T>::replicates(uint64_t (*hashFunction) (const T & key), const Array<T> & rhs) {
   Array<Set> repSets;
-  HashTable<T> ht(hashFunction, 10001);
+  
+  std::size_t numSlots = 16;
+  while (numSlots < 2 * rhs.size()) numSlots *= 2;
+  std::size_t mask = numSlots - 1;
+  // each slot holds the index in repSets of a distinct element, or -1
+  std::vector<int> slots(numSlots, -1);
+  std::vector<uint64_t> hashes;
       
   for (int k = 0; k < rhs.size(); k++) {
-    if ( ht.add(rhs[k]) ) {
+    uint64_t h = hashFunction(rhs[k]);
+    std::size_t slot = static_cast<std::size_t>(h) & mask;
+    while (slots[slot] != -1 && 
+           (hashes[ slots[slot] ] != h || !(rhs[ repSets[ slots[slot] ][0] ] == rhs[k]))) {
+      slot = (slot + 1) & mask;
+    }
+    if (slots[slot] == -1) {
+      slots[slot] = static_cast<int>(repSets.size());
+      hashes.push_back(h);
       repSets.add( Set::SingletonSet(k) );
     } else {
-      repSets[ ht.lookup(rhs[k]) ].add(k);
+      repSets[ slots[slot] ].add(k);
     }
   }
 
   return repSets;
 }
-
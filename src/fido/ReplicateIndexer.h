@@ -4,14 +4,22 @@
 #ifndef _ReplicateIndexer_h
 #define _ReplicateIndexer_h
 
-#include "HashTable.h"
+#include <vector>
+#include <stdint.h>
 #include "Set.h"
 
+/*
+* ReplicateIndexer finds the replicates in an Array: the result holds a Set of
+*   indices for each distinct element, in order of first occurrence. Elements
+*   are located through an open addressing table on @hashFunction, which 
+*   should be a strong hash, as every collision costs a full comparison.
+*
+*/
 template <typename T>
 class ReplicateIndexer
 {
  public:
-  static Array<Set> replicates(unsigned int (*hashFunction) (const T & key), const Array<T> & rhs);
+  static Array<Set> replicates(uint64_t (*hashFunction) (const T & key), const Array<T> & rhs);
 };
 
 #include "ReplicateIndexer.cpp"
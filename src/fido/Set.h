@@ -4,6 +4,7 @@
 #ifndef _Set_H
 #define _Set_H
 
+#include <stdint.h>
 #include "Array.h"
 #include "Random.h"
 
@@ -32,12 +33,16 @@ class Set : public Array<int> {
     return Array<int>::operator [](k);
   }
 
-  // for hashing sets
-  static unsigned int sumSetElements(const Set & s) {
-    unsigned int sum = 0;
-    for (std::size_t k=0; k<s.size(); k++)
-      sum += static_cast<unsigned int>(s[k]);
-    return sum;
+  // for hashing sets, mixes every element so that sets with equal sums of
+  // elements do not collide
+  static uint64_t hashSetElements(const Set & s) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ s.size();
+    for (std::size_t k=0; k<s.size(); k++) {
+      h ^= static_cast<uint64_t>(s[static_cast<int>(k)]) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+    }
+    return h;
   }
 
   using Array<int>::size;
@@ -18,12 +18,14 @@
 #include <set>
 #include <vector>
 #include <ctype.h>
+#include <cassert>
 using namespace std;
 #include "Globals.h"
 #include "ssl.h"
 
 #include <stdarg.h>
 #include <cstring>
+#include <algorithm>
 #include "Timer.h"
 
 extern "C" {
@@ -44,32 +46,110 @@ extern "C" {
 // for compatibility issues, not using log2
 
 AlgIn::AlgIn(const unsigned int size, const int numFeat) {
-  vals = new double*[size];
+  vals = NULL;
+  valsMem_ = NULL;
+  rowCapacity_ = 0;
   Y = new double[size];
   C = new double[size];
   n = numFeat;
+  rowStride = (numFeat + 7) / 8 * 8;
+  m = 0;
   positives = 0;
   negatives = 0;
 }
 AlgIn::~AlgIn() {
-  delete[] vals;
+  delete[] valsMem_;
   delete[] Y;
   delete[] C;
 }
 
+void AlgIn::reserveRows(const int numRows) {
+  if (numRows <= rowCapacity_) {
+    return;
+  }
+  // grow geometrically, the number of positives changes between iterations
+  int newCapacity = std::max(numRows, rowCapacity_ + rowCapacity_ / 2);
+  std::size_t numBytes = sizeof(double) * static_cast<std::size_t>(newCapacity)
+                         * static_cast<std::size_t>(rowStride);
+  char* newMem = new char[numBytes + 64];
+  double* newVals = reinterpret_cast<double*>(
+      (reinterpret_cast<std::size_t>(newMem) + 63) / 64 * 64);
+  if (vals != NULL) {
+    memcpy(newVals, vals, sizeof(double) * static_cast<std::size_t>(rowCapacity_)
+                          * static_cast<std::size_t>(rowStride));
+  }
+  delete[] valsMem_;
+  valsMem_ = newMem;
+  vals = newVals;
+  rowCapacity_ = newCapacity;
+}
+
+SvmWorkspace::SvmWorkspace() {
+  weights.d = 0;
+  outputs.d = 0;
+  weightsBar.d = 0;
+  outputsBar.d = 0;
+  activeSubset.d = 0;
+  z = q = r = p = NULL;
+  deltas = NULL;
+  exampleCapacity_ = 0;
+  featureCapacity_ = 0;
+}
+SvmWorkspace::~SvmWorkspace() {
+  delete[] z;
+  delete[] q;
+  delete[] r;
+  delete[] p;
+  delete[] deltas;
+}
+
+void SvmWorkspace::resize(const int m, const int n) {
+  if (m > exampleCapacity_) {
+    // grow geometrically, the number of training examples differs between
+    // the folds and iterations
+    exampleCapacity_ = std::max(m, exampleCapacity_ + exampleCapacity_ / 2);
+    std::size_t numExamples = static_cast<std::size_t>(exampleCapacity_);
+    delete[] outputs.vec;
+    delete[] outputsBar.vec;
+    delete[] activeSubset.vec;
+    delete[] z;
+    delete[] q;
+    delete[] deltas;
+    outputs.vec = new double[numExamples];
+    outputsBar.vec = new double[numExamples];
+    activeSubset.vec = new int[numExamples];
+    z = new double[numExamples];
+    q = new double[numExamples];
+    deltas = new Delta[numExamples];
+  }
+  if (n > featureCapacity_) {
+    featureCapacity_ = n;
+    std::size_t numFeatures = static_cast<std::size_t>(n);
+    delete[] weights.vec;
+    delete[] weightsBar.vec;
+    delete[] r;
+    delete[] p;
+    weights.vec = new double[numFeatures];
+    weightsBar.vec = new double[numFeatures];
+    r = new double[numFeatures];
+    p = new double[numFeatures];
+  }
+  weights.d = n;
+  outputs.d = m;
+}
+
+/* computes q = X_J * p over the active rows, with the dot products of */
+/* the SIMD dispatched BLAS kernels                                     */
 double cglsFun1(int active, int* J, const double* Y,
-                double* set2, int n, double* q, 
+                const AlgIn& data, int n, double* q, 
                 double* p, double cpos, double cneg){
   double omega_q = 0.0;
-  int inc = 1;
   int i = 0;
+  int inc = 1;
 
-  char trans = 'T';
-  double alpha = 1.0;
-  double beta = 0.0;
-  dgemv_(&trans, &n, &active,
-         &alpha, set2, &n,
-         p, &inc, &beta, q, &inc);
+  for (i = 0; i < active; i++) {
+    q[i] = ddot_(&n, data.getRow(J[i]), &inc, p, &inc);
+  }
 
   for (i = 0; i < active; i++) {
     omega_q += ((Y[J[i]]==1)? cpos : cneg) * (q[i]) * (q[i]);
@@ -79,7 +159,7 @@ double cglsFun1(int active, int* J, const double* Y,
 }
 
 void cglsFun2(int active, int* J, const double* Y,
-              double* set2, int n0, int n, double* q, 
+              const AlgIn& data, int n, double* q, 
               double* o, double* z, double* r, 
               double cpos, double cneg){
   int i;
@@ -88,14 +168,14 @@ void cglsFun2(int active, int* J, const double* Y,
   for (i = 0; i < active; i++) {
     o[J[i]] += q[i];
     z[i] -= ((Y[J[i]]==1)? cpos : cneg) * q[i];
-    daxpy_(&n, &(z[i]), set2 + i * n, &inc, r, &inc);
+    daxpy_(&n, &(z[i]), data.getRow(J[i]), &inc, r, &inc);
   }
 }
 
 int CGLS(const AlgIn& data, const double lambda, const int cgitermax,
          const double epsilon, const vector_int& Subset,
          vector_double& Weights, vector_double& Outputs,
-         double cpos, double cneg) {
+         double cpos, double cneg, SvmWorkspace& workspace) {
   if (VERBOSE_CGLS) {
     cout << "CGLS starting..." << endl;
   }
@@ -103,35 +183,28 @@ int CGLS(const AlgIn& data, const double lambda, const int cgitermax,
   Timer tictoc;
   int active = Subset.d;
   int* J = Subset.vec;
-  double** set = data.vals;
   const double* Y = data.Y;
   int n = data.n;
   double* beta = Weights.vec;
   double* o = Outputs.vec;
   // initialize z
-  double* z = new double[active];
-  double* q = new double[active];
+  double* z = workspace.z;
+  double* q = workspace.q;
   int ii = 0;
   register int i;
-  int n0 = n-1;
   int inc = 1;
   double one = 1;
   double negLambda = -lambda;
-  int rowStart = 0;
-  double* set2 = new double[n*active];
-  double* r = new double[n];
+  double* r = workspace.r;
   for (i = n; i--;) {
     r[i] = 0.0;
   }
   for (i = 0; i < active; i++) {
     ii = J[i];
     z[i] = ((Y[ii]==1)? cpos : cneg) * (Y[ii] - o[ii]);
-    rowStart = i * n;
-    memcpy(set2 + rowStart, set[ii], sizeof(double)*static_cast<std::size_t>(n0));
-    set2[rowStart + n0] = 1.0;
-    daxpy_(&n, &(z[i]), set2 + i*n, &inc, r, &inc);
+    daxpy_(&n, &(z[i]), data.getRow(ii), &inc, r, &inc);
   }
-  double* p = new double[n];
+  double* p = workspace.p;
   daxpy_(&n, &negLambda, beta, &inc, r, &inc);
   memcpy(p, r, sizeof(double)*static_cast<std::size_t>(n));
   double omega1 = ddot_(&n, r, &inc, r, &inc);
@@ -147,7 +220,7 @@ int CGLS(const AlgIn& data, const double lambda, const int cgitermax,
   // iterate
   while (cgiter < cgitermax) {
     cgiter++;
-    omega_q = cglsFun1(active, J, Y, set2, n, q, p, cpos, cneg);
+    omega_q = cglsFun1(active, J, Y, data, n, q, p, cpos, cneg);
     gamma = omega1 / (lambda * omega_p + omega_q);
     inv_omega2 = 1 / omega1;
 
@@ -157,8 +230,8 @@ int CGLS(const AlgIn& data, const double lambda, const int cgitermax,
     daxpy_(&n, &gamma, p, &inc, beta, &inc);
     dscal_(&active, &gamma, q, &inc);
 
-    cglsFun2(active, J, Y, set2,
-             n0, n, q, o, z, r, cpos, cneg);
+    cglsFun2(active, J, Y, data,
+             n, q, o, z, r, cpos, cneg);
 
     omega_z = ddot_(&active, z, &inc, z, &inc);
     omega1 = ddot_(&n, r, &inc, r, &inc);
@@ -185,20 +258,25 @@ int CGLS(const AlgIn& data, const double lambda, const int cgitermax,
     cerr << "CGLS converged in " << cgiter << " iteration(s) and "
         << tictoc.getCPUTimeStr() << " CPU seconds." << endl;
   }
-  delete[] z;
-  delete[] q;
-  delete[] r;
-  delete[] p;
-  delete[] set2;
   return optimality;
 }
 
+void computeOutputs(const AlgIn& data, const vector_double& Weights,
+                    vector_double& Outputs) {
+  int n0 = Weights.d - 1;
+  int inc = 1;
+  double* w = Weights.vec;
+  for (int i = 0; i < Outputs.d; i++) {
+    Outputs.vec[i] = ddot_(&n0, data.getRow(i), &inc, w, &inc) + w[n0];
+  }
+}
+
 int L2_SVM_MFN(const AlgIn& data, options& Options,
                vector_double& Weights,
-               vector_double& Outputs, double cpos, double cneg) {
+               vector_double& Outputs, double cpos, double cneg,
+               SvmWorkspace& workspace) {
   /* Disassemble the structures */
   Timer tictoc;
-  double** set = data.vals;
   const double* Y = data.Y;
   int n = Weights.d;
   const int m = data.m;
@@ -213,8 +291,10 @@ int L2_SVM_MFN(const AlgIn& data, options& Options,
   int ini = 0;
   int n0 = n-1;
   int inc = 1;
-  vector_int ActiveSubset;
-  ActiveSubset.vec = new int[m];
+  // resizing here could free Weights and Outputs, which are often the
+  // weights and outputs of the workspace
+  assert(workspace.hasRoomFor(m, n));
+  vector_int& ActiveSubset = workspace.activeSubset;
   ActiveSubset.d = m;
   // initialize
   F = 0.5 * lambda * ddot_(&n, w, &inc, w, &inc);
@@ -236,12 +316,10 @@ int L2_SVM_MFN(const AlgIn& data, options& Options,
   int iter = 0;
   int opt = 0;
   int opt2 = 0;
-  vector_double Weights_bar;
-  vector_double Outputs_bar;
-  double* w_bar = new double[static_cast<std::size_t>(n)];
-  double* o_bar = new double[static_cast<std::size_t>(m)];
-  Weights_bar.vec = w_bar;
-  Outputs_bar.vec = o_bar;
+  vector_double& Weights_bar = workspace.weightsBar;
+  vector_double& Outputs_bar = workspace.outputsBar;
+  double* w_bar = Weights_bar.vec;
+  double* o_bar = Outputs_bar.vec;
   Weights_bar.d = n;
   Outputs_bar.d = m;
   double delta = 0.0;
@@ -261,10 +339,10 @@ int L2_SVM_MFN(const AlgIn& data, options& Options,
                epsilon,
                ActiveSubset,
                Weights_bar,
-               Outputs_bar, cpos, cneg);
+               Outputs_bar, cpos, cneg, workspace);
     for (register int i = active; i < m; i++) {
       ii = ActiveSubset.vec[i];
-      o_bar[ii] = ddot_(&n0, set[ii], &inc, w_bar, &inc) + w_bar[n - 1];
+      o_bar[ii] = ddot_(&n0, data.getRow(ii), &inc, w_bar, &inc) + w_bar[n - 1];
     }
     if (ini == 0) {
       cgitermax = CGITERMAX;
@@ -303,7 +381,8 @@ int L2_SVM_MFN(const AlgIn& data, options& Options,
         return 1;
       }
     }
-    delta = line_search(w, w_bar, lambda, o, o_bar, Y, n, m, cpos, cneg);
+    delta = line_search(w, w_bar, lambda, o, o_bar, Y, n, m, cpos, cneg,
+                        workspace.deltas);
     F_old = F;
     double delta2 = 1-delta;
     dscal_(&n, &delta2, w, &inc);
@@ -331,9 +410,22 @@ int L2_SVM_MFN(const AlgIn& data, options& Options,
   return 0;
 }
 
+/* sets the line search breakpoint of example i, including the changes of */
+/* L and R once the breakpoint is passed                                   */
+static inline void setBreakpoint(Delta& breakpoint, int i, int s, double diff,
+                                 const double* o, const double* o_bar,
+                                 const double* Y, double cpos, double cneg) {
+  breakpoint.delta = (1 - Y[i] * o[i]) / diff;
+  breakpoint.index = i;
+  breakpoint.s = s;
+  double d3 = s * ((Y[i]==1)? cpos : cneg) * (o_bar[i] - o[i]);
+  breakpoint.dL = d3 * (o[i] - Y[i]);
+  breakpoint.dR = d3 * (o_bar[i] - Y[i]);
+}
+
 double line_search(double* w, double* w_bar, double lambda, double* o,
                    double* o_bar, const double* Y, int d, /* data dimensionality -- 'n' */
-                   int l, double cpos, double cneg){
+                   int l, double cpos, double cneg, Delta* deltas){
   int i = 0;
   double omegaL = 0.0;
   double omegaR = 0.0;
@@ -347,10 +439,8 @@ double line_search(double* w, double* w_bar, double lambda, double* o,
   omegaR = lambda * omegaR;
   double L = omegaL;
   double R = omegaR;
-  int ii = 0;
   double d2 = 0.0;
 
-  Delta* deltas = new Delta[l];
   int p = 0;
   for (i = 0; i < l; i++) {
     diff = Y[i] * (o_bar[i] - o[i]);
@@ -359,33 +449,67 @@ double line_search(double* w, double* w_bar, double lambda, double* o,
       L += (o[i] - Y[i]) * d2;
       R += (o_bar[i] - Y[i]) * d2;
       if (diff > 0) {
-        deltas[p].delta = (1 - Y[i] * o[i]) / diff;
-        deltas[p].index = i;
-        deltas[p].s = -1;
+        setBreakpoint(deltas[p], i, -1, diff, o, o_bar, Y, cpos, cneg);
         p++;
       }
     } else {
       if (diff < 0) {
-        deltas[p].delta = (1 - Y[i] * o[i]) / diff;
-        deltas[p].index = i;
-        deltas[p].s = 1;
+        setBreakpoint(deltas[p], i, 1, diff, o, o_bar, Y, cpos, cneg);
         p++;
       }
     }
   }
-  sort(deltas, deltas + p);
+  // The derivative L + delta * (R - L) changes sign at the first breakpoint
+  // where it is non-negative. Rather than sorting all breakpoints, this
+  // position is narrowed down by quickselect, which partitions the
+  // breakpoints into consecutive segments that each hold smaller ones than
+  // the next. The segments are then only sorted once the scan in sorted
+  // order below reaches them. The L and R of the narrowing are summed in
+  // partition order and can differ in the last bits from the sorted sums,
+  // which only affects which segments get sorted, not the step size.
+  int segmentEnds[64];
+  int numSegments = 0;
+  int lo = 0;
+  int hi = p;
+  double loL = L;
+  double loR = R;
+  while (hi - lo > LINE_SEARCH_SORT_SIZE) {
+    int mid = lo + (hi - lo) / 2;
+    nth_element(deltas + lo, deltas + mid, deltas + hi);
+    double midL = loL;
+    double midR = loR;
+    for (i = lo; i < mid; i++) {
+      midL += deltas[i].dL;
+      midR += deltas[i].dR;
+    }
+    if (midL + deltas[mid].delta * (midR - midL) >= 0) {
+      hi = mid + 1;
+    } else {
+      loL = midL + deltas[mid].dL;
+      loR = midR + deltas[mid].dR;
+      lo = mid + 1;
+      segmentEnds[numSegments++] = lo;
+    }
+  }
+  if (numSegments == 0 || segmentEnds[numSegments - 1] < hi) {
+    segmentEnds[numSegments++] = hi;
+  }
+  if (segmentEnds[numSegments - 1] < p) {
+    segmentEnds[numSegments++] = p;
+  }
   double delta_prime = 0.0;
+  int segment = 0;
   for (i = 0; i < p; i++) {
+    if (i == 0 || i == segmentEnds[segment - 1]) {
+      sort(deltas + i, deltas + segmentEnds[segment++]);
+    }
     delta_prime = L + deltas[i].delta * (R - L);
     if (delta_prime >= 0) {
       break;
     }
-    ii = deltas[i].index;
-    diff = (deltas[i].s) * ((Y[ii]==1)? cpos : cneg) * (o_bar[ii] - o[ii]);
-    L += diff * (o[ii] - Y[ii]);
-    R += diff * (o_bar[ii] - Y[ii]);
+    L += deltas[i].dL;
+    R += deltas[i].dR;
   }
-  delete[] deltas;
   return (-L / (R - L));
 }
 
@@ -13,6 +13,7 @@
 #define _svmlin_H
 #include <vector>
 #include <ctime>
+#include <cstring>
 
 using namespace std;
 
@@ -23,9 +24,13 @@ using namespace std;
 #define BIG_EPSILON 0.01 /* for heuristic 2 in reference [2] */
 #define RELATIVE_STOP_EPS 1e-9 /* for L2-SVM-MFN relative stopping criterion */
 #define MFNITERMAX 50 /* maximum number of MFN iterations */
+#define LINE_SEARCH_SORT_SIZE 256 /* breakpoints line_search sorts rather than selects */
 
 #define VERBOSE_CGLS 0
 
+/* Training examples are stored in a contiguous row-major matrix, with the */
+/* constant bias term 1.0 as last column of each row. Rows start at 64-byte */
+/* boundaries, i.e. rowStride is n rounded up to a multiple of 8 doubles.   */
 class AlgIn {
   public:
     AlgIn(const unsigned int size, const int numFeat);
@@ -34,9 +39,21 @@ class AlgIn {
     int n; /* number of features */
     int positives;
     int negatives;
-    double** vals;
+    int rowStride; /* number of doubles between the starts of two rows */
+    double* vals; /* feature matrix, example i starts at vals + i*rowStride */
     double* Y; /* labels */
     double* C; /* cost associated with each example */
+    inline double* getRow(const int ix) const {
+      return vals + static_cast<std::size_t>(ix) * static_cast<std::size_t>(rowStride);
+    }
+    /* copies the n-1 features of an example and appends the bias term */
+    inline void setRow(const int ix, const double* features) {
+      double* row = getRow(ix);
+      std::memcpy(row, features, sizeof(double) * static_cast<std::size_t>(n - 1));
+      row[n - 1] = 1.0;
+    }
+    /* makes room for numRows examples, keeping the rows already set */
+    void reserveRows(const int numRows);
     void setCost(double pos, double neg) {
       int ix = 0;
       for (; ix < negatives; ++ix) {
@@ -46,6 +63,9 @@ class AlgIn {
         C[ix] = pos;
       }
     }
+  private:
+    char* valsMem_; /* unaligned allocation holding vals */
+    int rowCapacity_;
 };
 
 /* Data: Input examples are stored in sparse (Compressed Row Storage) format */
@@ -92,18 +112,56 @@ class Delta { /* used in line search */
   public:
     Delta() {
       delta = 0.0;
+      dL = 0.0;
+      dR = 0.0;
       index = 0;
       s = 0;
     }
     ;
     double delta;
+    double dL; /* changes of L and R when the breakpoint is passed */
+    double dR;
     int index;
     int s;
 };
+/* ties are broken by the example index, which makes the order total */
 inline bool operator<(const Delta& a, const Delta& b) {
-  return (a.delta < b.delta);
+  return (a.delta < b.delta) || (a.delta == b.delta && a.index < b.index);
 }
 
+/* Scratch buffers of the solvers below, which grow to the largest problem */
+/* they were used for and are then reused, such that repeated training on  */
+/* the same thread does not allocate. A workspace must only be used by one */
+/* thread at a time. The caller sizes the workspace with resize() before   */
+/* filling weights and outputs and calling the solvers, which never        */
+/* resize it themselves.                                                   */
+class SvmWorkspace {
+  public:
+    SvmWorkspace();
+    ~SvmWorkspace();
+    /* makes room for m examples and n features (including the bias term), */
+    /* and sets weights.d = n and outputs.d = m                            */
+    void resize(const int m, const int n);
+    inline bool hasRoomFor(const int m, const int n) const {
+      return m <= exampleCapacity_ && n <= featureCapacity_;
+    }
+    vector_double weights; /* weights and outputs of the callers of the solvers */
+    vector_double outputs;
+    vector_double weightsBar; /* used by L2_SVM_MFN */
+    vector_double outputsBar;
+    vector_int activeSubset;
+    double* z; /* used by CGLS */
+    double* q;
+    double* r;
+    double* p;
+    Delta* deltas; /* used by line_search */
+  private:
+    int exampleCapacity_;
+    int featureCapacity_;
+    SvmWorkspace(const SvmWorkspace&);
+    SvmWorkspace& operator=(const SvmWorkspace&);
+};
+
 /* svmlin algorithms and their subroutines */
 
 /* Conjugate Gradient for Sparse Linear Least Squares Problems */
@@ -112,14 +170,20 @@ inline bool operator<(const Delta& a, const Delta& b) {
 int CGLS(const AlgIn& set, const double lambda, const int cgitermax,
          const double epsilon, const vector_int& Subset,
          vector_double& Weights, vector_double& Outputs,
-         double cpos, double cneg);
+         double cpos, double cneg, SvmWorkspace& workspace);
 
 /* Linear Modified Finite Newton L2-SVM*/
 /* Solves: min_w 0.5*Options->lamda*w'*w + 0.5*sum_i Data->C[i] max(0,1 - Y[i] w' x_i)^2 */
+/* The workspace has to be resized for set.m examples and Weights.d features */
 int L2_SVM_MFN(const AlgIn& set, options& Options,
                vector_double& Weights,
-               vector_double& Outputs, double cpos, double cneg);
+               vector_double& Outputs, double cpos, double cneg,
+               SvmWorkspace& workspace);
+/* Sets Outputs to the decision values o_i = w'x_i of the current Weights, */
+/* used to warm start L2_SVM_MFN from a previous solution                  */
+void computeOutputs(const AlgIn& set, const vector_double& Weights,
+                    vector_double& Outputs);
 double line_search(double* w, double* w_bar, double lambda, double* o,
                          double* o_bar, const double* Y, int d, int l,
-                          double cpos, double cneg);
+                          double cpos, double cneg, Delta* deltas);
 #endif
@@ -0,0 +1,110 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Unit tests for the BLAS routines used by the SVM solver, which are
+ * either the bundled (SIMD dispatched) ones or those of a system BLAS.
+ */
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+extern "C" {
+  extern double dnrm2_(int *, double *, int *);
+  extern double ddot_(int *, double *, int *, double *, int *);
+  extern int daxpy_(int *, double *, double *, int *, double *, int *);
+  extern int dscal_(int *, double *, double *, int *);
+  extern int dgemv_(char *, int *, int *, double *, double *, int *,
+                    double *, int *, double *, double *, int *);
+}
+
+class BlasTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+        unsigned int seed = 7;
+        x.resize(kMaxLength);
+        y.resize(kMaxLength);
+        for (int i = 0 ; i < kMaxLength ; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            x[i] = (seed % 20011) / 997.0 - 10.0;
+            seed = seed * 1103515245u + 12345u;
+            y[i] = (seed % 30011) / 3001.0 - 5.0;
+        }
+    }
+    static const int kMaxLength = 97;
+    std::vector<double> x, y;
+};
+
+// Test all lengths up to and beyond the unrolled parts of the kernels
+TEST_F(BlasTest, CheckUnitStrideRoutines)
+{
+    int inc = 1;
+    for (int n = 0 ; n <= kMaxLength ; ++n) {
+        long double dot = 0.0, sq = 0.0;
+        for (int i = 0 ; i < n ; ++i) {
+            dot += (long double)x[i] * y[i];
+            sq += (long double)x[i] * x[i];
+        }
+        EXPECT_NEAR((double)dot, ddot_(&n, &x[0], &inc, &y[0], &inc), 1e-11);
+        EXPECT_NEAR(std::sqrt((double)sq), dnrm2_(&n, &x[0], &inc), 1e-11);
+
+        std::vector<double> ax(y), sx(x);
+        double a = -1.5;
+        daxpy_(&n, &a, &x[0], &inc, &ax[0], &inc);
+        dscal_(&n, &a, &sx[0], &inc);
+        for (int i = 0 ; i < kMaxLength ; ++i) {
+            EXPECT_DOUBLE_EQ(i < n ? y[i] + a * x[i] : y[i], ax[i]);
+            EXPECT_DOUBLE_EQ(i < n ? a * x[i] : x[i], sx[i]);
+        }
+    }
+}
+
+// The norm should neither under- nor overflow for extreme magnitudes
+TEST_F(BlasTest, CheckNormScaling)
+{
+    int n = 3, inc = 1;
+    double big[] = { 3e200, 4e200, 0.0 }, tiny[] = { 3e-200, 0.0, 4e-200 };
+    EXPECT_NEAR(5.0, dnrm2_(&n, big, &inc) / 1e200, 1e-14);
+    EXPECT_NEAR(5.0, dnrm2_(&n, tiny, &inc) / 1e-200, 1e-14);
+}
+
+// Test y := alpha*A*x + beta*y and y := alpha*A'*x + beta*y
+TEST_F(BlasTest, CheckMatrixVectorProduct)
+{
+    int m = 19, n = 5, lda = 19, inc = 1;
+    double alpha = 2.0, beta = 0.5;
+    char notrans = 'N', trans = 'T';
+
+    std::vector<double> yn(y.begin(), y.begin() + m);
+    dgemv_(&notrans, &m, &n, &alpha, &x[0], &lda, &y[0], &inc, &beta,
+           &yn[0], &inc);
+    for (int i = 0 ; i < m ; ++i) {
+        double sum = 0.0;
+        for (int j = 0 ; j < n ; ++j)
+            sum += x[i + j * lda] * y[j];
+        EXPECT_NEAR(alpha * sum + beta * y[i], yn[i], 1e-11);
+    }
+
+    std::vector<double> yt(y.begin(), y.begin() + n);
+    dgemv_(&trans, &m, &n, &alpha, &x[0], &lda, &y[0], &inc, &beta,
+           &yt[0], &inc);
+    for (int j = 0 ; j < n ; ++j) {
+        double sum = 0.0;
+        for (int i = 0 ; i < m ; ++i)
+            sum += x[i + j * lda] * y[i];
+        EXPECT_NEAR(alpha * sum + beta * y[j], yt[j], 1e-11);
+    }
+}
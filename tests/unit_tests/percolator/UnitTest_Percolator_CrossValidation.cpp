@@ -16,9 +16,12 @@
  */
 
 #include <gtest/gtest.h>
+#include <cmath>
+#include <algorithm>
 #include "SetHandler.h"
 #include "CrossValidation.h"
 #include "Globals.h"
+#include "PseudoRandom.h"
 
 /* A subclass of CrossValidation that gives us access to some
  * protected fields.
@@ -44,6 +47,9 @@ public:
     std::vector< std::vector<double> > const& weights(void) const {
         return w_;
     }
+    std::vector<candidateCposCfrac> const& candidates(void) const {
+        return classWeightsPerFold_;
+    }
 };
 
 /*
@@ -59,6 +65,7 @@ class CrossValidationTest : public ::testing::Test {
   protected:
     virtual void SetUp();
     virtual void TearDown();
+    void populate(SetHandler& setHandler, int N);
     int origVerbose;
 };
 
@@ -73,37 +80,15 @@ void CrossValidationTest::TearDown()
     Globals::getInstance()->setVerbose(origVerbose);
 }
 
-TEST_F(CrossValidationTest, doStepTest)
+// Our data set has two features. One flips between 0 and 1
+// without regard for label. The other is consistently increasing,
+// but with the targets' values slightly less than the decoys'
+// values.
+void CrossValidationTest::populate(SetHandler& setHandler, int N)
 {
-    // Note that we use an elevated testFdr (0.02 instead of 0.01),
-    // to compensate for the small size of the data sets.
-    int const N = 100;
-    double const testFdr = 0.02;
-
-    CrossValidationEx *crossValidation =
-            new CrossValidationEx(false,   // quickValidation
-                                  false,   // reportEachIteration
-                                  testFdr, // testFdr
-                                  0.01,    // selectionFdr
-                                  0.01,    // initialSectionFdr
-                                  0.0,     // selectedCpos
-                                  0.0,     // selectedCneg
-                                  10,      // nIter
-                                  true,    // usePi0
-                                  1,       // nestedXvalBins
-                                  false,   // trainBestPositive
-                                  1,       // numThreads
-                                  false);  // skipNormalizeScores
-
     FeatureNames::setNumFeatures(2);
-    SetHandler setHandler(0);
     int scanNumber = 1;
 
-    // Our data set has two features. One flips between 0 and 1
-    // without regard for label. The other is consistently increasing,
-    // but with the targets' values slightly less than the decoys'
-    // values.
-
     DataSet *targets = new DataSet();
     DataSet *decoys = new DataSet();
     targets->setLabel(+1);
@@ -126,6 +111,32 @@ TEST_F(CrossValidationTest, doStepTest)
     }
     setHandler.push_back_dataset(targets);
     setHandler.push_back_dataset(decoys);
+}
+
+TEST_F(CrossValidationTest, doStepTest)
+{
+    // Note that we use an elevated testFdr (0.02 instead of 0.01),
+    // to compensate for the small size of the data sets.
+    int const N = 100;
+    double const testFdr = 0.02;
+
+    CrossValidationEx *crossValidation =
+            new CrossValidationEx(false,   // quickValidation
+                                  false,   // reportEachIteration
+                                  testFdr, // testFdr
+                                  0.01,    // selectionFdr
+                                  0.01,    // initialSectionFdr
+                                  0.0,     // selectedCpos
+                                  0.0,     // selectedCneg
+                                  10,      // nIter
+                                  true,    // usePi0
+                                  1,       // nestedXvalBins
+                                  false,   // trainBestPositive
+                                  1,       // numThreads
+                                  false);  // skipNormalizeScores
+
+    SetHandler setHandler(0);
+    populate(setHandler, N);
 
     Normalizer *pNorm = NULL;
     setHandler.normalizeFeatures(pNorm);
@@ -156,3 +167,149 @@ TEST_F(CrossValidationTest, doStepTest)
 
     delete crossValidation;
 }
+
+// Starting from the previous iteration's weights should not change what the
+// training of a (cpos, cneg) pair converges to. The first step starts from
+// zero weights in both cases and has to give identical weights, the second
+// step trains on identical training sets.
+TEST_F(CrossValidationTest, warmStartTest)
+{
+    int const N = 100;
+    double const testFdr = 0.02;
+    std::vector< std::vector<candidateCposCfrac> > candidatesPerStep[2];
+
+    for (int warm = 0 ; warm < 2 ; ++warm) {
+        CrossValidationEx crossValidation(false, false, testFdr, 0.01, 0.01,
+                                          0.0, 0.0, 10, true, 1, false, 1,
+                                          false);
+        crossValidation.setWarmStart(warm == 1);
+        PseudoRandom::setSeed(1);  // same cross validation folds in both runs
+
+        SetHandler setHandler(0);
+        populate(setHandler, N);
+        Normalizer *pNorm = NULL;
+        Normalizer::resetNormalizer();
+        setHandler.normalizeFeatures(pNorm);
+        Scores scores(true);
+        scores.populateWithPSMs(setHandler);
+
+        SanityCheck check;
+        crossValidation.preIterationSetup(scores, &check, pNorm,
+                                          setHandler.getFeaturePool());
+        for (int step = 0 ; step < 2 ; ++step) {
+            int estimatedNumPositives = crossValidation.doStepEx(pNorm, 0.01);
+            EXPECT_LE(N, estimatedNumPositives);
+            EXPECT_GE(N * (1.0 + testFdr), estimatedNumPositives);
+            candidatesPerStep[warm].push_back(crossValidation.candidates());
+        }
+        delete pNorm;
+        Normalizer::resetNormalizer();
+    }
+
+    std::vector<candidateCposCfrac> const& cold1 = candidatesPerStep[0][0];
+    std::vector<candidateCposCfrac> const& warm1 = candidatesPerStep[1][0];
+    std::vector<candidateCposCfrac> const& cold2 = candidatesPerStep[0][1];
+    std::vector<candidateCposCfrac> const& warm2 = candidatesPerStep[1][1];
+    ASSERT_EQ(cold1.size(), warm1.size());
+    for (std::size_t i = 0 ; i < cold1.size() ; ++i) {
+        for (std::size_t ix = 0 ; ix < cold1[i].ww.size() ; ++ix) {
+            EXPECT_EQ(cold1[i].ww[ix], warm1[i].ww[ix]);
+            EXPECT_NEAR(cold2[i].ww[ix], warm2[i].ww[ix],
+                        1e-5 * (1.0 + std::fabs(cold2[i].ww[ix])));
+        }
+    }
+}
+
+// The number of folds is configurable. With more folds than are trained at
+// the same time, the folds are processed in several batches.
+TEST_F(CrossValidationTest, numFoldsTest)
+{
+    int const N = 100;
+    double const testFdr = 0.02;
+    unsigned int const numFolds[] = { 4u, 6u };
+
+    for (int i = 0 ; i < 2 ; ++i) {
+        CrossValidationEx crossValidation(false, false, testFdr, 0.01, 0.01,
+                                          0.0, 0.0, 10, true, 1, false, 1,
+                                          false);
+        crossValidation.setNumFolds(numFolds[i]);
+
+        SetHandler setHandler(0);
+        populate(setHandler, N);
+        Normalizer *pNorm = NULL;
+        Normalizer::resetNormalizer();
+        setHandler.normalizeFeatures(pNorm);
+        Scores scores(true);
+        scores.populateWithPSMs(setHandler);
+
+        SanityCheck check;
+        crossValidation.preIterationSetup(scores, &check, pNorm,
+                                          setHandler.getFeaturePool());
+        EXPECT_EQ(numFolds[i], crossValidation.weights().size());
+        EXPECT_EQ(numFolds[i] * 9u, crossValidation.candidates().size());
+
+        int estimatedNumPositives = crossValidation.doStepEx(pNorm, 0.01);
+        EXPECT_LE(N, estimatedNumPositives);
+        EXPECT_GE(N * (1.0 + testFdr), estimatedNumPositives);
+        for (unsigned int set = 0 ; set < numFolds[i] ; ++set) {
+            // the increasing feature separates targets from decoys
+            EXPECT_GT(crossValidation.weights()[set][0], 0.0);
+        }
+        delete pNorm;
+        Normalizer::resetNormalizer();
+    }
+}
+
+// Fills an SVM input with numNegatives decoys followed by numPositives targets
+static void populateSvmInput(AlgIn& svmInput, int numNegatives,
+                             int numPositives) {
+    svmInput.negatives = numNegatives;
+    svmInput.positives = numPositives;
+    svmInput.m = numNegatives + numPositives;
+    svmInput.reserveRows(svmInput.m);
+    for (int i = 0 ; i < svmInput.m ; ++i) {
+        bool isTarget = i >= numNegatives;
+        double features[2] = { (isTarget ? 0.5 : 0.0) + (i % 7) * 0.1,
+                               static_cast<double>(i % 2) };
+        svmInput.setRow(i, features);
+        svmInput.Y[i] = isTarget ? 1.0 : -1.0;
+    }
+}
+
+// A workspace that grew for a larger problem has to give the same solution
+// as a fresh one
+TEST(SvmWorkspaceTest, CheckReusedWorkspaceMatchesFreshOne)
+{
+    options pOptions;
+    pOptions.lambda = 1.0;
+    pOptions.lambda_u = 1.0;
+    pOptions.epsilon = EPSILON;
+    pOptions.cgitermax = CGITERMAX;
+    pOptions.mfnitermax = MFNITERMAX;
+
+    AlgIn largeInput(400, 3), smallInput(60, 3);
+    populateSvmInput(largeInput, 250, 150);
+    populateSvmInput(smallInput, 40, 20);
+
+    SvmWorkspace reused, fresh;
+    reused.resize(largeInput.m, 3);
+    std::fill(reused.weights.vec, reused.weights.vec + 3, 0.0);
+    std::fill(reused.outputs.vec, reused.outputs.vec + largeInput.m, 0.0);
+    L2_SVM_MFN(largeInput, pOptions, reused.weights, reused.outputs,
+               1.0, 1.0, reused);
+
+    SvmWorkspace* workspaces[2] = { &reused, &fresh };
+    for (int k = 0 ; k < 2 ; ++k) {
+        workspaces[k]->resize(smallInput.m, 3);
+        std::fill(workspaces[k]->weights.vec, workspaces[k]->weights.vec + 3,
+                  0.0);
+        std::fill(workspaces[k]->outputs.vec,
+                  workspaces[k]->outputs.vec + smallInput.m, 0.0);
+        L2_SVM_MFN(smallInput, pOptions, workspaces[k]->weights,
+                   workspaces[k]->outputs, 2.0, 1.0, *workspaces[k]);
+    }
+    for (int ix = 0 ; ix < 3 ; ++ix) {
+        EXPECT_EQ(fresh.weights.vec[ix], reused.weights.vec[ix]);
+    }
+    EXPECT_GT(fresh.weights.vec[0], 0.0);
+}
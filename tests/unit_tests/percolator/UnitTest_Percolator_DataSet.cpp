@@ -52,10 +52,10 @@ TEST_F(DataSetTest, ChecMinimalPsmParsing)
     DataSet::readPsm("Id\t-1\tPEPTIDE\tProteinList",
             1, optionalFields, true, myPsm, featurePool, decoyPrefix);
     ASSERT_TRUE(myPsm != NULL);
-    ASSERT_EQ("Id", myPsm->getId());
-    ASSERT_EQ("PEPTIDE", myPsm->getFullPeptide());
+    ASSERT_STREQ("Id", myPsm->getId());
+    ASSERT_STREQ("PEPTIDE", myPsm->getFullPeptide());
     ASSERT_EQ(1, myPsm->proteinIds.size());
-    ASSERT_EQ("ProteinList", myPsm->proteinIds[0]);
+    ASSERT_STREQ("ProteinList", PSMDescription::getProteinName(myPsm->proteinIds[0]));
 }
 
 // Throw on lines with missing fields.
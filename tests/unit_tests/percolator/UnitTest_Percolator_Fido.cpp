@@ -20,10 +20,16 @@
  */
 /* This file include test cases for the EludeCaller class */
 #include <gtest/gtest.h>
+#include <sstream>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "PackedVector.h"
 #include "PackedMatrix.h"
 #include "BaseSpline.h"
+#include "GroupPowerBigraph.h"
 
 class FidoVectorTest : public ::testing::Test {
  protected:
@@ -195,3 +201,209 @@ EXPECT_EQ(-15,(int)res[0]);
 EXPECT_EQ(8,(int)res[1]);
 EXPECT_EQ(2,(int)res[2]);
 }
+
+// the associations of a node as a vector, to compare them at once
+static std::vector<int> associationsOf(const GraphLayer & gl, int k) {
+  const Set & as = gl.associations[k];
+  std::vector<int> nodes;
+  for (int j = 0; j < as.size(); ++j) {
+    nodes.push_back(as[j]);
+  }
+  return nodes;
+}
+
+TEST(FidoBigraphTest, ReadBuildsSortedEdgeListsAndSections) {
+  // P1 lists protein A twice and is read again with protein C, P4 is below
+  // the peptide threshold and does not connect D and E
+  std::istringstream graphStream(
+      "e P1\nr A\nr B\nr A\np 0.9\n"
+      "e P2\nr B\np 0.8\n"
+      "e P1\nr C\np 0.5\n"
+      "e P3\nr D\np 0.7\n"
+      "e P4\nr E\nr D\np 0.0005\n");
+  BasicBigraph graph(0.0, 1e-3, 0.0);
+  graph.read(graphStream);
+
+  ASSERT_EQ(4, graph.PSMsToProteins.size());
+  ASSERT_EQ(5, graph.proteinsToPSMs.size());
+  const char* psmNames[] = {"P1", "P2", "P3", "P4"};
+  const char* proteinNames[] = {"A", "B", "C", "D", "E"};
+  for (int k = 0; k < 4; ++k) {
+    EXPECT_EQ(psmNames[k], graph.PSMsToProteins.names[k]);
+  }
+  for (int k = 0; k < 5; ++k) {
+    EXPECT_EQ(proteinNames[k], graph.proteinsToPSMs.names[k]);
+  }
+  EXPECT_DOUBLE_EQ(0.9, graph.PSMsToProteins.weights[0]);
+
+  // both directions without duplicates and in increasing order
+  int p1[] = {0, 1, 2}, p4[] = {3, 4}, b[] = {0, 1}, d[] = {2, 3};
+  EXPECT_EQ(std::vector<int>(p1, p1 + 3), associationsOf(graph.PSMsToProteins, 0));
+  EXPECT_EQ(std::vector<int>(1, 1), associationsOf(graph.PSMsToProteins, 1));
+  EXPECT_EQ(std::vector<int>(1, 3), associationsOf(graph.PSMsToProteins, 2));
+  EXPECT_EQ(std::vector<int>(p4, p4 + 2), associationsOf(graph.PSMsToProteins, 3));
+  EXPECT_EQ(std::vector<int>(1, 0), associationsOf(graph.proteinsToPSMs, 0));
+  EXPECT_EQ(std::vector<int>(b, b + 2), associationsOf(graph.proteinsToPSMs, 1));
+  EXPECT_EQ(std::vector<int>(1, 0), associationsOf(graph.proteinsToPSMs, 2));
+  EXPECT_EQ(std::vector<int>(d, d + 2), associationsOf(graph.proteinsToPSMs, 3));
+  EXPECT_EQ(std::vector<int>(1, 3), associationsOf(graph.proteinsToPSMs, 4));
+
+  // the sections are the components traced without P4, which pruning
+  // clones into both of them
+  graph.prune();
+  ASSERT_EQ(5, graph.PSMsToProteins.size());
+  EXPECT_EQ("P4_clone_1", graph.PSMsToProteins.names[3]);
+  EXPECT_EQ("P4_clone_2", graph.PSMsToProteins.names[4]);
+  Array<BasicBigraph> sections = graph.partitionSections();
+  ASSERT_EQ(3, sections.size());
+  EXPECT_EQ(3, sections[0].proteinsToPSMs.size());
+  EXPECT_EQ(2, sections[0].PSMsToProteins.size());
+  ASSERT_EQ(1, sections[1].proteinsToPSMs.size());
+  EXPECT_EQ("D", sections[1].proteinsToPSMs.names[0]);
+  EXPECT_EQ(2, sections[1].PSMsToProteins.size());
+  ASSERT_EQ(1, sections[2].proteinsToPSMs.size());
+  EXPECT_EQ("E", sections[2].proteinsToPSMs.names[0]);
+  ASSERT_EQ(1, sections[2].PSMsToProteins.size());
+  EXPECT_EQ("P4_clone_2", sections[2].PSMsToProteins.names[0]);
+}
+
+class FidoGraphTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // peptides shared between proteins give subgraphs with several 
+    // configurations, protein C and D form a group
+    graphText = 
+      "e PEPA\nr A\nr B\np 0.9\n"
+      "e PEPB\nr B\np 0.6\n"
+      "e PEPC\nr C\nr D\np 0.95\n"
+      "e PEPD\nr C\nr D\nr E\np 0.3\n"
+      "e PEPE\nr E\np 0.05\n"
+      "e PEPF\nr F\np 0.7\n";
+    std::istringstream graphStream(graphText);
+    graph = new GroupPowerBigraph(0.1, 0.01, 0.5);
+    graph->read(graphStream);
+  }
+  virtual void TearDown() { delete graph; }
+
+  std::string graphText;
+  GroupPowerBigraph* graph;
+};
+
+TEST_F(FidoGraphTest, ModelEvaluationMatchesStoredProbabilities) {
+  double alphas[] = {0.008, 0.128, 0.5};
+  double gammas[] = {0.1, 0.5, 0.9};
+  for (unsigned int i = 0; i < 3; ++i) {
+    Model m(alphas[i], 0.001, gammas[i]);
+    std::vector<std::vector<std::string> > names, expectedNames;
+    std::vector<double> probs, expectedProbs;
+    graph->getProteinProbsAndNames(m, names, probs);
+    
+    graph->setAlphaBetaGamma(m.alpha, m.beta, m.gamma);
+    graph->getProteinProbs();
+    graph->getProteinProbsAndNames(expectedNames, expectedProbs);
+    
+    ASSERT_GT(probs.size(), 0u);
+    ASSERT_EQ(expectedProbs.size(), probs.size());
+    EXPECT_TRUE(expectedNames == names);
+    for (std::size_t k = 0; k < probs.size(); ++k) {
+      EXPECT_DOUBLE_EQ(expectedProbs[k], probs[k]);
+    }
+  }
+}
+
+TEST_F(FidoGraphTest, ProteinProbsMatchFullEnumeration) {
+  // PEPs from summing over all configurations of the fixture's graph
+  const char* expectedNames[] = {"B", "C", "F", "A", "E"};
+  double expectedPeps[] = {0.1711412985346028, 0.26563032397134356, 
+                           0.27397260273972612, 0.32998181623703071, 
+                           0.47375026496383854};
+  std::vector<std::vector<std::string> > names;
+  std::vector<double> probs;
+  graph->setAlphaBetaGamma(0.1, 0.01, 0.5);
+  graph->getProteinProbs();
+  graph->getProteinProbsAndNames(names, probs);
+  
+  ASSERT_EQ(5u, probs.size());
+  EXPECT_EQ(2u, names[1].size());
+  for (std::size_t k = 0; k < probs.size(); ++k) {
+    EXPECT_EQ(expectedNames[k], names[k][0]);
+    EXPECT_NEAR(expectedPeps[k], probs[k], 1e-12);
+  }
+}
+
+TEST_F(FidoGraphTest, RebuildMatchesReadingAgain) {
+  // prune as for the fast grid search, then return to the default thresholds
+  double proteinThreshold = graph->getProteinThreshold();
+  double psmThreshold = graph->getPsmThreshold();
+  double peptideThreshold = graph->getPeptideThreshold();
+  std::istringstream graphStream(graphText);
+  graph->setProteinThreshold(0.5);
+  graph->setPsmThreshold(0.5);
+  graph->setPeptideThreshold(0.5);
+  graph->read(graphStream);
+  
+  graph->setProteinThreshold(proteinThreshold);
+  graph->setPsmThreshold(psmThreshold);
+  graph->setPeptideThreshold(peptideThreshold);
+  ASSERT_TRUE(graph->rebuild());
+  
+  Model m(0.1, 0.01, 0.5);
+  std::vector<std::vector<std::string> > names, expectedNames;
+  std::vector<double> probs, expectedProbs;
+  graph->getProteinProbsAndNames(m, names, probs);
+  
+  GroupPowerBigraph freshGraph(0.1, 0.01, 0.5);
+  std::istringstream freshStream(graphText);
+  freshGraph.read(freshStream);
+  freshGraph.getProteinProbsAndNames(m, expectedNames, expectedProbs);
+  
+  ASSERT_EQ(5u, probs.size());
+  EXPECT_TRUE(expectedNames == names);
+  EXPECT_TRUE(expectedProbs == probs);
+}
+
+TEST(FidoParallelTest, ProteinProbsIndependentOfThreads) {
+  // many components of different sizes, such that the dynamic schedule
+  // hands them to the threads in a different order than they are stored
+  std::ostringstream graphText;
+  unsigned int seed = 5;
+  for (int c = 0; c < 60; ++c) {
+    int numProteins = 1 + c % 5;
+    for (int j = 0; j < 2 * numProteins; ++j) {
+      seed = seed * 1103515245u + 12345u;
+      graphText << "e PEP" << c << "_" << j << "\n";
+      graphText << "r PROT" << c << "_" << j % numProteins << "\n";
+      graphText << "r PROT" << c << "_" << (seed >> 8) % numProteins << "\n";
+      graphText << "p " << ((seed >> 12) % 1000) / 1000.0 << "\n";
+    }
+  }
+  
+  Model m(0.1, 0.01, 0.5);
+  std::vector<std::vector<std::string> > names[2], modelNames[2];
+  std::vector<double> probs[2], modelProbs[2];
+#ifdef _OPENMP
+  int maxThreads = omp_get_max_threads();
+#endif
+  for (int run = 0; run < 2; ++run) {
+#ifdef _OPENMP
+    omp_set_num_threads(run == 0 ? 1 : 4);
+#endif
+    std::istringstream graphStream(graphText.str());
+    GroupPowerBigraph graph(0.1, 0.01, 0.5);
+    graph.read(graphStream);
+    graph.getProteinProbsAndNames(m, modelNames[run], modelProbs[run]);
+    graph.setAlphaBetaGamma(m.alpha, m.beta, m.gamma);
+    graph.getProteinProbs();
+    graph.getProteinProbsAndNames(names[run], probs[run]);
+  }
+#ifdef _OPENMP
+  omp_set_num_threads(maxThreads);
+#endif
+  
+  ASSERT_GT(probs[0].size(), 60u);
+  EXPECT_TRUE(names[0] == names[1]);
+  EXPECT_TRUE(probs[0] == probs[1]);
+  EXPECT_TRUE(modelNames[0] == modelNames[1]);
+  EXPECT_TRUE(modelProbs[0] == modelProbs[1]);
+  EXPECT_TRUE(names[0] == modelNames[0]);
+}
@@ -0,0 +1,237 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Unit tests for the input stream that decompresses gzip and BGZF files,
+ * which has to read the same data as an uncompressed file.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "InputStream.h"
+#include "MyException.h"
+#include "ValidateTabFile.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+
+static std::string makePinLines(int numLines) {
+  std::ostringstream oss;
+  oss << "SpecId\tLabel\tScanNr\tfeature\tPeptide\tProteins\n";
+  for (int i = 0; i < numLines; ++i) {
+    oss << "psm_" << i << '\t' << (i % 3 == 0 ? -1 : 1) << '\t' << i << '\t'
+        << (i * 0.37) << "\tK.PEPTIDE" << i << ".R\tprot_" << i % 97 << '\n';
+  }
+  return oss.str();
+}
+
+static void writeGzip(const std::string& fileName, const std::string& data,
+                      int numMembers) {
+  std::size_t memberSize = data.size() / numMembers + 1u;
+  for (int member = 0; member < numMembers; ++member) {
+    gzFile file = gzopen(fileName.c_str(), member == 0 ? "wb" : "ab");
+    std::string part = data.substr(member * memberSize, memberSize);
+    gzwrite(file, part.data(), static_cast<unsigned>(part.size()));
+    gzclose(file);
+  }
+}
+
+static void putLittleEndian(std::string& out, unsigned int value, int n) {
+  for (int i = 0; i < n; ++i) out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+// writes data as BGZF blocks of at most blockSize bytes, ending with the
+// empty block that bgzip writes as end of file marker
+static void writeBgzf(const std::string& fileName, const std::string& data,
+                      std::size_t blockSize) {
+  std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+  for (std::size_t pos = 0; pos <= data.size(); pos += blockSize) {
+    std::size_t n = std::min(blockSize, data.size() - pos);
+    std::vector<unsigned char> deflated(compressBound(static_cast<uLong>(n)) + 64u);
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data() + pos));
+    strm.avail_in = static_cast<uInt>(n);
+    strm.next_out = deflated.data();
+    strm.avail_out = static_cast<uInt>(deflated.size());
+    deflate(&strm, Z_FINISH);
+    std::size_t deflatedSize = strm.total_out;
+    deflateEnd(&strm);
+
+    std::string block("\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0", 16);
+    putLittleEndian(block, static_cast<unsigned>(deflatedSize + 25u), 2);
+    block.append(reinterpret_cast<char*>(deflated.data()), deflatedSize);
+    putLittleEndian(block, static_cast<unsigned>(crc32(crc32(0L, Z_NULL, 0),
+        reinterpret_cast<const Bytef*>(data.data() + pos), static_cast<uInt>(n))), 4);
+    putLittleEndian(block, static_cast<unsigned>(n), 4);
+    file.write(block.data(), static_cast<std::streamsize>(block.size()));
+    if (n == 0u) break;
+  }
+}
+
+static std::string readAll(std::istream& is) {
+  std::ostringstream oss;
+  std::string line;
+  while (std::getline(is, line)) oss << line << '\n';
+  return oss.str();
+}
+
+TEST(InputStreamTest, CheckReadsConcatenatedGzipMembers)
+{
+  std::string data = makePinLines(100000);
+  std::string fileName = "input_stream_test.pin.gz";
+  writeGzip(fileName, data, 3);
+
+  InputStream is(fileName);
+  ASSERT_TRUE(is.is_open());
+  EXPECT_FALSE(is.hasRandomAccess());
+  EXPECT_EQ(data, readAll(is));
+  is.close();
+  remove(fileName.c_str());
+}
+
+TEST(InputStreamTest, CheckReadsBgzfBlocks)
+{
+  // more blocks than are decompressed in one batch
+  std::string data = makePinLines(100000);
+  std::string fileName = "input_stream_test.pin.bgz";
+  writeBgzf(fileName, data, 8192u);
+
+  InputStream is(fileName);
+  ASSERT_TRUE(is.is_open());
+  EXPECT_FALSE(is.hasRandomAccess());
+  EXPECT_EQ(data, readAll(is));
+  is.close();
+  remove(fileName.c_str());
+}
+
+TEST(InputStreamTest, CheckSeeksInDecompressedData)
+{
+  std::string data = makePinLines(100000);
+  std::string fileName = "input_stream_test_seek.pin.gz";
+  writeGzip(fileName, data, 1);
+
+  InputStream is(fileName);
+  std::string header, line, lineAgain;
+  std::getline(is, header);
+  std::streampos firstPsmPos = is.tellg();
+  EXPECT_EQ(static_cast<std::streamoff>(header.size() + 1u),
+            static_cast<std::streamoff>(firstPsmPos));
+  std::getline(is, line);
+
+  // beyond the first buffer of decompressed data, and back again
+  std::size_t farPos = data.size() - 100u;
+  is.seekg(static_cast<std::streamoff>(farPos), std::ios::beg);
+  EXPECT_EQ(data.substr(farPos), readAll(is));
+  is.clear();
+  is.seekg(firstPsmPos);
+  std::getline(is, lineAgain);
+  EXPECT_EQ(line, lineAgain);
+  is.close();
+  remove(fileName.c_str());
+}
+
+TEST(InputStreamTest, CheckReportsTruncatedFile)
+{
+  std::string data = makePinLines(100000);
+  std::string fileName = "input_stream_test_truncated.pin.gz";
+  writeGzip(fileName, data, 1);
+  std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+  std::string compressed((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  in.close();
+  std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary);
+  out.write(compressed.data(), static_cast<std::streamsize>(compressed.size() / 2));
+  out.close();
+
+  InputStream is(fileName);
+  EXPECT_THROW(readAll(is), MyException);
+  is.close();
+  remove(fileName.c_str());
+}
+#endif
+
+TEST(InputStreamTest, CheckReadsUncompressedFile)
+{
+  std::string data = "SpecId\tLabel\npsm_1\t1\npsm_2\t-1\n";
+  std::string fileName = "input_stream_test.pin";
+  std::ofstream out(fileName.c_str());
+  out << data;
+  out.close();
+
+  InputStream is(fileName);
+  ASSERT_TRUE(is.is_open());
+  EXPECT_TRUE(is.hasRandomAccess());
+  EXPECT_EQ(data, readAll(is));
+  is.close();
+  remove(fileName.c_str());
+
+  InputStream missing("input_stream_test_missing.pin");
+  EXPECT_FALSE(missing.is_open());
+  EXPECT_TRUE(missing.fail());
+}
+
+TEST(InputStreamTest, CheckMergesMultiplePins)
+{
+  std::vector<std::string> fileNames;
+  fileNames.push_back("input_stream_test_merge_a.pin");
+  fileNames.push_back("input_stream_test_merge_b.pin");
+  std::ofstream a(fileNames[0].c_str());
+  a << "SpecId\tLabel\tCharge2\tCharge3\tPeptide\tProteins\n"
+    << "DefaultDirection\t-\t0\t0\n"
+    << "psm_1\t1\t1\t0\tK.PEPTIDE.R\tprot_1\n";
+  a.close();
+  // lacks the Charge2 column and repeats the default direction
+  std::ofstream b(fileNames[1].c_str());
+  b << "SpecId\tLabel\tCharge3\tPeptide\tProteins\n"
+    << "DefaultDirection\t-\t0\n"
+    << "psm_2\t-1\t1\tK.EDITPEP.R\tprot_2\tprot_3\n";
+  b.close();
+
+  ValidateTabFile validateTab;
+  InputStream is;
+  is.open(validateTab.openMultiplePINs(fileNames));
+  EXPECT_FALSE(is.hasRandomAccess());
+  std::string merged = "SpecId\tLabel\tCharge2\tCharge3\tPeptide\tProteins\t\n"
+      "DefaultDirection\t-\t0\t0\n"
+      "psm_1\t1\t1\t0\tK.PEPTIDE.R\tprot_1\n"
+      "psm_2\t-1\t0\t1\tK.EDITPEP.R\tprot_2\tprot_3\t\n";
+  EXPECT_EQ(merged, readAll(is));
+  // rewinding reads the files again
+  is.clear();
+  is.seekg(0, std::ios::beg);
+  EXPECT_EQ(merged, readAll(is));
+  is.close();
+  // the exception mask of the producer does not outlive it, and a failed
+  // open does not carry over to the next one
+  EXPECT_EQ(std::ios::goodbit, is.exceptions());
+  EXPECT_NO_THROW(is.open("input_stream_test_missing.pin"));
+  EXPECT_TRUE(is.fail());
+  is.open(validateTab.openMultiplePINs(fileNames));
+  EXPECT_TRUE(is.good());
+  EXPECT_EQ(merged, readAll(is));
+  is.close();
+  EXPECT_EQ(std::ios::goodbit, is.exceptions());
+  remove(fileNames[0].c_str());
+  remove(fileNames[1].c_str());
+}
@@ -0,0 +1,94 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Unit tests for the buffered writer of the result files, whose output
+ * has to be identical to streaming the same values.
+ */
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <sstream>
+#include <string>
+#include "ResultWriter.h"
+
+TEST(ResultWriterTest, CheckFormatDoubleMatchesPrintf)
+{
+    std::vector<double> values;
+    values.push_back(0.0);
+    values.push_back(-0.0);
+    values.push_back(1.0);
+    values.push_back(0.5);
+    values.push_back(2.5);
+    values.push_back(-1.5e-300);
+    values.push_back(123456.5);
+    values.push_back(999999.5);
+    values.push_back(9.9999949999e-5);
+    values.push_back(0.0001);
+    values.push_back(1e21);
+    values.push_back(1e-7);
+    values.push_back(std::numeric_limits<double>::max());
+    values.push_back(std::numeric_limits<double>::denorm_min());
+    values.push_back(std::numeric_limits<double>::infinity());
+    values.push_back(std::numeric_limits<double>::quiet_NaN());
+    // scores, q-values and PEPs span many orders of magnitude
+    double x = 0.123456789;
+    for (int i = 0 ; i < 20000 ; ++i) {
+        x = x * 3.9 * (1.0 - x);
+        int exponent = (i % 41) - 20;
+        values.push_back((i % 2 ? -x : x) * std::pow(10.0, exponent));
+        // values with few significant digits and their neighbours
+        double rounded = std::floor(x * 1000.0) / 1000.0;
+        values.push_back(rounded);
+        values.push_back(std::nextafter(rounded + 0.0005, 1.0));
+    }
+
+    char expected[64], actual[32];
+    int precisions[] = {1, 3, 6, 10, 15, 17};
+    for (std::size_t p = 0 ; p < sizeof(precisions) / sizeof(int) ; ++p) {
+        for (std::size_t ix = 0 ; ix < values.size() ; ++ix) {
+            snprintf(expected, sizeof(expected), "%.*g", precisions[p], values[ix]);
+            std::size_t length = ResultWriter::formatDouble(values[ix], precisions[p], actual);
+            ASSERT_EQ(std::string(expected), std::string(actual, length))
+                << "precision " << precisions[p];
+        }
+    }
+}
+
+TEST(ResultWriterTest, CheckOutputMatchesStream)
+{
+    bool backgroundWriting = ResultWriter::getBackgroundWriting();
+    for (int background = 0 ; background < 2 ; ++background) {
+        ResultWriter::setBackgroundWriting(background != 0);
+        std::ostringstream expected, actual;
+        {
+            // a small buffer to hand over many buffers
+            ResultWriter writer(actual, 64u);
+            for (int i = 0 ; i < 1000 ; ++i) {
+                double score = std::sin(i * 0.37) * std::pow(10.0, i % 9 - 4);
+                expected << "psm_" << i << '\t' << -i << '\t' << (unsigned int)i
+                         << '\t' << score << '\t' << 1.0 / (i + 1) << "\n";
+                writer << "psm_" << i
+                       << '\t' << -i << '\t' << (unsigned int)i << '\t' << score
+                       << '\t' << 1.0 / (i + 1);
+                writer.endRow();
+            }
+        }
+        EXPECT_EQ(expected.str(), actual.str());
+    }
+    ResultWriter::setBackgroundWriting(backgroundWriting);
+}
@@ -21,9 +21,17 @@
 
 #include <gtest/gtest.h>
 #include <cstdarg>
+#include <stdexcept>
 #include "SetHandler.h"
 #include "DataSet.h"
 #include "Scores.h"
+#include "BatchScorer.h"
+#include "ssl.h"
+#include "PosteriorEstimator.h"
+#include "TargetDecoyStatistics.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // Some strings in alphabetical order.
 static std::string const psmNames[] = { "ABC", "DEF", "GHI", "JKL", "MNO" };
@@ -59,13 +67,13 @@ TEST_F(ScoreHolderTest, CheckOrderingFunctions)
     // scan values are assigned [ 2, 3, 4, 0, 1 ]
     scores.clear();
     for (int i = 0 ; i < 5 ; ++i) {
-        PSMDescription *pPSM = new PSMDescription(psmNames[i]);
+        PSMDescription *pPSM = new PSMDescription("K." + psmNames[i] + ".R");
         pPSM->scan = (i + 2) % 5;
         scores.push_back(ScoreHolder(1.0 + i, +1, pPSM));
     }
-    std::sort(scores.begin(), scores.end(), lexicOrderProb());
+    sortByKeys<PeptideKey>(scores, LexicOrderPeptideKey());
     ASSERT_TRUE(checkOrder(&scores, 1.0, 2.0, 3.0, 4.0, 5.0));
-    std::sort(scores.begin(), scores.end(), OrderScanMassCharge());
+    sortByKeys<SpectrumKey>(scores, OrderSpectrumMassKey());
     ASSERT_TRUE(checkOrder(&scores, 4.0, 5.0, 1.0, 2.0, 3.0));
     
     // specFileNr values are assigned [ 3, 3, 4, 4, 5]
@@ -77,7 +85,7 @@ TEST_F(ScoreHolderTest, CheckOrderingFunctions)
         pPSM->scan = i / 2;
         scores.push_back(ScoreHolder(1.0 + i, +1, pPSM));
     }
-    std::sort(scores.begin(), scores.end(), OrderScanHash());
+    sortByKeys<ScanHashKey>(scores, std::less<ScanHashKey>());
     for (int i = 0 ; i < 5 ; ++i) {
         std::cerr << scores.at(i).score << std::endl;
     }
@@ -92,7 +100,7 @@ TEST_F(ScoreHolderTest, CheckOrderingFunctions)
         pPSM->scan = (i + 2) % 5;
         scores.push_back(ScoreHolder(1.0 + i, +1, pPSM));
     }
-    std::sort(scores.begin(), scores.end(), OrderScanMassCharge());
+    sortByKeys<SpectrumKey>(scores, OrderSpectrumMassKey());
     ASSERT_TRUE(checkOrder(&scores, 1.0, 2.0, 4.0, 3.0, 5.0));
 
     // scan values are assigned [ 2, 2, 1, 1, 0 ]
@@ -157,6 +165,165 @@ TEST_F(ScoreHolderTest, CheckUniquenessFilter)
 }
 
 
+// The ScoreHolder comparators that sorted the ScoreHolders before they were
+// sorted through keys, as references for the key comparators
+struct RefGreater {
+    bool operator()(const ScoreHolder& one, const ScoreHolder& other) const {
+        return (one.score > other.score) || (one.score == other.score && one.pPSM->scan > other.pPSM->scan) || (one.score == other.score && one.pPSM->scan == other.pPSM->scan && one.pPSM->expMass > other.pPSM->expMass) || (one.score == other.score && one.pPSM->scan == other.pPSM->scan && one.pPSM->expMass == other.pPSM->expMass && one.label > other.label);
+    }
+};
+
+struct RefLess {
+    bool operator()(const ScoreHolder& one, const ScoreHolder& other) const {
+        return (one.score < other.score) || (one.score == other.score && one.pPSM->scan < other.pPSM->scan) || (one.score == other.score && one.pPSM->scan == other.pPSM->scan && one.pPSM->expMass < other.pPSM->expMass) || (one.score == other.score && one.pPSM->scan == other.pPSM->scan && one.pPSM->expMass == other.pPSM->expMass && one.label < other.label);
+    }
+};
+
+struct RefLexicOrderProb {
+    static int compStrIt(const char* first1, const char* last1,
+                         const char* first2, const char* last2) {
+        for ( ; (first1 != last1) && (first2 != last2); first1++, first2++ ) {
+            if (*first1 < *first2) return 1;
+            if (*first2 < *first1) return -1;
+        }
+        if (first2 != last2) return 1;
+        else if (first1 != last1) return -1;
+        else return 0;
+    }
+    bool operator()(const ScoreHolder& x, const ScoreHolder& y) const {
+        const char* xPeptide = x.pPSM->getFullPeptideSequence();
+        const char* yPeptide = y.pPSM->getFullPeptideSequence();
+        int peptCmp = compStrIt(xPeptide + 2,
+                                xPeptide + x.pPSM->getFullPeptideLength() - 2,
+                                yPeptide + 2,
+                                yPeptide + y.pPSM->getFullPeptideLength() - 2);
+        return ( ( peptCmp == 1 )
+        || ( (peptCmp == 0) && (x.label > y.label) )
+        || ( (peptCmp == 0) && (x.label == y.label) && (x.score > y.score) ) );
+    }
+};
+
+struct RefOrderScanHash {
+    bool operator()(const ScoreHolder& x, const ScoreHolder& y) const {
+        size_t hash_x = fast_uint_hash(x.pPSM->specFileNr) ^ (fast_uint_hash(x.pPSM->scan) << 1);
+        size_t hash_y = fast_uint_hash(y.pPSM->specFileNr) ^ (fast_uint_hash(y.pPSM->scan) << 1);
+        return (hash_x < hash_y);
+    }
+};
+
+struct RefOrderScanMassCharge {
+    bool operator()(const ScoreHolder& x, const ScoreHolder& y) const {
+        return ( (x.pPSM->specFileNr < y.pPSM->specFileNr )
+        || ( (x.pPSM->specFileNr == y.pPSM->specFileNr) && (x.pPSM->scan < y.pPSM->scan) )
+        || ( (x.pPSM->specFileNr == y.pPSM->specFileNr) && (x.pPSM->scan == y.pPSM->scan) && (x.pPSM->expMass < y.pPSM->expMass) )
+        || ( (x.pPSM->specFileNr == y.pPSM->specFileNr) && (x.pPSM->scan == y.pPSM->scan) && (x.pPSM->expMass == y.pPSM->expMass)
+           && (x.score > y.score) ) );
+    }
+};
+
+struct RefOrderScanMassLabelCharge {
+    bool operator()(const ScoreHolder& x, const ScoreHolder& y) const {
+        return ( (x.pPSM->specFileNr < y.pPSM->specFileNr )
+        || ( (x.pPSM->specFileNr == y.pPSM->specFileNr) && (x.pPSM->scan < y.pPSM->scan) )
+        || ( (x.pPSM->specFileNr == y.pPSM->specFileNr) && (x.pPSM->scan == y.pPSM->scan) && (x.pPSM->expMass < y.pPSM->expMass) )
+        || ( (x.pPSM->specFileNr == y.pPSM->specFileNr) && (x.pPSM->scan == y.pPSM->scan) && (x.pPSM->expMass == y.pPSM->expMass)
+           && (x.label > y.label) )
+        || ( (x.pPSM->specFileNr == y.pPSM->specFileNr) && (x.pPSM->scan == y.pPSM->scan) && (x.pPSM->expMass == y.pPSM->expMass)
+           && (x.label == y.label) && (x.score > y.score) ) );
+    }
+};
+
+struct RefUniqueScanMassCharge {
+    bool operator()(const ScoreHolder& x, const ScoreHolder& y) const {
+        return (x.pPSM->specFileNr == y.pPSM->specFileNr) && (x.pPSM->scan == y.pPSM->scan) && (x.pPSM->expMass == y.pPSM->expMass);
+    }
+};
+
+struct RefUniqueScanMassLabelCharge {
+    bool operator()(const ScoreHolder& x, const ScoreHolder& y) const {
+        return (x.pPSM->specFileNr == y.pPSM->specFileNr) && (x.pPSM->scan == y.pPSM->scan) && (x.label == y.label) && (x.pPSM->expMass == y.pPSM->expMass);
+    }
+};
+
+// Same PSMs in the same order
+static bool samePsms(const std::vector<ScoreHolder>& expected,
+                     const std::vector<ScoreHolder>& actual)
+{
+    if (expected.size() != actual.size())
+        return false;
+    for (std::size_t ix = 0 ; ix < expected.size() ; ++ix) {
+        if (expected[ix].pPSM != actual[ix].pPSM)
+            return false;
+    }
+    return true;
+}
+
+// Verify that sorting through the keys gives exactly the order of the
+// ScoreHolder comparators, also among tied scores and PSMs of the same
+// spectrum and mass, which are left in the order std::sort leaves them.
+// Peptides with tied scores keep their relative order.
+TEST_F(ScoreHolderTest, CheckKeysOrderLikeComparators)
+{
+    static std::string const peptides[] = {
+        "K.ABC.R", "R.ABC.K", "K.AB.R", "K.ABCD.R", "-.BA.-" };
+    std::vector<ScoreHolder> scores;
+    unsigned int seed = 7;
+    for (int i = 0 ; i < 3000 ; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        unsigned int r = seed >> 8;
+        PSMDescription *pPSM = new PSMDescription(peptides[r % 5]);
+        pPSM->specFileNr = (r >> 3) % 3;
+        pPSM->scan = (r >> 5) % 40;
+        pPSM->expMass = 500.0 + 0.5 * ((r >> 11) % 2);
+        scores.push_back(ScoreHolder(((r >> 12) % 8) / 4.0, (r >> 15) % 2 ? +1 : -1, pPSM));
+    }
+
+    std::vector<ScoreHolder> expected(scores), actual(scores);
+    std::sort(expected.begin(), expected.end(), RefGreater());
+    sortByKeys<ScanMassKey>(actual, GreaterScanMassKey());
+    EXPECT_TRUE(samePsms(expected, actual));
+
+    expected = scores;
+    actual = scores;
+    std::sort(expected.begin(), expected.end(), RefLess());
+    sortByKeys<ScanMassKey>(actual, LessScanMassKey());
+    EXPECT_TRUE(samePsms(expected, actual));
+
+    expected = scores;
+    actual = scores;
+    std::stable_sort(expected.begin(), expected.end(), RefLexicOrderProb());
+    sortByKeys<PeptideKey>(actual, LexicOrderPeptideKey());
+    EXPECT_TRUE(samePsms(expected, actual));
+
+    expected = scores;
+    actual = scores;
+    std::sort(expected.begin(), expected.end(), RefOrderScanHash());
+    sortByKeys<ScanHashKey>(actual, std::less<ScanHashKey>());
+    EXPECT_TRUE(samePsms(expected, actual));
+
+    expected = scores;
+    actual = scores;
+    std::sort(expected.begin(), expected.end(), RefOrderScanMassCharge());
+    expected.erase(std::unique(expected.begin(), expected.end(),
+                               RefUniqueScanMassCharge()), expected.end());
+    sortUniqueByKeys<SpectrumKey>(actual, OrderSpectrumMassKey(),
+                                  UniqueSpectrumMassKey());
+    EXPECT_EQ(3u * 40u * 2u, actual.size());
+    EXPECT_TRUE(samePsms(expected, actual));
+
+    expected = scores;
+    actual = scores;
+    std::sort(expected.begin(), expected.end(), RefOrderScanMassLabelCharge());
+    expected.erase(std::unique(expected.begin(), expected.end(),
+                               RefUniqueScanMassLabelCharge()), expected.end());
+    sortUniqueByKeys<SpectrumKey>(actual, OrderSpectrumMassLabelKey(),
+                                  UniqueSpectrumMassLabelKey());
+    EXPECT_TRUE(samePsms(expected, actual));
+
+    for (std::size_t ix = 0 ; ix < scores.size() ; ++ix)
+        delete scores[ix].pPSM;
+}
+
 class ScoresTest : public ::testing::Test {
   protected:
     virtual void SetUp();
@@ -222,3 +389,279 @@ TEST_F(ScoresTest, CheckPopulatingEmpty)
     setHandler.push_back_dataset(set2);
     EXPECT_THROW(scores.populateWithPSMs(setHandler), MyException);
 }
+
+// Verify that counting the positives without sorting the PSMs agrees
+// with the full calculation, and that the q-values of the full
+// calculation match PosteriorEstimator::getQValues, also for tied scores.
+TEST_F(ScoresTest, CheckNumPositivesMatchFullCalculation)
+{
+    FeatureNames::setNumFeatures(1);
+    SetHandler setHandler(0);
+    DataSet *targets = new DataSet();
+    DataSet *decoys = new DataSet();
+    targets->setLabel(+1);
+    decoys->setLabel(-1);
+    unsigned int scanNumber = 1;
+    for (int i = 0 ; i < 600 ; ++i) {
+        PSMDescription *psm = new PSMDescription();
+        psm->features = new double[1];
+        psm->features[0] = (i % 53) / 10.0;
+        psm->scan = scanNumber++;
+        targets->registerPsm(psm);
+    }
+    for (int i = 0 ; i < 400 ; ++i) {
+        PSMDescription *psm = new PSMDescription();
+        psm->features = new double[1];
+        psm->features[0] = (i % 31) / 10.0 - 0.5;
+        psm->scan = scanNumber++;
+        decoys->registerPsm(psm);
+    }
+    setHandler.push_back_dataset(targets);
+    setHandler.push_back_dataset(decoys);
+
+    Scores fast(false), full(false);
+    fast.populateWithPSMs(setHandler);
+    full.populateWithPSMs(setHandler);
+    std::vector<double> w(2);
+    w[0] = 1.0;
+    w[1] = 0.0;
+    for (int skip = 0 ; skip < 2 ; ++skip) {
+        for (double fdr = 0.01 ; fdr < 0.5 ; fdr *= 2.0) {
+            int numFast = fast.calcNumPositives(w, fdr, skip != 0);
+            int numFull = full.calcScores(w, fdr, skip != 0);
+            EXPECT_EQ(numFull, numFast);
+
+            std::vector<std::pair<double, bool> > combined;
+            for (std::vector<ScoreHolder>::const_iterator it = full.begin() ;
+                    it != full.end() ; ++it) {
+                combined.push_back(it->toPair());
+                if (it != full.begin())
+                    ASSERT_GE((it - 1)->score, it->score);
+            }
+            std::vector<double> q;
+            PosteriorEstimator::setNegative(true);
+            PosteriorEstimator::getQValues(1.0, combined, q, skip != 0);
+            ASSERT_EQ(q.size(), full.size());
+            for (std::size_t ix = 0 ; ix < q.size() ; ++ix)
+                ASSERT_EQ(q[ix], (full.begin() + ix)->q);
+        }
+    }
+}
+
+// Verify that the bootstrapped pi0 estimate depends only on the seed and
+// not on the number of threads drawing the replicates.
+TEST(PosteriorEstimatorTest, CheckPi0IndependentOfThreadCount)
+{
+    std::vector<double> p;
+    for (int i = 0 ; i < 5000 ; ++i) {
+        // mixture of uniform null p-values and small true positive ones
+        double u = (i * 0.6180339887) - static_cast<int>(i * 0.6180339887);
+        p.push_back(i % 3 == 0 ? u * u * u * 0.01 : u);
+    }
+    std::sort(p.begin(), p.end());
+#ifdef _OPENMP
+    int maxThreads = omp_get_max_threads();
+#endif
+    std::vector<double> pi0s;
+    for (int numThreads = 1 ; numThreads <= 4 ; numThreads *= 2) {
+#ifdef _OPENMP
+        omp_set_num_threads(numThreads);
+#endif
+        PseudoRandom::setSeed(1);
+        pi0s.push_back(PosteriorEstimator::estimatePi0(p));
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(maxThreads);
+#endif
+    EXPECT_GT(pi0s[0], 0.55);
+    EXPECT_LT(pi0s[0], 0.8);
+    for (std::size_t ix = 1 ; ix < pi0s.size() ; ++ix)
+        EXPECT_EQ(pi0s[0], pi0s[ix]);
+}
+
+// Verify that the fused statistics on a single column agree with the
+// separate calculations of PosteriorEstimator, also for tied scores.
+TEST(TargetDecoyStatisticsTest, CheckMatchesPosteriorEstimator)
+{
+    std::vector<std::pair<double, bool> > combined;
+    for (int i = 0 ; i < 3000 ; ++i) {
+        double u = (i * 0.7548776662) - static_cast<int>(i * 0.7548776662);
+        bool isTarget = (i % 5 != 0 && i % 7 != 0);
+        double score = static_cast<int>(u * 40.0) / 10.0;
+        if (isTarget && i % 3 == 0) score += 2.0;
+        combined.push_back(std::make_pair(score, isTarget));
+    }
+    std::sort(combined.rbegin(), combined.rend());
+
+    TargetDecoyStatistics statistics;
+    statistics.resize(combined.size());
+    for (std::size_t ix = 0 ; ix < combined.size() ; ++ix)
+        statistics.set(ix, combined[ix].first, combined[ix].second);
+
+    std::vector<double> expected, actual;
+    PosteriorEstimator::getPValues(combined, expected);
+    statistics.calcPValues(actual);
+    EXPECT_EQ(expected, actual);
+
+    for (int usePi0 = 0 ; usePi0 < 2 ; ++usePi0) {
+        double pi0 = usePi0 ? 0.7 : 1.0;
+        PosteriorEstimator::setNegative(usePi0 != 0);
+        expected.clear();
+        PosteriorEstimator::getQValues(pi0, combined, expected);
+        statistics.calcQValues(pi0, usePi0 != 0, false, actual);
+        EXPECT_EQ(expected, actual);
+
+        PosteriorEstimator::estimatePEP(combined, usePi0 != 0, pi0, expected, true);
+        statistics.calcPEPs(usePi0 != 0, pi0, actual);
+        EXPECT_EQ(expected, actual);
+    }
+    PosteriorEstimator::setNegative(true);
+}
+
+// Verify the q-values without the decoy plus one of target-decoy
+// competition. For pi0 = 1 they are those of PosteriorEstimator, also when
+// assigned directly to the records. For pi0 < 1, where getQValues throws
+// std::out_of_range, the mix-max counts are taken at the tied group itself.
+TEST(TargetDecoyStatisticsTest, CheckQValuesSkippingDecoysPlusOne)
+{
+    double const scores[] = { 6.0, 5.0, 4.0, 3.0, 2.0, 1.0 };
+    bool const isTarget[] = { true, false, true, false, false, true };
+    std::vector<std::pair<double, bool> > combined;
+    std::vector<ScoreHolder> records;
+    TargetDecoyStatistics statistics;
+    statistics.resize(6u);
+    for (std::size_t ix = 0 ; ix < 6u ; ++ix) {
+        combined.push_back(std::make_pair(scores[ix], isTarget[ix]));
+        records.push_back(ScoreHolder(scores[ix], isTarget[ix] ? 1 : -1));
+        statistics.set(ix, scores[ix], isTarget[ix]);
+    }
+
+    std::vector<double> expected, actual;
+    PosteriorEstimator::setNegative(true);
+    PosteriorEstimator::getQValues(1.0, combined, expected, true);
+    statistics.calcQValues(1.0, true, true, actual);
+    EXPECT_EQ(expected, actual);
+    EXPECT_EQ(2, statistics.assignQValues(records, 1.0, true, 0.6));
+    for (std::size_t ix = 0 ; ix < 6u ; ++ix)
+        EXPECT_EQ(expected[ix], records[ix].q);
+
+    expected.clear();
+    EXPECT_THROW(PosteriorEstimator::getQValues(0.25, combined, expected, true),
+                 std::out_of_range);
+    double const qValues[] = { 0.0, 1.0 / 3.0, 1.0 / 3.0, 7.0 / 12.0,
+                               13.0 / 18.0, 13.0 / 18.0 };
+    statistics.calcQValues(0.25, true, true, actual);
+    ASSERT_EQ(6u, actual.size());
+    for (std::size_t ix = 0 ; ix < 6u ; ++ix)
+        EXPECT_NEAR(qValues[ix], actual[ix], 1e-12);
+}
+
+// Verify that the views on the cross validation folds contain the same
+// PSMs as the copied folds of createXvalSetsBySpectrum.
+TEST_F(ScoresTest, CheckFoldViewsMatchCopiedFolds)
+{
+    FeatureNames::setNumFeatures(1);
+    SetHandler setHandler(0);
+    DataSet *targets = new DataSet();
+    DataSet *decoys = new DataSet();
+    targets->setLabel(+1);
+    decoys->setLabel(-1);
+    for (int i = 0 ; i < 300 ; ++i) {
+        PSMDescription *psm = new PSMDescription();
+        psm->features = new double[1];
+        psm->features[0] = (i % 53) / 10.0;
+        psm->scan = static_cast<unsigned int>(i / 2);
+        targets->registerPsm(psm);
+    }
+    for (int i = 0 ; i < 200 ; ++i) {
+        PSMDescription *psm = new PSMDescription();
+        psm->features = new double[1];
+        psm->features[0] = (i % 31) / 10.0 - 0.5;
+        psm->scan = static_cast<unsigned int>(i);
+        decoys->registerPsm(psm);
+    }
+    setHandler.push_back_dataset(targets);
+    setHandler.push_back_dataset(decoys);
+
+    unsigned int const numFolds = 3;
+    Scores viewed(false), copied(false);
+    viewed.populateWithPSMs(setHandler);
+    copied.populateWithPSMs(setHandler);
+    PseudoRandom::setSeed(1);
+    viewed.assignXvalFoldsBySpectrum(numFolds);
+    std::vector<Scores> train, test;
+    FeatureMemoryPool featurePool;
+    PseudoRandom::setSeed(1);
+    copied.createXvalSetsBySpectrum(train, test, numFolds, featurePool);
+    ASSERT_EQ(numFolds, train.size());
+
+    std::vector<double> w(2);
+    w[0] = 1.0;
+    w[1] = 0.0;
+    std::vector<const std::vector<double>*> weights(1, &w);
+    for (unsigned int fold = 0 ; fold < numFolds ; ++fold) {
+        std::vector<int> numViewed, numCopied;
+        ScoresFoldView(viewed, fold, true).calcNumPositives(weights, 0.1,
+                                                            false, numViewed);
+        test[fold].calcNumPositives(weights, 0.1, false, numCopied);
+        EXPECT_EQ(numCopied, numViewed);
+
+        AlgIn viewedInput(500, 2), copiedInput(500, 2);
+        ScoresFoldView(viewed, fold, false).generateNegativeTrainingSet(
+            viewedInput, 1.0);
+        train[fold].generateNegativeTrainingSet(copiedInput, 1.0);
+        EXPECT_EQ(copiedInput.negatives, viewedInput.negatives);
+        EXPECT_EQ(static_cast<int>(train[fold].negSize()),
+                  viewedInput.negatives);
+    }
+}
+
+// Verify that every available scoring kernel reproduces the scalar
+// scores exactly, including the rows that do not fill a whole tile.
+TEST(BatchScorerTest, CheckKernelsMatchScalarScores)
+{
+    const std::size_t numRows = 37, numFeatures = 23, numWeights = 3;
+    std::vector< std::vector<double> > features(numRows,
+        std::vector<double>(numFeatures));
+    std::vector< std::vector<double> > weights(numWeights,
+        std::vector<double>(numFeatures + 1));
+    unsigned int seed = 1;
+    for (std::size_t i = 0 ; i < numRows ; ++i) {
+        for (std::size_t j = 0 ; j < numFeatures ; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            features[i][j] = (seed % 20011) / 997.0 - 10.0;
+        }
+    }
+    for (std::size_t k = 0 ; k < numWeights ; ++k) {
+        for (std::size_t j = 0 ; j <= numFeatures ; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            weights[k][j] = (seed % 30011) / 3001.0 - 5.0;
+        }
+    }
+
+    std::vector<const double*> rows, weightPtrs;
+    for (std::size_t i = 0 ; i < numRows ; ++i)
+        rows.push_back(&features[i][0]);
+    for (std::size_t k = 0 ; k < numWeights ; ++k)
+        weightPtrs.push_back(&weights[k][0]);
+
+    const BatchScorer::InstructionSet instructionSets[] = {
+        BatchScorer::SCALAR, BatchScorer::AVX2, BatchScorer::AVX512 };
+    for (int s = 0 ; s < 3 ; ++s) {
+        if (!BatchScorer::isSupported(instructionSets[s]))
+            continue;
+        std::vector<double> scores(numRows * numWeights);
+        BatchScorer::scoreRows(&rows[0], numRows, numFeatures,
+            &weightPtrs[0], numWeights, &scores[0], instructionSets[s]);
+        for (std::size_t k = 0 ; k < numWeights ; ++k) {
+            for (std::size_t i = 0 ; i < numRows ; ++i) {
+                std::size_t ix = numFeatures;
+                double score = weights[k][ix];
+                for (; ix-- ;)
+                    score += features[i][ix] * weights[k][ix];
+                ASSERT_EQ(score, scores[k * numRows + i])
+                    << BatchScorer::getName(instructionSets[s]);
+            }
+        }
+    }
+}
@@ -17,6 +17,9 @@
 
 #include <gtest/gtest.h>
 #include <sstream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "SetHandler.h"
 
 /* A simple class that tracks global deletions.
@@ -161,3 +164,90 @@ TEST_F(SetHandlerTest, TestReadWithFeatures)
             "id05\t-1\t3838.10\t2837.188\t0.021003\t0.021003\tPEP\tPRO\n"
             "id06\t-1\t2182.15\t2182.175\t-0.02667\t0.026670\tPEP\tPRO\n"));
 }
+
+// Verify that PSMs read back from the binary PIN cache are identical to
+// the ones parsed from the tab delimited input file.
+TEST_F(SetHandlerTest, TestPinCacheRoundTrip)
+{
+    Globals::getInstance()->setVerbose(0);
+    std::string pinFN = ::testing::TempDir() + "pincache_test.pin";
+    std::remove(PinCache::getCacheFN(pinFN).c_str());
+    {
+        std::ofstream pinStream(pinFN.c_str());
+        pinStream << "id\tLabel\tScanNr\tExpMass\tf1\tf2\tPeptide\tProteins\n"
+                     "id01\t1\t1\t1324.73\t0.5\t-1.25\tK.PEPTIDE.R\tPROT1\tPROT2\n"
+                     "id02\t-1\t1\t1324.73\t0.25\t3\tK.EDITPEP.R\tdecoy_PROT1\n"
+                     "id03\t1\t2\t3709.60\t1e-3\t7.5\tK.PEPTIDE.R\tPROT2\n";
+    }
+    std::vector<std::vector<double> > features[2];
+    std::vector<std::string> ids[2], proteins[2];
+    for (int run = 0; run < 2; ++run) {
+        SetHandler sh(0);
+        sh.setPinCacheFN(pinFN);
+        std::ifstream pinStream(pinFN.c_str());
+        SanityCheck *pCheck = NULL;
+        EXPECT_EQ(1, sh.readTab(pinStream, pCheck));
+        EXPECT_FALSE(pCheck->concatenatedSearch());
+        delete pCheck;
+        EXPECT_EQ(2u, sh.getSubsetFromLabel(1)->getSize());
+        EXPECT_EQ(1u, sh.getSubsetFromLabel(-1)->getSize());
+        for (unsigned int ix = 0; ix < 2u; ++ix) {
+            const std::vector<PSMDescription*>& psms = sh.getSubset(ix)->getPsms();
+            for (size_t jx = 0; jx < psms.size(); ++jx) {
+                features[run].push_back(std::vector<double>(
+                    psms[jx]->features, psms[jx]->features + 2));
+                ids[run].push_back(psms[jx]->getId());
+                for (size_t kx = 0; kx < psms[jx]->proteinIds.size(); ++kx) {
+                    proteins[run].push_back(PSMDescription::getProteinName(psms[jx]->proteinIds[kx]));
+                }
+            }
+        }
+        std::ifstream cacheStream(PinCache::getCacheFN(pinFN).c_str());
+        EXPECT_TRUE(cacheStream.good());
+    }
+    EXPECT_EQ(features[0], features[1]);
+    EXPECT_EQ(ids[0], ids[1]);
+    EXPECT_EQ(proteins[0], proteins[1]);
+    EXPECT_EQ(4u, proteins[1].size());
+    std::remove(PinCache::getCacheFN(pinFN).c_str());
+    std::remove(pinFN.c_str());
+}
+
+// Verify that the chunked reader registers PSMs, default scan numbers and
+// spectrum file names in file order, independent of the number of threads.
+TEST_F(SetHandlerTest, TestReadOrderIndependentOfThreads)
+{
+    Globals::getInstance()->setVerbose(0);
+    std::ostringstream input;
+    input << "id\tLabel\tFileName\tf1\tPeptide\tProteins\n";
+    for (int ix = 0; ix < 200; ++ix) {
+        input << "id" << ix << '\t' << (ix % 3 == 0 ? -1 : 1) << "\tfile"
+              << (ix * 7) % 5 << '\t' << ix << "\tK.PEPTIDE.R\tPROT\n";
+    }
+    std::vector<std::string> readOrder[2];
+#ifdef _OPENMP
+    int maxThreads = omp_get_max_threads();
+#endif
+    for (int run = 0; run < 2; ++run) {
+#ifdef _OPENMP
+        omp_set_num_threads(run == 0 ? 1 : 4);
+#endif
+        SetHandler sh(0);
+        EXPECT_TRUE(testInput(&sh, input.str().c_str()));
+        for (unsigned int ix = 0; ix < 2u; ++ix) {
+            const std::vector<PSMDescription*>& psms = sh.getSubset(ix)->getPsms();
+            for (size_t jx = 0; jx < psms.size(); ++jx) {
+                std::ostringstream psm;
+                psm << psms[jx]->getId() << ' ' << psms[jx]->scan << ' '
+                    << psms[jx]->specFileNr << ' ' << psms[jx]->features[0];
+                readOrder[run].push_back(psm.str());
+            }
+        }
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(maxThreads);
+#endif
+    EXPECT_EQ(200u, readOrder[0].size());
+    EXPECT_EQ("id1 3 1 1", readOrder[0][0]);
+    EXPECT_EQ(readOrder[0], readOrder[1]);
+}
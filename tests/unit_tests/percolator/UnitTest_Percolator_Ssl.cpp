@@ -0,0 +1,211 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Unit tests for the training input and the line search of the L2-SVM-MFN
+ * solver.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <vector>
+#include "ssl.h"
+
+// Rows have to survive the growth of the matrix, start at 64-byte
+// boundaries and end with the bias term
+TEST(AlgInTest, CheckRowsSurviveGrowth)
+{
+    int const numFeatures = 11;
+    AlgIn svmInput(1000, numFeatures);
+    EXPECT_EQ(16, svmInput.rowStride);
+    std::vector<double> features(numFeatures - 1);
+    int numRows = 0;
+    for (int capacity = 1 ; capacity <= 1000 ; capacity = capacity * 3 + 1) {
+        svmInput.reserveRows(capacity);
+        for ( ; numRows < capacity ; ++numRows) {
+            for (int j = 0 ; j < numFeatures - 1 ; ++j) {
+                features[j] = numRows * 100.0 + j;
+            }
+            svmInput.setRow(numRows, &features[0]);
+        }
+        for (int i = 0 ; i < numRows ; ++i) {
+            const double* row = svmInput.getRow(i);
+            ASSERT_EQ(0u, reinterpret_cast<std::size_t>(row) % 64u);
+            for (int j = 0 ; j < numFeatures - 1 ; ++j) {
+                ASSERT_EQ(i * 100.0 + j, row[j]) << "row " << i;
+            }
+            ASSERT_EQ(1.0, row[numFeatures - 1]);
+        }
+    }
+}
+
+// The breakpoints as they were before the line search selected rather than
+// sorted them, with ties broken by the example index like Delta
+struct SortedDelta {
+    double delta;
+    int index;
+    int s;
+};
+static bool operator<(const SortedDelta& a, const SortedDelta& b) {
+    return (a.delta < b.delta) || (a.delta == b.delta && a.index < b.index);
+}
+
+// The line search as it was before, which sorts all breakpoints
+static double sortedLineSearch(const double* w, const double* w_bar,
+                               double lambda, const double* o,
+                               const double* o_bar, const double* Y, int d,
+                               int l, double cpos, double cneg,
+                               SortedDelta* deltas) {
+    double omegaL = 0.0, omegaR = 0.0, diff = 0.0;
+    for (int i = d; i--;) {
+        diff = w_bar[i] - w[i];
+        omegaL += w[i] * diff;
+        omegaR += w_bar[i] * diff;
+    }
+    double L = lambda * omegaL;
+    double R = lambda * omegaR;
+    int p = 0;
+    for (int i = 0 ; i < l ; i++) {
+        diff = Y[i] * (o_bar[i] - o[i]);
+        if (Y[i] * o[i] < 1) {
+            double d2 = ((Y[i]==1)? cpos : cneg) * (o_bar[i] - o[i]);
+            L += (o[i] - Y[i]) * d2;
+            R += (o_bar[i] - Y[i]) * d2;
+            if (diff > 0) {
+                deltas[p].delta = (1 - Y[i] * o[i]) / diff;
+                deltas[p].index = i;
+                deltas[p].s = -1;
+                p++;
+            }
+        } else if (diff < 0) {
+            deltas[p].delta = (1 - Y[i] * o[i]) / diff;
+            deltas[p].index = i;
+            deltas[p].s = 1;
+            p++;
+        }
+    }
+    std::sort(deltas, deltas + p);
+    for (int i = 0 ; i < p ; i++) {
+        if (L + deltas[i].delta * (R - L) >= 0) {
+            break;
+        }
+        int ii = deltas[i].index;
+        diff = (deltas[i].s) * ((Y[ii]==1)? cpos : cneg) * (o_bar[ii] - o[ii]);
+        L += diff * (o[ii] - Y[ii]);
+        R += diff * (o_bar[ii] - Y[ii]);
+    }
+    return (-L / (R - L));
+}
+
+// A line search problem between the weights w and w_bar with outputs o and
+// o_bar of l examples
+class LineSearchTest : public ::testing::Test {
+  protected:
+    void populate(int l, unsigned int seed, double shift, bool ties) {
+        w.assign(kNumFeatures, 0.0);
+        w_bar.assign(kNumFeatures, 0.0);
+        for (int i = 0 ; i < kNumFeatures ; ++i) {
+            w[i] = nextValue(seed);
+            w_bar[i] = nextValue(seed);
+        }
+        o.resize(l);
+        o_bar.resize(l);
+        Y.resize(l);
+        for (int i = 0 ; i < l ; ++i) {
+            Y[i] = (nextValue(seed) > 0.0) ? 1.0 : -1.0;
+            o[i] = 2.0 * nextValue(seed);
+            o_bar[i] = 2.0 * nextValue(seed) + shift * Y[i];
+            if (ties) {
+                // outputs on a coarse grid give many equal breakpoints
+                o[i] = static_cast<int>(o[i] * 4.0) / 4.0;
+                o_bar[i] = static_cast<int>(o_bar[i] * 4.0) / 4.0;
+            }
+        }
+        deltas.resize(l);
+        sortedDeltas.resize(l);
+    }
+    double search(bool sorted, double lambda, double cpos, double cneg) {
+        int l = static_cast<int>(o.size());
+        if (sorted) {
+            return sortedLineSearch(&w[0], &w_bar[0], lambda, &o[0], &o_bar[0],
+                                    &Y[0], kNumFeatures, l, cpos, cneg,
+                                    &sortedDeltas[0]);
+        }
+        return line_search(&w[0], &w_bar[0], lambda, &o[0], &o_bar[0], &Y[0],
+                           kNumFeatures, l, cpos, cneg, &deltas[0]);
+    }
+    // uniform in [-1, 1)
+    static double nextValue(unsigned int& seed) {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 8) / 8388608.0 - 1.0;
+    }
+    static const int kNumFeatures = 5;
+    std::vector<double> w, w_bar, o, o_bar, Y;
+    std::vector<Delta> deltas;
+    std::vector<SortedDelta> sortedDeltas;
+};
+
+// The step size has to be bit-identical to that of sorting all breakpoints,
+// whether the derivative changes sign early, late or not at all
+TEST_F(LineSearchTest, CheckStepMatchesSortedBreakpoints)
+{
+    int const sizes[] = { 1, 10, LINE_SEARCH_SORT_SIZE,
+                          LINE_SEARCH_SORT_SIZE + 1, 5000, 40000 };
+    double const shifts[] = { -1.0, 0.0, 0.5, 2.0 };
+    double const lambdas[] = { 1e-4, 1.0, 100.0 };
+    for (std::size_t s = 0 ; s < sizeof(sizes) / sizeof(sizes[0]) ; ++s) {
+        for (int t = 0 ; t < 2 ; ++t) {
+            for (std::size_t k = 0 ; k < sizeof(shifts) / sizeof(shifts[0]) ; ++k) {
+                populate(sizes[s], static_cast<unsigned int>(17 * s + k + 1),
+                         shifts[k], t == 1);
+                for (std::size_t j = 0 ; j < sizeof(lambdas) / sizeof(lambdas[0]) ; ++j) {
+                    double expected = search(true, lambdas[j], 2.0, 0.5);
+                    double actual = search(false, lambdas[j], 2.0, 0.5);
+                    EXPECT_EQ(expected, actual) << "size " << sizes[s]
+                        << ", ties " << t << ", shift " << shifts[k]
+                        << ", lambda " << lambdas[j];
+                }
+            }
+        }
+    }
+}
+
+// Microbenchmark of selecting rather than sorting the breakpoints, run with
+// --gtest_also_run_disabled_tests
+TEST_F(LineSearchTest, DISABLED_BenchmarkAgainstSortedBreakpoints)
+{
+    int const l = 2000000;
+    int const numRepeats = 5;
+    double const shifts[] = { 0.0, 2.0 };
+    for (std::size_t k = 0 ; k < sizeof(shifts) / sizeof(shifts[0]) ; ++k) {
+        populate(l, 3u, shifts[k], false);
+        double seconds[2] = { 0.0, 0.0 };
+        double steps[2] = { 0.0, 0.0 };
+        for (int sorted = 0 ; sorted < 2 ; ++sorted) {
+            std::clock_t start = std::clock();
+            for (int r = 0 ; r < numRepeats ; ++r) {
+                steps[sorted] = search(sorted == 1, 1.0, 2.0, 0.5);
+            }
+            seconds[sorted] = static_cast<double>(std::clock() - start)
+                              / CLOCKS_PER_SEC / numRepeats;
+        }
+        EXPECT_EQ(steps[1], steps[0]);
+        std::cerr << "line search over " << l << " examples with shift "
+                  << shifts[k] << ": selected " << seconds[0] << " s, sorted "
+                  << seconds[1] << " s" << std::endl;
+    }
+}
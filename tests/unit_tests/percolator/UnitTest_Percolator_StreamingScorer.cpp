@@ -0,0 +1,192 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Unit tests for scoring the PSMs of a tab delimited input while streaming
+ * through it.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Globals.h"
+#include "PseudoRandom.h"
+#include "Scores.h"
+#include "SetHandler.h"
+#include "StreamingScorer.h"
+
+// Target and decoy results of the PSM and the peptide level
+struct LevelOutputs {
+    std::string psmTargets, psmDecoys, peptideTargets, peptideDecoys;
+};
+
+class StreamingScorerTest : public ::testing::Test {
+  protected:
+    virtual void SetUp();
+    virtual void TearDown();
+    void scoreInMemory(bool usePi0, bool tdc, LevelOutputs& outputs);
+    void scoreStreaming(bool usePi0, bool tdc, LevelOutputs& outputs);
+    std::string pin;
+    std::vector<double> rawWeights;
+    std::string decoyPrefix;
+  private:
+    int origVerbose;
+};
+
+// Three PSMs per scan, targets and decoys on the same scans, with repeated
+// peptides. The features are on a coarse grid, which gives tied scores and
+// few bins for the PEP fits, and every other target scores higher.
+void StreamingScorerTest::SetUp()
+{
+    origVerbose = Globals::getInstance()->getVerbose();
+    Globals::getInstance()->setVerbose(0);
+    decoyPrefix = "decoy_";
+    std::ostringstream oss;
+    oss << "SpecId\tLabel\tScanNr\tExpMass\tfeature1\tfeature2\tPeptide\tProteins\n";
+    unsigned int seed = 11;
+    for (int i = 0 ; i < 3000 ; ++i) {
+        bool isDecoy = (i % 3 == 2) || (i % 7 == 0);
+        seed = seed * 1103515245u + 12345u;
+        double u = (seed >> 8) / 16777216.0;
+        seed = seed * 1103515245u + 12345u;
+        double v = (seed >> 8) / 16777216.0;
+        oss << "psm_" << i << '\t' << (isDecoy ? -1 : 1) << '\t' << i / 3
+            << '\t' << 1000.0 + (i % 3 == 0 ? 0.0 : 0.5) << '\t'
+            << static_cast<int>(u * 16.0) / 4.0 + (isDecoy || i % 2 ? 0.0 : 2.0)
+            << '\t' << (v < 0.5 ? 0 : 1) << '\t'
+            << "K.PEPT" << char('A' + i % 11) << char('A' + i % 13) << ".R\t"
+            << (isDecoy ? decoyPrefix : std::string()) << "prot_" << i % 50;
+        if (i % 4 == 0)
+            oss << '\t' << (isDecoy ? decoyPrefix : std::string()) << "prot_" << i % 37;
+        oss << '\n';
+    }
+    pin = oss.str();
+    rawWeights.push_back(1.0);
+    rawWeights.push_back(0.5);
+    rawWeights.push_back(-0.5);
+}
+
+void StreamingScorerTest::TearDown()
+{
+    Globals::getInstance()->setVerbose(origVerbose);
+}
+
+// The steps of Caller::run and Caller::calculatePSMProb
+void StreamingScorerTest::scoreInMemory(bool usePi0, bool tdc,
+                                        LevelOutputs& outputs)
+{
+    PseudoRandom::setSeed(1);
+    SetHandler setHandler(0);
+    setHandler.setDecoyPrefix(decoyPrefix);
+    std::istringstream in(pin);
+    std::vector<double> weights(rawWeights);
+    Scores scores(usePi0);
+    SanityCheck* pCheck = NULL;
+    ASSERT_EQ(1, setHandler.readAndScoreTab(in, weights, scores, pCheck));
+    scores.postMergeStep();
+    scores.calcQ(0.01);
+    scores.normalizeScores(0.01, weights);
+
+    if (tdc)
+        scores.weedOutRedundantTDC();
+    scores.calcQ(0.01);
+    scores.calcPep();
+    std::ostringstream psmTargets, psmDecoys;
+    scores.print(1, psmTargets);
+    scores.print(-1, psmDecoys);
+
+    scores.weedOutRedundant();
+    scores.calcQ(0.01);
+    scores.calcPep();
+    std::ostringstream peptideTargets, peptideDecoys;
+    scores.print(1, peptideTargets);
+    scores.print(-1, peptideDecoys);
+
+    outputs.psmTargets = psmTargets.str();
+    outputs.psmDecoys = psmDecoys.str();
+    outputs.peptideTargets = peptideTargets.str();
+    outputs.peptideDecoys = peptideDecoys.str();
+}
+
+// The steps of Caller::streamAndOutputResult
+void StreamingScorerTest::scoreStreaming(bool usePi0, bool tdc,
+                                         LevelOutputs& outputs)
+{
+    PseudoRandom::setSeed(1);
+    SetHandler setHandler(0);
+    setHandler.setDecoyPrefix(decoyPrefix);
+    std::stringstream in(pin);
+    std::vector<double> weights(rawWeights);
+    std::vector<OptionalField> optionalFields;
+    unsigned int lineNr = setHandler.readTabHeader(in, optionalFields);
+    StreamingScorer scorer(usePi0, false);
+    scorer.readAndScorePSMs(in, lineNr, optionalFields, weights,
+                            setHandler.getDecoyPrefix());
+    scorer.postMergeStep();
+    scorer.calcQ(0.01);
+    scorer.normalizeScores(0.01, weights);
+
+    if (tdc)
+        scorer.weedOutRedundantTDC();
+    scorer.calcQ(0.01);
+    scorer.calcPep();
+    std::ostringstream psmTargets, psmDecoys;
+    scorer.print(1, in, psmTargets);
+    scorer.print(-1, in, psmDecoys);
+
+    scorer.weedOutRedundant();
+    scorer.calcQ(0.01);
+    scorer.calcPep();
+    std::ostringstream peptideTargets, peptideDecoys;
+    scorer.print(1, in, peptideTargets);
+    scorer.print(-1, in, peptideDecoys);
+
+    outputs.psmTargets = psmTargets.str();
+    outputs.psmDecoys = psmDecoys.str();
+    outputs.peptideTargets = peptideTargets.str();
+    outputs.peptideDecoys = peptideDecoys.str();
+}
+
+// The streamed results have to be identical to the in-memory ones, with
+// target-decoy competition and with pi0 estimation
+TEST_F(StreamingScorerTest, CheckOutputMatchesInMemoryScoring)
+{
+    // the PEP fits dominate the run time, hence only two combinations
+    bool const usePi0s[] = { false, true };
+    bool const tdcs[] = { true, false };
+    for (int k = 0 ; k < 2 ; ++k) {
+        LevelOutputs expected, actual;
+        scoreInMemory(usePi0s[k], tdcs[k], expected);
+        scoreStreaming(usePi0s[k], tdcs[k], actual);
+        EXPECT_EQ(expected.psmTargets, actual.psmTargets) << "case " << k;
+        EXPECT_EQ(expected.psmDecoys, actual.psmDecoys) << "case " << k;
+        EXPECT_EQ(expected.peptideTargets, actual.peptideTargets) << "case " << k;
+        EXPECT_EQ(expected.peptideDecoys, actual.peptideDecoys) << "case " << k;
+
+        // all 1714 target PSMs without competition, fewer with it, and one
+        // target per peptide
+        long psmRows = std::count(actual.psmTargets.begin(),
+                                  actual.psmTargets.end(), '\n') - 1;
+        long peptideRows = std::count(actual.peptideTargets.begin(),
+                                      actual.peptideTargets.end(), '\n') - 1;
+        if (tdcs[k])
+            EXPECT_GT(1714, psmRows);
+        else
+            EXPECT_EQ(1714, psmRows);
+        EXPECT_EQ(143, peptideRows);
+    }
+}
@@ -0,0 +1,151 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Unit tests for the arena that stores the ids and peptides of the PSMs and
+ * the table that interns their protein names.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "PSMDescription.h"
+#include "SetHandler.h"
+#include "StringArena.h"
+
+TEST(StringArenaTest, CheckStoredStringsStayValid)
+{
+    StringArena arena;
+    std::vector<std::string> expected;
+    std::vector<const char*> stored;
+    for (int i = 0; i < 20000; ++i) {
+        std::ostringstream oss;
+        oss << "psm_" << i;
+        // an occasional string that is too long to share a block
+        if (i % 1000 == 0) oss << std::string(static_cast<size_t>(40000 + i), 'A');
+        expected.push_back(oss.str());
+        stored.push_back(arena.store(expected.back()));
+    }
+    expected.push_back("");
+    stored.push_back(arena.store(expected.back()));
+    for (size_t ix = 0; ix < expected.size(); ++ix) {
+        ASSERT_EQ(expected[ix], std::string(stored[ix]));
+    }
+    EXPECT_LT(0u, arena.getNumBytes());
+    arena.clear();
+    EXPECT_EQ(0u, arena.getNumBytes());
+}
+
+// Strings of an arena that was taken over stay valid after it is destroyed
+TEST(StringArenaTest, CheckTakenStringsStayValid)
+{
+    StringArena arena;
+    std::vector<std::string> expected;
+    std::vector<const char*> stored;
+    for (int chunk = 0; chunk < 4; ++chunk) {
+        StringArena chunkArena;
+        for (int i = 0; i < 5000; ++i) {
+            std::ostringstream oss;
+            oss << "chunk_" << chunk << "_psm_" << i;
+            expected.push_back(oss.str());
+            stored.push_back(chunkArena.store(expected.back()));
+        }
+        std::size_t numBytes = arena.getNumBytes() + chunkArena.getNumBytes();
+        arena.take(chunkArena);
+        EXPECT_EQ(numBytes, arena.getNumBytes());
+        EXPECT_EQ(0u, chunkArena.getNumBytes());
+        // the emptied arena can still be used
+        expected.push_back("after_take");
+        stored.push_back(chunkArena.store(expected.back()));
+        arena.take(chunkArena);
+    }
+    for (size_t ix = 0; ix < expected.size(); ++ix) {
+        ASSERT_EQ(expected[ix], std::string(stored[ix]));
+    }
+}
+
+TEST(StringArenaTest, CheckSymbolsNumberDistinctStrings)
+{
+    SymbolTable table;
+    // enough strings for the table to grow several times
+    for (unsigned int round = 0; round < 2u; ++round) {
+        for (unsigned int i = 0; i < 5000u; ++i) {
+            std::ostringstream oss;
+            oss << "sp|P" << i << "|PROT_HUMAN";
+            ASSERT_EQ(i, table.intern(oss.str()));
+        }
+    }
+    EXPECT_EQ(5000u, table.size());
+    EXPECT_STREQ("sp|P42|PROT_HUMAN", table[42u]);
+    // strings that only differ in length or contain a null character
+    EXPECT_EQ(5000u, table.intern(std::string("sp|P1", 5)));
+    EXPECT_EQ(5001u, table.intern(std::string("sp|P1\0", 6)));
+    EXPECT_EQ(5002u, table.intern(""));
+    EXPECT_EQ(5002u, table.intern(""));
+    EXPECT_EQ(42u, table.lookup("sp|P42|PROT_HUMAN"));
+    EXPECT_EQ(SymbolTable::kNotFound, table.lookup("sp|P5000|PROT_HUMAN"));
+    bool inserted = true;
+    std::string known("sp|P42|PROT_HUMAN"), unknown("sp|P5000|PROT_HUMAN");
+    EXPECT_EQ(42u, table.intern(known.data(), known.size(), inserted));
+    EXPECT_FALSE(inserted);
+    EXPECT_EQ(5003u, table.intern(unknown.data(), unknown.size(), inserted));
+    EXPECT_TRUE(inserted);
+    EXPECT_EQ(5004u, table.size());
+    table.clear();
+    EXPECT_EQ(0u, table.size());
+    EXPECT_EQ(0u, table.intern("decoy_sp|P42|PROT_HUMAN"));
+}
+
+TEST(StringArenaTest, CheckPsmStrings)
+{
+    StringArena arena;
+    PSMDescription owned("K.DAQLLVAER.M");
+    PSMDescription stored;
+    stored.setId("psm_1", &arena);
+    stored.setPeptide("K.DAQLLVAER.M", &arena);
+    ASSERT_STREQ("psm_1", stored.getId());
+    ASSERT_EQ(owned.getFullPeptideLength(), stored.getFullPeptideLength());
+    ASSERT_EQ("DAQLLVAER", stored.getPeptideSequence());
+    ASSERT_EQ("K", stored.getFlankN());
+    ASSERT_EQ("M", stored.getFlankC());
+    ASSERT_TRUE(owned == stored);
+    owned.setPeptide("K.DAQLLVAES.M");
+    ASSERT_TRUE(stored < owned);
+
+    std::vector<std::string> proteinNames;
+    proteinNames.push_back("sp|P1|PROT_HUMAN");
+    proteinNames.push_back("decoy_sp|P1|PROT_HUMAN");
+    owned.setProteinNames(proteinNames);
+    proteinNames.pop_back();
+    stored.setProteinNames(proteinNames);
+    ASSERT_EQ(2u, owned.proteinIds.size());
+    ASSERT_EQ(owned.proteinIds[0], stored.proteinIds[0]);
+    ASSERT_STREQ("decoy_sp|P1|PROT_HUMAN", PSMDescription::getProteinName(owned.proteinIds[1]));
+}
+
+// The protein names of the PSMs are dropped with the PSMs of a SetHandler
+TEST(StringArenaTest, CheckResetClearsProteinNames)
+{
+    SetHandler setHandler(0);
+    std::vector<std::string> proteinNames(1, "sp|P2|PROT_HUMAN");
+    PSMDescription psm;
+    psm.setProteinNames(proteinNames);
+    ASSERT_LT(0u, PSMDescription::getNumProteinNames());
+    setHandler.reset();
+    EXPECT_EQ(0u, PSMDescription::getNumProteinNames());
+    psm.setProteinNames(proteinNames);
+    EXPECT_EQ(0u, psm.proteinIds[0]);
+}
@@ -0,0 +1,123 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Unit tests for the detection of the protein decoy prefix of tab delimited
+ * input files.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "TabFileValidator.h"
+
+// writes numTargets target rows followed by numDecoys decoy rows
+static void writeTargetsFirstPin(const std::string& fileName, int numTargets,
+                                 int numDecoys, const std::string& decoyPrefix) {
+  std::ofstream out(fileName.c_str());
+  out << "SpecId\tLabel\tScanNr\tfeature\tPeptide\tProteins\n";
+  for (int i = 0; i < numTargets + numDecoys; ++i) {
+    bool isDecoy = i >= numTargets;
+    out << "psm_" << i << '\t' << (isDecoy ? -1 : 1) << '\t' << i << '\t'
+        << (i * 0.37) << "\tK.PEPTIDE" << i << ".R\t"
+        << (isDecoy ? decoyPrefix : std::string()) << "prot_" << i % 97
+        << '\t' << (isDecoy ? decoyPrefix : std::string()) << "prot_" << i % 89
+        << '\n';
+  }
+}
+
+// The decoys of a file that lists all targets first lie beyond the first
+// sampled bytes, the sample windows are spread over the whole file
+TEST(TabFileValidatorTest, CheckPrefixOfTargetsFirstFile)
+{
+  std::string fileName = "tab_file_validator_test.pin";
+  writeTargetsFirstPin(fileName, 5000, 200, "rev_");
+  std::size_t sampleBytes = 4096u;
+  std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+  ASSERT_LT(sampleBytes * 10u, static_cast<std::size_t>(in.tellg()));
+
+  int proteinIndex = -1, labelIndex = -1;
+  TabFileValidator::getProteinAndLabelColumnIndices(fileName, proteinIndex, labelIndex);
+  EXPECT_EQ(5, proteinIndex);
+  EXPECT_EQ(1, labelIndex);
+  EXPECT_EQ("rev_", TabFileValidator::findDecoyPrefix(fileName, proteinIndex,
+                                                      labelIndex, sampleBytes));
+  remove(fileName.c_str());
+}
+
+// Without decoy rows there is no prefix to detect, the default is used rather
+// than an empty prefix, which would match all proteins
+TEST(TabFileValidatorTest, CheckDefaultPrefixWithoutDecoys)
+{
+  std::string fileName = "tab_file_validator_test_targets.pin";
+  writeTargetsFirstPin(fileName, 500, 0, "rev_");
+  EXPECT_EQ(TabFileValidator::kDefaultDecoyPrefix,
+            TabFileValidator::detectDecoyPrefix(fileName));
+  remove(fileName.c_str());
+}
+
+// The strided sample reads at most the sample bytes plus the rest of one row
+// per window, however far into the rows the decoys are
+TEST(TabFileValidatorTest, CheckSampleBytesAreCapped)
+{
+  std::string fileName = "tab_file_validator_test_sample.pin";
+  writeTargetsFirstPin(fileName, 20000, 500, "rev_");
+  std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+  std::string header;
+  getline(in, header);
+
+  std::size_t sampleBytes = 8192u, maxRowBytes = 80u;
+  std::vector<std::string> proteinNames;
+  std::size_t bytesRead = TabFileValidator::sampleDecoyProteins(
+      in, true, 5, 1, sampleBytes, proteinNames);
+  EXPECT_LE(bytesRead, sampleBytes +
+            TabFileValidator::kDecoySampleWindows * maxRowBytes);
+  ASSERT_FALSE(proteinNames.empty());
+  for (std::size_t ix = 0; ix < proteinNames.size(); ++ix) {
+    EXPECT_EQ(0u, proteinNames[ix].find("rev_prot_"));
+  }
+
+  // without random access only the first rows are sampled
+  in.clear();
+  in.seekg(static_cast<std::streamoff>(header.size() + 1u));
+  proteinNames.clear();
+  bytesRead = TabFileValidator::sampleDecoyProteins(in, false, 5, 1,
+                                                    sampleBytes, proteinNames);
+  EXPECT_LE(bytesRead, sampleBytes + maxRowBytes);
+  EXPECT_TRUE(proteinNames.empty());
+  remove(fileName.c_str());
+}
+
+// Decoys without a common prefix fall back to the default prefix as well
+TEST(TabFileValidatorTest, CheckDefaultPrefixWithoutCommonPrefix)
+{
+  std::string fileName = "tab_file_validator_test_mixed.pin";
+  std::ofstream out(fileName.c_str());
+  out << "SpecId\tLabel\tScanNr\tfeature\tPeptide\tProteins\n";
+  for (int i = 0; i < 400; ++i) {
+    bool isDecoy = i % 2 == 1;
+    out << "psm_" << i << '\t' << (isDecoy ? -1 : 1) << '\t' << i << '\t'
+        << (i * 0.37) << "\tK.PEPTIDE" << i << ".R\t"
+        << (isDecoy ? (i % 4 == 1 ? "rev_" : "xyz_") : "") << "prot_" << i % 97
+        << '\n';
+  }
+  out.close();
+  EXPECT_EQ(TabFileValidator::kDefaultDecoyPrefix,
+            TabFileValidator::detectDecoyPrefix(fileName));
+  remove(fileName.c_str());
+}